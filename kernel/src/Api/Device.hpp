@@ -21,6 +21,7 @@
 #include "Syscall.hpp"
 #include <Drivers/Storage/BlockDevice.hpp>
 #include <Drivers/Storage/Nvme.hpp>
+#include <Drivers/Storage/VirtioBlk.hpp>
 
 namespace Montauk {
 
@@ -196,6 +197,25 @@ namespace Montauk {
             }
         }
 
+        for (int i = 0; i < Drivers::Storage::VirtioBlk::GetDeviceCount() && count < maxCount; i++) {
+            auto* info = Drivers::Storage::VirtioBlk::GetDeviceInfo(i);
+            if (!info) continue;
+            uint64_t sizeMB = (info->SectorCount * info->SectorSize) / (1024 * 1024);
+            uint64_t sizeGB = sizeMB / 1024;
+            char detail[48];
+            int p = 0;
+            if (sizeGB > 0) {
+                p = dl_append_dec(detail, p, (int)sizeGB, 48);
+                p = dl_append(detail, p, " GiB, virtio, ", 48);
+            } else {
+                p = dl_append_dec(detail, p, (int)sizeMB, 48);
+                p = dl_append(detail, p, " MiB, virtio, ", 48);
+            }
+            p = dl_append_dec(detail, p, info->QueueCount, 48);
+            p = dl_append(detail, p, info->QueueCount == 1 ? " queue" : " queues", 48);
+            add(7, info->Model, detail);
+        }
+
         // PCI devices (category 8)
         auto& pciDevs = Pci::GetDevices();
         for (int i = 0; i < (int)pciDevs.size() && count < maxCount; i++) {
@@ -269,11 +289,24 @@ namespace Montauk {
                 if (nsInfo->SectorCount == bdev->SectorCount) {
                     buf->type = 3;   // NVMe
                     buf->rpm = 1;    // SSD / non-rotating
+                    buf->supportsTrim = bdev->Discard != nullptr ? 1 : 0;
                     break;
                 }
             }
         }
 
+        // Virtio devices are matched by registry index: type=4, rpm=1
+        if (buf->type == 0) {
+            for (int i = 0; i < Drivers::Storage::VirtioBlk::GetDeviceCount(); i++) {
+                auto* info = Drivers::Storage::VirtioBlk::GetDeviceInfo(i);
+                if (!info || info->BlockDevice != blockDevIndex) continue;
+                buf->type = 4;   // VirtIO
+                buf->rpm = 1;
+                buf->supportsTrim = bdev->Discard != nullptr ? 1 : 0;
+                break;
+            }
+        }
+
         // If type is still 0, this block device is not recognized
         if (buf->type == 0) return -1;
 
@@ -1,35 +1,134 @@
 /*
     * Filesystem.hpp
     * SYS_OPEN, SYS_READ, SYS_GETSIZE, SYS_CLOSE, SYS_READDIR,
-    * SYS_FWRITE, SYS_FCREATE syscalls
+    * SYS_READDIRPLUS, SYS_FWRITE, SYS_FCREATE, SYS_SEEK, SYS_DUP,
+    * SYS_READV, SYS_COPYRANGE syscalls
     * Copyright (c) 2026 Daniel Hammer
 */
 
 #pragma once
 #include <Fs/Vfs.hpp>
+#include <Fs/Descriptors.hpp>
 #include <Sched/Scheduler.hpp>
 #include <Memory/PageFrameAllocator.hpp>
 #include <Memory/HHDM.hpp>
 #include <Memory/Paging.hpp>
 #include <Libraries/Memory.hpp>
+#include "Syscall.hpp"
 
 namespace Montauk {
+    // File syscalls take descriptors from the calling process's table
+    static Fs::Descriptors::OpenFile* GetOpenFile(int fd) {
+        auto* proc = Sched::GetCurrentProcessPtr();
+        if (proc == nullptr) return nullptr;
+        return Fs::Descriptors::Get(proc->files, fd);
+    }
+
+    static int InstallHandle(int handle) {
+        if (handle < 0) return -1;
+
+        auto* proc = Sched::GetCurrentProcessPtr();
+        if (proc == nullptr) {
+            Fs::Vfs::VfsClose(handle);
+            return -1;
+        }
+        return Fs::Descriptors::Install(proc->files, handle);
+    }
+
     static int Sys_Open(const char* path) {
-        return Fs::Vfs::VfsOpen(path);
+        return InstallHandle(Fs::Vfs::VfsOpen(path));
+    }
+
+    // Positional read; leaves the descriptor's position alone
+    static int Sys_Read(int fd, uint8_t* buffer, uint64_t offset, uint64_t size) {
+        auto* file = GetOpenFile(fd);
+        if (file == nullptr) return -1;
+        return Fs::Vfs::VfsRead(file->vfsHandle, buffer, offset, size);
+    }
+
+    static uint64_t Sys_GetSize(int fd) {
+        auto* file = GetOpenFile(fd);
+        if (file == nullptr) return 0;
+        return Fs::Vfs::VfsGetSize(file->vfsHandle);
     }
 
-    static int Sys_Read(int handle, uint8_t* buffer, uint64_t offset, uint64_t size) {
-        return Fs::Vfs::VfsRead(handle, buffer, offset, size);
+    static void Sys_Close(int fd) {
+        auto* proc = Sched::GetCurrentProcessPtr();
+        if (proc != nullptr) Fs::Descriptors::Close(proc->files, fd);
     }
 
-    static uint64_t Sys_GetSize(int handle) {
-        return Fs::Vfs::VfsGetSize(handle);
+    static int64_t Sys_Seek(int fd, int64_t offset, int whence) {
+        auto* file = GetOpenFile(fd);
+        if (file == nullptr) return -1;
+
+        int64_t base;
+        switch (whence) {
+            case SEEK_FROM_START:   base = 0; break;
+            case SEEK_FROM_CURRENT: base = (int64_t)file->position; break;
+            case SEEK_FROM_END:     base = (int64_t)Fs::Vfs::VfsGetSize(file->vfsHandle); break;
+            default:                return -1;
+        }
+        if (base + offset < 0) return -1;
+
+        file->position = (uint64_t)(base + offset);
+        return (int64_t)file->position;
     }
 
-    static void Sys_Close(int handle) {
-        Fs::Vfs::VfsClose(handle);
+    static int Sys_Dup(int fd) {
+        auto* proc = Sched::GetCurrentProcessPtr();
+        if (proc == nullptr) return -1;
+        return Fs::Descriptors::Dup(proc->files, fd);
     }
 
+    // Scatter read into `count` buffers (already validated by the caller) at
+    // `offset`, or at the descriptor's position when offset is POS_CURRENT.
+    // Returns bytes read; a short read ends the transfer.
+    static int64_t Sys_ReadV(int fd, const IoVec* iov, int count, uint64_t offset) {
+        auto* file = GetOpenFile(fd);
+        if (file == nullptr) return -1;
+
+        bool advance = offset == POS_CURRENT;
+        uint64_t pos = advance ? file->position : offset;
+        int64_t total = 0;
+
+        for (int i = 0; i < count; i++) {
+            if (iov[i].len == 0) continue;
+
+            int n = Fs::Vfs::VfsRead(file->vfsHandle, (uint8_t*)iov[i].base, pos, iov[i].len);
+            if (n < 0) {
+                if (total == 0) return -1;
+                break;
+            }
+            pos += n;
+            total += n;
+            if ((uint64_t)n < iov[i].len) break;
+        }
+
+        if (advance) file->position = pos;
+        return total;
+    }
+
+    // Copy between two descriptors without passing the data through userspace.
+    // Either offset may be POS_CURRENT to use and advance that descriptor's
+    // position. Returns bytes copied, 0 at the source's end, or -1.
+    static int64_t Sys_CopyRange(int srcFd, uint64_t srcOffset, int dstFd, uint64_t dstOffset, uint64_t size) {
+        auto* src = GetOpenFile(srcFd);
+        auto* dst = GetOpenFile(dstFd);
+        if (src == nullptr || dst == nullptr) return -1;
+
+        uint64_t srcPos = srcOffset == POS_CURRENT ? src->position : srcOffset;
+        uint64_t dstPos = dstOffset == POS_CURRENT ? dst->position : dstOffset;
+
+        int64_t copied = Fs::Vfs::VfsCopyRange(src->vfsHandle, srcPos, dst->vfsHandle, dstPos, size);
+        if (copied <= 0) return copied;
+
+        if (srcOffset == POS_CURRENT) src->position = srcPos + copied;
+        if (dstOffset == POS_CURRENT) dst->position = dstPos + copied;
+        return copied;
+    }
+
+    // Each call maps a fresh page for the names, which lives until the process
+    // exits. Long-running programs should use SYS_READDIRPLUS instead.
     static int Sys_ReadDir(const char* path, const char** outNames, int maxEntries) {
         // Get entries from VFS into a kernel-local array
         const char* kernelNames[256];
@@ -65,12 +164,59 @@ namespace Montauk {
         return copied;
     }
 
-    static int Sys_FWrite(int handle, const uint8_t* data, uint64_t offset, uint64_t size) {
-        return Fs::Vfs::VfsWrite(handle, data, offset, size);
+    struct DirRecordFill {
+        uint8_t* buffer;
+        uint64_t size;
+        uint64_t used;
+    };
+
+    static bool EmitDirRecord(void* ctx, const Fs::Vfs::DirEntryInfo& info) {
+        auto* fill = (DirRecordFill*)ctx;
+
+        int nameLen = info.NameLen < 255 ? info.NameLen : 255;
+        uint64_t recLen = (sizeof(DirRecord) + nameLen + 1 + 7) & ~7ull;
+        if (fill->used + recLen > fill->size) return false;
+
+        auto* rec = (DirRecord*)(fill->buffer + fill->used);
+        rec->inode = info.FileId;
+        rec->size = info.Size;
+        rec->mtime = info.MTime;
+        rec->recLen = (uint16_t)recLen;
+        rec->type = info.IsDirectory ? DIRENT_DIR : DIRENT_FILE;
+        rec->nameLen = (uint8_t)nameLen;
+        rec->_pad = 0;
+
+        char* name = (char*)(rec + 1);
+        memcpy(name, info.Name, nameLen);
+        name[nameLen] = '\0';
+
+        fill->used += recLen;
+        return true;
+    }
+
+    // Fill `buffer` with DirRecords starting at *cursor (0 = first entry) and
+    // advance the cursor. Returns bytes written, 0 at the end of the directory.
+    static int64_t Sys_ReadDirPlus(const char* path, uint64_t* cursor, uint8_t* buffer, uint64_t size) {
+        DirRecordFill fill = { buffer, size, 0 };
+        uint64_t pos = *cursor;
+
+        int result = Fs::Vfs::VfsReadDirPlus(path, &pos, EmitDirRecord, &fill);
+        if (result < 0) return -1;
+        *cursor = pos;
+
+        // Entries remain but not even one fits: the buffer is too small
+        if (result > 0 && fill.used == 0) return -1;
+        return (int64_t)fill.used;
+    }
+
+    static int Sys_FWrite(int fd, const uint8_t* data, uint64_t offset, uint64_t size) {
+        auto* file = GetOpenFile(fd);
+        if (file == nullptr) return -1;
+        return Fs::Vfs::VfsWrite(file->vfsHandle, data, offset, size);
     }
 
     static int Sys_FCreate(const char* path) {
-        return Fs::Vfs::VfsCreate(path);
+        return InstallHandle(Fs::Vfs::VfsCreate(path));
     }
 
     static int Sys_FDelete(const char* path) {
@@ -9,6 +9,7 @@
 #include <Memory/Paging.hpp>
 #include <Memory/HHDM.hpp>
 #include <Memory/PageFrameAllocator.hpp>
+#include <Memory/Heap.hpp>
 
 namespace Montauk {
 
@@ -18,10 +19,28 @@ namespace Montauk {
         uint64_t numPages;
     };
 
-    static constexpr int MaxHeapAllocs = 512;
+    // Records live on the kernel heap and grow on demand, so idle slots cost nothing
+    static constexpr int InitialHeapAllocs = 32;
 
-    static HeapAlloc g_heapAllocs[Sched::MaxProcesses][MaxHeapAllocs];
-    static int g_heapAllocCount[Sched::MaxProcesses];
+    struct HeapAllocTable {
+        HeapAlloc* entries;
+        int count;
+        int capacity;
+    };
+
+    static HeapAllocTable g_heapAllocs[Sched::MaxProcesses];
+
+    static bool ReserveHeapAlloc(HeapAllocTable& table) {
+        if (table.count < table.capacity) return true;
+
+        int newCapacity = table.capacity ? table.capacity * 2 : InitialHeapAllocs;
+        auto* entries = (HeapAlloc*)Memory::g_heap->Realloc(table.entries, newCapacity * sizeof(HeapAlloc));
+        if (entries == nullptr) return false;
+
+        table.entries = entries;
+        table.capacity = newCapacity;
+        return true;
+    }
 
     // Get the process table slot index for the current process
     static int GetCurrentSlot() {
@@ -51,31 +70,35 @@ namespace Montauk {
 
         uint64_t numPages = size / 0x1000;
 
+        // Reserve the tracking record first so a mapped range can always be freed
+        int slot = GetCurrentSlot();
+        if (slot < 0 || !ReserveHeapAlloc(g_heapAllocs[slot])) return 0;
+
         // Allocate physical pages and map them into the process
         for (uint64_t i = 0; i < numPages; i++) {
             void* page = Memory::g_pfa->AllocateZeroed();
             if (page == nullptr) return 0;
             uint64_t physAddr = Memory::SubHHDM((uint64_t)page);
-            if (!Memory::VMM::Paging::MapUserIn(proc->pml4Phys, physAddr, userVa + i * 0x1000)) return 0;
+            if (!Memory::VMM::Paging::MapUserIn(proc->pml4Phys, physAddr, userVa + i * 0x1000, true)) return 0;
         }
 
         proc->heapNext += size;
 
         // Track the allocation so Sys_Free can release it
-        int slot = GetCurrentSlot();
-        if (slot >= 0) Sched::g_allocatedPages[slot] += numPages;
-        if (slot >= 0 && g_heapAllocCount[slot] < MaxHeapAllocs) {
-            g_heapAllocs[slot][g_heapAllocCount[slot]++] = { userVa, numPages };
-        }
+        auto& table = g_heapAllocs[slot];
+        table.entries[table.count++] = { userVa, numPages };
+        Sched::g_allocatedPages[slot] += numPages;
 
         return userVa;
     }
 
-    // Reset heap allocation tracking for a process slot.
+    // Release heap allocation tracking for a process slot.
     // The actual physical pages are freed by Paging::FreeUserHalf() during process cleanup.
     static void CleanupHeapForSlot(int slot, uint64_t /*pml4Phys*/) {
         if (slot < 0 || slot >= Sched::MaxProcesses) return;
-        g_heapAllocCount[slot] = 0;
+        auto& table = g_heapAllocs[slot];
+        if (table.entries != nullptr) Memory::g_heap->Free(table.entries);
+        table = {};
         Sched::g_allocatedPages[slot] = 0;
     }
 
@@ -86,25 +109,32 @@ namespace Montauk {
         int slot = GetCurrentSlot();
         if (slot < 0) return;
 
+        auto& table = g_heapAllocs[slot];
+
         // Find the allocation record matching this address
         int idx = -1;
-        for (int i = 0; i < g_heapAllocCount[slot]; i++) {
-            if (g_heapAllocs[slot][i].va == addr) {
+        for (int i = 0; i < table.count; i++) {
+            if (table.entries[i].va == addr) {
                 idx = i;
                 break;
             }
         }
         if (idx < 0) return;  // Unknown address — ignore
 
-        uint64_t va = g_heapAllocs[slot][idx].va;
-        uint64_t numPages = g_heapAllocs[slot][idx].numPages;
+        uint64_t va = table.entries[idx].va;
+        uint64_t numPages = table.entries[idx].numPages;
 
-        // Free physical pages in bulk and unmap virtual addresses
+        // Free physical pages in bulk and unmap virtual addresses.
+        // Pages compressed out by Zram have no frame; UnmapUserIn drops their slot.
         for (uint64_t i = 0; i < numPages; i++) {
             uint64_t pageVa = va + i * 0x1000;
-            uint64_t physAddr = Memory::VMM::Paging::GetPhysAddr(proc->pml4Phys, pageVa);
-            if (physAddr != 0) {
-                Memory::g_pfa->Free((void*)Memory::HHDM(physAddr));
+            auto* pte = Memory::VMM::Paging::GetUserPte(proc->pml4Phys, pageVa);
+            if (pte == nullptr) continue;
+            if (pte->Present) {
+                uint64_t physAddr = Memory::VMM::Paging::GetPhysAddr(proc->pml4Phys, pageVa);
+                if (physAddr != 0) {
+                    Memory::g_pfa->Free((void*)Memory::HHDM(physAddr));
+                }
             }
             Memory::VMM::Paging::UnmapUserIn(proc->pml4Phys, pageVa);
         }
@@ -112,7 +142,7 @@ namespace Montauk {
         Sched::g_allocatedPages[slot] -= numPages;
 
         // Remove tracking entry by swapping with the last element
-        g_heapAllocs[slot][idx] = g_heapAllocs[slot][g_heapAllocCount[slot] - 1];
-        g_heapAllocCount[slot]--;
+        table.entries[idx] = table.entries[table.count - 1];
+        table.count--;
     }
 };
@@ -10,10 +10,17 @@
 #include <Memory/Paging.hpp>
 #include <ACPI/AcpiShutdown.hpp>
 #include <ACPI/AcpiSleep.hpp>
+#include <Drivers/Storage/BlockCache.hpp>
+#include <Fs/Fat32.hpp>
+#include <Fs/Ext2.hpp>
 
 namespace Montauk {
 
     static void Sys_Reset() {
+        Fs::Ext2::Sync();
+        Fs::Fat32::Sync();
+        Drivers::Storage::BlockCache::Flush(-1);
+
         if (Efi::g_ResetSystem) {
             /* Switch to kernel PML4 which has identity-mapped UEFI runtime regions */
             Memory::VMM::LoadCR3(Memory::VMM::g_paging->PML4);
@@ -27,6 +34,10 @@ namespace Montauk {
     }
 
     static void Sys_Shutdown() {
+        Fs::Ext2::Sync();
+        Fs::Fat32::Sync();
+        Drivers::Storage::BlockCache::Flush(-1);
+
         /* Primary: ACPI S5 shutdown via PM1 control registers */
         if (Hal::AcpiShutdown::IsAvailable()) {
             Hal::AcpiShutdown::Shutdown();
@@ -47,6 +58,9 @@ namespace Montauk {
         if (!Hal::AcpiSleep::IsS3Available()) {
             return -1; // S3 not supported
         }
+        Fs::Ext2::Sync();
+        Fs::Fat32::Sync();
+        Drivers::Storage::BlockCache::Flush(-1);
         return (int64_t)Hal::AcpiSleep::Suspend();
     }
 };
@@ -110,6 +110,8 @@ namespace Montauk {
         // Clean up any windows owned by this process (unmaps pixel pages from desktop)
         WinServer::CleanupProcess(pid);
 
+        Fs::Descriptors::CloseAll(proc->files);
+
         // Free I/O redirect buffers
         if (proc->outBuf) {
             Memory::g_pfa->Free(proc->outBuf);
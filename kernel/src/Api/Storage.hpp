@@ -7,10 +7,12 @@
 #pragma once
 #include <cstdint>
 #include <Drivers/Storage/BlockDevice.hpp>
+#include <Drivers/Storage/BlockCache.hpp>
 #include <Drivers/Storage/Gpt.hpp>
 #include <Fs/FsProbe.hpp>
 #include <Fs/Fat32.hpp>
 #include <Fs/Ext2.hpp>
+#include <Fs/Vfs.hpp>
 
 #include "Syscall.hpp"
 
@@ -82,6 +84,18 @@ namespace Montauk {
         return (int64_t)(count * dev->SectorSize);
     }
 
+    // Write back cached inodes, FAT updates and disk blocks. Returns 0 on success, -1 if any write failed.
+    static int64_t Sys_Sync() {
+        Fs::Ext2::Sync();
+        Fs::Fat32::Sync();
+        return Drivers::Storage::BlockCache::Flush(-1) ? 0 : -1;
+    }
+
+    // Discard the free space of a mounted drive. Returns bytes discarded, -1 on error.
+    static int64_t Sys_FsTrim(int drive) {
+        return Fs::Vfs::VfsTrim(drive);
+    }
+
     // Initialize a new GPT on a block device. Returns 0 on success, -1 on error.
     static int64_t Sys_GptInit(int blockDev) {
         return (int64_t)Drivers::Storage::Gpt::InitializeGpt(blockDev);
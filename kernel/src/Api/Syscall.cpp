@@ -15,7 +15,7 @@
 /* Syscall impl. includes */
 #include "Process.hpp"    // SYS_EXIT, SYS_YIELD, SYS_SLEEP_MS, SYS_GETPID, SYS_WAITPID, SYS_SPAWN, SYS_GETARGS, SYS_PROCLIST, SYS_KILL
 #include "Terminal.hpp"   // SYS_PRINT, SYS_PUTCHAR
-#include "Filesystem.hpp" // SYS_OPEN, SYS_READ, SYS_GETSIZE, SYS_CLOSE, SYS_READDIR, SYS_FWRITE, SYS_FCREATE
+#include "Filesystem.hpp" // SYS_OPEN, SYS_READ, SYS_GETSIZE, SYS_CLOSE, SYS_READDIR, SYS_READDIRPLUS, SYS_FWRITE, SYS_FCREATE, SYS_SEEK, SYS_DUP, SYS_READV, SYS_COPYRANGE
 #include "Heap.hpp"       // SYS_ALLOC, SYS_FREE
 #include "Time.hpp"       // SYS_GETTICKS, SYS_GETMILLISECONDS, SYS_GETTIME
 #include "Keyboard.hpp"   // SYS_ISKEYAVAILABLE, SYS_GETKEY, SYS_GETCHAR
@@ -28,7 +28,7 @@
 #include "Random.hpp"     // SYS_GETRANDOM
 #include "MemInfo.hpp"    // SYS_MEMSTATS
 #include "Device.hpp"     // SYS_DEVLIST, SYS_DISKINFO
-#include "Storage.hpp"    // SYS_PARTLIST, SYS_DISKREAD, SYS_DISKWRITE
+#include "Storage.hpp"    // SYS_PARTLIST, SYS_DISKREAD, SYS_DISKWRITE, SYS_SYNC, SYS_FSTRIM
 #include "Window.hpp"     // SYS_WINCREATE, SYS_WINDESTROY, SYS_WINPRESENT, SYS_WINPOLL, SYS_WINENUM, SYS_WINMAP, SYS_WINSENDEVENT, SYS_WINRESIZE, SYS_WINSETSCALE, SYS_WINGETSCALE
 #include "Audio.hpp"      // SYS_AUDIOOPEN, SYS_AUDIOCLOSE, SYS_AUDIOWRITE, SYS_AUDIOCTL
 #include "BluetoothSyscall.hpp" // SYS_BTSCAN, SYS_BTCONNECT, SYS_BTDISCONNECT, SYS_BTLIST, SYS_BTINFO
@@ -99,6 +99,33 @@ namespace Montauk {
                 return (int64_t)Sys_ReadDir((const char*)frame->arg1,
                                             (const char**)frame->arg2,
                                             (int)frame->arg3);
+            case SYS_SEEK:
+                return Sys_Seek((int)frame->arg1, (int64_t)frame->arg2, (int)frame->arg3);
+            case SYS_DUP:
+                return (int64_t)Sys_Dup((int)frame->arg1);
+            case SYS_READV: {
+                if (!ValidUserPtr(frame->arg2)) return -1;
+                int count = (int)frame->arg3;
+                if (count < 0 || count > MAX_IOVECS) return -1;
+
+                // Copy the vector first so userspace cannot change it under us
+                IoVec iov[MAX_IOVECS];
+                memcpy(iov, (const void*)frame->arg2, count * sizeof(IoVec));
+                for (int i = 0; i < count; i++) {
+                    uint64_t base = (uint64_t)iov[i].base;
+                    if (iov[i].len == 0) continue;
+                    if (!ValidUserPtr(base) || iov[i].len > USER_SPACE_END - base) return -1;
+                }
+                return Sys_ReadV((int)frame->arg1, iov, count, frame->arg4);
+            }
+            case SYS_COPYRANGE:
+                return Sys_CopyRange((int)frame->arg1, frame->arg2, (int)frame->arg3,
+                                     frame->arg4, frame->arg5);
+            case SYS_READDIRPLUS:
+                if (!ValidUserPtr(frame->arg1) || !ValidUserPtr(frame->arg2) || !ValidUserPtr(frame->arg3)) return -1;
+                if (frame->arg4 > USER_SPACE_END - frame->arg3) return -1;
+                return Sys_ReadDirPlus((const char*)frame->arg1, (uint64_t*)frame->arg2,
+                                       (uint8_t*)frame->arg3, frame->arg4);
             case SYS_ALLOC:
                 return (int64_t)Sys_Alloc(frame->arg1);
             case SYS_FREE:
@@ -307,6 +334,10 @@ namespace Montauk {
             case SYS_FSFORMAT:
                 if (!ValidUserPtr(frame->arg1)) return -1;
                 return (int64_t)Sys_FsFormat((const FsFormatParams*)frame->arg1);
+            case SYS_SYNC:
+                return Sys_Sync();
+            case SYS_FSTRIM:
+                return Sys_FsTrim((int)frame->arg1);
             case SYS_AUDIOOPEN:
                 return Sys_AudioOpen((uint32_t)frame->arg1, (uint8_t)frame->arg2, (uint8_t)frame->arg3);
             case SYS_AUDIOCLOSE:
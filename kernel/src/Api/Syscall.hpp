@@ -93,6 +93,11 @@ namespace Montauk {
     static constexpr uint64_t SYS_FDELETE         = 77;
     static constexpr uint64_t SYS_FMKDIR          = 78;
     static constexpr uint64_t SYS_DRIVELIST      = 79;
+    static constexpr uint64_t SYS_READDIRPLUS    = 92;
+    static constexpr uint64_t SYS_SEEK           = 93;
+    static constexpr uint64_t SYS_DUP            = 94;
+    static constexpr uint64_t SYS_READV          = 95;
+    static constexpr uint64_t SYS_COPYRANGE      = 96;
 
     /* Graphics.hpp */
     static constexpr uint64_t SYS_TERMSCALE       = 43;
@@ -148,6 +153,8 @@ namespace Montauk {
     static constexpr uint64_t SYS_GPTADD      = 74;
     static constexpr uint64_t SYS_FSMOUNT     = 75;
     static constexpr uint64_t SYS_FSFORMAT    = 76;
+    static constexpr uint64_t SYS_SYNC        = 90;
+    static constexpr uint64_t SYS_FSTRIM      = 91;
 
     /* Audio.hpp */
     static constexpr uint64_t SYS_AUDIOOPEN  = 80;
@@ -270,7 +277,7 @@ namespace Montauk {
 
     struct DiskInfo {
         uint8_t  port;              // block device index
-        uint8_t  type;              // 0=none, 1=SATA, 2=SATAPI, 3=NVMe
+        uint8_t  type;              // 0=none, 1=SATA, 2=SATAPI, 3=NVMe, 4=VirtIO
         uint8_t  sataGen;           // SATA gen (1/2/3)
         uint8_t  _pad0;
         uint64_t sectorCount;       // Total user-addressable sectors
@@ -324,6 +331,38 @@ namespace Montauk {
     static constexpr int FS_TYPE_FAT32 = 1;
     static constexpr int FS_TYPE_EXT2  = 2;
 
+    // Origins for SYS_SEEK
+    static constexpr int SEEK_FROM_START   = 0;
+    static constexpr int SEEK_FROM_CURRENT = 1;
+    static constexpr int SEEK_FROM_END     = 2;
+
+    // SYS_READV/SYS_COPYRANGE offset meaning "at the descriptor's position, advancing it"
+    static constexpr uint64_t POS_CURRENT = ~0ull;
+
+    // Buffers per SYS_READV call
+    static constexpr int MAX_IOVECS = 64;
+
+    struct IoVec {
+        void*    base;
+        uint64_t len;
+    };
+
+    // Entry types for DirRecord::type
+    static constexpr uint8_t DIRENT_FILE = 0;
+    static constexpr uint8_t DIRENT_DIR  = 1;
+
+    // Record written by SYS_READDIRPLUS. The NUL-terminated base name follows
+    // the header; recLen (a multiple of 8) is the offset of the next record.
+    struct DirRecord {
+        uint64_t inode;           // Inode, first cluster or ramdisk node (0 = none)
+        uint64_t size;            // Bytes, 0 for directories
+        uint64_t mtime;           // Unix seconds, 0 if unknown
+        uint16_t recLen;
+        uint8_t  type;            // DIRENT_FILE or DIRENT_DIR
+        uint8_t  nameLen;
+        uint32_t _pad;
+    };
+
     struct FsFormatParams {
         int32_t  partIndex;       // global partition index
         int32_t  fsType;          // FS_TYPE_FAT32, etc.
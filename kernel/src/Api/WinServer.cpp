@@ -6,6 +6,7 @@
 
 #include "WinServer.hpp"
 #include <Memory/PageFrameAllocator.hpp>
+#include <Memory/Heap.hpp>
 #include <Memory/Paging.hpp>
 #include <Memory/HHDM.hpp>
 #include <Libraries/Memory.hpp>
@@ -17,6 +18,27 @@ namespace WinServer {
     static WindowSlot g_slots[MaxWindows];
     static int g_uiScale = 1;
 
+    // Make room for numPages frame addresses in the slot's page table
+    static bool ReservePixelPages(WindowSlot& slot, int numPages) {
+        if (numPages <= slot.pixelPageCapacity) return true;
+
+        auto* pages = (uint64_t*)Memory::g_heap->Realloc(slot.pixelPhysPages, numPages * sizeof(uint64_t));
+        if (pages == nullptr) return false;
+
+        slot.pixelPhysPages = pages;
+        slot.pixelPageCapacity = numPages;
+        return true;
+    }
+
+    static void ReleaseSlot(WindowSlot& slot) {
+        if (slot.pixelPhysPages != nullptr) {
+            Memory::g_heap->Free(slot.pixelPhysPages);
+        }
+        slot.pixelPhysPages = nullptr;
+        slot.pixelPageCapacity = 0;
+        slot.used = false;
+    }
+
     int Create(int ownerPid, uint64_t ownerPml4, const char* title, int w, int h,
                uint64_t& heapNext, uint64_t& outVa) {
         // Find a free slot
@@ -48,6 +70,12 @@ namespace WinServer {
         slot.desktopVa = 0;
         slot.desktopPid = 0;
 
+        if (!ReservePixelPages(slot, numPages)) {
+            ReleaseSlot(slot);
+            return -1;
+        }
+        memset(slot.pixelPhysPages, 0, numPages * sizeof(uint64_t));
+
         // Copy title
         int tlen = 0;
         while (title[tlen] && tlen < 63) {
@@ -62,13 +90,13 @@ namespace WinServer {
             void* page = Memory::g_pfa->AllocateZeroed();
             if (page == nullptr) {
                 // Cleanup on failure - mark slot unused
-                slot.used = false;
+                ReleaseSlot(slot);
                 return -1;
             }
             uint64_t physAddr = Memory::SubHHDM((uint64_t)page);
             slot.pixelPhysPages[i] = physAddr;
             if (!Memory::VMM::Paging::MapUserIn(ownerPml4, physAddr, userVa + (uint64_t)i * 0x1000)) {
-                slot.used = false;
+                ReleaseSlot(slot);
                 return -1;
             }
         }
@@ -120,7 +148,7 @@ namespace WinServer {
             }
         }
 
-        slot.used = false;
+        ReleaseSlot(slot);
         return 0;
     }
 
@@ -216,6 +244,7 @@ namespace WinServer {
         uint64_t bufSize = (uint64_t)newW * newH * 4;
         int numPages = (int)((bufSize + 0xFFF) / 0x1000);
         if (numPages > MaxPixelPages) return -1;
+        if (!ReservePixelPages(slot, numPages)) return -1;
 
         // Unmap old pixel pages from owner's address space, then free them
         int oldNumPages = slot.pixelNumPages;
@@ -307,7 +336,7 @@ namespace WinServer {
                 // after CleanupProcess) will free them.  Freeing here would
                 // cause a double-free, creating a cycle in the PFA free list.
 
-                g_slots[i].used = false;
+                ReleaseSlot(g_slots[i]);
             }
         }
     }
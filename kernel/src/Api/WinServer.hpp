@@ -19,7 +19,8 @@ namespace WinServer {
         int ownerPid;
         char title[64];
         int width, height;
-        uint64_t pixelPhysPages[MaxPixelPages];
+        uint64_t* pixelPhysPages;  // Heap-allocated, pixelPageCapacity entries
+        int pixelPageCapacity;
         int pixelNumPages;
         uint64_t ownerVa;      // VA in owner's address space
         uint64_t desktopVa;    // VA in desktop's address space (0 = not yet mapped)
@@ -13,6 +13,10 @@ namespace kcp {
         }
     }
 
+    bool Spinlock::TryAcquire() {
+        return !atomic_flag.test_and_set(std::memory_order_acquire);
+    }
+
     void Spinlock::Release() {
         atomic_flag.clear(std::memory_order_release);
     }
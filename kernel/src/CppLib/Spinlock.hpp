@@ -12,6 +12,7 @@ namespace kcp {
         std::atomic_flag atomic_flag{ATOMIC_FLAG_INIT};
     public:
         void Acquire();
+        bool TryAcquire();
         void Release();
     };
 };
\ No newline at end of file
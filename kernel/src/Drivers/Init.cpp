@@ -12,6 +12,7 @@
 #include <Drivers/USB/Xhci.hpp>
 #include <Drivers/Storage/Ahci.hpp>
 #include <Drivers/Storage/Nvme.hpp>
+#include <Drivers/Storage/VirtioBlk.hpp>
 #include <Drivers/Storage/Gpt.hpp>
 #include <Drivers/Audio/IntelHda.hpp>
 #include <Graphics/Cursor.hpp>
@@ -24,6 +25,11 @@ namespace Drivers {
     // Device ID whitelists
     // -------------------------------------------------------------------------
 
+    static constexpr uint16_t g_virtioBlkIds[] = {
+        Storage::VirtioBlk::PCI_DEVICE_BLK_LEGACY,
+        Storage::VirtioBlk::PCI_DEVICE_BLK_MODERN,
+    };
+
     static constexpr uint16_t g_e1000Ids[] = {
         0x100E,
     };
@@ -71,6 +77,10 @@ namespace Drivers {
         return Storage::Nvme::Probe(dev);
     }
 
+    static bool ProbeVirtioBlk(const Pci::PciDevice& dev) {
+        return Storage::VirtioBlk::Probe(dev);
+    }
+
     static bool ProbeIntelHda(const Pci::PciDevice& dev) {
         return Audio::IntelHda::Probe(dev);
     }
@@ -148,7 +158,17 @@ namespace Drivers {
             Pci::ProbePhase::Normal,
             ProbeNvme,
         },
-        // Order 7: Intel HDA — Normal phase, match vendor=0x8086 + class=0x04 (Multimedia)
+        // Order 7: virtio-blk — Normal phase, vendor=0x1AF4 + deviceIds list
+        {
+            "VirtioBlk",
+            Storage::VirtioBlk::PCI_VENDOR_VIRTIO,
+            0xFF, 0xFF, 0xFF,
+            g_virtioBlkIds,
+            sizeof(g_virtioBlkIds) / sizeof(g_virtioBlkIds[0]),
+            Pci::ProbePhase::Normal,
+            ProbeVirtioBlk,
+        },
+        // Order 8: Intel HDA — Normal phase, match vendor=0x8086 + class=0x04 (Multimedia)
         //          SubClass 0x01 = "Multimedia audio controller" (most Intel HDA)
         //          SubClass 0x03 = "Audio device" (HDA-compatible)
         {
@@ -14,7 +14,7 @@ namespace Drivers {
     // Post-probe: wire up GPU framebuffer to cursor subsystem.
     void InitializeGraphics();
 
-    // Probe PCI devices for Normal-phase drivers (xHCI, E1000, E1000E, AHCI, NVMe, IntelHDA).
+    // Probe PCI devices for Normal-phase drivers (xHCI, E1000, E1000E, AHCI, NVMe, VirtioBlk, IntelHDA).
     // USB class drivers (Bluetooth, etc.) initialize automatically during xHCI enumeration.
     void ProbeNormal();
 
@@ -6,6 +6,8 @@
 
 #include "Ahci.hpp"
 #include "BlockDevice.hpp"
+#include "BlockQueue.hpp"
+#include "Dma.hpp"
 #include <Pci/Pci.hpp>
 #include <Terminal/Terminal.hpp>
 #include <CppLib/Stream.hpp>
@@ -13,6 +15,7 @@
 #include <Memory/Paging.hpp>
 #include <Memory/PageFrameAllocator.hpp>
 #include <Libraries/Memory.hpp>
+#include <CppLib/Spinlock.hpp>
 #include <Hal/Apic/Interrupts.hpp>
 #include <Hal/Apic/IoApic.hpp>
 
@@ -50,22 +53,6 @@ namespace Drivers::Storage::Ahci {
         return ReadReg(PORT_BASE + port * PORT_SIZE + reg);
     }
 
-    // -------------------------------------------------------------------------
-    // DMA buffer allocation
-    // -------------------------------------------------------------------------
-
-    static void* AllocateDmaBuffer(uint64_t& outPhys, int pages = 1) {
-        void* virt;
-        if (pages == 1) {
-            virt = Memory::g_pfa->AllocateZeroed();
-        } else {
-            virt = Memory::g_pfa->ReallocConsecutive(nullptr, pages);
-            memset(virt, 0, pages * 0x1000);
-        }
-        outPhys = Memory::SubHHDM(virt);
-        return virt;
-    }
-
     // -------------------------------------------------------------------------
     // BIOS/OS Handoff
     // -------------------------------------------------------------------------
@@ -196,7 +183,7 @@ namespace Drivers::Storage::Ahci {
         // and FIS area (256 bytes, 256-byte aligned)
         // Both fit in one 4 KiB page
         uint64_t clPhys;
-        void* clVirt = AllocateDmaBuffer(clPhys);
+        void* clVirt = Dma::AllocateBuffer(clPhys);
         g_ports[port].CmdList = (CommandHeader*)clVirt;
         g_ports[port].CmdListPhys = clPhys;
 
@@ -216,7 +203,7 @@ namespace Drivers::Storage::Ahci {
         CommandHeader* headers = g_ports[port].CmdList;
         for (int i = 0; i < CMD_HEADER_COUNT; i++) {
             uint64_t ctPhys;
-            void* ctVirt = AllocateDmaBuffer(ctPhys);
+            void* ctVirt = Dma::AllocateBuffer(ctPhys);
             g_ports[port].CmdTables[i] = (CommandTable*)ctVirt;
             g_ports[port].CmdTablesPhys[i] = ctPhys;
 
@@ -233,7 +220,7 @@ namespace Drivers::Storage::Ahci {
         // Enable interrupts for this port
         WritePortReg(port, PORT_IE,
             PORT_IS_DHRS | PORT_IS_PSS | PORT_IS_DSS |
-            PORT_IS_SDBS | PORT_IS_TFES);
+            PORT_IS_SDBS | PORT_IS_ERRORS);
 
         // Power on and spin up if needed
         uint32_t cmd = ReadPortReg(port, PORT_CMD);
@@ -318,19 +305,62 @@ namespace Drivers::Storage::Ahci {
         return -1;
     }
 
-    static void BuildReadWriteCommand(int port, int slot, uint64_t lba, uint32_t count,
-                                       uint64_t bufferPhys, bool write) {
-        CommandHeader* hdr = &g_ports[port].CmdList[slot];
-        CommandTable* tbl = g_ports[port].CmdTables[slot];
+    // Append `bytes` at physical `phys` to the PRDT, extending the previous
+    // entry when the memory continues it
+    static bool AddPrdtRegion(CommandTable* tbl, int& prdtIdx, uint64_t phys, uint32_t bytes) {
+        if (prdtIdx > 0) {
+            PrdtEntry& prev = tbl->PrdtEntries[prdtIdx - 1];
+            uint64_t prevPhys = ((uint64_t)prev.DataBaseHigh << 32) | prev.DataBaseLow;
+            uint32_t prevBytes = (prev.ByteCount & 0x3FFFFF) + 1;
+            // Each PRDT entry can transfer up to 4 MiB
+            if (prevPhys + prevBytes == phys && prevBytes + bytes <= 0x400000) {
+                prev.ByteCount = prevBytes + bytes - 1;
+                return true;
+            }
+        }
+        if (prdtIdx >= MAX_PRDT_ENTRIES) return false;
+
+        tbl->PrdtEntries[prdtIdx].DataBaseLow = (uint32_t)(phys & 0xFFFFFFFF);
+        tbl->PrdtEntries[prdtIdx].DataBaseHigh = (uint32_t)(phys >> 32);
+        tbl->PrdtEntries[prdtIdx].Reserved = 0;
+        // Byte count is (actual bytes - 1)
+        tbl->PrdtEntries[prdtIdx].ByteCount = bytes - 1;
+        prdtIdx++;
+        return true;
+    }
 
-        // Clear the command table
-        memset(tbl, 0, sizeof(CommandTable) + sizeof(PrdtEntry) * MAX_PRDT_ENTRIES);
+    // Build the PRDT straight from the caller's pages. Fails if a segment is
+    // not DMA-safe, not word aligned, or too fragmented for the table.
+    static bool BuildDirectPrdt(CommandTable* tbl, int& prdtIdx,
+                                const Storage::IoSegment* segs, int segCount) {
+        for (int i = 0; i < segCount; i++) {
+            if (((uint64_t)segs[i].Buffer & 1) || (segs[i].Length & 1)) return false;
+
+            const uint8_t* p = (const uint8_t*)segs[i].Buffer;
+            uint32_t bytes = segs[i].Length;
+            while (bytes > 0) {
+                uint64_t phys = Storage::Dma::Translate(p);
+                if (phys == 0) return false;
+
+                uint32_t chunk = 0x1000 - (uint32_t)(phys & 0xFFF);
+                if (chunk > bytes) chunk = bytes;
+                if (!AddPrdtRegion(tbl, prdtIdx, phys, chunk)) return false;
+
+                p += chunk;
+                bytes -= chunk;
+            }
+        }
+        return true;
+    }
 
-        // Build FIS
+    // Fill in the command FIS. NCQ commands carry the sector count in the
+    // feature register and the tag (the slot index) in bits 7:3 of count.
+    static void WriteCommandFis(CommandTable* tbl, int slot, bool queued, bool write,
+                                uint64_t lba, uint32_t count) {
         FisRegH2D* fis = (FisRegH2D*)tbl->CommandFis;
+        memset(fis, 0, sizeof(FisRegH2D));
         fis->FisType = (uint8_t)FisType::RegH2D;
         fis->CmdCtl = 1;  // Command
-        fis->Command = write ? ATA_CMD_WRITE_DMA_EX : ATA_CMD_READ_DMA_EX;
         fis->Device = (1 << 6); // LBA mode
 
         fis->Lba0 = (uint8_t)(lba);
@@ -340,40 +370,585 @@ namespace Drivers::Storage::Ahci {
         fis->Lba4 = (uint8_t)(lba >> 32);
         fis->Lba5 = (uint8_t)(lba >> 40);
 
-        fis->Count = (uint16_t)count;
+        if (queued) {
+            fis->Command = write ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED;
+            fis->FeatureLow = (uint8_t)count;
+            fis->FeatureHigh = (uint8_t)(count >> 8);
+            fis->Count = (uint16_t)(slot << 3);
+        } else {
+            fis->Command = write ? ATA_CMD_WRITE_DMA_EX : ATA_CMD_READ_DMA_EX;
+            fis->Count = (uint16_t)count;
+        }
+    }
 
-        // Build PRDT entries
-        uint32_t bytesRemaining = count * SECTOR_SIZE;
-        int prdtIdx = 0;
-        uint64_t currentPhys = bufferPhys;
+    // -------------------------------------------------------------------------
+    // Command slots
+    //
+    // Each read/write owns a slot of its port; the slot index is both the
+    // command list entry and, with NCQ, the queue tag. Completions are reaped
+    // by the port interrupt or by whoever polls. Errors are only recorded
+    // there: recovery restarts the port, which is too slow for an interrupt
+    // handler, so it runs from the next poll.
+    // -------------------------------------------------------------------------
 
-        while (bytesRemaining > 0 && prdtIdx < MAX_PRDT_ENTRIES) {
-            uint32_t chunkSize = bytesRemaining;
-            // Each PRDT entry can transfer up to 4 MiB (aligned to word boundary)
-            if (chunkSize > 0x400000) {
-                chunkSize = 0x400000;
-            }
+    struct CmdSlot {
+        bool      busy;
+        volatile bool done;
+        bool      ok;
+        bool      orphaned;     // Synchronous caller timed out; reclaim on completion
+        bool      write;
+        bool      queued;       // FPDMA QUEUED rather than DMA EXT
+        bool      bounced;      // Data went through `bounce` rather than the caller's pages
+        bool      copyBack;     // Bounced async read waiting to leave interrupt context
+        bool      trim;         // DATA SET MANAGEMENT; failed rather than retried
+        uint8_t   retries;
+        void*     tag;          // BlockQueue tag, nullptr for synchronous commands
+        uint64_t  lba;
+        uint32_t  count;
+        uint8_t*  bounce;       // Bounce buffer, kept for reuse while idle
+        int       bouncePages;
+        uint64_t  bouncePhys;
+        const Storage::IoSegment* segs;
+        int       segCount;
+    };
+
+    struct PortQueue {
+        CmdSlot   slots[CMD_HEADER_COUNT];
+        int       depth;        // NCQ depth, or 1 without NCQ
+        bool      ncq;
+        bool      failed;       // Error seen; the port needs recovery
+        uint32_t  issued;       // Slots currently owned by the HBA
+        uint32_t  unqueued;     // Non-queued retries; NCQ commands wait for them
+        kcp::Spinlock lock;
+    };
+
+    static PortQueue g_queues[MAX_PORTS] = {};
+
+    // Idle slots give back bounce buffers larger than this when polled
+    static constexpr int KeepPages = 16;
+
+    // Times a command is reissued after a port error before it fails
+    static constexpr int MaxRetries = 2;
+
+    // Completions arrive from the interrupt handler. Never touch the page
+    // frame allocator with a port lock held: its lock does not mask interrupts.
+    static uint64_t LockPort(PortQueue& q) {
+        uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        q.lock.Acquire();
+        return flags;
+    }
+
+    static void UnlockPort(PortQueue& q, uint64_t flags) {
+        q.lock.Release();
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+    }
 
-            tbl->PrdtEntries[prdtIdx].DataBaseLow = (uint32_t)(currentPhys & 0xFFFFFFFF);
-            tbl->PrdtEntries[prdtIdx].DataBaseHigh = (uint32_t)(currentPhys >> 32);
-            tbl->PrdtEntries[prdtIdx].Reserved = 0;
-            // Byte count is (actual bytes - 1), bit 31 = interrupt on completion for last entry
-            tbl->PrdtEntries[prdtIdx].ByteCount = (chunkSize - 1);
-            if (bytesRemaining <= chunkSize) {
-                tbl->PrdtEntries[prdtIdx].ByteCount |= (1u << 31); // IOC
+    // Queued and non-queued commands must not be mixed, so nothing new is
+    // handed out while the port awaits recovery or drains non-queued retries.
+    static int ReserveSlot(int port) {
+        PortQueue& q = g_queues[port];
+        uint64_t flags = LockPort(q);
+        if (!q.failed && q.unqueued == 0) {
+            for (int i = 0; i < q.depth; i++) {
+                CmdSlot& slot = q.slots[i];
+                if (slot.busy) continue;
+
+                slot.busy = true;
+                slot.done = false;
+                slot.ok = false;
+                slot.orphaned = false;
+                slot.copyBack = false;
+                slot.retries = 0;
+                slot.trim = false;
+                slot.tag = nullptr;
+                slot.segs = nullptr;
+                slot.segCount = 0;
+                UnlockPort(q, flags);
+                return i;
             }
+        }
+        UnlockPort(q, flags);
+        return -1;
+    }
+
+    static void ReleaseSlot(int port, int idx) {
+        PortQueue& q = g_queues[port];
+        uint64_t flags = LockPort(q);
+        q.slots[idx].busy = false;
+        UnlockPort(q, flags);
+    }
+
+    // Give a reserved slot a bounce buffer of at least `bytes`
+    static bool EnsureBounce(CmdSlot& slot, uint32_t bytes) {
+        int pagesNeeded = (bytes + 0xFFF) / 0x1000;
+
+        // The slot is ours, so its cached buffer can be swapped without the lock
+        if (slot.bounce != nullptr && slot.bouncePages < pagesNeeded) {
+            Memory::g_pfa->Free(slot.bounce, slot.bouncePages);
+            slot.bounce = nullptr;
+        }
+        if (slot.bounce == nullptr) {
+            slot.bounce = (uint8_t*)Dma::AllocateBuffer(slot.bouncePhys, pagesNeeded);
+            if (slot.bounce == nullptr) return false;
+            slot.bouncePages = pagesNeeded;
+        }
+        return true;
+    }
 
-            currentPhys += chunkSize;
-            bytesRemaining -= chunkSize;
-            prdtIdx++;
+    // Map the data for a reserved slot. Kernel buffers are described
+    // directly; anything else goes through the slot's bounce buffer.
+    static bool BuildReadWriteCommand(int port, int idx, bool write, uint64_t lba, uint32_t count,
+                                      const Storage::IoSegment* segs, int segCount) {
+        CmdSlot& slot = g_queues[port].slots[idx];
+        CommandHeader* hdr = &g_ports[port].CmdList[idx];
+        CommandTable* tbl = g_ports[port].CmdTables[idx];
+        uint32_t totalBytes = count * SECTOR_SIZE;
+
+        // Clear the command table
+        memset(tbl, 0, sizeof(CommandTable) + sizeof(PrdtEntry) * MAX_PRDT_ENTRIES);
+
+        int prdtIdx = 0;
+        slot.bounced = false;
+        if (!BuildDirectPrdt(tbl, prdtIdx, segs, segCount)) {
+            if (!EnsureBounce(slot, totalBytes)) return false;
+
+            memset(tbl->PrdtEntries, 0, sizeof(PrdtEntry) * MAX_PRDT_ENTRIES);
+            prdtIdx = 0;
+            AddPrdtRegion(tbl, prdtIdx, slot.bouncePhys, totalBytes);
+            slot.bounced = true;
+
+            if (write) {
+                uint8_t* out = slot.bounce;
+                for (int i = 0; i < segCount; i++) {
+                    memcpy(out, segs[i].Buffer, segs[i].Length);
+                    out += segs[i].Length;
+                }
+            }
         }
 
+        // Interrupt on completion for the last entry
+        tbl->PrdtEntries[prdtIdx - 1].ByteCount |= (1u << 31);
+
+        slot.queued = g_queues[port].ncq;
+        slot.write = write;
+        slot.lba = lba;
+        slot.count = count;
+        WriteCommandFis(tbl, idx, slot.queued, write, lba, count);
+
         // Set up command header
         // CFL = FIS length in dwords (5 for FisRegH2D = 20 bytes / 4)
         hdr->CflPmpA = 5; // CFL bits [4:0]
         hdr->Flags = write ? CMDHDR_WRITE : 0;
         hdr->PrdtLength = (uint16_t)prdtIdx;
         hdr->PrdByteCount = 0;
+        return true;
+    }
+
+    static bool IssueIo(int port, int idx, bool write, uint64_t lba, uint32_t count,
+                        const Storage::IoSegment* segs, int segCount, void* tag) {
+        if (!BuildReadWriteCommand(port, idx, write, lba, count, segs, segCount)) return false;
+
+        PortQueue& q = g_queues[port];
+        CmdSlot& slot = q.slots[idx];
+        uint32_t bit = 1u << idx;
+
+        uint64_t flags = LockPort(q);
+        slot.tag = tag;
+        slot.segs = segs;
+        slot.segCount = segCount;
+        q.issued |= bit;
+        // The tag must be marked active before the command is issued
+        if (slot.queued) WritePortReg(port, PORT_SACT, bit);
+        WritePortReg(port, PORT_CI, bit);
+        UnlockPort(q, flags);
+        return true;
+    }
+
+    // Copy bounced read data out to the caller's segments. Never from the
+    // interrupt handler: the segments may be user memory, which is only
+    // reachable under the submitter's page tables and may be swapped out.
+    static void CopyBounced(const CmdSlot& slot) {
+        uint8_t* in = slot.bounce;
+        for (int i = 0; i < slot.segCount; i++) {
+            memcpy(slot.segs[i].Buffer, in, slot.segs[i].Length);
+            in += slot.segs[i].Length;
+        }
+    }
+
+    // Finish one slot (port lock held). Asynchronous completions are handed
+    // back in tags/oks so BlockQueue::Complete can run after the lock is
+    // dropped; bounced reads among them wait in `copyBack` for PollPort
+    // outside interrupt context.
+    static void CompleteSlot(CmdSlot& slot, bool ok, void** tags, bool* oks, int& n) {
+        if (slot.tag != nullptr && ok && slot.bounced && !slot.write) {
+            slot.copyBack = true;
+        } else if (slot.tag != nullptr) {
+            tags[n] = slot.tag;
+            oks[n] = ok;
+            n++;
+            slot.busy = false;
+        } else if (slot.orphaned) {
+            slot.busy = false;
+        } else {
+            slot.ok = ok;
+            slot.done = true;
+        }
+    }
+
+    // Acknowledge the port interrupt and complete every command the HBA has
+    // retired (port lock held). NCQ completions clear their PxSACT bit,
+    // non-queued ones their PxCI bit; after an error the HBA stops and the
+    // commands still set are left to RecoverPort.
+    static int ReapPort(int port, void** tags, bool* oks) {
+        PortQueue& q = g_queues[port];
+        int n = 0;
+
+        uint32_t is = ReadPortReg(port, PORT_IS);
+        if (is != 0) WritePortReg(port, PORT_IS, is);
+        if (is & PORT_IS_ERRORS) q.failed = true;
+
+        uint32_t active = ReadPortReg(port, PORT_SACT) | ReadPortReg(port, PORT_CI);
+        uint32_t finished = q.issued & ~active;
+        q.issued &= ~finished;
+        q.unqueued &= ~finished;
+
+        for (int i = 0; i < CMD_HEADER_COUNT; i++) {
+            if (finished & (1u << i)) CompleteSlot(q.slots[i], true, tags, oks, n);
+        }
+        return n;
+    }
+
+    // COMRESET, for a device left busy by an error
+    static void ResetLink(int port) {
+        uint32_t sctl = ReadPortReg(port, PORT_SCTL) & ~SCTL_DET_MASK;
+        WritePortReg(port, PORT_SCTL, sctl | SCTL_DET_INIT);
+
+        // DET=1 must be held for at least 1 ms
+        for (int i = 0; i < 100000; i++) asm volatile("pause" ::: "memory");
+        WritePortReg(port, PORT_SCTL, sctl);
+
+        for (int i = 0; i < 1000000; i++) {
+            if ((ReadPortReg(port, PORT_SSTS) & SSTS_DET_MASK) == SSTS_DET_PRESENT) break;
+            asm volatile("" ::: "memory");
+        }
+        for (int i = 0; i < 1000000; i++) {
+            if (!(ReadPortReg(port, PORT_TFD) & (PORT_TFD_BSY | PORT_TFD_DRQ))) break;
+            asm volatile("" ::: "memory");
+        }
+        WritePortReg(port, PORT_SERR, 0xFFFFFFFF);
+    }
+
+    // Restart a port after an error (port lock held). The device aborts every
+    // outstanding NCQ command on error without saying which one failed, so
+    // survivors are reissued as non-queued commands: those run one at a time
+    // and PxCMD.CCS names the culprit if the error repeats.
+    static int RecoverPort(int port, void** tags, bool* oks) {
+        PortQueue& q = g_queues[port];
+        int n = 0;
+
+        uint32_t stuck = q.issued;
+        int current = (ReadPortReg(port, PORT_CMD) >> PORT_CMD_CCS_SHIFT) & 0x1F;
+
+        // Clearing ST also clears PxCI and PxSACT
+        WritePortReg(port, PORT_CMD, ReadPortReg(port, PORT_CMD) & ~PORT_CMD_ST);
+        for (int i = 0; i < 500000; i++) {
+            if (!(ReadPortReg(port, PORT_CMD) & PORT_CMD_CR)) break;
+            asm volatile("" ::: "memory");
+        }
+
+        WritePortReg(port, PORT_SERR, 0xFFFFFFFF);
+        WritePortReg(port, PORT_IS, 0xFFFFFFFF);
+        if (ReadPortReg(port, PORT_TFD) & (PORT_TFD_BSY | PORT_TFD_DRQ)) ResetLink(port);
+        StartPort(port);
+
+        q.issued = 0;
+        q.unqueued = 0;
+        q.failed = false;
+
+        uint32_t retry = 0;
+        for (int i = 0; i < CMD_HEADER_COUNT; i++) {
+            if (!(stuck & (1u << i))) continue;
+            CmdSlot& slot = q.slots[i];
+
+            bool culprit = !slot.queued && i == current;
+            if (culprit || slot.orphaned || slot.trim || slot.retries >= MaxRetries) {
+                CompleteSlot(slot, false, tags, oks, n);
+                continue;
+            }
+
+            slot.retries++;
+            slot.queued = false;
+            WriteCommandFis(g_ports[port].CmdTables[i], i, false, slot.write, slot.lba, slot.count);
+            g_ports[port].CmdList[i].PrdByteCount = 0;
+            retry |= 1u << i;
+        }
+
+        if (retry != 0) {
+            q.issued = retry;
+            q.unqueued = retry;
+            WritePortReg(port, PORT_CI, retry);
+        }
+        return n;
+    }
+
+    // Reap one port. Outside interrupt context (`reclaim`), a failed port is
+    // recovered, bounced asynchronous reads are copied out and completed, and
+    // oversized bounce buffers of idle slots are released.
+    static void PollPort(int port, bool reclaim) {
+        PortQueue& q = g_queues[port];
+        void* tags[CMD_HEADER_COUNT];
+        bool oks[CMD_HEADER_COUNT];
+        int copies[CMD_HEADER_COUNT];
+        int copyCount = 0;
+        uint8_t* spare[CMD_HEADER_COUNT];
+        int sparePages[CMD_HEADER_COUNT];
+        int spareCount = 0;
+        bool recovered = false;
+
+        uint64_t flags = LockPort(q);
+        int n = ReapPort(port, tags, oks);
+        if (reclaim && q.failed) {
+            n += RecoverPort(port, tags + n, oks + n);
+            recovered = true;
+        }
+        if (reclaim) {
+            for (int i = 0; i < q.depth; i++) {
+                CmdSlot& slot = q.slots[i];
+                if (slot.copyBack) {
+                    slot.copyBack = false;
+                    copies[copyCount++] = i;
+                }
+                if (slot.busy || slot.bounce == nullptr || slot.bouncePages <= KeepPages) continue;
+                spare[spareCount] = slot.bounce;
+                sparePages[spareCount] = slot.bouncePages;
+                spareCount++;
+                slot.bounce = nullptr;
+            }
+        }
+        UnlockPort(q, flags);
+
+        if (recovered) {
+            KernelLogStream(WARNING, "AHCI") << "Port " << port << " recovered from error, TFD="
+                << base::hex << (uint64_t)ReadPortReg(port, PORT_TFD);
+        }
+        for (int i = 0; i < spareCount; i++) Memory::g_pfa->Free(spare[i], sparePages[i]);
+        for (int i = 0; i < n; i++) BlockQueue::Complete(tags[i], oks[i]);
+
+        // The slots stay busy until copied, so their bounce buffers are intact
+        for (int i = 0; i < copyCount; i++) {
+            CmdSlot& slot = q.slots[copies[i]];
+            void* tag = slot.tag;
+            CopyBounced(slot);
+            ReleaseSlot(port, copies[i]);
+            BlockQueue::Complete(tag, true);
+        }
+    }
+
+    // Reserve a slot, polling completions until one frees up
+    static int WaitForSlot(int port) {
+        int idx = ReserveSlot(port);
+        for (int i = 0; idx < 0 && i < 5000000; i++) {
+            PollPort(port, true);
+            asm volatile("pause" ::: "memory");
+            idx = ReserveSlot(port);
+        }
+        return idx;
+    }
+
+    // Wait for a synchronous command and release its slot
+    static bool WaitSlot(int port, int idx) {
+        // Normally the interrupt completes the slot; polling covers callers
+        // running with interrupts masked and drives error recovery
+        PortQueue& q = g_queues[port];
+        for (int i = 0; i < 5000000 && !q.slots[idx].done; i++) {
+            PollPort(port, true);
+            asm volatile("pause" ::: "memory");
+        }
+
+        uint64_t flags = LockPort(q);
+        CmdSlot& slot = q.slots[idx];
+        if (!slot.done) {
+            // Late completion must not touch the caller's buffer. The next
+            // poll resets the port and reclaims the slot.
+            slot.orphaned = true;
+            slot.segCount = 0;
+            q.failed = true;
+            UnlockPort(q, flags);
+            KernelLogStream(ERROR, "AHCI") << "Port " << port << " command timeout";
+            return false;
+        }
+        bool ok = slot.ok;
+        UnlockPort(q, flags);
+
+        // Bounced data is copied here, in the caller's address space
+        if (ok && slot.bounced && !slot.write) CopyBounced(slot);
+        ReleaseSlot(port, idx);
+        return ok;
+    }
+
+    // One command of at most MAX_TRANSFER_SECTORS, waited for
+    static bool TransferChunk(int port, uint64_t lba, uint32_t count, void* buffer, bool write) {
+        Storage::IoSegment seg = { buffer, count * SECTOR_SIZE };
+
+        int idx = WaitForSlot(port);
+        if (idx < 0) {
+            KernelLogStream(ERROR, "AHCI") << (write ? "WriteSectors" : "ReadSectors")
+                << ": no free command slot";
+            return false;
+        }
+        if (!IssueIo(port, idx, write, lba, count, &seg, 1, nullptr)) {
+            ReleaseSlot(port, idx);
+            return false;
+        }
+
+        return WaitSlot(port, idx);
+    }
+
+    static bool Transfer(int port, uint64_t lba, uint32_t count, void* buffer, bool write) {
+        uint8_t* p = (uint8_t*)buffer;
+        while (count > 0) {
+            uint32_t n = count < (uint32_t)MAX_TRANSFER_SECTORS ? count : (uint32_t)MAX_TRANSFER_SECTORS;
+            if (!TransferChunk(port, lba, n, p, write)) return false;
+            lba += n;
+            count -= n;
+            p += (uint64_t)n * SECTOR_SIZE;
+        }
+        return true;
+    }
+
+    // DATA SET MANAGEMENT is not a queued command, so it waits for the port
+    // to go idle. The slot's `unqueued` bit is set at reservation, which
+    // holds off new NCQ commands until it completes.
+    static int ReserveIdleSlot(int port) {
+        PortQueue& q = g_queues[port];
+        for (int i = 0; i < 5000000; i++) {
+            int idx = -1;
+            uint64_t flags = LockPort(q);
+            if (!q.failed && q.issued == 0 && q.unqueued == 0) {
+                for (int s = 0; s < q.depth; s++) {
+                    if (!q.slots[s].busy) {
+                        idx = s;
+                        break;
+                    }
+                }
+            }
+            if (idx >= 0) {
+                CmdSlot& slot = q.slots[idx];
+                slot.busy = true;
+                slot.done = false;
+                slot.ok = false;
+                slot.orphaned = false;
+                slot.copyBack = false;
+                slot.retries = 0;
+                slot.trim = true;
+                slot.tag = nullptr;
+                slot.segs = nullptr;
+                slot.segCount = 0;
+                q.unqueued |= 1u << idx;
+            }
+            UnlockPort(q, flags);
+            if (idx >= 0) return idx;
+
+            PollPort(port, true);
+            asm volatile("pause" ::: "memory");
+        }
+        return -1;
+    }
+
+    // TRIM up to TRIM_RANGES_PER_BLOCK ranges of at most 0xFFFF sectors
+    static bool TrimChunk(int port, uint64_t lba, uint64_t count) {
+        int idx = ReserveIdleSlot(port);
+        if (idx < 0) {
+            KernelLogStream(ERROR, "AHCI") << "Discard: port " << port << " did not go idle";
+            return false;
+        }
+
+        PortQueue& q = g_queues[port];
+        CmdSlot& slot = q.slots[idx];
+        if (!EnsureBounce(slot, SECTOR_SIZE)) {
+            uint64_t flags = LockPort(q);
+            q.unqueued &= ~(1u << idx);
+            UnlockPort(q, flags);
+            ReleaseSlot(port, idx);
+            return false;
+        }
+
+        // Range entries: bits 47:0 = LBA, bits 63:48 = sector count
+        uint64_t* ranges = (uint64_t*)slot.bounce;
+        memset(ranges, 0, SECTOR_SIZE);
+        for (int n = 0; count > 0 && n < TRIM_RANGES_PER_BLOCK; n++) {
+            uint64_t len = count < 0xFFFF ? count : 0xFFFF;
+            ranges[n] = (lba & 0xFFFFFFFFFFFFULL) | (len << 48);
+            lba += len;
+            count -= len;
+        }
+
+        CommandHeader* hdr = &g_ports[port].CmdList[idx];
+        CommandTable* tbl = g_ports[port].CmdTables[idx];
+        memset(tbl, 0, sizeof(CommandTable) + sizeof(PrdtEntry));
+
+        FisRegH2D* fis = (FisRegH2D*)tbl->CommandFis;
+        fis->FisType = (uint8_t)FisType::RegH2D;
+        fis->CmdCtl = 1;
+        fis->Command = ATA_CMD_DATA_SET_MGMT;
+        fis->FeatureLow = DSM_TRIM;
+        fis->Count = 1;         // 512-byte blocks of range entries
+        fis->Device = (1 << 6);
+
+        tbl->PrdtEntries[0].DataBaseLow = (uint32_t)(slot.bouncePhys & 0xFFFFFFFF);
+        tbl->PrdtEntries[0].DataBaseHigh = (uint32_t)(slot.bouncePhys >> 32);
+        tbl->PrdtEntries[0].ByteCount = (SECTOR_SIZE - 1) | (1u << 31);
+
+        hdr->CflPmpA = 5;
+        hdr->Flags = CMDHDR_WRITE;
+        hdr->PrdtLength = 1;
+        hdr->PrdByteCount = 0;
+
+        uint32_t bit = 1u << idx;
+        uint64_t flags = LockPort(q);
+        slot.queued = false;
+        slot.write = true;
+        slot.bounced = false;
+        slot.tag = nullptr;
+        q.issued |= bit;
+        q.unqueued |= bit;
+        WritePortReg(port, PORT_CI, bit);
+        UnlockPort(q, flags);
+
+        return WaitSlot(port, idx);
+    }
+
+    // BlockDevice::Discard
+    static bool Discard(void* ctx, uint64_t lba, uint64_t count) {
+        int port = (int)(uintptr_t)ctx;
+        constexpr uint64_t perCommand = (uint64_t)TRIM_RANGES_PER_BLOCK * 0xFFFF;
+
+        while (count > 0) {
+            uint64_t n = count < perCommand ? count : perCommand;
+            if (!TrimChunk(port, lba, n)) return false;
+            lba += n;
+            count -= n;
+        }
+        return true;
+    }
+
+    // BlockDevice::StartIo
+    static bool StartIo(void* ctx, bool write, uint64_t lba, uint32_t count,
+                        const Storage::IoSegment* segs, int segCount, void* tag) {
+        int port = (int)(uintptr_t)ctx;
+        if (count == 0 || count > (uint32_t)MAX_TRANSFER_SECTORS) return false;
+
+        int idx = WaitForSlot(port);
+        if (idx < 0) {
+            KernelLogStream(ERROR, "AHCI") << "StartIo: no free command slot";
+            return false;
+        }
+        if (!IssueIo(port, idx, write, lba, count, segs, segCount, tag)) {
+            ReleaseSlot(port, idx);
+            return false;
+        }
+        return true;
     }
 
     // -------------------------------------------------------------------------
@@ -405,7 +980,7 @@ namespace Drivers::Storage::Ahci {
 
         // Allocate a page for IDENTIFY data (512 bytes)
         uint64_t identPhys;
-        uint16_t* identData = (uint16_t*)AllocateDmaBuffer(identPhys);
+        uint16_t* identData = (uint16_t*)Dma::AllocateBuffer(identPhys);
 
         CommandHeader* hdr = &g_ports[port].CmdList[slot];
         CommandTable* tbl = g_ports[port].CmdTables[slot];
@@ -543,9 +1118,12 @@ namespace Drivers::Storage::Ahci {
         uint32_t is = ReadReg(REG_IS);
         if (is == 0) return;
 
-        // Acknowledge each port's interrupt
+        // Acknowledge each port's interrupt and reap its completions
         for (int i = 0; i < MAX_PORTS; i++) {
-            if (is & (1u << i)) {
+            if (!(is & (1u << i))) continue;
+            if (g_ports[i].Active) {
+                PollPort(i, false);
+            } else {
                 uint32_t portIs = ReadPortReg(i, PORT_IS);
                 WritePortReg(i, PORT_IS, portIs);
             }
@@ -734,6 +1312,17 @@ namespace Drivers::Storage::Ahci {
 
             if (type == PortType::Sata) {
                 if (IdentifyDevice(i)) {
+                    // NCQ needs both the HBA and the drive; tags are limited
+                    // by the smaller of the two
+                    PortQueue& q = g_queues[i];
+                    q.ncq = (cap & CAP_SNCQ) && g_ports[i].SupportsNcq;
+                    q.depth = 1;
+                    if (q.ncq) {
+                        q.depth = g_ports[i].NcqDepth < numSlots ? g_ports[i].NcqDepth : (int)numSlots;
+                        KernelLogStream(INFO, "AHCI") << "Port " << base::dec << (uint64_t)i
+                            << ": NCQ, " << (uint64_t)q.depth << " tags";
+                    }
+
                     g_ports[i].Active = true;
                     g_activePortCount++;
 
@@ -748,6 +1337,13 @@ namespace Drivers::Storage::Ahci {
                     bdev.Ctx = (void*)(uintptr_t)i;
                     bdev.SectorCount = g_ports[i].SectorCount;
                     bdev.SectorSize = g_ports[i].SectorSizeLog;
+                    bdev.MaxTransferSectors = MAX_TRANSFER_SECTORS;
+                    bdev.StartIo = StartIo;
+                    bdev.PollIo = [](void* ctx) {
+                        PollPort((int)(uintptr_t)ctx, true);
+                    };
+                    bdev.QueueDepth = (uint16_t)q.depth;
+                    bdev.Discard = g_ports[i].SupportsTrim ? Discard : nullptr;
                     memcpy(bdev.Model, g_ports[i].Model, 41);
                     Storage::RegisterBlockDevice(bdev);
                 }
@@ -794,33 +1390,7 @@ namespace Drivers::Storage::Ahci {
         }
         if (count == 0 || buffer == nullptr) return false;
 
-        // Limit to 128 sectors per command (64 KiB)
-        if (count > 128) {
-            KernelLogStream(ERROR, "AHCI") << "ReadSectors: count " << count << " exceeds max 128";
-            return false;
-        }
-
-        int slot = FindFreeSlot(port);
-        if (slot < 0) {
-            KernelLogStream(ERROR, "AHCI") << "ReadSectors: no free command slot";
-            return false;
-        }
-
-        // Allocate DMA buffer (we need physically contiguous memory for DMA)
-        uint32_t totalBytes = count * SECTOR_SIZE;
-        int pagesNeeded = (totalBytes + 0xFFF) / 0x1000;
-        uint64_t dmaPhys;
-        void* dmaVirt = AllocateDmaBuffer(dmaPhys, pagesNeeded);
-
-        BuildReadWriteCommand(port, slot, lba, count, dmaPhys, false);
-
-        bool ok = IssueCommand(port, slot);
-        if (ok) {
-            memcpy(buffer, dmaVirt, totalBytes);
-        }
-
-        Memory::g_pfa->Free(dmaVirt, pagesNeeded);
-        return ok;
+        return Transfer(port, lba, count, buffer, false);
     }
 
     bool WriteSectors(int port, uint64_t lba, uint32_t count, const void* buffer) {
@@ -829,30 +1399,7 @@ namespace Drivers::Storage::Ahci {
         }
         if (count == 0 || buffer == nullptr) return false;
 
-        if (count > 128) {
-            KernelLogStream(ERROR, "AHCI") << "WriteSectors: count " << count << " exceeds max 128";
-            return false;
-        }
-
-        int slot = FindFreeSlot(port);
-        if (slot < 0) {
-            KernelLogStream(ERROR, "AHCI") << "WriteSectors: no free command slot";
-            return false;
-        }
-
-        uint32_t totalBytes = count * SECTOR_SIZE;
-        int pagesNeeded = (totalBytes + 0xFFF) / 0x1000;
-        uint64_t dmaPhys;
-        void* dmaVirt = AllocateDmaBuffer(dmaPhys, pagesNeeded);
-
-        memcpy(dmaVirt, buffer, totalBytes);
-
-        BuildReadWriteCommand(port, slot, lba, count, dmaPhys, true);
-
-        bool ok = IssueCommand(port, slot);
-
-        Memory::g_pfa->Free(dmaVirt, pagesNeeded);
-        return ok;
+        return Transfer(port, lba, count, (void*)buffer, true);
     }
 
 };
@@ -30,6 +30,7 @@ namespace Drivers::Storage::Ahci {
     // CAP register bits
     constexpr uint32_t CAP_S64A       = (1u << 31);  // Supports 64-bit Addressing
     constexpr uint32_t CAP_SSS        = (1u << 27);  // Supports Staggered Spin-up
+    constexpr uint32_t CAP_SNCQ       = (1u << 30);  // Supports Native Command Queuing
 
     // BOHC register bits
     constexpr uint32_t BOHC_BOS       = (1u << 0);   // BIOS Owned Semaphore
@@ -64,6 +65,7 @@ namespace Drivers::Storage::Ahci {
     constexpr uint32_t PORT_CMD_SUD   = (1u << 1);   // Spin-Up Device
     constexpr uint32_t PORT_CMD_POD   = (1u << 2);   // Power On Device
     constexpr uint32_t PORT_CMD_FRE   = (1u << 4);   // FIS Receive Enable
+    constexpr uint32_t PORT_CMD_CCS_SHIFT = 8;       // Current Command Slot (bits 12:8)
     constexpr uint32_t PORT_CMD_FR    = (1u << 14);  // FIS Receive Running
     constexpr uint32_t PORT_CMD_CR    = (1u << 15);  // Command List Running
     constexpr uint32_t PORT_CMD_ICC_ACTIVE = (1u << 28); // Interface Comm Control: Active
@@ -78,12 +80,20 @@ namespace Drivers::Storage::Ahci {
     constexpr uint32_t PORT_IS_PSS    = (1u << 1);   // PIO Setup FIS
     constexpr uint32_t PORT_IS_DSS    = (1u << 2);   // DMA Setup FIS
     constexpr uint32_t PORT_IS_SDBS   = (1u << 3);   // Set Device Bits
+    constexpr uint32_t PORT_IS_IFS    = (1u << 27);  // Interface Fatal Error
+    constexpr uint32_t PORT_IS_HBDS   = (1u << 28);  // Host Bus Data Error
+    constexpr uint32_t PORT_IS_HBFS   = (1u << 29);  // Host Bus Fatal Error
     constexpr uint32_t PORT_IS_TFES   = (1u << 30);  // Task File Error Status
+    constexpr uint32_t PORT_IS_ERRORS = PORT_IS_IFS | PORT_IS_HBDS | PORT_IS_HBFS | PORT_IS_TFES;
 
     // PORT_SSTS (SStatus) fields
     constexpr uint32_t SSTS_DET_MASK  = 0x0F;        // Device Detection
     constexpr uint32_t SSTS_DET_PRESENT = 0x03;      // Phy communication established
 
+    // PORT_SCTL (SControl) fields
+    constexpr uint32_t SCTL_DET_MASK  = 0x0F;        // Device Detection Initialization
+    constexpr uint32_t SCTL_DET_INIT  = 0x01;        // Perform interface initialization (COMRESET)
+
     // Device signatures
     constexpr uint32_t SIG_ATA        = 0x00000101;   // SATA drive
     constexpr uint32_t SIG_ATAPI      = 0xEB140101;   // SATAPI drive
@@ -170,6 +180,9 @@ namespace Drivers::Storage::Ahci {
     constexpr uint8_t ATA_CMD_IDENTIFY      = 0xEC;
     constexpr uint8_t ATA_CMD_READ_DMA_EX   = 0x25;  // READ DMA EXT (48-bit LBA)
     constexpr uint8_t ATA_CMD_WRITE_DMA_EX  = 0x35;  // WRITE DMA EXT (48-bit LBA)
+    constexpr uint8_t ATA_CMD_DATA_SET_MGMT = 0x06;  // DATA SET MANAGEMENT (TRIM)
+    constexpr uint8_t ATA_CMD_READ_FPDMA_QUEUED  = 0x60;  // NCQ read
+    constexpr uint8_t ATA_CMD_WRITE_FPDMA_QUEUED = 0x61;  // NCQ write
 
     // =========================================================================
     // Constants
@@ -177,9 +190,14 @@ namespace Drivers::Storage::Ahci {
 
     constexpr int MAX_PORTS          = 32;
     constexpr int CMD_HEADER_COUNT   = 32;    // 32 command slots per port
-    constexpr int MAX_PRDT_ENTRIES   = 8;     // Max PRDT entries per command
+    constexpr int MAX_PRDT_ENTRIES   = 248;   // Fills the rest of a command table page
+    constexpr int MAX_TRANSFER_SECTORS = 1024; // Per command; larger requests are split
     constexpr int SECTOR_SIZE        = 512;
 
+    // DATA SET MANAGEMENT
+    constexpr uint8_t DSM_TRIM       = 0x01;  // Feature bit 0
+    constexpr int TRIM_RANGES_PER_BLOCK = 64; // 8-byte range entries per 512-byte block
+
     // MSI configuration
     constexpr uint8_t  MSI_IRQ       = 25;    // IRQ slot 25 = vector 57
     constexpr uint32_t MSI_VECTOR    = 57;
@@ -244,8 +262,9 @@ namespace Drivers::Storage::Ahci {
     int GetPortCount();
 
     // Read sectors from a SATA device
-    // port: port index (0-31), lba: starting LBA, count: sector count (max 128)
+    // port: port index (0-31), lba: starting LBA, count: sector count
     // buffer: destination buffer (must be large enough for count * 512 bytes)
+    // Kernel buffers are transferred in place; others go through a bounce buffer.
     // Returns true on success
     bool ReadSectors(int port, uint64_t lba, uint32_t count, void* buffer);
 
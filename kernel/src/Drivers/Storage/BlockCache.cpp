@@ -0,0 +1,731 @@
+/*
+    * BlockCache.cpp
+    * Write-back buffer cache beneath the block device registry
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#include "BlockCache.hpp"
+#include "BlockDevice.hpp"
+#include "BlockQueue.hpp"
+#include <Memory/PageFrameAllocator.hpp>
+#include <Memory/Heap.hpp>
+#include <Libraries/Memory.hpp>
+#include <CppLib/Spinlock.hpp>
+#include <CppLib/Stream.hpp>
+#include <Terminal/Terminal.hpp>
+#include <Timekeeping/ApicTimer.hpp>
+
+namespace Drivers::Storage::BlockCache {
+
+    static constexpr int32_t None = -1;
+
+    static constexpr uint8_t FlagValid = (1 << 0);
+    static constexpr uint8_t FlagDirty = (1 << 1);
+
+    // One cached block. Headers live in a heap array; data pages come from
+    // the PFA on demand and are returned under memory pressure.
+    struct Buffer {
+        uint8_t* data;
+        uint64_t block;         // Device block index (lba / sectors per block)
+        uint64_t dirtySince;    // Milliseconds when the block was first dirtied
+        int32_t  hashNext;
+        int32_t  lruPrev;       // Towards most recently used
+        int32_t  lruNext;       // Towards least recently used
+        int16_t  dev;
+        uint8_t  flags;
+    };
+
+    static Buffer* g_buffers = nullptr;
+    static int32_t* g_hash = nullptr;
+    static uint32_t g_hashMask = 0;
+    static int g_capacity = 0;
+
+    static int32_t g_lruHead = None;    // Most recently used
+    static int32_t g_lruTail = None;    // Least recently used
+    static int32_t g_freeList = None;   // Unused headers, chained through hashNext
+
+    static int g_dirtyCount = 0;
+    static uint64_t g_oldestDirty = 0;
+
+    static kcp::Spinlock g_lock;
+
+    // -------------------------------------------------------------------------
+    // Geometry
+    // -------------------------------------------------------------------------
+
+    static uint32_t SectorsPerBlock(const BlockDevice* raw) {
+        if (raw->SectorSize == 0 || raw->SectorSize > BlockSize || BlockSize % raw->SectorSize) return 0;
+        return BlockSize / raw->SectorSize;
+    }
+
+    // Sectors of `block` that exist on the device (the last block may be short)
+    static uint32_t ValidSectors(const BlockDevice* raw, uint64_t block) {
+        uint32_t spb = SectorsPerBlock(raw);
+        uint64_t first = block * spb;
+        if (first >= raw->SectorCount) return 0;
+        uint64_t left = raw->SectorCount - first;
+        return left < spb ? (uint32_t)left : spb;
+    }
+
+    static uint32_t MaxTransfer(const BlockDevice* raw) {
+        return raw->MaxTransferSectors != 0 ? raw->MaxTransferSectors : 128;
+    }
+
+    // Uncached transfers, split at the driver's per-request limit
+    static bool RawRead(const BlockDevice* raw, uint64_t lba, uint32_t count, void* buffer) {
+        uint8_t* out = (uint8_t*)buffer;
+        uint32_t max = MaxTransfer(raw);
+        while (count > 0) {
+            uint32_t n = count < max ? count : max;
+            if (!raw->ReadSectors(raw->Ctx, lba, n, out)) return false;
+            lba += n;
+            count -= n;
+            out += (uint64_t)n * raw->SectorSize;
+        }
+        return true;
+    }
+
+    static bool RawWrite(const BlockDevice* raw, uint64_t lba, uint32_t count, const void* buffer) {
+        const uint8_t* in = (const uint8_t*)buffer;
+        uint32_t max = MaxTransfer(raw);
+        while (count > 0) {
+            uint32_t n = count < max ? count : max;
+            if (!raw->WriteSectors(raw->Ctx, lba, n, in)) return false;
+            lba += n;
+            count -= n;
+            in += (uint64_t)n * raw->SectorSize;
+        }
+        return true;
+    }
+
+    // -------------------------------------------------------------------------
+    // Hash and LRU lists
+    // -------------------------------------------------------------------------
+
+    static uint32_t HashKey(int dev, uint64_t block) {
+        uint64_t h = (block ^ ((uint64_t)dev << 56)) * 0x9E3779B97F4A7C15ULL;
+        return (uint32_t)(h >> 40) & g_hashMask;
+    }
+
+    static int32_t Lookup(int dev, uint64_t block) {
+        for (int32_t i = g_hash[HashKey(dev, block)]; i != None; i = g_buffers[i].hashNext) {
+            if (g_buffers[i].dev == dev && g_buffers[i].block == block) return i;
+        }
+        return None;
+    }
+
+    static void HashInsert(int32_t idx) {
+        uint32_t h = HashKey(g_buffers[idx].dev, g_buffers[idx].block);
+        g_buffers[idx].hashNext = g_hash[h];
+        g_hash[h] = idx;
+    }
+
+    static void HashRemove(int32_t idx) {
+        int32_t* link = &g_hash[HashKey(g_buffers[idx].dev, g_buffers[idx].block)];
+        while (*link != None) {
+            if (*link == idx) {
+                *link = g_buffers[idx].hashNext;
+                return;
+            }
+            link = &g_buffers[*link].hashNext;
+        }
+    }
+
+    static void LruUnlink(int32_t idx) {
+        Buffer& b = g_buffers[idx];
+        if (b.lruPrev != None) g_buffers[b.lruPrev].lruNext = b.lruNext;
+        else g_lruHead = b.lruNext;
+        if (b.lruNext != None) g_buffers[b.lruNext].lruPrev = b.lruPrev;
+        else g_lruTail = b.lruPrev;
+        b.lruPrev = b.lruNext = None;
+    }
+
+    static void LruPushFront(int32_t idx) {
+        Buffer& b = g_buffers[idx];
+        b.lruPrev = None;
+        b.lruNext = g_lruHead;
+        if (g_lruHead != None) g_buffers[g_lruHead].lruPrev = idx;
+        g_lruHead = idx;
+        if (g_lruTail == None) g_lruTail = idx;
+    }
+
+    static void Touch(int32_t idx) {
+        if (g_lruHead == idx) return;
+        LruUnlink(idx);
+        LruPushFront(idx);
+    }
+
+    // -------------------------------------------------------------------------
+    // Dirty tracking and write-back
+    // -------------------------------------------------------------------------
+
+    static void MarkDirty(int32_t idx) {
+        Buffer& b = g_buffers[idx];
+        if (b.flags & FlagDirty) return;
+
+        uint64_t now = Timekeeping::GetMilliseconds();
+        b.flags |= FlagDirty;
+        b.dirtySince = now;
+        if (g_dirtyCount++ == 0) g_oldestDirty = now;
+    }
+
+    static bool WriteBack(int32_t idx) {
+        Buffer& b = g_buffers[idx];
+        if (!(b.flags & FlagDirty)) return true;
+
+        auto* raw = GetRawBlockDevice(b.dev);
+        if (raw == nullptr) return false;
+
+        uint32_t spb = SectorsPerBlock(raw);
+        if (!raw->WriteSectors(raw->Ctx, b.block * spb, ValidSectors(raw, b.block), b.data)) {
+            return false;
+        }
+
+        b.flags &= ~FlagDirty;
+        g_dirtyCount--;
+        return true;
+    }
+
+    // Dirty blocks are written back in batches through the request queue,
+    // which sorts them, merges neighbours and keeps the device busy
+    static constexpr int FlushBatch = 64;
+    static BlockQueue::Request g_flushRequests[FlushBatch];
+    static int32_t g_flushBuffers[FlushBatch];
+
+    static bool CompleteBatch(int count) {
+        bool ok = true;
+        BlockQueue::Unplug(-1);
+
+        for (int k = 0; k < count; k++) {
+            Buffer& b = g_buffers[g_flushBuffers[k]];
+            if (BlockQueue::Wait(&g_flushRequests[k])) {
+                b.flags &= ~FlagDirty;
+                g_dirtyCount--;
+                continue;
+            }
+
+            Kt::KernelLogStream(Kt::WARNING, "BlockCache") << "Write-back failed for device "
+                << base::dec << (uint64_t)b.dev << " block " << b.block;
+            ok = false;
+        }
+        return ok;
+    }
+
+    static bool FlushLocked(int dev) {
+        bool ok = true;
+        int batched = 0;
+
+        for (int i = 0; i < g_capacity && g_dirtyCount > batched; i++) {
+            Buffer& b = g_buffers[i];
+            if (!(b.flags & FlagDirty)) continue;
+            if (dev >= 0 && b.dev != dev) continue;
+
+            auto* raw = GetRawBlockDevice(b.dev);
+            BlockQueue::Request& req = g_flushRequests[batched];
+            if (raw != nullptr) {
+                uint32_t spb = SectorsPerBlock(raw);
+                BlockQueue::Prepare(req, b.dev, true, b.block * spb, ValidSectors(raw, b.block), b.data);
+            }
+            if (raw == nullptr || !BlockQueue::Submit(&req)) {
+                if (!WriteBack(i)) {
+                    Kt::KernelLogStream(Kt::WARNING, "BlockCache") << "Write-back failed for device "
+                        << base::dec << (uint64_t)b.dev << " block " << b.block;
+                    ok = false;
+                }
+                continue;
+            }
+
+            g_flushBuffers[batched++] = i;
+            if (batched == FlushBatch) {
+                if (!CompleteBatch(batched)) ok = false;
+                batched = 0;
+            }
+        }
+        if (batched > 0 && !CompleteBatch(batched)) ok = false;
+
+        if (g_dirtyCount > 0) {
+            uint64_t oldest = ~0ULL;
+            for (int i = 0; i < g_capacity; i++) {
+                Buffer& b = g_buffers[i];
+                if ((b.flags & FlagDirty) && b.dirtySince < oldest) oldest = b.dirtySince;
+            }
+            g_oldestDirty = oldest;
+        }
+        return ok;
+    }
+
+    // Periodic write-back, piggybacked on cache traffic
+    static void FlushExpired() {
+        if (g_dirtyCount == 0) return;
+
+        uint64_t now = Timekeeping::GetMilliseconds();
+        if (now - g_oldestDirty < WritebackDelayMs) return;
+
+        // Blocks that failed to write are retried after another delay
+        if (!FlushLocked(-1)) g_oldestDirty = now;
+    }
+
+    // -------------------------------------------------------------------------
+    // Buffer allocation
+    // -------------------------------------------------------------------------
+
+    static void Detach(int32_t idx) {
+        HashRemove(idx);
+        LruUnlink(idx);
+        g_buffers[idx].flags = 0;
+    }
+
+    // Get an unused buffer with a data page, evicting the coldest block if needed
+    static int32_t GetBuffer() {
+        if (g_freeList != None) {
+            int32_t idx = g_freeList;
+            Buffer& b = g_buffers[idx];
+            if (b.data == nullptr) {
+                b.data = (uint8_t*)Memory::g_pfa->Allocate();
+            }
+            if (b.data != nullptr) {
+                g_freeList = b.hashNext;
+                return idx;
+            }
+        }
+
+        // Prefer the coldest clean block; fall back to writing back a dirty one
+        for (int32_t i = g_lruTail; i != None; i = g_buffers[i].lruPrev) {
+            if (!(g_buffers[i].flags & FlagDirty)) {
+                Detach(i);
+                return i;
+            }
+        }
+        for (int32_t i = g_lruTail; i != None; i = g_buffers[i].lruPrev) {
+            if (WriteBack(i)) {
+                Detach(i);
+                return i;
+            }
+        }
+        return None;
+    }
+
+    static void PutBuffer(int32_t idx) {
+        g_buffers[idx].flags = 0;
+        g_buffers[idx].hashNext = g_freeList;
+        g_freeList = idx;
+    }
+
+    // Find or load a block. With `fill` false the caller overwrites every
+    // valid sector, so the device read is skipped on a miss.
+    static int32_t GetBlock(int dev, const BlockDevice* raw, uint64_t block, bool fill) {
+        int32_t idx = Lookup(dev, block);
+        if (idx != None) {
+            Touch(idx);
+            return idx;
+        }
+
+        idx = GetBuffer();
+        if (idx == None) return None;
+
+        Buffer& b = g_buffers[idx];
+        if (fill) {
+            uint32_t spb = SectorsPerBlock(raw);
+            if (!raw->ReadSectors(raw->Ctx, block * spb, ValidSectors(raw, block), b.data)) {
+                PutBuffer(idx);
+                return None;
+            }
+        }
+
+        b.dev = (int16_t)dev;
+        b.block = block;
+        b.flags = FlagValid;
+        HashInsert(idx);
+        LruPushFront(idx);
+        return idx;
+    }
+
+    // Load the uncached blocks of [block, endBlock). Each run of adjacent
+    // misses becomes one device request scattered into the new buffers'
+    // pages. Blocks that cannot be loaded this way are left to GetBlock.
+    static void FillRange(int dev, const BlockDevice* raw, uint64_t block, uint64_t endBlock) {
+        uint32_t spb = SectorsPerBlock(raw);
+        uint32_t maxRun = MaxTransfer(raw) / spb;
+        if (maxRun > (uint32_t)BlockQueue::MaxSegments) maxRun = BlockQueue::MaxSegments;
+        if (maxRun < 2) return;
+
+        while (block < endBlock) {
+            if (Lookup(dev, block) != None) {
+                block++;
+                continue;
+            }
+
+            // Gather the run; only the device's last block can be short
+            int32_t run[BlockQueue::MaxSegments];
+            uint32_t n = 0;
+            uint32_t sectors = 0;
+            while (block + n < endBlock && n < maxRun && Lookup(dev, block + n) == None) {
+                uint32_t valid = ValidSectors(raw, block + n);
+                if (valid == 0) break;
+                int32_t idx = GetBuffer();
+                if (idx == None) break;
+                run[n++] = idx;
+                sectors += valid;
+                if (valid < spb) break;
+            }
+            if (n < 2) {
+                for (uint32_t k = 0; k < n; k++) PutBuffer(run[k]);
+                return;
+            }
+
+            BlockQueue::Request req;
+            BlockQueue::Prepare(req, dev, false, block * spb, sectors, nullptr);
+            for (uint32_t k = 0; k < n; k++) {
+                BlockQueue::AddSegment(req, g_buffers[run[k]].data,
+                                       ValidSectors(raw, block + k) * raw->SectorSize);
+            }
+
+            if (!BlockQueue::Submit(&req) || !BlockQueue::Wait(&req)) {
+                for (uint32_t k = 0; k < n; k++) PutBuffer(run[k]);
+                return;
+            }
+
+            for (uint32_t k = 0; k < n; k++) {
+                Buffer& b = g_buffers[run[k]];
+                b.dev = (int16_t)dev;
+                b.block = block + k;
+                b.flags = FlagValid;
+                HashInsert(run[k]);
+                LruPushFront(run[k]);
+            }
+            block += n;
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // Public API
+    // -------------------------------------------------------------------------
+
+    void Initialize() {
+        Montauk::MemStats stats;
+        Memory::g_pfa->GetStats(&stats);
+
+        // Let the cache grow to 1/16 of RAM; Shrink() gives it back on demand
+        int capacity = (int)(stats.totalBytes / 16 / BlockSize);
+        if (capacity < 64) capacity = 64;
+        if (capacity > MaxBuffers) capacity = MaxBuffers;
+
+        uint32_t buckets = 1;
+        while (buckets < (uint32_t)capacity) buckets <<= 1;
+
+        g_buffers = (Buffer*)Memory::g_heap->Request(capacity * sizeof(Buffer));
+        g_hash = (int32_t*)Memory::g_heap->Request(buckets * sizeof(int32_t));
+        if (g_buffers == nullptr || g_hash == nullptr) {
+            Kt::KernelLogStream(Kt::ERROR, "BlockCache") << "Failed to allocate cache tables";
+            return;
+        }
+
+        for (uint32_t i = 0; i < buckets; i++) g_hash[i] = None;
+        for (int i = capacity - 1; i >= 0; i--) {
+            g_buffers[i] = {};
+            g_buffers[i].lruPrev = g_buffers[i].lruNext = None;
+            g_buffers[i].hashNext = g_freeList;
+            g_freeList = i;
+        }
+
+        g_hashMask = buckets - 1;
+        g_capacity = capacity;
+
+        Kt::KernelLogStream(Kt::OK, "BlockCache") << "Up to " << base::dec << (uint64_t)capacity
+            << " blocks (" << (uint64_t)capacity * BlockSize / 1024 << " KiB)";
+    }
+
+    bool Read(int dev, uint64_t lba, uint32_t count, void* buffer) {
+        auto* raw = GetRawBlockDevice(dev);
+        if (raw == nullptr) return false;
+
+        uint32_t spb = SectorsPerBlock(raw);
+        uint64_t bytes = (uint64_t)count * raw->SectorSize;
+        if (g_capacity == 0 || spb == 0) {
+            return RawRead(raw, lba, count, buffer);
+        }
+
+        uint8_t* out = (uint8_t*)buffer;
+        uint64_t end = lba + count;
+        bool ok = true;
+
+        g_lock.Acquire();
+
+        if (bytes > BypassBytes) {
+            // Large transfer: read from the device, then overlay newer dirty data
+            ok = RawRead(raw, lba, count, buffer);
+            for (uint64_t block = lba / spb; ok && block * spb < end && g_dirtyCount > 0; block++) {
+                int32_t idx = Lookup(dev, block);
+                if (idx == None || !(g_buffers[idx].flags & FlagDirty)) continue;
+
+                uint64_t first = block * spb > lba ? block * spb : lba;
+                uint64_t last = (block + 1) * spb < end ? (block + 1) * spb : end;
+                memcpy(out + (first - lba) * raw->SectorSize,
+                       g_buffers[idx].data + (first - block * spb) * raw->SectorSize,
+                       (last - first) * raw->SectorSize);
+            }
+        } else {
+            // Misses are read in as few requests as possible first
+            FillRange(dev, raw, lba / spb, (end + spb - 1) / spb);
+
+            for (uint64_t block = lba / spb; block * spb < end; block++) {
+                int32_t idx = GetBlock(dev, raw, block, true);
+                if (idx == None) {
+                    ok = false;
+                    break;
+                }
+
+                uint64_t first = block * spb > lba ? block * spb : lba;
+                uint64_t last = (block + 1) * spb < end ? (block + 1) * spb : end;
+                memcpy(out + (first - lba) * raw->SectorSize,
+                       g_buffers[idx].data + (first - block * spb) * raw->SectorSize,
+                       (last - first) * raw->SectorSize);
+            }
+        }
+
+        FlushExpired();
+        g_lock.Release();
+        return ok;
+    }
+
+    bool Write(int dev, uint64_t lba, uint32_t count, const void* buffer) {
+        auto* raw = GetRawBlockDevice(dev);
+        if (raw == nullptr) return false;
+
+        uint32_t spb = SectorsPerBlock(raw);
+        uint64_t bytes = (uint64_t)count * raw->SectorSize;
+        if (g_capacity == 0 || spb == 0) {
+            return RawWrite(raw, lba, count, buffer);
+        }
+
+        const uint8_t* in = (const uint8_t*)buffer;
+        uint64_t end = lba + count;
+        bool ok = true;
+
+        g_lock.Acquire();
+
+        if (bytes > BypassBytes) {
+            // Large transfer: write through, refreshing any cached copies
+            for (uint64_t block = lba / spb; block * spb < end; block++) {
+                int32_t idx = Lookup(dev, block);
+                if (idx == None) continue;
+
+                uint64_t first = block * spb > lba ? block * spb : lba;
+                uint64_t last = (block + 1) * spb < end ? (block + 1) * spb : end;
+                memcpy(g_buffers[idx].data + (first - block * spb) * raw->SectorSize,
+                       in + (first - lba) * raw->SectorSize,
+                       (last - first) * raw->SectorSize);
+            }
+            ok = RawWrite(raw, lba, count, buffer);
+        } else {
+            for (uint64_t block = lba / spb; block * spb < end; block++) {
+                uint64_t first = block * spb > lba ? block * spb : lba;
+                uint64_t last = (block + 1) * spb < end ? (block + 1) * spb : end;
+                bool whole = first == block * spb && last - first >= ValidSectors(raw, block);
+
+                int32_t idx = GetBlock(dev, raw, block, !whole);
+                if (idx == None) {
+                    ok = false;
+                    break;
+                }
+
+                memcpy(g_buffers[idx].data + (first - block * spb) * raw->SectorSize,
+                       in + (first - lba) * raw->SectorSize,
+                       (last - first) * raw->SectorSize);
+                MarkDirty(idx);
+            }
+        }
+
+        FlushExpired();
+        g_lock.Release();
+        return ok;
+    }
+
+    bool Discard(int dev, uint64_t lba, uint64_t count) {
+        auto* raw = GetRawBlockDevice(dev);
+        if (raw == nullptr || raw->Discard == nullptr) return false;
+        if (count == 0 || lba + count > raw->SectorCount) return false;
+
+        uint32_t spb = SectorsPerBlock(raw);
+        if (g_capacity == 0 || spb == 0) {
+            return raw->Discard(raw->Ctx, lba, count);
+        }
+
+        uint64_t firstBlock = (lba + spb - 1) / spb;
+        uint64_t endBlock = (lba + count) / spb;
+
+        g_lock.Acquire();
+
+        // Dropped under the lock so no write-back can land after the discard
+        if (endBlock > firstBlock) {
+            bool scan = endBlock - firstBlock > (uint64_t)g_capacity;
+            for (int32_t idx = 0; scan && idx < g_capacity; idx++) {
+                Buffer& b = g_buffers[idx];
+                if (!(b.flags & FlagValid) || b.dev != dev) continue;
+                if (b.block < firstBlock || b.block >= endBlock) continue;
+                if (b.flags & FlagDirty) g_dirtyCount--;
+                Detach(idx);
+                PutBuffer(idx);
+            }
+            for (uint64_t block = firstBlock; !scan && block < endBlock; block++) {
+                int32_t idx = Lookup(dev, block);
+                if (idx == None) continue;
+                if (g_buffers[idx].flags & FlagDirty) g_dirtyCount--;
+                Detach(idx);
+                PutBuffer(idx);
+            }
+        }
+
+        bool ok = raw->Discard(raw->Ctx, lba, count);
+        g_lock.Release();
+        return ok;
+    }
+
+    // A cached block overlapping zeroed sectors [lba, end): dropped when
+    // wholly inside, otherwise zeroed in place so a later write-back cannot
+    // bring old data back
+    static void ZeroCached(const BlockDevice* raw, int32_t idx, uint64_t lba, uint64_t end) {
+        uint32_t spb = SectorsPerBlock(raw);
+        uint64_t block = g_buffers[idx].block;
+        uint64_t first = block * spb > lba ? block * spb : lba;
+        uint64_t last = (block + 1) * spb < end ? (block + 1) * spb : end;
+
+        if (first == block * spb && last - first >= ValidSectors(raw, block)) {
+            if (g_buffers[idx].flags & FlagDirty) g_dirtyCount--;
+            Detach(idx);
+            PutBuffer(idx);
+        } else {
+            memset(g_buffers[idx].data + (first - block * spb) * raw->SectorSize, 0,
+                   (last - first) * raw->SectorSize);
+        }
+    }
+
+    // A cached block overlapping sectors zeroed while the lock was dropped: a
+    // clean copy may have been read before the zeroes landed and is dropped.
+    // A dirty one was written after the request started and is newer.
+    static void DropStale(int32_t idx) {
+        if (g_buffers[idx].flags & FlagDirty) return;
+        Detach(idx);
+        PutBuffer(idx);
+    }
+
+    // Apply ZeroCached (before the device write) or DropStale (after it) to
+    // every cached block of `dev` overlapping [lba, end)
+    static void ZeroCachedRange(int dev, const BlockDevice* raw, uint64_t lba, uint64_t end, bool after) {
+        uint32_t spb = SectorsPerBlock(raw);
+        uint64_t firstBlock = lba / spb;
+        uint64_t endBlock = (end + spb - 1) / spb;
+
+        if (endBlock - firstBlock > (uint64_t)g_capacity) {
+            for (int32_t idx = 0; idx < g_capacity; idx++) {
+                Buffer& b = g_buffers[idx];
+                if (!(b.flags & FlagValid) || b.dev != dev) continue;
+                if (b.block < firstBlock || b.block >= endBlock) continue;
+                if (after) DropStale(idx);
+                else ZeroCached(raw, idx, lba, end);
+            }
+        } else {
+            for (uint64_t block = firstBlock; block < endBlock; block++) {
+                int32_t idx = Lookup(dev, block);
+                if (idx == None) continue;
+                if (after) DropStale(idx);
+                else ZeroCached(raw, idx, lba, end);
+            }
+        }
+    }
+
+    bool WriteZeroes(int dev, uint64_t lba, uint64_t count) {
+        auto* raw = GetRawBlockDevice(dev);
+        if (raw == nullptr || raw->SectorSize == 0) return false;
+        if (count == 0 || lba + count > raw->SectorCount) return false;
+
+        // Without a device command, zeroes go out from a buffer allocated
+        // before taking the lock (allocation may shrink the cache). A single
+        // page will do when memory is too fragmented for a large one.
+        uint8_t* zeroes = nullptr;
+        uint32_t chunk = 0;
+        int pages = 0;
+        if (raw->WriteZeroes == nullptr) {
+            chunk = ZeroChunkBytes / raw->SectorSize;
+            if (count < chunk) chunk = (uint32_t)count;
+            pages = (int)(((uint64_t)chunk * raw->SectorSize + 0xFFF) / 0x1000);
+            zeroes = pages > 1 ? (uint8_t*)Memory::g_pfa->AllocateConsecutive(pages) : nullptr;
+            if (zeroes == nullptr) {
+                pages = 1;
+                zeroes = (uint8_t*)Memory::g_pfa->Allocate();
+                if (zeroes == nullptr) return false;
+                uint32_t pageSectors = 0x1000 / raw->SectorSize;
+                if (pageSectors == 0) {
+                    Memory::g_pfa->Free(zeroes);
+                    return false;
+                }
+                if (chunk > pageSectors) chunk = pageSectors;
+            }
+            memset(zeroes, 0, (uint64_t)pages * 0x1000);
+        }
+
+        uint64_t end = lba + count;
+        bool cached = g_capacity != 0 && SectorsPerBlock(raw) != 0;
+
+        // The lock is not held across the device I/O. Cached copies are
+        // dropped or zeroed before it, so no older dirty data can be written
+        // back over the zeroes; clean copies a reader fetched in the meantime
+        // are dropped after it.
+        if (cached) {
+            g_lock.Acquire();
+            ZeroCachedRange(dev, raw, lba, end, false);
+            g_lock.Release();
+        }
+
+        bool ok = true;
+        if (zeroes == nullptr) {
+            ok = raw->WriteZeroes(raw->Ctx, lba, count);
+        } else {
+            for (uint64_t pos = lba; ok && pos < end; pos += chunk) {
+                uint32_t n = end - pos < chunk ? (uint32_t)(end - pos) : chunk;
+                ok = RawWrite(raw, pos, n, zeroes);
+            }
+        }
+
+        if (cached) {
+            g_lock.Acquire();
+            ZeroCachedRange(dev, raw, lba, end, true);
+            g_lock.Release();
+        }
+        if (zeroes != nullptr) Memory::g_pfa->Free(zeroes, pages);
+        return ok;
+    }
+
+    bool Flush(int dev) {
+        if (g_capacity == 0) return true;
+
+        g_lock.Acquire();
+        bool ok = FlushLocked(dev);
+        g_lock.Release();
+        return ok;
+    }
+
+    int Shrink(int pages) {
+        // Called from allocation paths, possibly while the cache itself is
+        // allocating; back off instead of deadlocking.
+        if (g_capacity == 0 || !g_lock.TryAcquire()) return 0;
+
+        int freed = 0;
+        int32_t i = g_lruTail;
+        while (i != None && freed < pages) {
+            int32_t prev = g_buffers[i].lruPrev;
+            if (!(g_buffers[i].flags & FlagDirty)) {
+                Detach(i);
+                Memory::g_pfa->Free(g_buffers[i].data);
+                g_buffers[i].data = nullptr;
+                PutBuffer(i);
+                freed++;
+            }
+            i = prev;
+        }
+
+        g_lock.Release();
+        return freed;
+    }
+
+};
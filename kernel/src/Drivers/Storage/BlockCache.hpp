@@ -0,0 +1,50 @@
+/*
+    * BlockCache.hpp
+    * Write-back buffer cache beneath the block device registry
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#pragma once
+#include <cstdint>
+
+namespace Drivers::Storage::BlockCache {
+
+    // Cache granularity: one page holds BlockSize / SectorSize sectors
+    static constexpr uint32_t BlockSize = 0x1000;
+
+    // Requests larger than this go straight to the device (cache stays coherent)
+    static constexpr uint32_t BypassBytes = 64 * 1024;
+
+    // Largest single write used to emulate WriteZeroes
+    static constexpr uint32_t ZeroChunkBytes = 1024 * 1024;
+
+    // Dirty buffers older than this are written back on the next cache access
+    static constexpr uint64_t WritebackDelayMs = 5000;
+
+    // Upper bound on cached blocks; the actual limit is scaled to system RAM
+    static constexpr int MaxBuffers = 8192;
+
+    void Initialize();
+
+    // Sector I/O through the cache (device index as registered)
+    bool Read(int dev, uint64_t lba, uint32_t count, void* buffer);
+    bool Write(int dev, uint64_t lba, uint32_t count, const void* buffer);
+
+    // Drop cached blocks lying entirely inside the range, dirty or not, then
+    // pass the discard to the driver. Partly covered blocks stay cached.
+    bool Discard(int dev, uint64_t lba, uint64_t count);
+
+    // Zero a sector range. Cached blocks inside it are dropped and partly
+    // covered ones are zeroed in place, then the driver's WriteZeroes runs,
+    // or writes of up to ZeroChunkBytes when the device has none.
+    bool WriteZeroes(int dev, uint64_t lba, uint64_t count);
+
+    // Write back dirty blocks of one device, or of all devices if dev < 0.
+    // Returns false if any block failed to write (it stays dirty).
+    bool Flush(int dev);
+
+    // Drop up to `pages` clean blocks and return their frames to the page
+    // frame allocator. Safe to call from allocation paths; never does I/O.
+    int Shrink(int pages);
+
+};
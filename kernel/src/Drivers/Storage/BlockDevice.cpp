@@ -5,16 +5,51 @@
 */
 
 #include "BlockDevice.hpp"
+#include "BlockCache.hpp"
+#include "BlockQueue.hpp"
 
 namespace Drivers::Storage {
 
+    // Devices handed out by GetBlockDevice() route through the buffer cache;
+    // the driver's own callbacks are kept here for the cache to use.
     static BlockDevice g_devices[MaxBlockDevices] = {};
+    static BlockDevice g_rawDevices[MaxBlockDevices] = {};
     static int g_deviceCount = 0;
 
+    static bool CachedReadSectors(void* ctx, uint64_t lba, uint32_t count, void* buffer) {
+        return BlockCache::Read((int)(uintptr_t)ctx, lba, count, buffer);
+    }
+
+    static bool CachedWriteSectors(void* ctx, uint64_t lba, uint32_t count, const void* buffer) {
+        return BlockCache::Write((int)(uintptr_t)ctx, lba, count, buffer);
+    }
+
+    static bool CachedDiscard(void* ctx, uint64_t lba, uint64_t count) {
+        return BlockCache::Discard((int)(uintptr_t)ctx, lba, count);
+    }
+
+    static bool CachedWriteZeroes(void* ctx, uint64_t lba, uint64_t count) {
+        return BlockCache::WriteZeroes((int)(uintptr_t)ctx, lba, count);
+    }
+
     int RegisterBlockDevice(const BlockDevice& dev) {
         if (g_deviceCount >= MaxBlockDevices) return -1;
-        g_devices[g_deviceCount] = dev;
-        return g_deviceCount++;
+        int index = g_deviceCount;
+
+        g_rawDevices[index] = dev;
+        g_devices[index] = dev;
+        g_devices[index].ReadSectors = CachedReadSectors;
+        g_devices[index].WriteSectors = CachedWriteSectors;
+        g_devices[index].Ctx = (void*)(uintptr_t)index;
+        g_devices[index].StartIo = nullptr;
+        g_devices[index].PollIo = nullptr;
+        g_devices[index].QueueDepth = 0;
+        if (dev.Discard != nullptr) g_devices[index].Discard = CachedDiscard;
+        g_devices[index].WriteZeroes = CachedWriteZeroes;
+
+        g_deviceCount++;
+        BlockQueue::AttachDevice(index);
+        return index;
     }
 
     const BlockDevice* GetBlockDevice(int index) {
@@ -22,6 +57,11 @@ namespace Drivers::Storage {
         return &g_devices[index];
     }
 
+    const BlockDevice* GetRawBlockDevice(int index) {
+        if (index < 0 || index >= g_deviceCount) return nullptr;
+        return &g_rawDevices[index];
+    }
+
     int GetBlockDeviceCount() {
         return g_deviceCount;
     }
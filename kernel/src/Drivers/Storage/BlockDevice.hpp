@@ -11,21 +11,51 @@ namespace Drivers::Storage {
 
     static constexpr int MaxBlockDevices = 32;
 
+    // One piece of a scatter-gather list: a kernel virtual range whose
+    // length is a multiple of the device sector size
+    struct IoSegment {
+        void*    Buffer;
+        uint32_t Length;
+    };
+
     struct BlockDevice {
         bool (*ReadSectors)(void* ctx, uint64_t lba, uint32_t count, void* buffer);
         bool (*WriteSectors)(void* ctx, uint64_t lba, uint32_t count, const void* buffer);
         void*    Ctx;
         uint64_t SectorCount;
         uint16_t SectorSize;
+        uint32_t MaxTransferSectors;    // Largest single request the driver accepts
         char     Model[41];
+
+        // Optional asynchronous path used by BlockQueue. StartIo issues a
+        // command and returns without waiting; the driver reports it later
+        // through BlockQueue::Complete(tag, ok), from PollIo or its interrupt
+        // handler, never from inside StartIo itself.
+        bool (*StartIo)(void* ctx, bool write, uint64_t lba, uint32_t count,
+                        const IoSegment* segs, int segCount, void* tag);
+        void (*PollIo)(void* ctx);
+        uint16_t QueueDepth;            // Commands StartIo may have outstanding
+
+        // Optional: tell the device `count` sectors at `lba` no longer hold
+        // data (TRIM / Deallocate). nullptr when the device cannot discard.
+        bool (*Discard)(void* ctx, uint64_t lba, uint64_t count);
+
+        // Optional on drivers: zero `count` sectors at `lba` without sending
+        // data (NVMe Write Zeroes). Devices from GetBlockDevice() always
+        // provide it, falling back to large writes from a zeroed buffer.
+        bool (*WriteZeroes)(void* ctx, uint64_t lba, uint64_t count);
     };
 
     // Register a block device. Returns the assigned index, or -1 on failure.
     int RegisterBlockDevice(const BlockDevice& dev);
 
     // Get a registered block device by index. Returns nullptr if invalid.
+    // I/O through the returned device goes through the buffer cache.
     const BlockDevice* GetBlockDevice(int index);
 
+    // Same device with the driver's own callbacks (bypasses the buffer cache).
+    const BlockDevice* GetRawBlockDevice(int index);
+
     // Get the number of registered block devices.
     int GetBlockDeviceCount();
 
@@ -0,0 +1,299 @@
+/*
+    * BlockQueue.cpp
+    * Asynchronous block request queues with sorting and merging
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#include "BlockQueue.hpp"
+#include <Memory/Heap.hpp>
+#include <Libraries/Memory.hpp>
+#include <CppLib/Spinlock.hpp>
+#include <CppLib/Stream.hpp>
+#include <Terminal/Terminal.hpp>
+
+namespace Drivers::Storage::BlockQueue {
+
+    // One command handed to the driver: a run of LBA-adjacent requests
+    struct Dispatch {
+        Request*  first;        // Merged requests, chained through Next
+        uint64_t  lba;
+        uint32_t  count;
+        int       segCount;
+        int16_t   dev;
+        bool      write;
+        bool      busy;
+        IoSegment segs[MaxDispatchSegments];
+    };
+
+    struct DeviceQueue {
+        Request*  pending;      // Sorted by LBA
+        uint64_t  headPos;      // LBA just past the last dispatched command
+        Dispatch* slots;
+        int       depth;
+        int       inFlight;
+        kcp::Spinlock lock;
+    };
+
+    static DeviceQueue g_queues[MaxBlockDevices];
+
+    // Completions may arrive from interrupt handlers
+    static uint64_t Lock(DeviceQueue& q) {
+        uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        q.lock.Acquire();
+        return flags;
+    }
+
+    static void Unlock(DeviceQueue& q, uint64_t flags) {
+        q.lock.Release();
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+    }
+
+    static uint32_t MaxTransfer(const BlockDevice* raw) {
+        return raw->MaxTransferSectors != 0 ? raw->MaxTransferSectors : 128;
+    }
+
+    // -------------------------------------------------------------------------
+    // Dispatch
+    // -------------------------------------------------------------------------
+
+    static void AppendSegment(Dispatch* d, const IoSegment& seg) {
+        // Coalesce pieces that are contiguous in memory
+        if (d->segCount > 0) {
+            IoSegment& prev = d->segs[d->segCount - 1];
+            if ((uint8_t*)prev.Buffer + prev.Length == seg.Buffer
+                && (uint64_t)prev.Length + seg.Length <= 0xFFFFFFFFull) {
+                prev.Length += seg.Length;
+                return;
+            }
+        }
+        d->segs[d->segCount++] = seg;
+    }
+
+    static void AppendRequest(Dispatch* d, Request* req) {
+        for (int i = 0; i < req->SegmentCount; i++) AppendSegment(d, req->Segments[i]);
+        d->count += req->Count;
+    }
+
+    // Take the next request in C-LOOK order (upwards from the head position,
+    // wrapping to the lowest LBA) and absorb the requests that directly follow it.
+    static void BuildDispatch(DeviceQueue& q, Dispatch* d, const BlockDevice* raw) {
+        Request** link = &q.pending;
+        while (*link != nullptr && (*link)->Lba < q.headPos) link = &(*link)->Next;
+        if (*link == nullptr) link = &q.pending;
+
+        Request* req = *link;
+        *link = req->Next;
+        req->Next = nullptr;
+
+        d->first = req;
+        d->lba = req->Lba;
+        d->count = 0;
+        d->segCount = 0;
+        d->write = req->Write;
+        AppendRequest(d, req);
+
+        uint32_t max = MaxTransfer(raw);
+        Request* tail = req;
+        while (*link != nullptr) {
+            Request* next = *link;
+            if (next->Write != d->write || next->Lba != d->lba + d->count) break;
+            if (d->count + next->Count > max) break;
+            if (d->segCount + next->SegmentCount > MaxDispatchSegments) break;
+
+            *link = next->Next;
+            next->Next = nullptr;
+            tail->Next = next;
+            tail = next;
+            AppendRequest(d, next);
+        }
+
+        q.headPos = d->lba + d->count;
+    }
+
+    // Serve a command through the driver's synchronous callbacks
+    static bool RunSync(const BlockDevice* raw, const Dispatch* d) {
+        uint64_t lba = d->lba;
+        uint32_t max = MaxTransfer(raw);
+
+        for (int i = 0; i < d->segCount; i++) {
+            uint8_t* buf = (uint8_t*)d->segs[i].Buffer;
+            uint32_t left = d->segs[i].Length / raw->SectorSize;
+            while (left > 0) {
+                uint32_t n = left < max ? left : max;
+                bool ok = d->write ? raw->WriteSectors(raw->Ctx, lba, n, buf)
+                                   : raw->ReadSectors(raw->Ctx, lba, n, buf);
+                if (!ok) return false;
+                lba += n;
+                left -= n;
+                buf += (uint64_t)n * raw->SectorSize;
+            }
+        }
+        return true;
+    }
+
+    // Release the slot, then complete every merged request
+    static void Finish(Dispatch* d, bool ok) {
+        DeviceQueue& q = g_queues[d->dev];
+        Request* req = d->first;
+
+        uint64_t flags = Lock(q);
+        d->busy = false;
+        d->first = nullptr;
+        q.inFlight--;
+        Unlock(q, flags);
+
+        while (req != nullptr) {
+            Request* next = req->Next;
+            req->Ok = ok;
+            if (req->OnComplete != nullptr) req->OnComplete(req);
+            asm volatile("" ::: "memory");
+            req->Done = true;
+            req = next;
+        }
+    }
+
+    static void Kick(int dev) {
+        auto* raw = GetRawBlockDevice(dev);
+        DeviceQueue& q = g_queues[dev];
+        if (raw == nullptr || q.slots == nullptr) return;
+
+        for (;;) {
+            Dispatch* d = nullptr;
+
+            uint64_t flags = Lock(q);
+            if (q.pending != nullptr && q.inFlight < q.depth) {
+                for (int i = 0; i < q.depth; i++) {
+                    if (!q.slots[i].busy) {
+                        d = &q.slots[i];
+                        break;
+                    }
+                }
+            }
+            if (d != nullptr) {
+                d->busy = true;
+                q.inFlight++;
+                BuildDispatch(q, d, raw);
+            }
+            Unlock(q, flags);
+
+            if (d == nullptr) return;
+
+            if (raw->StartIo != nullptr) {
+                if (!raw->StartIo(raw->Ctx, d->write, d->lba, d->count, d->segs, d->segCount, d)) {
+                    Finish(d, false);
+                }
+            } else {
+                Finish(d, RunSync(raw, d));
+            }
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // Public API
+    // -------------------------------------------------------------------------
+
+    void AttachDevice(int dev) {
+        auto* raw = GetRawBlockDevice(dev);
+        if (raw == nullptr) return;
+
+        DeviceQueue& q = g_queues[dev];
+        int depth = 1;
+        if (raw->StartIo != nullptr && raw->QueueDepth > 1) {
+            depth = raw->QueueDepth < MaxDepth ? raw->QueueDepth : MaxDepth;
+        }
+
+        q.slots = (Dispatch*)Memory::g_heap->Request(depth * sizeof(Dispatch));
+        if (q.slots == nullptr) {
+            Kt::KernelLogStream(Kt::ERROR, "BlockQueue") << "Failed to allocate queue for device "
+                << base::dec << (uint64_t)dev;
+            return;
+        }
+        memset(q.slots, 0, depth * sizeof(Dispatch));
+        for (int i = 0; i < depth; i++) q.slots[i].dev = (int16_t)dev;
+
+        q.pending = nullptr;
+        q.headPos = 0;
+        q.depth = depth;
+        q.inFlight = 0;
+
+        Kt::KernelLogStream(Kt::OK, "BlockQueue") << "Device " << base::dec << (uint64_t)dev
+            << ": " << (raw->StartIo != nullptr ? "async" : "sync") << ", depth " << (uint64_t)depth;
+    }
+
+    void Prepare(Request& req, int dev, bool write, uint64_t lba, uint32_t count, void* buffer) {
+        memset(&req, 0, sizeof(Request));
+        req.Device = dev;
+        req.Write = write;
+        req.Lba = lba;
+        req.Count = count;
+
+        auto* raw = GetRawBlockDevice(dev);
+        if (buffer != nullptr && raw != nullptr) {
+            AddSegment(req, buffer, count * raw->SectorSize);
+        }
+    }
+
+    bool AddSegment(Request& req, void* buffer, uint32_t length) {
+        if (req.SegmentCount >= MaxSegments) return false;
+        req.Segments[req.SegmentCount++] = { buffer, length };
+        return true;
+    }
+
+    bool Submit(Request* req) {
+        auto* raw = GetRawBlockDevice(req->Device);
+        if (raw == nullptr || g_queues[req->Device].slots == nullptr) return false;
+        if (req->Count == 0 || req->Count > MaxTransfer(raw)) return false;
+        if (req->Lba + req->Count > raw->SectorCount) return false;
+        if (req->SegmentCount <= 0 || req->SegmentCount > MaxSegments) return false;
+
+        uint64_t bytes = 0;
+        for (int i = 0; i < req->SegmentCount; i++) {
+            if (req->Segments[i].Buffer == nullptr || req->Segments[i].Length % raw->SectorSize) return false;
+            bytes += req->Segments[i].Length;
+        }
+        if (bytes != (uint64_t)req->Count * raw->SectorSize) return false;
+
+        req->Done = false;
+        req->Ok = false;
+
+        DeviceQueue& q = g_queues[req->Device];
+        uint64_t flags = Lock(q);
+
+        // Sorted insert; equal LBAs keep submission order
+        Request** link = &q.pending;
+        while (*link != nullptr && (*link)->Lba <= req->Lba) link = &(*link)->Next;
+        req->Next = *link;
+        *link = req;
+
+        Unlock(q, flags);
+        return true;
+    }
+
+    void Unplug(int dev) {
+        if (dev >= 0) {
+            Kick(dev);
+            return;
+        }
+        for (int i = 0; i < GetBlockDeviceCount(); i++) Kick(i);
+    }
+
+    bool Wait(Request* req) {
+        auto* raw = GetRawBlockDevice(req->Device);
+
+        Kick(req->Device);
+        while (!req->Done) {
+            if (raw->PollIo != nullptr) raw->PollIo(raw->Ctx);
+
+            // Completions free slots for requests still queued behind them
+            Kick(req->Device);
+            asm volatile("pause" ::: "memory");
+        }
+        return req->Ok;
+    }
+
+    void Complete(void* tag, bool ok) {
+        Finish((Dispatch*)tag, ok);
+    }
+
+};
@@ -0,0 +1,71 @@
+/*
+    * BlockQueue.hpp
+    * Asynchronous block request queues with sorting and merging
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#pragma once
+#include <cstdint>
+#include "BlockDevice.hpp"
+
+namespace Drivers::Storage::BlockQueue {
+
+    // Scatter-gather entries a single request may carry
+    static constexpr int MaxSegments = 16;
+
+    // Segments in one merged driver command
+    static constexpr int MaxDispatchSegments = 64;
+
+    // Upper bound on commands in flight per device
+    static constexpr int MaxDepth = 32;
+
+    struct Request;
+    using CompletionFn = void (*)(Request* req);
+
+    // Owned by the submitter, which must keep it alive until Done is set.
+    // Requests in flight together are not ordered against each other.
+    // Segments must be kernel memory: completion, including a driver's
+    // bounce copy, may run in whichever thread polls the device.
+    struct Request {
+        int          Device;        // Raw block device index
+        bool         Write;
+        uint64_t     Lba;
+        uint32_t     Count;         // Sectors, at most the device's MaxTransferSectors
+        IoSegment    Segments[MaxSegments];
+        int          SegmentCount;
+        // Optional, may run from a driver's completion path; runs before
+        // Done is set, so it must not resubmit
+        CompletionFn OnComplete;
+        void*        Arg;
+
+        // Written by the queue
+        volatile bool Done;
+        bool          Ok;
+        Request*      Next;
+    };
+
+    // Set up queue state for a newly registered device
+    void AttachDevice(int dev);
+
+    // Reset `req` to describe `count` sectors at `lba` backed by one buffer.
+    // More segments can be added with AddSegment.
+    void Prepare(Request& req, int dev, bool write, uint64_t lba, uint32_t count, void* buffer);
+    bool AddSegment(Request& req, void* buffer, uint32_t length);
+
+    // Queue a request. Nothing reaches the device until Unplug() or Wait().
+    // Returns false without queueing if the request is malformed.
+    bool Submit(Request* req);
+
+    // Dispatch queued requests of one device, or of all devices if dev < 0.
+    // Devices without StartIo are served synchronously by the caller.
+    void Unplug(int dev);
+
+    // Unplug the request's device and poll until it completes. Returns req->Ok.
+    bool Wait(Request* req);
+
+    // Called by drivers when a command issued through StartIo finishes.
+    // Safe from interrupt handlers: it never dispatches, so requests queued
+    // behind the command go out on the next Submit/Unplug/Wait.
+    void Complete(void* tag, bool ok);
+
+};
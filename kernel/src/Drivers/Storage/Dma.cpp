@@ -0,0 +1,41 @@
+/*
+    * Dma.cpp
+    * Physical address lookup for direct storage DMA
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#include "Dma.hpp"
+#include <Memory/HHDM.hpp>
+#include <Memory/Paging.hpp>
+#include <Memory/PageFrameAllocator.hpp>
+#include <Libraries/Memory.hpp>
+
+namespace Drivers::Storage::Dma {
+
+    static constexpr uint64_t KernelHalfBase = 0xFFFF800000000000ULL;
+
+    uint64_t Translate(const void* virt) {
+        uint64_t addr = (uint64_t)virt;
+        if (addr < KernelHalfBase || Memory::VMM::g_paging == nullptr) return 0;
+
+        // Kernel-half mappings are shared by every address space and never paged out
+        uint64_t page = addr & ~0xFFFULL;
+        uint64_t phys = Memory::VMM::g_paging->GetPhysAddr(page);
+        if (phys == 0) return 0;
+        return phys | (addr & 0xFFF);
+    }
+
+    void* AllocateBuffer(uint64_t& outPhys, int pages) {
+        void* virt;
+        if (pages == 1) {
+            virt = Memory::g_pfa->AllocateZeroed();
+        } else {
+            virt = Memory::g_pfa->AllocateConsecutive(pages);
+            if (virt != nullptr) memset(virt, 0, (uint64_t)pages * 0x1000);
+        }
+        if (virt == nullptr) return nullptr;
+        outPhys = Memory::SubHHDM(virt);
+        return virt;
+    }
+
+};
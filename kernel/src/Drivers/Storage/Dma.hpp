@@ -0,0 +1,22 @@
+/*
+    * Dma.hpp
+    * Physical address lookup for direct storage DMA
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#pragma once
+#include <cstdint>
+
+namespace Drivers::Storage::Dma {
+
+    // Physical address backing a kernel virtual address, or 0 if the memory
+    // must not be handed to a device (user-half pages can be compressed out
+    // by Zram while the transfer is in flight)
+    uint64_t Translate(const void* virt);
+
+    // Zeroed, physically contiguous pages for the device to use, or nullptr
+    // (without a panic) when memory is too fragmented. Free with
+    // Memory::g_pfa->Free(virt, pages).
+    void* AllocateBuffer(uint64_t& outPhys, int pages = 1);
+
+};
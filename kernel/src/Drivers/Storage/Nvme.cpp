@@ -6,6 +6,8 @@
 
 #include "Nvme.hpp"
 #include "BlockDevice.hpp"
+#include "BlockQueue.hpp"
+#include "Dma.hpp"
 #include <Pci/Pci.hpp>
 #include <Terminal/Terminal.hpp>
 #include <CppLib/Stream.hpp>
@@ -13,8 +15,11 @@
 #include <Memory/Paging.hpp>
 #include <Memory/PageFrameAllocator.hpp>
 #include <Libraries/Memory.hpp>
+#include <CppLib/Spinlock.hpp>
 #include <Hal/Apic/Interrupts.hpp>
 #include <Hal/Apic/IoApic.hpp>
+#include <Hal/Apic/Apic.hpp>
+#include <Hal/Apic/ApicInit.hpp>
 
 using namespace Kt;
 
@@ -39,24 +44,14 @@ namespace Drivers::Storage::Nvme {
     static uint8_t   g_adminCqPhase = 1;    // Expected phase bit starts at 1
     static uint16_t  g_adminCmdId = 0;
 
-    // I/O queue state (single I/O queue pair)
-    static SqEntry*  g_ioSq = nullptr;
-    static CqEntry*  g_ioCq = nullptr;
-    static uint64_t  g_ioSqPhys = 0;
-    static uint64_t  g_ioCqPhys = 0;
-    static uint16_t  g_ioSqTail = 0;
-    static uint16_t  g_ioCqHead = 0;
-    static uint8_t   g_ioCqPhase = 1;
-    static uint16_t  g_ioCmdId = 0;
-    static uint16_t  g_ioSqDepth = 0;
-    static uint16_t  g_ioCqDepth = 0;
-
     // Namespace state
     static int g_nsCount = 0;
     static NamespaceInfo g_namespaces[MAX_NAMESPACES] = {};
 
     // Controller identify data
     static uint32_t g_mdts = 0;  // Max Data Transfer Size in pages (0 = unlimited)
+    static bool g_supportsDsm = false;  // Dataset Management (deallocate)
+    static bool g_supportsWriteZeroes = false;
 
     // -------------------------------------------------------------------------
     // Register access
@@ -97,22 +92,6 @@ namespace Drivers::Storage::Nvme {
         *(volatile uint32_t*)(g_mmioBase + offset) = value;
     }
 
-    // -------------------------------------------------------------------------
-    // DMA buffer allocation
-    // -------------------------------------------------------------------------
-
-    static void* AllocateDmaBuffer(uint64_t& outPhys, int pages = 1) {
-        void* virt;
-        if (pages == 1) {
-            virt = Memory::g_pfa->AllocateZeroed();
-        } else {
-            virt = Memory::g_pfa->ReallocConsecutive(nullptr, pages);
-            memset(virt, 0, pages * 0x1000);
-        }
-        outPhys = Memory::SubHHDM(virt);
-        return virt;
-    }
-
     // -------------------------------------------------------------------------
     // Admin command submission
     // -------------------------------------------------------------------------
@@ -163,43 +142,538 @@ namespace Drivers::Storage::Nvme {
     }
 
     // -------------------------------------------------------------------------
-    // I/O command submission
+    // I/O queues and command slots
+    // Each outstanding I/O command owns a slot of its queue; the slot index is
+    // its CommandId. Completions are reaped by the queue's interrupt or by
+    // whoever polls; asynchronous ones go to BlockQueue, synchronous waiters
+    // watch their slot. Data is transferred straight from the caller's pages
+    // through the slot's PRP list; only layouts PRPs cannot describe go
+    // through a bounce buffer, which stays attached to the idle slot so the
+    // interrupt path never has to free memory.
     // -------------------------------------------------------------------------
 
-    static void SubmitIoCommand(SqEntry& cmd) {
-        cmd.CommandId = g_ioCmdId++;
-        g_ioSq[g_ioSqTail] = cmd;
-        g_ioSqTail = (g_ioSqTail + 1) % g_ioSqDepth;
-        WriteSqTailDoorbell(1, g_ioSqTail);
+    struct IoSlot {
+        bool      busy;
+        volatile bool done;
+        bool      ok;
+        bool      orphaned;     // Synchronous caller timed out; reclaim on completion
+        bool      write;
+        bool      bounced;      // Data went through `dma` rather than the caller's pages
+        bool      copyBack;     // Bounced async read waiting to leave interrupt context
+        void*     tag;          // BlockQueue tag, nullptr for synchronous commands
+        uint8_t*  dma;          // Bounce buffer, kept for reuse while idle
+        int       pages;
+        uint64_t  dmaPhys;
+        uint64_t* prpList;      // Preallocated PRP list page
+        uint64_t  prpListPhys;
+        const Storage::IoSegment* segs;
+        int       segCount;
+    };
+
+    struct IoQueue {
+        SqEntry*  sq;
+        CqEntry*  cq;
+        uint64_t  sqPhys;
+        uint64_t  cqPhys;
+        uint16_t  id;           // Queue ID (1-based; 0 is the admin queue)
+        uint16_t  depth;        // Entries in each of SQ and CQ
+        uint16_t  sqTail;
+        uint16_t  cqHead;
+        uint8_t   cqPhase;
+        int       slotCount;    // depth - 1 commands may be outstanding
+        IoSlot    slots[IO_QUEUE_DEPTH];
+        kcp::Spinlock lock;
+    };
+
+    // Idle slots give back bounce buffers larger than this when polled
+    static constexpr int KeepPages = 16;
+
+    static IoQueue g_ioQueues[MAX_IO_QUEUES] = {};
+    static int g_ioQueueCount = 0;
+    static int g_msixVectors = 0;   // 0 = single MSI or legacy interrupt
+
+    // Completions arrive from interrupt handlers. Never touch the page frame
+    // allocator with a queue lock held: its lock does not mask interrupts.
+    static uint64_t LockIo(IoQueue& q) {
+        uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        q.lock.Acquire();
+        return flags;
     }
 
-    static bool WaitIoCompletion(CqEntry& out) {
-        for (int i = 0; i < 5000000; i++) {
-            CqEntry* cqe = &g_ioCq[g_ioCqHead];
-            uint16_t status = cqe->Status;
+    static void UnlockIo(IoQueue& q, uint64_t flags) {
+        q.lock.Release();
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+    }
 
-            if ((status & CQE_PHASE_BIT) == g_ioCqPhase) {
-                out = *cqe;
+    static int ReserveSlot(IoQueue& q) {
+        uint64_t flags = LockIo(q);
+        for (int i = 0; i < q.slotCount; i++) {
+            IoSlot& slot = q.slots[i];
+            if (slot.busy) continue;
+
+            slot.busy = true;
+            slot.done = false;
+            slot.ok = false;
+            slot.orphaned = false;
+            slot.copyBack = false;
+            slot.tag = nullptr;
+            slot.segs = nullptr;
+            slot.segCount = 0;
+            UnlockIo(q, flags);
+            return i;
+        }
+        UnlockIo(q, flags);
+        return -1;
+    }
+
+    static void ReleaseSlot(IoQueue& q, int idx) {
+        uint64_t flags = LockIo(q);
+        q.slots[idx].busy = false;
+        UnlockIo(q, flags);
+    }
 
-                g_ioCqHead++;
-                if (g_ioCqHead >= g_ioCqDepth) {
-                    g_ioCqHead = 0;
-                    g_ioCqPhase ^= 1;
+    // PRP entries one list page holds (no list chaining)
+    static constexpr int PrpListEntries = 0x1000 / sizeof(uint64_t);
+
+    // Dataset Management range (16 bytes, up to 256 per command)
+    struct DsmRange {
+        uint32_t Attributes;
+        uint32_t Length;        // Logical blocks
+        uint64_t StartLba;
+    } __attribute__((packed));
+
+    static constexpr int DsmMaxRanges = 0x1000 / sizeof(DsmRange);
+    static constexpr uint32_t DsmMaxRangeBlocks = 0xFFFFFFFF;
+
+    // Write Zeroes takes a 16-bit, 0-based block count
+    static constexpr uint32_t WriteZeroesMaxBlocks = 0x10000;
+
+    // The queue of the submitting CPU, falling back to any queue with room
+    static IoQueue* ReserveAnySlot(int& idx) {
+        int first = (int)(Hal::LocalApic::GetId() % (uint32_t)g_ioQueueCount);
+        for (int k = 0; k < g_ioQueueCount; k++) {
+            IoQueue& q = g_ioQueues[(first + k) % g_ioQueueCount];
+            idx = ReserveSlot(q);
+            if (idx >= 0) return &q;
+        }
+        return nullptr;
+    }
+
+    static void SubmitIoCommand(IoQueue& q, SqEntry& cmd) {
+        q.sq[q.sqTail] = cmd;
+        q.sqTail = (q.sqTail + 1) % q.depth;
+        WriteSqTailDoorbell(q.id, q.sqTail);
+    }
+
+    // Describe the caller's segments with PRPs. Only the first entry may
+    // start inside a page and every piece but the last must run to the end
+    // of its page; anything else (or memory that is not DMA-safe) fails.
+    static bool BuildDirectPrps(IoSlot& slot, const Storage::IoSegment* segs, int segCount,
+                                uint64_t& prp1, uint64_t& prp2) {
+        int listCount = 0;
+        bool first = true;
+
+        for (int i = 0; i < segCount; i++) {
+            uint8_t* p = (uint8_t*)segs[i].Buffer;
+            uint32_t left = segs[i].Length;
+            while (left > 0) {
+                uint64_t phys = Dma::Translate(p);
+                if (phys == 0) return false;
+
+                uint32_t inPage = 0x1000 - (uint32_t)(phys & 0xFFF);
+                uint32_t chunk = left < inPage ? left : inPage;
+
+                if (first) {
+                    if (phys & 0x3) return false;
+                    prp1 = phys;
+                    first = false;
+                } else {
+                    if ((phys & 0xFFF) || listCount >= PrpListEntries) return false;
+                    slot.prpList[listCount++] = phys;
                 }
-                WriteCqHeadDoorbell(1, g_ioCqHead);
 
-                if (status & CQE_STATUS_MASK) {
-                    KernelLogStream(ERROR, "NVMe") << "I/O command failed, status="
-                        << base::hex << (uint64_t)(status >> 1);
-                    return false;
+                p += chunk;
+                left -= chunk;
+                bool last = left == 0 && i == segCount - 1;
+                if (chunk < inPage && !last) return false;
+            }
+        }
+
+        if (listCount == 0) prp2 = 0;
+        else if (listCount == 1) prp2 = slot.prpList[0];
+        else prp2 = slot.prpListPhys;
+        return true;
+    }
+
+    // Fall back to the slot's physically contiguous bounce buffer
+    static bool BuildBouncePrps(IoSlot& slot, bool write, uint32_t totalBytes,
+                                const Storage::IoSegment* segs, int segCount,
+                                uint64_t& prp1, uint64_t& prp2) {
+        int pagesNeeded = (totalBytes + 0xFFF) / 0x1000;
+
+        // The slot is ours, so its cached buffer can be swapped without the lock
+        if (slot.dma != nullptr && slot.pages < pagesNeeded) {
+            Memory::g_pfa->Free(slot.dma, slot.pages);
+            slot.dma = nullptr;
+        }
+        if (slot.dma == nullptr) {
+            slot.dma = (uint8_t*)Dma::AllocateBuffer(slot.dmaPhys, pagesNeeded);
+            if (slot.dma == nullptr) return false;
+            slot.pages = pagesNeeded;
+        }
+
+        prp1 = slot.dmaPhys;
+        prp2 = 0;
+        if (pagesNeeded == 2) {
+            prp2 = slot.dmaPhys + 0x1000;
+        } else if (pagesNeeded > 2) {
+            for (int i = 1; i < pagesNeeded; i++) {
+                slot.prpList[i - 1] = slot.dmaPhys + (uint64_t)i * 0x1000;
+            }
+            prp2 = slot.prpListPhys;
+        }
+
+        if (write) {
+            uint8_t* out = slot.dma;
+            for (int i = 0; i < segCount; i++) {
+                memcpy(out, segs[i].Buffer, segs[i].Length);
+                out += segs[i].Length;
+            }
+        }
+        return true;
+    }
+
+    // Map the data for a reserved slot and issue the command
+    static bool IssueIo(IoQueue& q, int idx, int ns, bool write, uint64_t lba, uint32_t count,
+                        const Storage::IoSegment* segs, int segCount, void* tag) {
+        IoSlot& slot = q.slots[idx];
+        uint32_t totalBytes = count * g_namespaces[ns].SectorSize;
+
+        SqEntry cmd = {};
+        cmd.Opcode = write ? IO_CMD_WRITE : IO_CMD_READ;
+        cmd.CommandId = (uint16_t)idx;
+        cmd.Nsid = g_namespaces[ns].Nsid;
+
+        uint64_t prp1 = 0, prp2 = 0;
+        bool bounced = false;
+        if (!BuildDirectPrps(slot, segs, segCount, prp1, prp2)) {
+            if (!BuildBouncePrps(slot, write, totalBytes, segs, segCount, prp1, prp2)) return false;
+            bounced = true;
+        }
+        cmd.Prp1 = prp1;
+        cmd.Prp2 = prp2;
+
+        // CDW10-11: Starting LBA (64-bit)
+        cmd.Cdw10 = (uint32_t)(lba & 0xFFFFFFFF);
+        cmd.Cdw11 = (uint32_t)(lba >> 32);
+        // CDW12: bits 15:0 = Number of Logical Blocks (0-based)
+        cmd.Cdw12 = count - 1;
+
+        uint64_t flags = LockIo(q);
+        slot.write = write;
+        slot.bounced = bounced;
+        slot.tag = tag;
+        slot.segs = segs;
+        slot.segCount = segCount;
+        SubmitIoCommand(q, cmd);
+        UnlockIo(q, flags);
+        return true;
+    }
+
+    // Copy bounced read data out to the caller's segments. Never from the
+    // interrupt handler: the segments may be user memory, which is only
+    // reachable under the submitter's page tables and may be swapped out.
+    static void CopyBounced(const IoSlot& slot) {
+        uint8_t* in = slot.dma;
+        for (int i = 0; i < slot.segCount; i++) {
+            memcpy(slot.segs[i].Buffer, in, slot.segs[i].Length);
+            in += slot.segs[i].Length;
+        }
+    }
+
+    // Consume new completion entries (queue lock held). Finished asynchronous
+    // commands are handed back in tags/oks so that BlockQueue::Complete can
+    // run after the lock is dropped; bounced reads among them wait in
+    // `copyBack` for PollQueue outside interrupt context.
+    static int ReapIo(IoQueue& q, void** tags, bool* oks) {
+        int n = 0;
+        bool consumed = false;
+
+        for (;;) {
+            CqEntry* cqe = &q.cq[q.cqHead];
+            uint16_t status = cqe->Status;
+            if ((status & CQE_PHASE_BIT) != q.cqPhase) break;
+
+            uint16_t cid = cqe->CommandId;
+            consumed = true;
+            q.cqHead++;
+            if (q.cqHead >= q.depth) {
+                q.cqHead = 0;
+                q.cqPhase ^= 1;
+            }
+
+            if (cid >= q.slotCount || !q.slots[cid].busy) continue;
+            IoSlot& slot = q.slots[cid];
+
+            bool ok = (status & CQE_STATUS_MASK) == 0;
+            if (!ok) {
+                KernelLogStream(ERROR, "NVMe") << "I/O command failed, status="
+                    << base::hex << (uint64_t)(status >> 1);
+            }
+
+            if (slot.tag != nullptr && ok && slot.bounced && !slot.write) {
+                slot.copyBack = true;
+            } else if (slot.tag != nullptr) {
+                tags[n] = slot.tag;
+                oks[n] = ok;
+                n++;
+                slot.busy = false;
+            } else if (slot.orphaned) {
+                slot.busy = false;
+            } else {
+                slot.ok = ok;
+                slot.done = true;
+            }
+        }
+
+        if (consumed) WriteCqHeadDoorbell(q.id, q.cqHead);
+        return n;
+    }
+
+    // Reap one queue. Outside interrupt context (`process`), bounced
+    // asynchronous reads are copied out and completed, and oversized bounce
+    // buffers of idle slots are released.
+    static void PollQueue(IoQueue& q, bool process) {
+        void* tags[IO_QUEUE_DEPTH];
+        bool oks[IO_QUEUE_DEPTH];
+        int copies[IO_QUEUE_DEPTH];
+        int copyCount = 0;
+        uint8_t* spareDma[IO_QUEUE_DEPTH];
+        int sparePages[IO_QUEUE_DEPTH];
+        int spareCount = 0;
+
+        uint64_t flags = LockIo(q);
+        int n = ReapIo(q, tags, oks);
+        if (process) {
+            for (int i = 0; i < q.slotCount; i++) {
+                IoSlot& slot = q.slots[i];
+                if (slot.copyBack) {
+                    slot.copyBack = false;
+                    copies[copyCount++] = i;
                 }
-                return true;
+                if (slot.busy || slot.dma == nullptr || slot.pages <= KeepPages) continue;
+                spareDma[spareCount] = slot.dma;
+                sparePages[spareCount] = slot.pages;
+                spareCount++;
+                slot.dma = nullptr;
             }
-            asm volatile("" ::: "memory");
         }
+        UnlockIo(q, flags);
+
+        for (int i = 0; i < spareCount; i++) Memory::g_pfa->Free(spareDma[i], sparePages[i]);
+        for (int i = 0; i < n; i++) BlockQueue::Complete(tags[i], oks[i]);
+
+        // The slots stay busy until copied, so their bounce buffers are intact
+        for (int i = 0; i < copyCount; i++) {
+            IoSlot& slot = q.slots[copies[i]];
+            void* tag = slot.tag;
+            CopyBounced(slot);
+            ReleaseSlot(q, copies[i]);
+            BlockQueue::Complete(tag, true);
+        }
+    }
 
-        KernelLogStream(ERROR, "NVMe") << "I/O command timeout";
-        return false;
+    static void PollCompletions() {
+        for (int i = 0; i < g_ioQueueCount; i++) PollQueue(g_ioQueues[i], true);
+    }
+
+    // Reserve a slot for a synchronous command, polling until one frees up
+    static IoQueue* ReserveSyncSlot(int& idx) {
+        IoQueue* q = ReserveAnySlot(idx);
+        for (int i = 0; q == nullptr && i < 5000000; i++) {
+            PollCompletions();
+            q = ReserveAnySlot(idx);
+        }
+        if (q == nullptr) {
+            KernelLogStream(ERROR, "NVMe") << "No free I/O slot";
+        }
+        return q;
+    }
+
+    // Wait for a synchronous command and release its slot
+    static bool WaitSync(IoQueue& q, int idx) {
+        // Normally the interrupt completes the slot; polling covers callers
+        // running with interrupts masked
+        for (int i = 0; i < 5000000 && !q.slots[idx].done; i++) {
+            PollQueue(q, false);
+            asm volatile("pause" ::: "memory");
+        }
+
+        uint64_t flags = LockIo(q);
+        IoSlot& slot = q.slots[idx];
+        if (!slot.done) {
+            // Late completion must not touch the caller's buffer. A direct
+            // transfer may still land there; nothing can stop the device now.
+            slot.orphaned = true;
+            slot.segCount = 0;
+            UnlockIo(q, flags);
+            KernelLogStream(ERROR, "NVMe") << "I/O command timeout";
+            return false;
+        }
+        bool ok = slot.ok;
+        UnlockIo(q, flags);
+
+        // Bounced data is copied here, in the caller's address space
+        if (ok && slot.bounced && !slot.write) CopyBounced(slot);
+        ReleaseSlot(q, idx);
+        return ok;
+    }
+
+    // Issue one command and wait until it completes
+    static bool SyncIoChunk(int ns, bool write, uint64_t lba, uint32_t count, void* buffer) {
+        Storage::IoSegment seg = { buffer, count * g_namespaces[ns].SectorSize };
+
+        int idx = -1;
+        IoQueue* q = ReserveSyncSlot(idx);
+        if (q == nullptr) return false;
+
+        if (!IssueIo(*q, idx, ns, write, lba, count, &seg, 1, nullptr)) {
+            ReleaseSlot(*q, idx);
+            return false;
+        }
+        return WaitSync(*q, idx);
+    }
+
+    // Split transfers larger than the controller accepts in one command
+    static bool SyncIo(int ns, bool write, uint64_t lba, uint32_t count, void* buffer) {
+        uint32_t maxBlocks = g_namespaces[ns].MaxTransferBlocks;
+        uint8_t* p = (uint8_t*)buffer;
+
+        while (count > 0) {
+            uint32_t n = count < maxBlocks ? count : maxBlocks;
+            if (!SyncIoChunk(ns, write, lba, n, p)) return false;
+            lba += n;
+            count -= n;
+            p += (uint64_t)n * g_namespaces[ns].SectorSize;
+        }
+        return true;
+    }
+
+    // Deallocate up to DsmMaxRanges * DsmMaxRangeBlocks blocks with one
+    // Dataset Management command; the range list goes in the slot's bounce page
+    static bool DeallocateChunk(int ns, uint64_t lba, uint64_t count) {
+        int idx = -1;
+        IoQueue* q = ReserveSyncSlot(idx);
+        if (q == nullptr) return false;
+
+        IoSlot& slot = q->slots[idx];
+        SqEntry cmd = {};
+        uint64_t prp1 = 0, prp2 = 0;
+        if (!BuildBouncePrps(slot, false, 0x1000, nullptr, 0, prp1, prp2)) {
+            ReleaseSlot(*q, idx);
+            return false;
+        }
+
+        DsmRange* ranges = (DsmRange*)slot.dma;
+        memset(ranges, 0, 0x1000);
+        int n = 0;
+        while (count > 0 && n < DsmMaxRanges) {
+            uint32_t len = count < DsmMaxRangeBlocks ? (uint32_t)count : DsmMaxRangeBlocks;
+            ranges[n].Length = len;
+            ranges[n].StartLba = lba;
+            lba += len;
+            count -= len;
+            n++;
+        }
+
+        cmd.Opcode = IO_CMD_DSM;
+        cmd.CommandId = (uint16_t)idx;
+        cmd.Nsid = g_namespaces[ns].Nsid;
+        cmd.Prp1 = prp1;
+        cmd.Prp2 = prp2;
+        cmd.Cdw10 = (uint32_t)(n - 1);      // Number of ranges (0-based)
+        cmd.Cdw11 = DSM_ATTR_DEALLOCATE;
+
+        uint64_t flags = LockIo(*q);
+        slot.write = true;                  // Nothing to copy back
+        slot.bounced = false;
+        slot.tag = nullptr;
+        SubmitIoCommand(*q, cmd);
+        UnlockIo(*q, flags);
+
+        return WaitSync(*q, idx);
+    }
+
+    // BlockDevice::Discard
+    static bool Discard(void* ctx, uint64_t lba, uint64_t count) {
+        int ns = (int)(uintptr_t)ctx;
+        constexpr uint64_t perCommand = (uint64_t)DsmMaxRanges * DsmMaxRangeBlocks;
+
+        while (count > 0) {
+            uint64_t n = count < perCommand ? count : perCommand;
+            if (!DeallocateChunk(ns, lba, n)) return false;
+            lba += n;
+            count -= n;
+        }
+        return true;
+    }
+
+    // Zero up to WriteZeroesMaxBlocks blocks without transferring data
+    static bool WriteZeroesChunk(int ns, uint64_t lba, uint32_t count) {
+        int idx = -1;
+        IoQueue* q = ReserveSyncSlot(idx);
+        if (q == nullptr) return false;
+
+        IoSlot& slot = q->slots[idx];
+        SqEntry cmd = {};
+        cmd.Opcode = IO_CMD_WRITE_ZEROES;
+        cmd.CommandId = (uint16_t)idx;
+        cmd.Nsid = g_namespaces[ns].Nsid;
+        cmd.Cdw10 = (uint32_t)lba;
+        cmd.Cdw11 = (uint32_t)(lba >> 32);
+        cmd.Cdw12 = count - 1;              // NLB (0-based)
+
+        uint64_t flags = LockIo(*q);
+        slot.write = true;                  // Nothing to copy back
+        slot.bounced = false;
+        slot.tag = nullptr;
+        SubmitIoCommand(*q, cmd);
+        UnlockIo(*q, flags);
+
+        return WaitSync(*q, idx);
+    }
+
+    // BlockDevice::WriteZeroes
+    static bool WriteZeroes(void* ctx, uint64_t lba, uint64_t count) {
+        int ns = (int)(uintptr_t)ctx;
+
+        while (count > 0) {
+            uint32_t n = count < WriteZeroesMaxBlocks ? (uint32_t)count : WriteZeroesMaxBlocks;
+            if (!WriteZeroesChunk(ns, lba, n)) return false;
+            lba += n;
+            count -= n;
+        }
+        return true;
+    }
+
+    // BlockDevice::StartIo
+    static bool StartIo(void* ctx, bool write, uint64_t lba, uint32_t count,
+                        const Storage::IoSegment* segs, int segCount, void* tag) {
+        int ns = (int)(uintptr_t)ctx;
+        if (count == 0 || count > g_namespaces[ns].MaxTransferBlocks) return false;
+
+        int idx = -1;
+        IoQueue* q = ReserveAnySlot(idx);
+        if (q == nullptr) {
+            KernelLogStream(ERROR, "NVMe") << "StartIo: no free I/O slot";
+            return false;
+        }
+        if (!IssueIo(*q, idx, ns, write, lba, count, segs, segCount, tag)) {
+            ReleaseSlot(*q, idx);
+            return false;
+        }
+        return true;
     }
 
     // -------------------------------------------------------------------------
@@ -261,11 +735,20 @@ namespace Drivers::Storage::Nvme {
     static bool SetupAdminQueues() {
         // Allocate Admin Submission Queue (ADMIN_QUEUE_DEPTH * 64 bytes)
         // At 32 entries * 64 bytes = 2048 bytes, fits in 1 page
-        g_adminSq = (SqEntry*)AllocateDmaBuffer(g_adminSqPhys);
+        g_adminSq = (SqEntry*)Dma::AllocateBuffer(g_adminSqPhys);
 
         // Allocate Admin Completion Queue (ADMIN_QUEUE_DEPTH * 16 bytes)
         // At 32 entries * 16 bytes = 512 bytes, fits in 1 page
-        g_adminCq = (CqEntry*)AllocateDmaBuffer(g_adminCqPhys);
+        g_adminCq = (CqEntry*)Dma::AllocateBuffer(g_adminCqPhys);
+
+        if (g_adminSq == nullptr || g_adminCq == nullptr) {
+            KernelLogStream(ERROR, "NVMe") << "Failed to allocate admin queues";
+            if (g_adminSq != nullptr) Memory::g_pfa->Free(g_adminSq);
+            if (g_adminCq != nullptr) Memory::g_pfa->Free(g_adminCq);
+            g_adminSq = nullptr;
+            g_adminCq = nullptr;
+            return false;
+        }
 
         g_adminSqTail = 0;
         g_adminCqHead = 0;
@@ -290,7 +773,11 @@ namespace Drivers::Storage::Nvme {
 
     static bool IdentifyController() {
         uint64_t identPhys;
-        uint8_t* identData = (uint8_t*)AllocateDmaBuffer(identPhys);
+        uint8_t* identData = (uint8_t*)Dma::AllocateBuffer(identPhys);
+        if (identData == nullptr) {
+            KernelLogStream(ERROR, "NVMe") << "Failed to allocate identify buffer";
+            return false;
+        }
 
         SqEntry cmd = {};
         cmd.Opcode = ADMIN_IDENTIFY;
@@ -336,6 +823,11 @@ namespace Drivers::Storage::Nvme {
         // NN (Number of Namespaces): bytes 516-519
         uint32_t nn = *(uint32_t*)(identData + 516);
 
+        // ONCS (Optional NVM Command Support): bytes 520-521
+        uint16_t oncs = *(uint16_t*)(identData + 520);
+        g_supportsDsm = (oncs & ONCS_DSM) != 0;
+        g_supportsWriteZeroes = (oncs & ONCS_WRITE_ZEROES) != 0;
+
         KernelLogStream(OK, "NVMe") << "Controller: " << model;
         KernelLogStream(INFO, "NVMe") << "MDTS: " << (g_mdts ? (uint64_t)(g_mdts * 4) : 0)
             << " KiB, Namespaces: " << (uint64_t)nn;
@@ -351,7 +843,11 @@ namespace Drivers::Storage::Nvme {
         for (uint32_t nsid = 1; nsid <= nn; nsid++) {
             // Identify Namespace
             uint64_t nsIdentPhys;
-            uint8_t* nsIdentData = (uint8_t*)AllocateDmaBuffer(nsIdentPhys);
+            uint8_t* nsIdentData = (uint8_t*)Dma::AllocateBuffer(nsIdentPhys);
+            if (nsIdentData == nullptr) {
+                KernelLogStream(WARNING, "NVMe") << "Failed to allocate namespace identify buffer";
+                break;
+            }
 
             SqEntry nsCmd = {};
             nsCmd.Opcode = ADMIN_IDENTIFY;
@@ -401,6 +897,12 @@ namespace Drivers::Storage::Nvme {
                 g_namespaces[idx].MaxTransferBlocks = 128;
             }
 
+            // A command's PRPs must fit one list page (2 MiB)
+            uint32_t prpLimit = (PrpListEntries * 0x1000) / sectorSize;
+            if (g_namespaces[idx].MaxTransferBlocks > prpLimit) {
+                g_namespaces[idx].MaxTransferBlocks = prpLimit;
+            }
+
             g_nsCount++;
 
             uint64_t sizeBytes = nsze * sectorSize;
@@ -445,72 +947,105 @@ namespace Drivers::Storage::Nvme {
         return true;
     }
 
-    static bool CreateIoQueues() {
-        // Request 1 SQ + 1 CQ
-        uint16_t sqCount = 1;
-        uint16_t cqCount = 1;
-        if (!SetNumberOfQueues(sqCount, cqCount)) {
-            KernelLogStream(ERROR, "NVMe") << "Set Number of Queues failed";
-            return false;
-        }
-
-        KernelLogStream(INFO, "NVMe") << "Allocated " << (uint64_t)sqCount
-            << " SQ(s), " << (uint64_t)cqCount << " CQ(s)";
-
-        // Determine queue depths (capped by controller max)
-        g_ioSqDepth = IO_QUEUE_DEPTH;
-        g_ioCqDepth = IO_QUEUE_DEPTH;
-        if (g_ioSqDepth > g_maxQueueEntries) g_ioSqDepth = g_maxQueueEntries;
-        if (g_ioCqDepth > g_maxQueueEntries) g_ioCqDepth = g_maxQueueEntries;
+    static bool CreateIoQueue(IoQueue& q, uint16_t id, uint16_t depth) {
+        q.id = id;
+        q.depth = depth;
 
         // Allocate I/O CQ
-        int cqPages = ((uint32_t)g_ioCqDepth * sizeof(CqEntry) + 0xFFF) / 0x1000;
-        g_ioCq = (CqEntry*)AllocateDmaBuffer(g_ioCqPhys, cqPages);
-        g_ioCqHead = 0;
-        g_ioCqPhase = 1;
+        int cqPages = ((uint32_t)depth * sizeof(CqEntry) + 0xFFF) / 0x1000;
+        q.cq = (CqEntry*)Dma::AllocateBuffer(q.cqPhys, cqPages);
+        q.cqHead = 0;
+        q.cqPhase = 1;
+        if (q.cq == nullptr) return false;
+
+        // With MSI-X each queue interrupts on its own table entry
+        uint32_t vector = g_msixVectors > id ? id : 0;
 
-        // Create I/O Completion Queue (queue ID = 1)
+        // Create I/O Completion Queue
         {
             SqEntry cmd = {};
             cmd.Opcode = ADMIN_CREATE_IO_CQ;
-            cmd.Prp1 = g_ioCqPhys;
+            cmd.Prp1 = q.cqPhys;
             // CDW10: bits 31:16 = queue size (0-based), bits 15:0 = queue ID
-            cmd.Cdw10 = ((uint32_t)(g_ioCqDepth - 1) << 16) | 1;
+            cmd.Cdw10 = ((uint32_t)(depth - 1) << 16) | id;
             // CDW11: bit 0 = physically contiguous, bit 1 = interrupts enabled
             //        bits 31:16 = interrupt vector
-            cmd.Cdw11 = (1u << 0) | (1u << 1) | (0u << 16);
+            cmd.Cdw11 = (1u << 0) | (1u << 1) | (vector << 16);
 
             CqEntry cqe;
             if (!AdminCommand(cmd, cqe)) {
-                KernelLogStream(ERROR, "NVMe") << "Create I/O CQ failed";
+                KernelLogStream(ERROR, "NVMe") << "Create I/O CQ " << base::dec << (uint64_t)id << " failed";
                 return false;
             }
         }
 
         // Allocate I/O SQ
-        int sqPages = ((uint32_t)g_ioSqDepth * sizeof(SqEntry) + 0xFFF) / 0x1000;
-        g_ioSq = (SqEntry*)AllocateDmaBuffer(g_ioSqPhys, sqPages);
-        g_ioSqTail = 0;
-        g_ioCmdId = 0;
+        int sqPages = ((uint32_t)depth * sizeof(SqEntry) + 0xFFF) / 0x1000;
+        q.sq = (SqEntry*)Dma::AllocateBuffer(q.sqPhys, sqPages);
+        q.sqTail = 0;
+        if (q.sq == nullptr) return false;
 
-        // Create I/O Submission Queue (queue ID = 1, linked to CQ ID = 1)
+        // Create I/O Submission Queue, linked to the CQ with the same ID
         {
             SqEntry cmd = {};
             cmd.Opcode = ADMIN_CREATE_IO_SQ;
-            cmd.Prp1 = g_ioSqPhys;
+            cmd.Prp1 = q.sqPhys;
             // CDW10: bits 31:16 = queue size (0-based), bits 15:0 = queue ID
-            cmd.Cdw10 = ((uint32_t)(g_ioSqDepth - 1) << 16) | 1;
+            cmd.Cdw10 = ((uint32_t)(depth - 1) << 16) | id;
             // CDW11: bit 0 = physically contiguous, bits 31:16 = CQ ID
-            cmd.Cdw11 = (1u << 0) | (1u << 16);
+            cmd.Cdw11 = (1u << 0) | ((uint32_t)id << 16);
 
             CqEntry cqe;
             if (!AdminCommand(cmd, cqe)) {
-                KernelLogStream(ERROR, "NVMe") << "Create I/O SQ failed";
+                KernelLogStream(ERROR, "NVMe") << "Create I/O SQ " << base::dec << (uint64_t)id << " failed";
                 return false;
             }
         }
 
-        KernelLogStream(OK, "NVMe") << "I/O queues created (depth " << (uint64_t)g_ioSqDepth << ")";
+        // One PRP list page per slot, so issuing never has to allocate one
+        q.slotCount = 0;
+        for (int i = 0; i < depth - 1; i++) {
+            q.slots[i].prpList = (uint64_t*)Dma::AllocateBuffer(q.slots[i].prpListPhys);
+            if (q.slots[i].prpList == nullptr) break;
+            q.slotCount++;
+        }
+        return q.slotCount > 0;
+    }
+
+    static bool CreateIoQueues() {
+        // One queue pair per CPU, bounded by the MSI-X vectors we have
+        int want = Hal::GetDetectedCpuCount();
+        if (want < 1) want = 1;
+        if (want > MAX_IO_QUEUES) want = MAX_IO_QUEUES;
+        if (g_msixVectors > 1 && want > g_msixVectors - 1) want = g_msixVectors - 1;
+
+        uint16_t sqCount = (uint16_t)want;
+        uint16_t cqCount = (uint16_t)want;
+        if (!SetNumberOfQueues(sqCount, cqCount)) {
+            KernelLogStream(ERROR, "NVMe") << "Set Number of Queues failed";
+            return false;
+        }
+
+        KernelLogStream(INFO, "NVMe") << "Allocated " << (uint64_t)sqCount
+            << " SQ(s), " << (uint64_t)cqCount << " CQ(s)";
+
+        int count = want;
+        if (count > sqCount) count = sqCount;
+        if (count > cqCount) count = cqCount;
+
+        // Determine queue depth (capped by controller max)
+        uint16_t depth = IO_QUEUE_DEPTH;
+        if (depth > g_maxQueueEntries) depth = g_maxQueueEntries;
+
+        g_ioQueueCount = 0;
+        for (int i = 0; i < count; i++) {
+            if (!CreateIoQueue(g_ioQueues[i], (uint16_t)(i + 1), depth)) break;
+            g_ioQueueCount++;
+        }
+        if (g_ioQueueCount == 0) return false;
+
+        KernelLogStream(OK, "NVMe") << "I/O queues created: " << base::dec << (uint64_t)g_ioQueueCount
+            << " x depth " << (uint64_t)depth;
         return true;
     }
 
@@ -519,10 +1054,77 @@ namespace Drivers::Storage::Nvme {
     // -------------------------------------------------------------------------
 
     static void HandleInterrupt(uint8_t irq) {
-        (void)irq;
-        // NVMe uses polling-based completion in this driver.
-        // The interrupt handler just acknowledges the interrupt.
-        // Completions are consumed in the polling loops above.
+        // MSI-X: the vector identifies the queue (entry 0 is the admin queue,
+        // whose commands are polled)
+        if (g_msixVectors > 0) {
+            int id = irq - MSIX_IRQ_BASE;
+            if (id >= 1 && id <= g_ioQueueCount) PollQueue(g_ioQueues[id - 1], false);
+            return;
+        }
+
+        // Shared MSI or legacy line: check every queue
+        for (int i = 0; i < g_ioQueueCount; i++) PollQueue(g_ioQueues[i], false);
+    }
+
+    // -------------------------------------------------------------------------
+    // MSI-X setup
+    // Returns the number of table entries programmed, 0 if MSI-X is unusable.
+    // -------------------------------------------------------------------------
+
+    static int SetupMsix(uint8_t bus, uint8_t dev, uint8_t func) {
+        uint8_t cap = Pci::FindCapability(bus, dev, func, Pci::PCI_CAP_MSIX);
+        if (cap == 0) {
+            KernelLogStream(INFO, "NVMe") << "MSI-X capability not found";
+            return 0;
+        }
+
+        uint16_t msgCtrl = Pci::LegacyRead16(bus, dev, func, cap + 2);
+        int tableSize = (msgCtrl & 0x7FF) + 1;
+
+        // Table Offset/BIR: bits 2:0 = BAR index, bits 31:3 = offset into it
+        uint32_t tableReg = Pci::LegacyRead32(bus, dev, func, cap + 4);
+        uint64_t barPhys = Pci::ReadBar(bus, dev, func, (int)(tableReg & 0x7));
+        if (barPhys == 0) {
+            KernelLogStream(WARNING, "NVMe") << "MSI-X table BAR unusable";
+            return 0;
+        }
+
+        uint64_t tablePhys = barPhys + (tableReg & ~0x7u);
+        uint64_t tableEnd = tablePhys + (uint64_t)tableSize * 16;
+        for (uint64_t page = tablePhys & ~0xFFFULL; page < tableEnd; page += 0x1000) {
+            Memory::VMM::g_paging->MapMMIO(page, Memory::HHDM(page));
+        }
+        volatile uint32_t* table = (volatile uint32_t*)Memory::HHDM(tablePhys);
+
+        int vectors = tableSize < MAX_IO_QUEUES + 1 ? tableSize : MAX_IO_QUEUES + 1;
+
+        // Entry layout: address low, address high, data, vector control (bit 0 = masked)
+        for (int v = 0; v < tableSize; v++) {
+            volatile uint32_t* entry = table + v * 4;
+            if (v >= vectors) {
+                entry[3] = 1;
+                continue;
+            }
+
+            uint8_t irq = (uint8_t)(MSIX_IRQ_BASE + v);
+            Hal::RegisterIrqHandler(irq, HandleInterrupt);
+            entry[0] = MSI_ADDR_BASE;
+            entry[1] = 0;
+            entry[2] = Hal::IRQ_VECTOR_BASE + irq;
+            entry[3] = 0;
+        }
+
+        msgCtrl |= (1 << 15);    // MSI-X Enable
+        msgCtrl &= ~(1 << 14);   // Function Mask off
+        Pci::LegacyWrite16(bus, dev, func, cap + 2, msgCtrl);
+
+        uint16_t pciCmd = Pci::LegacyRead16(bus, dev, func, (uint8_t)Pci::PCI_REG_COMMAND);
+        pciCmd |= Pci::PCI_CMD_INTX_DISABLE;
+        Pci::LegacyWrite16(bus, dev, func, (uint8_t)Pci::PCI_REG_COMMAND, pciCmd);
+
+        KernelLogStream(OK, "NVMe") << "MSI-X enabled: " << base::dec << (uint64_t)vectors
+            << " of " << (uint64_t)tableSize << " vectors";
+        return vectors;
     }
 
     // -------------------------------------------------------------------------
@@ -618,8 +1220,9 @@ namespace Drivers::Storage::Nvme {
             return false;
         }
 
-        // Step 2: Set up MSI
-        bool hasMsi = SetupMsi(dev.Bus, dev.Device, dev.Function);
+        // Step 2: Set up MSI-X, falling back to MSI and then the legacy line
+        g_msixVectors = SetupMsix(dev.Bus, dev.Device, dev.Function);
+        bool hasMsi = g_msixVectors > 0 || SetupMsi(dev.Bus, dev.Device, dev.Function);
         if (!hasMsi) {
             uint8_t irqLine = Pci::LegacyRead8(dev.Bus, dev.Device, dev.Function,
                 (uint8_t)Pci::PCI_REG_INTERRUPT);
@@ -665,9 +1268,20 @@ namespace Drivers::Storage::Nvme {
             bdev.WriteSectors = [](void* ctx, uint64_t lba, uint32_t count, const void* buffer) -> bool {
                 return WriteSectors((int)(uintptr_t)ctx, lba, count, buffer);
             };
+            bdev.StartIo = StartIo;
+            bdev.PollIo = [](void*) {
+                PollCompletions();
+            };
+            bdev.Discard = g_supportsDsm ? Discard : nullptr;
+            bdev.WriteZeroes = g_supportsWriteZeroes ? WriteZeroes : nullptr;
             bdev.Ctx = (void*)(uintptr_t)i;
             bdev.SectorCount = g_namespaces[i].SectorCount;
             bdev.SectorSize = (uint16_t)g_namespaces[i].SectorSize;
+            bdev.MaxTransferSectors = g_namespaces[i].MaxTransferBlocks;
+            // Leave half of the slots for synchronous callers
+            int slots = 0;
+            for (int q = 0; q < g_ioQueueCount; q++) slots += g_ioQueues[q].slotCount;
+            bdev.QueueDepth = (uint16_t)(slots / 2);
             memcpy(bdev.Model, g_namespaces[i].Model, 41);
             Storage::RegisterBlockDevice(bdev);
         }
@@ -705,68 +1319,8 @@ namespace Drivers::Storage::Nvme {
         }
         if (count == 0 || buffer == nullptr) return false;
 
-        // Limit to max transfer size
-        uint32_t maxBlocks = g_namespaces[ns].MaxTransferBlocks;
-        if (count > maxBlocks) {
-            KernelLogStream(ERROR, "NVMe") << "ReadSectors: count " << count
-                << " exceeds max " << maxBlocks;
-            return false;
-        }
-
-        uint32_t sectorSize = g_namespaces[ns].SectorSize;
-        uint32_t totalBytes = count * sectorSize;
-        int pagesNeeded = (totalBytes + 0xFFF) / 0x1000;
-
-        uint64_t dmaPhys;
-        void* dmaVirt = AllocateDmaBuffer(dmaPhys, pagesNeeded);
-
-        // Build NVMe Read command
-        SqEntry cmd = {};
-        cmd.Opcode = IO_CMD_READ;
-        cmd.Nsid = g_namespaces[ns].Nsid;
-        cmd.Prp1 = dmaPhys;
-
-        // PRP2: If transfer spans more than one page, set PRP2
-        if (totalBytes > 0x1000) {
-            // For transfers spanning exactly 2 pages, PRP2 = second page address
-            // For transfers spanning more pages, PRP2 should point to a PRP list.
-            // Since our DMA buffer is physically contiguous, we can point to the
-            // second page directly for 2-page transfers. For larger transfers,
-            // we build a PRP list.
-            if (pagesNeeded == 2) {
-                cmd.Prp2 = dmaPhys + 0x1000;
-            } else {
-                // Build a PRP list (array of physical page addresses)
-                uint64_t prpListPhys;
-                uint64_t* prpList = (uint64_t*)AllocateDmaBuffer(prpListPhys);
-                for (int i = 1; i < pagesNeeded; i++) {
-                    prpList[i - 1] = dmaPhys + (uint64_t)i * 0x1000;
-                }
-                cmd.Prp2 = prpListPhys;
-            }
-        }
-
-        // CDW10-11: Starting LBA (64-bit)
-        cmd.Cdw10 = (uint32_t)(lba & 0xFFFFFFFF);
-        cmd.Cdw11 = (uint32_t)(lba >> 32);
-        // CDW12: bits 15:0 = Number of Logical Blocks (0-based)
-        cmd.Cdw12 = count - 1;
-
-        SubmitIoCommand(cmd);
-
-        CqEntry cqe;
-        bool ok = WaitIoCompletion(cqe);
-        if (ok) {
-            memcpy(buffer, dmaVirt, totalBytes);
-        }
-
-        // Free PRP list if we allocated one
-        if (pagesNeeded > 2 && cmd.Prp2 != 0 && cmd.Prp2 != dmaPhys + 0x1000) {
-            Memory::g_pfa->Free((void*)Memory::HHDM(cmd.Prp2));
-        }
-
-        Memory::g_pfa->Free(dmaVirt, pagesNeeded);
-        return ok;
+        // Oversized requests are split into several commands
+        return SyncIo(ns, false, lba, count, buffer);
     }
 
     bool WriteSectors(int ns, uint64_t lba, uint32_t count, const void* buffer) {
@@ -775,55 +1329,7 @@ namespace Drivers::Storage::Nvme {
         }
         if (count == 0 || buffer == nullptr) return false;
 
-        uint32_t maxBlocks = g_namespaces[ns].MaxTransferBlocks;
-        if (count > maxBlocks) {
-            KernelLogStream(ERROR, "NVMe") << "WriteSectors: count " << count
-                << " exceeds max " << maxBlocks;
-            return false;
-        }
-
-        uint32_t sectorSize = g_namespaces[ns].SectorSize;
-        uint32_t totalBytes = count * sectorSize;
-        int pagesNeeded = (totalBytes + 0xFFF) / 0x1000;
-
-        uint64_t dmaPhys;
-        void* dmaVirt = AllocateDmaBuffer(dmaPhys, pagesNeeded);
-        memcpy(dmaVirt, buffer, totalBytes);
-
-        // Build NVMe Write command
-        SqEntry cmd = {};
-        cmd.Opcode = IO_CMD_WRITE;
-        cmd.Nsid = g_namespaces[ns].Nsid;
-        cmd.Prp1 = dmaPhys;
-
-        if (totalBytes > 0x1000) {
-            if (pagesNeeded == 2) {
-                cmd.Prp2 = dmaPhys + 0x1000;
-            } else {
-                uint64_t prpListPhys;
-                uint64_t* prpList = (uint64_t*)AllocateDmaBuffer(prpListPhys);
-                for (int i = 1; i < pagesNeeded; i++) {
-                    prpList[i - 1] = dmaPhys + (uint64_t)i * 0x1000;
-                }
-                cmd.Prp2 = prpListPhys;
-            }
-        }
-
-        cmd.Cdw10 = (uint32_t)(lba & 0xFFFFFFFF);
-        cmd.Cdw11 = (uint32_t)(lba >> 32);
-        cmd.Cdw12 = count - 1;
-
-        SubmitIoCommand(cmd);
-
-        CqEntry cqe;
-        bool ok = WaitIoCompletion(cqe);
-
-        if (pagesNeeded > 2 && cmd.Prp2 != 0 && cmd.Prp2 != dmaPhys + 0x1000) {
-            Memory::g_pfa->Free((void*)Memory::HHDM(cmd.Prp2));
-        }
-
-        Memory::g_pfa->Free(dmaVirt, pagesNeeded);
-        return ok;
+        return SyncIo(ns, true, lba, count, (void*)buffer);
     }
 
 };
@@ -122,6 +122,12 @@ namespace Drivers::Storage::Nvme {
 
     constexpr uint8_t IO_CMD_READ  = 0x02;
     constexpr uint8_t IO_CMD_WRITE = 0x01;
+    constexpr uint8_t IO_CMD_WRITE_ZEROES = 0x08;
+    constexpr uint8_t IO_CMD_DSM   = 0x09;   // Dataset Management
+
+    constexpr uint32_t DSM_ATTR_DEALLOCATE = (1u << 2);  // CDW11 AD bit
+    constexpr uint16_t ONCS_DSM            = (1u << 2);  // Identify Controller ONCS
+    constexpr uint16_t ONCS_WRITE_ZEROES   = (1u << 3);
 
     // =========================================================================
     // Identify CNS values
@@ -142,6 +148,7 @@ namespace Drivers::Storage::Nvme {
 
     constexpr int ADMIN_QUEUE_DEPTH = 32;    // Admin queue entries
     constexpr int IO_QUEUE_DEPTH    = 64;    // I/O queue entries
+    constexpr int MAX_IO_QUEUES     = 8;     // One I/O queue pair per CPU, up to this many
     constexpr int MAX_NAMESPACES    = 8;
 
     // =========================================================================
@@ -158,13 +165,18 @@ namespace Drivers::Storage::Nvme {
     };
 
     // =========================================================================
-    // MSI configuration (use a different IRQ slot than AHCI)
+    // Interrupt configuration (use a different IRQ slot than AHCI)
     // =========================================================================
 
+    // Single-message MSI fallback: every queue shares one vector
     constexpr uint8_t  MSI_IRQ       = 26;    // IRQ slot 26 = vector 58
     constexpr uint32_t MSI_VECTOR    = 58;
     constexpr uint32_t MSI_ADDR_BASE = 0xFEE00000;
 
+    // MSI-X: table entry 0 serves the admin queue, entry N I/O queue N.
+    // IRQ slots 28-36 = vectors 60-68.
+    constexpr uint8_t  MSIX_IRQ_BASE = 28;
+
     // =========================================================================
     // Public API
     // =========================================================================
@@ -0,0 +1,1139 @@
+/*
+    * VirtioBlk.cpp
+    * Virtio block device driver (modern PCI transport)
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#include "VirtioBlk.hpp"
+#include "BlockDevice.hpp"
+#include "BlockQueue.hpp"
+#include "Dma.hpp"
+#include <Pci/Pci.hpp>
+#include <Terminal/Terminal.hpp>
+#include <CppLib/Stream.hpp>
+#include <Memory/HHDM.hpp>
+#include <Memory/Paging.hpp>
+#include <Memory/PageFrameAllocator.hpp>
+#include <Libraries/Memory.hpp>
+#include <CppLib/Spinlock.hpp>
+#include <Hal/Apic/Interrupts.hpp>
+#include <Hal/Apic/IoApic.hpp>
+#include <Hal/Apic/Apic.hpp>
+#include <Hal/Apic/ApicInit.hpp>
+
+using namespace Kt;
+
+namespace Drivers::Storage::VirtioBlk {
+
+    // -------------------------------------------------------------------------
+    // Request slots and queues
+    // Every request owns a slot of its queue. With indirect descriptors the
+    // slot's page holds the request header, status byte and a descriptor
+    // table, and the request takes a single ring entry (slot N = descriptor
+    // N); otherwise the slot owns a fixed run of ring descriptors and chains
+    // them directly. Either way the used ring's head index maps straight back
+    // to the slot. As in the NVMe driver, data moves straight from the
+    // caller's pages and only layouts the ring cannot describe are bounced.
+    // -------------------------------------------------------------------------
+
+    // Layout of each slot's page
+    static constexpr uint32_t SlotHeaderOffset = 0;
+    static constexpr uint32_t SlotStatusOffset = 16;
+    static constexpr uint32_t SlotRangeOffset  = 32;
+    static constexpr uint32_t SlotTableOffset  = 64;
+    static constexpr int      IndirectEntries  = (0x1000 - SlotTableOffset) / sizeof(VirtqDesc);
+
+    // Without indirect descriptors, a slot needs at least this many ring entries
+    static constexpr int MinDirectDescs = 8;
+
+    // Largest transfer a single request carries
+    static constexpr uint32_t MaxTransferBytes = 1024 * 1024;
+
+    // Idle slots give back bounce buffers larger than this when polled
+    static constexpr int KeepPages = 16;
+
+    struct Slot {
+        bool      busy;
+        volatile bool done;
+        bool      ok;
+        bool      orphaned;     // Synchronous caller timed out; reclaim on completion
+        bool      write;
+        bool      bounced;      // Data went through `dma` rather than the caller's pages
+        bool      copyBack;     // Bounced async read waiting to leave interrupt context
+        void*     tag;          // BlockQueue tag, nullptr for synchronous requests
+        uint8_t*  page;         // Header, status byte, range and indirect table
+        uint64_t  pagePhys;
+        uint16_t  head;         // Descriptor index published in the avail ring
+        uint8_t*  dma;          // Bounce buffer, kept for reuse while idle
+        int       pages;
+        uint64_t  dmaPhys;
+        const Storage::IoSegment* segs;
+        int       segCount;
+    };
+
+    struct Queue {
+        uint16_t   index;
+        uint16_t   size;            // Ring entries (power of two)
+        VirtqDesc* desc;
+        volatile uint16_t* avail;   // flags, idx, ring[size], used_event
+        volatile uint8_t*  used;    // flags, idx, ring[size], avail_event
+        uint64_t   descPhys;
+        uint64_t   availPhys;
+        uint64_t   usedPhys;
+        volatile uint16_t* notify;
+        uint16_t   availIdx;        // Next value of avail->idx
+        uint16_t   lastUsed;        // Used entries consumed so far
+        uint16_t   perSlot;         // Ring descriptors per slot (1 with indirect)
+        int        slotCount;
+        Slot       slots[MAX_SLOTS];
+        kcp::Spinlock lock;
+    };
+
+    struct Device {
+        uint8_t   bus, dev, func;
+        volatile uint8_t* common;
+        volatile uint8_t* isr;
+        volatile uint8_t* config;
+        volatile uint8_t* notifyBase;
+        uint32_t  notifyMultiplier;
+
+        bool      indirect;
+        bool      eventIdx;
+        bool      msix;
+        uint32_t  sectorScale;      // 512-byte sectors per logical block
+        uint32_t  sizeMax;          // Bytes per data descriptor
+        int       maxDataDescs;     // Data descriptors per request
+        uint32_t  maxTransferBlocks;
+        uint32_t  maxDiscardSectors;
+        uint32_t  maxZeroesSectors;
+
+        int       queueCount;
+        Queue     queues[MAX_QUEUES];
+        DeviceInfo info;
+    };
+
+    static Device g_devices[MAX_DEVICES] = {};
+    static int g_deviceCount = 0;
+
+    // Owner of each MSI-X IRQ slot
+    struct VectorOwner {
+        int8_t device;
+        int8_t queue;
+    };
+
+    static VectorOwner g_vectors[MSIX_IRQ_LIMIT - MSIX_IRQ_BASE] = {};
+    static int g_nextIrq = MSIX_IRQ_BASE;
+    static bool g_legacyIrqRegistered[Hal::IRQ_COUNT] = {};
+
+    // -------------------------------------------------------------------------
+    // Register access
+    // -------------------------------------------------------------------------
+
+    static uint8_t Read8(volatile uint8_t* base, uint32_t off) {
+        return *(volatile uint8_t*)(base + off);
+    }
+
+    static uint16_t Read16(volatile uint8_t* base, uint32_t off) {
+        return *(volatile uint16_t*)(base + off);
+    }
+
+    static uint32_t Read32(volatile uint8_t* base, uint32_t off) {
+        return *(volatile uint32_t*)(base + off);
+    }
+
+    static void Write8(volatile uint8_t* base, uint32_t off, uint8_t value) {
+        *(volatile uint8_t*)(base + off) = value;
+    }
+
+    static void Write16(volatile uint8_t* base, uint32_t off, uint16_t value) {
+        *(volatile uint16_t*)(base + off) = value;
+    }
+
+    static void Write32(volatile uint8_t* base, uint32_t off, uint32_t value) {
+        *(volatile uint32_t*)(base + off) = value;
+    }
+
+    static void Write64(volatile uint8_t* base, uint32_t off, uint64_t value) {
+        Write32(base, off, (uint32_t)(value & 0xFFFFFFFF));
+        Write32(base, off + 4, (uint32_t)(value >> 32));
+    }
+
+    // -------------------------------------------------------------------------
+    // Locking (same rules as the NVMe driver: completions run from interrupt
+    // handlers, so never touch the page frame allocator with a queue lock held)
+    // -------------------------------------------------------------------------
+
+    static uint64_t LockQueue(Queue& q) {
+        uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        q.lock.Acquire();
+        return flags;
+    }
+
+    static void UnlockQueue(Queue& q, uint64_t flags) {
+        q.lock.Release();
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+    }
+
+    static int ReserveSlot(Queue& q) {
+        uint64_t flags = LockQueue(q);
+        for (int i = 0; i < q.slotCount; i++) {
+            Slot& slot = q.slots[i];
+            if (slot.busy) continue;
+
+            slot.busy = true;
+            slot.done = false;
+            slot.ok = false;
+            slot.orphaned = false;
+            slot.copyBack = false;
+            slot.tag = nullptr;
+            slot.segs = nullptr;
+            slot.segCount = 0;
+            UnlockQueue(q, flags);
+            return i;
+        }
+        UnlockQueue(q, flags);
+        return -1;
+    }
+
+    static void ReleaseSlot(Queue& q, int idx) {
+        uint64_t flags = LockQueue(q);
+        q.slots[idx].busy = false;
+        UnlockQueue(q, flags);
+    }
+
+    // The queue of the submitting CPU, falling back to any queue with room
+    static Queue* ReserveAnySlot(Device& d, int& idx) {
+        int first = (int)(Hal::LocalApic::GetId() % (uint32_t)d.queueCount);
+        for (int k = 0; k < d.queueCount; k++) {
+            Queue& q = d.queues[(first + k) % d.queueCount];
+            idx = ReserveSlot(q);
+            if (idx >= 0) return &q;
+        }
+        return nullptr;
+    }
+
+    // -------------------------------------------------------------------------
+    // Descriptor chains
+    // -------------------------------------------------------------------------
+
+    // Descriptors a slot may fill, in the indirect table or in the ring
+    static VirtqDesc* SlotTable(Device& d, Queue& q, Slot& slot) {
+        if (d.indirect) return (VirtqDesc*)(slot.page + SlotTableOffset);
+        return &q.desc[slot.head];
+    }
+
+    // Append a physical range to the data descriptors, merging it with the
+    // previous one when contiguous and splitting at size_max
+    static bool AppendData(Device& d, VirtqDesc* table, int& n, uint64_t phys, uint32_t len,
+                           uint16_t flags) {
+        while (len > 0) {
+            VirtqDesc* prev = n > 1 ? &table[n - 1] : nullptr;
+            if (prev != nullptr && prev->Addr + prev->Len == phys && prev->Len < d.sizeMax) {
+                uint32_t room = d.sizeMax - prev->Len;
+                uint32_t take = len < room ? len : room;
+                prev->Len += take;
+                phys += take;
+                len -= take;
+                continue;
+            }
+
+            if (n - 1 >= d.maxDataDescs) return false;
+            uint32_t take = len < d.sizeMax ? len : d.sizeMax;
+            table[n].Addr = phys;
+            table[n].Len = take;
+            table[n].Flags = flags;
+            n++;
+            phys += take;
+            len -= take;
+        }
+        return true;
+    }
+
+    // Describe the caller's segments page by page; fails on memory that is
+    // not DMA-safe or on more fragments than a request may carry
+    static bool BuildDirectData(Device& d, VirtqDesc* table, int& n, bool write,
+                                const Storage::IoSegment* segs, int segCount) {
+        uint16_t flags = write ? 0 : DESC_F_WRITE;
+        for (int i = 0; i < segCount; i++) {
+            uint8_t* p = (uint8_t*)segs[i].Buffer;
+            uint32_t left = segs[i].Length;
+            while (left > 0) {
+                uint64_t phys = Dma::Translate(p);
+                if (phys == 0) return false;
+
+                uint32_t inPage = 0x1000 - (uint32_t)(phys & 0xFFF);
+                uint32_t chunk = left < inPage ? left : inPage;
+                if (!AppendData(d, table, n, phys, chunk, flags)) return false;
+                p += chunk;
+                left -= chunk;
+            }
+        }
+        return true;
+    }
+
+    // Fall back to the slot's physically contiguous bounce buffer
+    static bool BuildBounceData(Device& d, Slot& slot, VirtqDesc* table, int& n, bool write,
+                                uint32_t totalBytes, const Storage::IoSegment* segs, int segCount) {
+        int pagesNeeded = (totalBytes + 0xFFF) / 0x1000;
+
+        // The slot is ours, so its cached buffer can be swapped without the lock
+        if (slot.dma != nullptr && slot.pages < pagesNeeded) {
+            Memory::g_pfa->Free(slot.dma, slot.pages);
+            slot.dma = nullptr;
+        }
+        if (slot.dma == nullptr) {
+            slot.dma = (uint8_t*)Dma::AllocateBuffer(slot.dmaPhys, pagesNeeded);
+            if (slot.dma == nullptr) return false;
+            slot.pages = pagesNeeded;
+        }
+
+        if (write) {
+            uint8_t* out = slot.dma;
+            for (int i = 0; i < segCount; i++) {
+                memcpy(out, segs[i].Buffer, segs[i].Length);
+                out += segs[i].Length;
+            }
+        }
+
+        n = 1;
+        return AppendData(d, table, n, slot.dmaPhys, totalBytes, write ? 0 : DESC_F_WRITE);
+    }
+
+    // Close the chain with the status byte, link the descriptors and return
+    // the number used
+    static int FinishChain(Device& d, Slot& slot, VirtqDesc* table, int n) {
+        table[0].Addr = slot.pagePhys + SlotHeaderOffset;
+        table[0].Len = sizeof(RequestHeader);
+        table[0].Flags = 0;
+
+        table[n].Addr = slot.pagePhys + SlotStatusOffset;
+        table[n].Len = 1;
+        table[n].Flags = DESC_F_WRITE;
+        n++;
+
+        // Indirect tables index from 0, direct runs from the slot's head
+        uint16_t base = d.indirect ? 0 : slot.head;
+        for (int i = 0; i < n - 1; i++) {
+            table[i].Flags |= DESC_F_NEXT;
+            table[i].Next = (uint16_t)(base + i + 1);
+        }
+        table[n - 1].Next = 0;
+        return n;
+    }
+
+    // -------------------------------------------------------------------------
+    // Submission and completion
+    // -------------------------------------------------------------------------
+
+    // vring_need_event: has `newIdx` moved past the index the other side
+    // asked to be told about since `oldIdx`?
+    static bool NeedEvent(uint16_t eventIdx, uint16_t newIdx, uint16_t oldIdx) {
+        return (uint16_t)(newIdx - eventIdx - 1) < (uint16_t)(newIdx - oldIdx);
+    }
+
+    static volatile uint16_t* UsedIdx(Queue& q) {
+        return (volatile uint16_t*)(q.used + 2);
+    }
+
+    static volatile VirtqUsedElem* UsedRing(Queue& q) {
+        return (volatile VirtqUsedElem*)(q.used + 4);
+    }
+
+    // Device-written hint: notify once avail->idx passes this
+    static volatile uint16_t* AvailEvent(Queue& q) {
+        return (volatile uint16_t*)(q.used + 4 + (uint32_t)q.size * sizeof(VirtqUsedElem));
+    }
+
+    // Driver-written hint: interrupt once used->idx passes this
+    static volatile uint16_t* UsedEvent(Queue& q) {
+        return &q.avail[2 + q.size];
+    }
+
+    // Publish a prepared slot and notify the device if it asked for it
+    // (queue lock held)
+    static void Publish(Device& d, Queue& q, Slot& slot, int descCount) {
+        if (d.indirect) {
+            VirtqDesc& head = q.desc[slot.head];
+            head.Addr = slot.pagePhys + SlotTableOffset;
+            head.Len = (uint32_t)descCount * sizeof(VirtqDesc);
+            head.Flags = DESC_F_INDIRECT;
+            head.Next = 0;
+        }
+
+        uint16_t old = q.availIdx;
+        q.avail[2 + (old & (q.size - 1))] = slot.head;
+        q.availIdx = old + 1;
+        asm volatile("" ::: "memory");
+        q.avail[1] = q.availIdx;
+
+        // The index store must be visible before the device's hint is read
+        asm volatile("mfence" ::: "memory");
+
+        bool kick;
+        if (d.eventIdx) {
+            kick = NeedEvent(*AvailEvent(q), q.availIdx, old);
+        } else {
+            kick = (Read16(q.used, 0) & USED_F_NO_NOTIFY) == 0;
+        }
+        if (kick) *q.notify = q.index;
+    }
+
+    // Map the data for a reserved slot and submit the request
+    static bool IssueIo(Device& d, Queue& q, int idx, bool write, uint64_t lba, uint32_t count,
+                        const Storage::IoSegment* segs, int segCount, void* tag) {
+        Slot& slot = q.slots[idx];
+        uint32_t totalBytes = count * d.info.SectorSize;
+
+        RequestHeader* hdr = (RequestHeader*)(slot.page + SlotHeaderOffset);
+        hdr->Type = write ? REQ_OUT : REQ_IN;
+        hdr->Reserved = 0;
+        hdr->Sector = lba * d.sectorScale;
+        slot.page[SlotStatusOffset] = 0xFF;
+
+        VirtqDesc* table = SlotTable(d, q, slot);
+        int n = 1;
+        bool bounced = false;
+        if (!BuildDirectData(d, table, n, write, segs, segCount)) {
+            if (!BuildBounceData(d, slot, table, n, write, totalBytes, segs, segCount)) return false;
+            bounced = true;
+        }
+        int descCount = FinishChain(d, slot, table, n);
+
+        uint64_t flags = LockQueue(q);
+        slot.write = write;
+        slot.bounced = bounced;
+        slot.tag = tag;
+        slot.segs = segs;
+        slot.segCount = segCount;
+        Publish(d, q, slot, descCount);
+        UnlockQueue(q, flags);
+        return true;
+    }
+
+    // Copy bounced read data out to the caller's segments. Never from the
+    // interrupt handler: the segments may be user memory, which is only
+    // reachable under the submitter's page tables and may be swapped out.
+    static void CopyBounced(const Slot& slot) {
+        uint8_t* in = slot.dma;
+        for (int i = 0; i < slot.segCount; i++) {
+            memcpy(slot.segs[i].Buffer, in, slot.segs[i].Length);
+            in += slot.segs[i].Length;
+        }
+    }
+
+    // Consume new used entries (queue lock held). Finished asynchronous
+    // requests are handed back in tags/oks so that BlockQueue::Complete can
+    // run after the lock is dropped; bounced reads among them wait in
+    // `copyBack` for PollQueue outside interrupt context.
+    static int ReapIo(Device& d, Queue& q, void** tags, bool* oks) {
+        int n = 0;
+
+        for (;;) {
+            while (q.lastUsed != *UsedIdx(q)) {
+                asm volatile("" ::: "memory");
+                uint32_t head = UsedRing(q)[q.lastUsed & (q.size - 1)].Id;
+                q.lastUsed++;
+
+                int idx = (int)(head / q.perSlot);
+                if (idx >= q.slotCount || !q.slots[idx].busy) continue;
+                Slot& slot = q.slots[idx];
+
+                uint8_t status = slot.page[SlotStatusOffset];
+                bool ok = status == REQ_S_OK;
+                if (!ok) {
+                    KernelLogStream(ERROR, "VirtIO") << "Request failed, status="
+                        << base::dec << (uint64_t)status;
+                }
+
+                if (slot.tag != nullptr && ok && slot.bounced && !slot.write) {
+                    slot.copyBack = true;
+                } else if (slot.tag != nullptr) {
+                    tags[n] = slot.tag;
+                    oks[n] = ok;
+                    n++;
+                    slot.busy = false;
+                } else if (slot.orphaned) {
+                    slot.busy = false;
+                } else {
+                    slot.ok = ok;
+                    slot.done = true;
+                }
+            }
+
+            if (!d.eventIdx) break;
+
+            // Ask for an interrupt on the next completion, then look again
+            // in case one landed before the device saw the new hint
+            *UsedEvent(q) = q.lastUsed;
+            asm volatile("mfence" ::: "memory");
+            if (q.lastUsed == *UsedIdx(q)) break;
+        }
+        return n;
+    }
+
+    // Reap one queue. Outside interrupt context (`process`), bounced
+    // asynchronous reads are copied out and completed, and oversized bounce
+    // buffers of idle slots are released.
+    static void PollQueue(Device& d, Queue& q, bool process) {
+        void* tags[MAX_SLOTS];
+        bool oks[MAX_SLOTS];
+        int copies[MAX_SLOTS];
+        int copyCount = 0;
+        uint8_t* spareDma[MAX_SLOTS];
+        int sparePages[MAX_SLOTS];
+        int spareCount = 0;
+
+        uint64_t flags = LockQueue(q);
+        int n = ReapIo(d, q, tags, oks);
+        if (process) {
+            for (int i = 0; i < q.slotCount; i++) {
+                Slot& slot = q.slots[i];
+                if (slot.copyBack) {
+                    slot.copyBack = false;
+                    copies[copyCount++] = i;
+                }
+                if (slot.busy || slot.dma == nullptr || slot.pages <= KeepPages) continue;
+                spareDma[spareCount] = slot.dma;
+                sparePages[spareCount] = slot.pages;
+                spareCount++;
+                slot.dma = nullptr;
+            }
+        }
+        UnlockQueue(q, flags);
+
+        for (int i = 0; i < spareCount; i++) Memory::g_pfa->Free(spareDma[i], sparePages[i]);
+        for (int i = 0; i < n; i++) BlockQueue::Complete(tags[i], oks[i]);
+
+        // The slots stay busy until copied, so their bounce buffers are intact
+        for (int i = 0; i < copyCount; i++) {
+            Slot& slot = q.slots[copies[i]];
+            void* tag = slot.tag;
+            CopyBounced(slot);
+            ReleaseSlot(q, copies[i]);
+            BlockQueue::Complete(tag, true);
+        }
+    }
+
+    static void PollDevice(Device& d) {
+        for (int i = 0; i < d.queueCount; i++) PollQueue(d, d.queues[i], true);
+    }
+
+    // Reserve a slot for a synchronous request, polling until one frees up
+    static Queue* ReserveSyncSlot(Device& d, int& idx) {
+        Queue* q = ReserveAnySlot(d, idx);
+        for (int i = 0; q == nullptr && i < 5000000; i++) {
+            PollDevice(d);
+            q = ReserveAnySlot(d, idx);
+        }
+        if (q == nullptr) {
+            KernelLogStream(ERROR, "VirtIO") << "No free request slot";
+        }
+        return q;
+    }
+
+    // Wait for a synchronous request and release its slot
+    static bool WaitSync(Device& d, Queue& q, int idx) {
+        // Normally the interrupt completes the slot; polling covers callers
+        // running with interrupts masked
+        for (int i = 0; i < 5000000 && !q.slots[idx].done; i++) {
+            PollQueue(d, q, false);
+            asm volatile("pause" ::: "memory");
+        }
+
+        uint64_t flags = LockQueue(q);
+        Slot& slot = q.slots[idx];
+        if (!slot.done) {
+            // Late completion must not touch the caller's buffer
+            slot.orphaned = true;
+            slot.segCount = 0;
+            UnlockQueue(q, flags);
+            KernelLogStream(ERROR, "VirtIO") << "Request timeout";
+            return false;
+        }
+        bool ok = slot.ok;
+        UnlockQueue(q, flags);
+
+        // Bounced data is copied here, in the caller's address space
+        if (ok && slot.bounced && !slot.write) CopyBounced(slot);
+        ReleaseSlot(q, idx);
+        return ok;
+    }
+
+    // Issue one request and wait until it completes
+    static bool SyncIoChunk(Device& d, bool write, uint64_t lba, uint32_t count, void* buffer) {
+        Storage::IoSegment seg = { buffer, count * d.info.SectorSize };
+
+        int idx = -1;
+        Queue* q = ReserveSyncSlot(d, idx);
+        if (q == nullptr) return false;
+
+        if (!IssueIo(d, *q, idx, write, lba, count, &seg, 1, nullptr)) {
+            ReleaseSlot(*q, idx);
+            return false;
+        }
+        return WaitSync(d, *q, idx);
+    }
+
+    // Split transfers larger than one request may carry
+    static bool SyncIo(Device& d, bool write, uint64_t lba, uint32_t count, void* buffer) {
+        uint8_t* p = (uint8_t*)buffer;
+
+        while (count > 0) {
+            uint32_t n = count < d.maxTransferBlocks ? count : d.maxTransferBlocks;
+            if (!SyncIoChunk(d, write, lba, n, p)) return false;
+            lba += n;
+            count -= n;
+            p += (uint64_t)n * d.info.SectorSize;
+        }
+        return true;
+    }
+
+    // Discard or zero one range; the segment goes in the slot's page
+    static bool RangeRequest(Device& d, uint32_t type, uint64_t sector, uint32_t sectors) {
+        int idx = -1;
+        Queue* q = ReserveSyncSlot(d, idx);
+        if (q == nullptr) return false;
+
+        Slot& slot = q->slots[idx];
+        RequestHeader* hdr = (RequestHeader*)(slot.page + SlotHeaderOffset);
+        hdr->Type = type;
+        hdr->Reserved = 0;
+        hdr->Sector = 0;
+        slot.page[SlotStatusOffset] = 0xFF;
+
+        RangeSegment* range = (RangeSegment*)(slot.page + SlotRangeOffset);
+        range->Sector = sector;
+        range->NumSectors = sectors;
+        range->Flags = 0;
+
+        VirtqDesc* table = SlotTable(d, *q, slot);
+        table[1].Addr = slot.pagePhys + SlotRangeOffset;
+        table[1].Len = sizeof(RangeSegment);
+        table[1].Flags = 0;
+        int descCount = FinishChain(d, slot, table, 2);
+
+        uint64_t flags = LockQueue(*q);
+        slot.write = true;                  // Nothing to copy back
+        slot.bounced = false;
+        slot.tag = nullptr;
+        Publish(d, *q, slot, descCount);
+        UnlockQueue(*q, flags);
+
+        return WaitSync(d, *q, idx);
+    }
+
+    static bool RangeRequests(Device& d, uint32_t type, uint32_t maxSectors,
+                              uint64_t lba, uint64_t count) {
+        uint64_t sector = lba * d.sectorScale;
+        uint64_t sectors = count * d.sectorScale;
+
+        // Keep every piece a whole number of logical blocks
+        uint64_t perRequest = maxSectors - maxSectors % d.sectorScale;
+        if (perRequest == 0) return false;
+
+        while (sectors > 0) {
+            uint32_t n = (uint32_t)(sectors < perRequest ? sectors : perRequest);
+            if (!RangeRequest(d, type, sector, n)) return false;
+            sector += n;
+            sectors -= n;
+        }
+        return true;
+    }
+
+    // -------------------------------------------------------------------------
+    // BlockDevice callbacks (ctx = device index)
+    // -------------------------------------------------------------------------
+
+    static bool Discard(void* ctx, uint64_t lba, uint64_t count) {
+        Device& d = g_devices[(int)(uintptr_t)ctx];
+        return RangeRequests(d, REQ_DISCARD, d.maxDiscardSectors, lba, count);
+    }
+
+    static bool WriteZeroes(void* ctx, uint64_t lba, uint64_t count) {
+        Device& d = g_devices[(int)(uintptr_t)ctx];
+        return RangeRequests(d, REQ_WRITE_ZEROES, d.maxZeroesSectors, lba, count);
+    }
+
+    static bool StartIo(void* ctx, bool write, uint64_t lba, uint32_t count,
+                        const Storage::IoSegment* segs, int segCount, void* tag) {
+        Device& d = g_devices[(int)(uintptr_t)ctx];
+        if (count == 0 || count > d.maxTransferBlocks) return false;
+        if (write && d.info.ReadOnly) return false;
+
+        int idx = -1;
+        Queue* q = ReserveAnySlot(d, idx);
+        if (q == nullptr) {
+            KernelLogStream(ERROR, "VirtIO") << "StartIo: no free request slot";
+            return false;
+        }
+        if (!IssueIo(d, *q, idx, write, lba, count, segs, segCount, tag)) {
+            ReleaseSlot(*q, idx);
+            return false;
+        }
+        return true;
+    }
+
+    static void PollIo(void* ctx) {
+        PollDevice(g_devices[(int)(uintptr_t)ctx]);
+    }
+
+    // -------------------------------------------------------------------------
+    // Interrupt handler
+    // -------------------------------------------------------------------------
+
+    static void HandleInterrupt(uint8_t irq) {
+        // MSI-X: the vector identifies the queue
+        if (irq >= MSIX_IRQ_BASE && irq < g_nextIrq) {
+            VectorOwner& owner = g_vectors[irq - MSIX_IRQ_BASE];
+            Device& d = g_devices[owner.device];
+            if (owner.queue < d.queueCount) PollQueue(d, d.queues[owner.queue], false);
+            return;
+        }
+
+        // Shared legacy line: reading ISR acknowledges the device
+        for (int i = 0; i < g_deviceCount; i++) {
+            Device& d = g_devices[i];
+            if (d.msix || d.queueCount == 0) continue;
+            if (Read8(d.isr, 0) & ISR_QUEUE) {
+                for (int k = 0; k < d.queueCount; k++) PollQueue(d, d.queues[k], false);
+            }
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // Capability discovery
+    // -------------------------------------------------------------------------
+
+    // Map the BAR window a virtio capability points at
+    static volatile uint8_t* MapCapRegion(const Pci::PciDevice& pci, uint8_t bar,
+                                          uint32_t offset, uint32_t length) {
+        if (bar > 5) return nullptr;
+        uint64_t barPhys = Pci::ReadBar(pci.Bus, pci.Device, pci.Function, bar);
+        if (barPhys == 0) return nullptr;
+
+        uint64_t start = barPhys + offset;
+        uint64_t end = start + (length ? length : 1);
+        for (uint64_t page = start & ~0xFFFULL; page < end; page += 0x1000) {
+            Memory::VMM::g_paging->MapMMIO(page, Memory::HHDM(page));
+        }
+        return (volatile uint8_t*)Memory::HHDM(start);
+    }
+
+    // Walk the capability list for the virtio register blocks, using the
+    // first capability of each type as the specification asks
+    static bool FindRegions(const Pci::PciDevice& pci, Device& d) {
+        uint8_t offset = Pci::LegacyRead8(pci.Bus, pci.Device, pci.Function, 0x34) & 0xFC;
+
+        while (offset != 0) {
+            uint8_t id = Pci::LegacyRead8(pci.Bus, pci.Device, pci.Function, offset);
+            if (id == PCI_CAP_VENDOR) {
+                uint8_t type = Pci::LegacyRead8(pci.Bus, pci.Device, pci.Function, offset + 3);
+                uint8_t bar = Pci::LegacyRead8(pci.Bus, pci.Device, pci.Function, offset + 4);
+                uint32_t off = Pci::LegacyRead32(pci.Bus, pci.Device, pci.Function, offset + 8);
+                uint32_t len = Pci::LegacyRead32(pci.Bus, pci.Device, pci.Function, offset + 12);
+
+                if (type == CAP_COMMON_CFG && d.common == nullptr) {
+                    d.common = MapCapRegion(pci, bar, off, len);
+                } else if (type == CAP_NOTIFY_CFG && d.notifyBase == nullptr) {
+                    d.notifyMultiplier = Pci::LegacyRead32(pci.Bus, pci.Device, pci.Function, offset + 16);
+                    d.notifyBase = MapCapRegion(pci, bar, off, len);
+                } else if (type == CAP_ISR_CFG && d.isr == nullptr) {
+                    d.isr = MapCapRegion(pci, bar, off, len);
+                } else if (type == CAP_DEVICE_CFG && d.config == nullptr) {
+                    d.config = MapCapRegion(pci, bar, off, len);
+                }
+            }
+            offset = Pci::LegacyRead8(pci.Bus, pci.Device, pci.Function, offset + 1) & 0xFC;
+        }
+
+        return d.common != nullptr && d.notifyBase != nullptr && d.isr != nullptr && d.config != nullptr;
+    }
+
+    // -------------------------------------------------------------------------
+    // Device initialization
+    // -------------------------------------------------------------------------
+
+    static bool ResetDevice(Device& d) {
+        Write8(d.common, COMMON_STATUS, 0);
+        for (int i = 0; i < 5000000; i++) {
+            if (Read8(d.common, COMMON_STATUS) == 0) return true;
+            asm volatile("pause" ::: "memory");
+        }
+        KernelLogStream(ERROR, "VirtIO") << "Device reset timeout";
+        return false;
+    }
+
+    static void SetStatus(Device& d, uint8_t bits) {
+        Write8(d.common, COMMON_STATUS, Read8(d.common, COMMON_STATUS) | bits);
+    }
+
+    static uint64_t ReadDeviceFeatures(Device& d) {
+        Write32(d.common, COMMON_DFSELECT, 0);
+        uint64_t lo = Read32(d.common, COMMON_DF);
+        Write32(d.common, COMMON_DFSELECT, 1);
+        uint64_t hi = Read32(d.common, COMMON_DF);
+        return lo | (hi << 32);
+    }
+
+    static bool NegotiateFeatures(Device& d, uint64_t& features) {
+        constexpr uint64_t wanted = F_VERSION_1 | F_RING_INDIRECT_DESC | F_RING_EVENT_IDX
+            | F_BLK_SIZE_MAX | F_BLK_SEG_MAX | F_BLK_RO | F_BLK_BLK_SIZE | F_BLK_MQ
+            | F_BLK_DISCARD | F_BLK_WRITE_ZEROES;
+
+        // VIRTIO_BLK_F_FLUSH is left out on purpose: without it the device
+        // must complete writes only once they are durable, and BlockDevice
+        // has no flush operation to offer instead
+        uint64_t offered = ReadDeviceFeatures(d);
+        if (!(offered & F_VERSION_1)) {
+            KernelLogStream(ERROR, "VirtIO") << "Device does not offer VIRTIO_F_VERSION_1";
+            return false;
+        }
+        features = offered & wanted;
+
+        Write32(d.common, COMMON_GFSELECT, 0);
+        Write32(d.common, COMMON_GF, (uint32_t)features);
+        Write32(d.common, COMMON_GFSELECT, 1);
+        Write32(d.common, COMMON_GF, (uint32_t)(features >> 32));
+
+        SetStatus(d, STATUS_FEATURES_OK);
+        if (!(Read8(d.common, COMMON_STATUS) & STATUS_FEATURES_OK)) {
+            KernelLogStream(ERROR, "VirtIO") << "Feature negotiation rejected";
+            return false;
+        }
+        return true;
+    }
+
+    // Read the block configuration, retrying if the device changed it meanwhile
+    static void ReadBlockConfig(Device& d, uint64_t features, uint64_t& capacity,
+                                uint32_t& blkSize, uint16_t& numQueues) {
+        uint8_t gen;
+        do {
+            gen = Read8(d.common, COMMON_CFGGENERATION);
+            capacity = (uint64_t)Read32(d.config, BLK_CFG_CAPACITY)
+                | ((uint64_t)Read32(d.config, BLK_CFG_CAPACITY + 4) << 32);
+            blkSize = (features & F_BLK_BLK_SIZE) ? Read32(d.config, BLK_CFG_BLK_SIZE) : 512;
+            numQueues = (features & F_BLK_MQ) ? Read16(d.config, BLK_CFG_NUM_QUEUES) : 1;
+
+            d.sizeMax = (features & F_BLK_SIZE_MAX) ? Read32(d.config, BLK_CFG_SIZE_MAX) : 0;
+            d.maxDataDescs = (features & F_BLK_SEG_MAX) ? (int)Read32(d.config, BLK_CFG_SEG_MAX) : 0;
+            d.maxDiscardSectors = (features & F_BLK_DISCARD) ? Read32(d.config, BLK_CFG_MAX_DISCARD) : 0;
+            d.maxZeroesSectors = (features & F_BLK_WRITE_ZEROES) ? Read32(d.config, BLK_CFG_MAX_ZEROES) : 0;
+        } while (gen != Read8(d.common, COMMON_CFGGENERATION));
+    }
+
+    // Program MSI-X entries for `want` request queues from the shared IRQ
+    // pool. Returns the number of vectors set up, 0 to use the legacy line.
+    static int SetupMsix(const Pci::PciDevice& pci, int devIndex, int want) {
+        uint8_t cap = Pci::FindCapability(pci.Bus, pci.Device, pci.Function, Pci::PCI_CAP_MSIX);
+        if (cap == 0) return 0;
+
+        uint16_t msgCtrl = Pci::LegacyRead16(pci.Bus, pci.Device, pci.Function, cap + 2);
+        int tableSize = (msgCtrl & 0x7FF) + 1;
+
+        int vectors = want;
+        if (vectors > tableSize) vectors = tableSize;
+        if (vectors > MSIX_IRQ_LIMIT - g_nextIrq) vectors = MSIX_IRQ_LIMIT - g_nextIrq;
+        if (vectors <= 0) {
+            KernelLogStream(WARNING, "VirtIO") << "No MSI-X IRQ slots left";
+            return 0;
+        }
+
+        // Table Offset/BIR: bits 2:0 = BAR index, bits 31:3 = offset into it
+        uint32_t tableReg = Pci::LegacyRead32(pci.Bus, pci.Device, pci.Function, cap + 4);
+        volatile uint8_t* tableBase = MapCapRegion(pci, (uint8_t)(tableReg & 0x7),
+                                                   tableReg & ~0x7u, (uint32_t)tableSize * 16);
+        if (tableBase == nullptr) return 0;
+        volatile uint32_t* table = (volatile uint32_t*)tableBase;
+
+        // Entry layout: address low, address high, data, vector control (bit 0 = masked)
+        for (int v = 0; v < tableSize; v++) {
+            volatile uint32_t* entry = table + v * 4;
+            if (v >= vectors) {
+                entry[3] = 1;
+                continue;
+            }
+
+            uint8_t irq = (uint8_t)(g_nextIrq + v);
+            g_vectors[irq - MSIX_IRQ_BASE] = { (int8_t)devIndex, (int8_t)v };
+            Hal::RegisterIrqHandler(irq, HandleInterrupt);
+            entry[0] = MSI_ADDR_BASE;
+            entry[1] = 0;
+            entry[2] = Hal::IRQ_VECTOR_BASE + irq;
+            entry[3] = 0;
+        }
+        g_nextIrq += vectors;
+
+        msgCtrl |= (1 << 15);    // MSI-X Enable
+        msgCtrl &= ~(1 << 14);   // Function Mask off
+        Pci::LegacyWrite16(pci.Bus, pci.Device, pci.Function, cap + 2, msgCtrl);
+
+        uint16_t pciCmd = Pci::LegacyRead16(pci.Bus, pci.Device, pci.Function, (uint8_t)Pci::PCI_REG_COMMAND);
+        pciCmd |= Pci::PCI_CMD_INTX_DISABLE;
+        Pci::LegacyWrite16(pci.Bus, pci.Device, pci.Function, (uint8_t)Pci::PCI_REG_COMMAND, pciCmd);
+        return vectors;
+    }
+
+    static void SetupLegacyIrq(const Pci::PciDevice& pci) {
+        uint8_t irqLine = Pci::LegacyRead8(pci.Bus, pci.Device, pci.Function,
+            (uint8_t)Pci::PCI_REG_INTERRUPT);
+        if (irqLine == 0xFF || irqLine >= Hal::IRQ_COUNT) {
+            KernelLogStream(WARNING, "VirtIO") << "No interrupt available, polling only";
+            return;
+        }
+
+        KernelLogStream(INFO, "VirtIO") << "Using legacy IRQ " << base::dec << (uint64_t)irqLine;
+        if (!g_legacyIrqRegistered[irqLine]) {
+            Hal::RegisterIrqHandler(irqLine, HandleInterrupt);
+            Hal::IoApic::UnmaskIrq(Hal::IoApic::GetGsiForIrq(irqLine));
+            g_legacyIrqRegistered[irqLine] = true;
+        }
+    }
+
+    static bool SetupQueue(Device& d, Queue& q, uint16_t index) {
+        Write16(d.common, COMMON_Q_SELECT, index);
+        uint16_t max = Read16(d.common, COMMON_Q_SIZE);
+        if (max == 0) return false;
+
+        // Split rings need a power-of-two size
+        uint16_t size = 1;
+        while ((uint32_t)size * 2 <= max && size * 2 <= MAX_QUEUE_SIZE) size *= 2;
+        if (size < 2) return false;
+
+        q.index = index;
+        q.size = size;
+        q.availIdx = 0;
+        q.lastUsed = 0;
+
+        int descPages = ((uint32_t)size * sizeof(VirtqDesc) + 0xFFF) / 0x1000;
+        int availPages = (6 + (uint32_t)size * 2 + 0xFFF) / 0x1000;
+        int usedPages = (6 + (uint32_t)size * sizeof(VirtqUsedElem) + 0xFFF) / 0x1000;
+        q.desc = (VirtqDesc*)Dma::AllocateBuffer(q.descPhys, descPages);
+        q.avail = (volatile uint16_t*)Dma::AllocateBuffer(q.availPhys, availPages);
+        q.used = (volatile uint8_t*)Dma::AllocateBuffer(q.usedPhys, usedPages);
+        if (q.desc == nullptr || q.avail == nullptr || q.used == nullptr) return false;
+
+        // Slots: one ring entry each with indirect tables, otherwise a
+        // fixed run of descriptors
+        if (d.indirect) {
+            q.slotCount = size < MAX_SLOTS ? size : MAX_SLOTS;
+            q.perSlot = 1;
+        } else {
+            q.slotCount = size / MinDirectDescs;
+            if (q.slotCount > MAX_SLOTS) q.slotCount = MAX_SLOTS;
+            if (q.slotCount == 0) return false;
+            q.perSlot = (uint16_t)(size / q.slotCount);
+        }
+
+        int slots = 0;
+        for (int i = 0; i < q.slotCount; i++) {
+            Slot& slot = q.slots[i];
+            slot.page = (uint8_t*)Dma::AllocateBuffer(slot.pagePhys);
+            if (slot.page == nullptr) break;
+            slot.head = (uint16_t)(i * q.perSlot);
+            slots++;
+        }
+        q.slotCount = slots;
+        if (slots == 0) return false;
+
+        Write16(d.common, COMMON_Q_SIZE, size);
+        if (d.msix) {
+            Write16(d.common, COMMON_Q_MSIX, index);
+            if (Read16(d.common, COMMON_Q_MSIX) != index) {
+                KernelLogStream(ERROR, "VirtIO") << "Queue " << base::dec << (uint64_t)index
+                    << " rejected its MSI-X vector";
+                return false;
+            }
+        }
+        Write64(d.common, COMMON_Q_DESC, q.descPhys);
+        Write64(d.common, COMMON_Q_AVAIL, q.availPhys);
+        Write64(d.common, COMMON_Q_USED, q.usedPhys);
+
+        uint16_t notifyOff = Read16(d.common, COMMON_Q_NOFF);
+        q.notify = (volatile uint16_t*)(d.notifyBase + (uint32_t)notifyOff * d.notifyMultiplier);
+
+        Write16(d.common, COMMON_Q_ENABLE, 1);
+        return true;
+    }
+
+    // -------------------------------------------------------------------------
+    // Probe (PCI driver entry point)
+    // -------------------------------------------------------------------------
+
+    bool Probe(const Pci::PciDevice& pci) {
+        if (g_deviceCount >= MAX_DEVICES) return false;
+
+        // A failed probe keeps its entry: its IRQ slots stay assigned to it
+        int devIndex = g_deviceCount++;
+        Device& d = g_devices[devIndex];
+        d.bus = pci.Bus;
+        d.dev = pci.Device;
+        d.func = pci.Function;
+
+        KernelLogStream(OK, "VirtIO") << "Found virtio-blk at PCI "
+            << base::hex << (uint64_t)pci.Bus << ":"
+            << (uint64_t)pci.Device << "." << (uint64_t)pci.Function
+            << " (" << (uint64_t)pci.VendorId << ":" << (uint64_t)pci.DeviceId << ")";
+
+        Pci::EnableBusMaster(pci.Bus, pci.Device, pci.Function);
+
+        if (!FindRegions(pci, d)) {
+            KernelLogStream(ERROR, "VirtIO") << "Modern register capabilities not found";
+            return false;
+        }
+
+        // Step 1: Reset, then acknowledge the device
+        if (!ResetDevice(d)) return false;
+        SetStatus(d, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+
+        // Step 2: Feature negotiation
+        uint64_t features = 0;
+        if (!NegotiateFeatures(d, features)) {
+            SetStatus(d, STATUS_FAILED);
+            return false;
+        }
+        d.indirect = (features & F_RING_INDIRECT_DESC) != 0;
+        d.eventIdx = (features & F_RING_EVENT_IDX) != 0;
+
+        // Step 3: Geometry and limits
+        uint64_t capacity;
+        uint32_t blkSize;
+        uint16_t numQueues;
+        ReadBlockConfig(d, features, capacity, blkSize, numQueues);
+
+        if (blkSize < 512 || blkSize > 0x1000 || (blkSize & (blkSize - 1))) blkSize = 512;
+        d.sectorScale = blkSize / 512;
+        d.info.SectorSize = blkSize;
+        d.info.SectorCount = capacity / d.sectorScale;
+        d.info.ReadOnly = (features & F_BLK_RO) != 0;
+        if (d.info.SectorCount == 0) {
+            KernelLogStream(ERROR, "VirtIO") << "Device has no capacity";
+            SetStatus(d, STATUS_FAILED);
+            return false;
+        }
+
+        if (d.sizeMax == 0 || d.sizeMax > MaxTransferBytes) d.sizeMax = MaxTransferBytes;
+        if (d.maxDiscardSectors == 0) features &= ~F_BLK_DISCARD;
+        if (d.maxZeroesSectors == 0) features &= ~F_BLK_WRITE_ZEROES;
+
+        // Step 4: Interrupts, one MSI-X vector per request queue
+        int want = Hal::GetDetectedCpuCount();
+        if (want < 1) want = 1;
+        if (want > MAX_QUEUES) want = MAX_QUEUES;
+        if (want > numQueues) want = numQueues;
+        if (want < 1) want = 1;
+
+        int vectors = SetupMsix(pci, devIndex, want);
+        d.msix = vectors > 0;
+        if (d.msix) {
+            want = vectors;
+            Write16(d.common, COMMON_MSIX, MSIX_NO_VECTOR);
+        } else {
+            SetupLegacyIrq(pci);
+        }
+
+        // Step 5: Request queues
+        d.queueCount = 0;
+        for (int i = 0; i < want; i++) {
+            if (!SetupQueue(d, d.queues[i], (uint16_t)i)) break;
+            d.queueCount++;
+        }
+        if (d.queueCount == 0) {
+            KernelLogStream(ERROR, "VirtIO") << "Failed to set up request queues";
+            SetStatus(d, STATUS_FAILED);
+            return false;
+        }
+
+        // Data descriptors a request may use: the indirect table or the
+        // slot's ring run, less header and status, bounded by seg_max
+        int limit = (d.indirect ? IndirectEntries : d.queues[0].perSlot) - 2;
+        if (d.maxDataDescs == 0 || d.maxDataDescs > limit) d.maxDataDescs = limit;
+
+        // Worst case every page of a transfer is its own descriptor
+        uint32_t perDesc = d.sizeMax < 0x1000 ? d.sizeMax : 0x1000;
+        uint64_t maxBytes = (uint64_t)(d.maxDataDescs - 1) * perDesc;
+        if (maxBytes > MaxTransferBytes) maxBytes = MaxTransferBytes;
+        d.maxTransferBlocks = (uint32_t)(maxBytes / blkSize);
+        if (d.maxTransferBlocks == 0) d.maxTransferBlocks = 1;
+
+        // Step 6: Go live
+        SetStatus(d, STATUS_DRIVER_OK);
+        if (Read8(d.common, COMMON_STATUS) & STATUS_NEEDS_RESET) {
+            KernelLogStream(ERROR, "VirtIO") << "Device needs reset after initialization";
+            return false;
+        }
+
+        memcpy(d.info.Model, "VirtIO Block Device", 20);
+        d.info.QueueCount = d.queueCount;
+        d.info.Active = true;
+
+        // Step 7: Register as a block device
+        Storage::BlockDevice bdev = {};
+        bdev.ReadSectors = [](void* ctx, uint64_t lba, uint32_t count, void* buffer) -> bool {
+            return ReadSectors((int)(uintptr_t)ctx, lba, count, buffer);
+        };
+        bdev.WriteSectors = [](void* ctx, uint64_t lba, uint32_t count, const void* buffer) -> bool {
+            return WriteSectors((int)(uintptr_t)ctx, lba, count, buffer);
+        };
+        bdev.StartIo = StartIo;
+        bdev.PollIo = PollIo;
+        bdev.Discard = (features & F_BLK_DISCARD) && !d.info.ReadOnly ? Discard : nullptr;
+        bdev.WriteZeroes = (features & F_BLK_WRITE_ZEROES) && !d.info.ReadOnly ? WriteZeroes : nullptr;
+        bdev.Ctx = (void*)(uintptr_t)devIndex;
+        bdev.SectorCount = d.info.SectorCount;
+        bdev.SectorSize = (uint16_t)d.info.SectorSize;
+        bdev.MaxTransferSectors = d.maxTransferBlocks;
+        // Leave half of the slots for synchronous callers
+        int slots = 0;
+        for (int q = 0; q < d.queueCount; q++) slots += d.queues[q].slotCount;
+        bdev.QueueDepth = (uint16_t)(slots / 2);
+        memcpy(bdev.Model, d.info.Model, 41);
+        d.info.BlockDevice = Storage::RegisterBlockDevice(bdev);
+
+        uint64_t sizeMB = (d.info.SectorCount * d.info.SectorSize) / (1024 * 1024);
+        KernelLogStream(OK, "VirtIO") << "Disk " << base::dec << (uint64_t)devIndex << ": "
+            << sizeMB << " MiB (" << (uint64_t)d.info.SectorSize << " B/sector), "
+            << (uint64_t)d.queueCount << " queue(s) x " << (uint64_t)d.queues[0].slotCount
+            << (d.indirect ? " indirect" : " direct") << (d.eventIdx ? ", event idx" : "")
+            << (d.msix ? ", MSI-X" : ", INTx") << (d.info.ReadOnly ? ", read-only" : "");
+        return true;
+    }
+
+    // -------------------------------------------------------------------------
+    // Public API
+    // -------------------------------------------------------------------------
+
+    bool IsInitialized() {
+        for (int i = 0; i < g_deviceCount; i++) {
+            if (g_devices[i].info.Active) return true;
+        }
+        return false;
+    }
+
+    int GetDeviceCount() {
+        return g_deviceCount;
+    }
+
+    const DeviceInfo* GetDeviceInfo(int index) {
+        if (index < 0 || index >= g_deviceCount || !g_devices[index].info.Active) {
+            return nullptr;
+        }
+        return &g_devices[index].info;
+    }
+
+    bool ReadSectors(int index, uint64_t lba, uint32_t count, void* buffer) {
+        if (GetDeviceInfo(index) == nullptr) return false;
+        if (count == 0 || buffer == nullptr) return false;
+
+        return SyncIo(g_devices[index], false, lba, count, buffer);
+    }
+
+    bool WriteSectors(int index, uint64_t lba, uint32_t count, const void* buffer) {
+        const DeviceInfo* info = GetDeviceInfo(index);
+        if (info == nullptr || info->ReadOnly) return false;
+        if (count == 0 || buffer == nullptr) return false;
+
+        return SyncIo(g_devices[index], true, lba, count, (void*)buffer);
+    }
+
+};
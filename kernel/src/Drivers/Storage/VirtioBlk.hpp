@@ -0,0 +1,196 @@
+/*
+    * VirtioBlk.hpp
+    * Virtio block device driver (modern PCI transport)
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#pragma once
+#include <cstdint>
+#include <Pci/Pci.hpp>
+
+namespace Drivers::Storage::VirtioBlk {
+
+    // =========================================================================
+    // PCI identification
+    // Ref: Virtual I/O Device (VIRTIO) Version 1.2, section 4.1
+    // =========================================================================
+
+    constexpr uint16_t PCI_VENDOR_VIRTIO      = 0x1AF4;
+    constexpr uint16_t PCI_DEVICE_BLK_LEGACY  = 0x1001;  // Transitional device
+    constexpr uint16_t PCI_DEVICE_BLK_MODERN  = 0x1042;  // 0x1040 + device type 2
+
+    // Vendor-specific capabilities locating the register blocks
+    constexpr uint8_t PCI_CAP_VENDOR          = 0x09;
+    constexpr uint8_t CAP_COMMON_CFG          = 1;
+    constexpr uint8_t CAP_NOTIFY_CFG          = 2;
+    constexpr uint8_t CAP_ISR_CFG             = 3;
+    constexpr uint8_t CAP_DEVICE_CFG          = 4;
+
+    // =========================================================================
+    // Common configuration structure (offsets into the COMMON_CFG region)
+    // =========================================================================
+
+    constexpr uint32_t COMMON_DFSELECT        = 0x00;  // Device feature select
+    constexpr uint32_t COMMON_DF              = 0x04;  // Device feature bits
+    constexpr uint32_t COMMON_GFSELECT        = 0x08;  // Driver feature select
+    constexpr uint32_t COMMON_GF              = 0x0C;  // Driver feature bits
+    constexpr uint32_t COMMON_MSIX            = 0x10;  // Configuration change vector
+    constexpr uint32_t COMMON_NUMQ            = 0x12;
+    constexpr uint32_t COMMON_STATUS          = 0x14;
+    constexpr uint32_t COMMON_CFGGENERATION   = 0x15;
+    constexpr uint32_t COMMON_Q_SELECT        = 0x16;
+    constexpr uint32_t COMMON_Q_SIZE          = 0x18;
+    constexpr uint32_t COMMON_Q_MSIX          = 0x1A;
+    constexpr uint32_t COMMON_Q_ENABLE        = 0x1C;
+    constexpr uint32_t COMMON_Q_NOFF          = 0x1E;  // Queue notify offset
+    constexpr uint32_t COMMON_Q_DESC          = 0x20;  // 64-bit
+    constexpr uint32_t COMMON_Q_AVAIL         = 0x28;  // 64-bit (driver area)
+    constexpr uint32_t COMMON_Q_USED          = 0x30;  // 64-bit (device area)
+
+    constexpr uint16_t MSIX_NO_VECTOR         = 0xFFFF;
+
+    // Device status bits
+    constexpr uint8_t STATUS_ACKNOWLEDGE      = (1u << 0);
+    constexpr uint8_t STATUS_DRIVER           = (1u << 1);
+    constexpr uint8_t STATUS_DRIVER_OK        = (1u << 2);
+    constexpr uint8_t STATUS_FEATURES_OK      = (1u << 3);
+    constexpr uint8_t STATUS_NEEDS_RESET      = (1u << 6);
+    constexpr uint8_t STATUS_FAILED           = (1u << 7);
+
+    // ISR status bits (reading the register clears it)
+    constexpr uint8_t ISR_QUEUE               = (1u << 0);
+    constexpr uint8_t ISR_CONFIG              = (1u << 1);
+
+    // =========================================================================
+    // Feature bits
+    // =========================================================================
+
+    constexpr uint64_t F_BLK_SIZE_MAX         = (1ULL << 1);   // size_max valid
+    constexpr uint64_t F_BLK_SEG_MAX          = (1ULL << 2);   // seg_max valid
+    constexpr uint64_t F_BLK_RO               = (1ULL << 5);   // Read-only device
+    constexpr uint64_t F_BLK_BLK_SIZE         = (1ULL << 6);   // blk_size valid
+    constexpr uint64_t F_BLK_MQ               = (1ULL << 12);  // num_queues valid
+    constexpr uint64_t F_BLK_DISCARD          = (1ULL << 13);
+    constexpr uint64_t F_BLK_WRITE_ZEROES     = (1ULL << 14);
+    constexpr uint64_t F_RING_INDIRECT_DESC   = (1ULL << 28);
+    constexpr uint64_t F_RING_EVENT_IDX       = (1ULL << 29);
+    constexpr uint64_t F_VERSION_1            = (1ULL << 32);
+
+    // =========================================================================
+    // Block device configuration (offsets into the DEVICE_CFG region)
+    // =========================================================================
+
+    constexpr uint32_t BLK_CFG_CAPACITY       = 0;    // 64-bit, in 512-byte sectors
+    constexpr uint32_t BLK_CFG_SIZE_MAX       = 8;
+    constexpr uint32_t BLK_CFG_SEG_MAX        = 12;
+    constexpr uint32_t BLK_CFG_BLK_SIZE       = 20;
+    constexpr uint32_t BLK_CFG_NUM_QUEUES     = 34;
+    constexpr uint32_t BLK_CFG_MAX_DISCARD    = 36;   // Sectors per discard segment
+    constexpr uint32_t BLK_CFG_MAX_ZEROES     = 48;   // Sectors per write zeroes segment
+
+    // =========================================================================
+    // Split virtqueue layout
+    // =========================================================================
+
+    struct VirtqDesc {
+        uint64_t Addr;
+        uint32_t Len;
+        uint16_t Flags;
+        uint16_t Next;
+    } __attribute__((packed));
+
+    static_assert(sizeof(VirtqDesc) == 16, "VirtqDesc must be 16 bytes");
+
+    constexpr uint16_t DESC_F_NEXT            = (1u << 0);
+    constexpr uint16_t DESC_F_WRITE           = (1u << 1);  // Device writes the buffer
+    constexpr uint16_t DESC_F_INDIRECT        = (1u << 2);
+
+    struct VirtqUsedElem {
+        uint32_t Id;            // Head descriptor of the finished chain
+        uint32_t Len;
+    } __attribute__((packed));
+
+    constexpr uint16_t USED_F_NO_NOTIFY       = (1u << 0);
+
+    // =========================================================================
+    // Block requests
+    // =========================================================================
+
+    struct RequestHeader {
+        uint32_t Type;
+        uint32_t Reserved;
+        uint64_t Sector;        // Always in 512-byte units
+    } __attribute__((packed));
+
+    // Discard / write zeroes segment
+    struct RangeSegment {
+        uint64_t Sector;
+        uint32_t NumSectors;
+        uint32_t Flags;
+    } __attribute__((packed));
+
+    constexpr uint32_t REQ_IN                 = 0;
+    constexpr uint32_t REQ_OUT                = 1;
+    constexpr uint32_t REQ_DISCARD            = 11;
+    constexpr uint32_t REQ_WRITE_ZEROES       = 13;
+
+    constexpr uint8_t  REQ_S_OK               = 0;
+    constexpr uint8_t  REQ_S_IOERR            = 1;
+    constexpr uint8_t  REQ_S_UNSUPP           = 2;
+
+    // =========================================================================
+    // Driver limits
+    // =========================================================================
+
+    constexpr int MAX_DEVICES      = 4;
+    constexpr int MAX_QUEUES       = 4;     // Request queues per device, one per CPU
+    constexpr int MAX_QUEUE_SIZE   = 256;   // Ring entries requested per queue
+    constexpr int MAX_SLOTS        = 64;    // Requests in flight per queue
+
+    // =========================================================================
+    // Interrupt configuration
+    // MSI-X entry N serves request queue N; configuration changes are not
+    // signalled. IRQ slots 37-47 = vectors 69-79, shared by all devices.
+    // =========================================================================
+
+    constexpr uint8_t  MSIX_IRQ_BASE  = 37;
+    constexpr uint8_t  MSIX_IRQ_LIMIT = 48;
+    constexpr uint32_t MSI_ADDR_BASE  = 0xFEE00000;
+
+    // =========================================================================
+    // Device info
+    // =========================================================================
+
+    struct DeviceInfo {
+        bool     Active;
+        int      BlockDevice;       // Index in the block device registry
+        uint64_t SectorCount;
+        uint32_t SectorSize;
+        int      QueueCount;
+        bool     ReadOnly;
+        char     Model[41];
+    };
+
+    // =========================================================================
+    // Public API
+    // =========================================================================
+
+    // Probe a PCI device (called by driver matching framework)
+    bool Probe(const Pci::PciDevice& dev);
+
+    // Check if at least one device was initialized
+    bool IsInitialized();
+
+    // Get number of probed devices; GetDeviceInfo skips ones that failed
+    int GetDeviceCount();
+
+    // Get info about a specific device
+    const DeviceInfo* GetDeviceInfo(int index);
+
+    // Read sectors from a device. Oversized requests are split.
+    bool ReadSectors(int index, uint64_t lba, uint32_t count, void* buffer);
+
+    // Write sectors to a device
+    bool WriteSectors(int index, uint64_t lba, uint32_t count, const void* buffer);
+
+};
@@ -0,0 +1,211 @@
+/*
+    * DentryCache.cpp
+    * Path component cache for VFS path resolution
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#include "DentryCache.hpp"
+#include <Memory/Heap.hpp>
+#include <Libraries/Memory.hpp>
+#include <CppLib/Spinlock.hpp>
+#include <CppLib/Stream.hpp>
+#include <Terminal/Terminal.hpp>
+
+namespace Fs::DentryCache {
+
+    static constexpr int32_t None = -1;
+    static constexpr uint32_t HashBuckets = 256;
+
+    struct Entry {
+        uint64_t parent;
+        uint64_t node;          // Unused for negative entries
+        uint32_t lastUse;
+        int32_t  hashNext;
+        int16_t  drive;
+        bool     used;
+        bool     negative;      // Name is known not to exist in parent
+        bool     isDir;
+        char     name[MaxNameLen];
+    };
+
+    static Entry* g_entries = nullptr;
+    static int32_t g_hash[HashBuckets];
+    static uint32_t g_clock = 0;
+
+    static kcp::Spinlock g_lock;
+
+    // -------------------------------------------------------------------------
+    // Hash table
+    // -------------------------------------------------------------------------
+
+    static uint32_t HashKey(int drive, uint64_t parent, const char* name, int len) {
+        uint64_t h = (parent * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)drive;
+        for (int i = 0; i < len; i++) h = (h ^ (uint8_t)name[i]) * 0x100000001B3ULL;
+        return (uint32_t)(h >> 32) & (HashBuckets - 1);
+    }
+
+    static bool NameEquals(const Entry& e, const char* name, int len) {
+        for (int i = 0; i < len; i++) {
+            if (e.name[i] != name[i]) return false;
+        }
+        return e.name[len] == '\0';
+    }
+
+    static int32_t Lookup(int drive, uint64_t parent, const char* name, int len) {
+        for (int32_t i = g_hash[HashKey(drive, parent, name, len)]; i != None; i = g_entries[i].hashNext) {
+            const Entry& e = g_entries[i];
+            if (e.drive == drive && e.parent == parent && NameEquals(e, name, len)) return i;
+        }
+        return None;
+    }
+
+    static void Remove(int32_t idx) {
+        Entry& e = g_entries[idx];
+        int len = 0;
+        while (e.name[len]) len++;
+
+        int32_t* link = &g_hash[HashKey(e.drive, e.parent, e.name, len)];
+        while (*link != None) {
+            if (*link == idx) {
+                *link = e.hashNext;
+                break;
+            }
+            link = &g_entries[*link].hashNext;
+        }
+        e.used = false;
+    }
+
+    // Take a free slot, or recycle the least recently used entry
+    static int32_t GetSlot() {
+        int32_t victim = None;
+        for (int32_t i = 0; i < MaxEntries; i++) {
+            if (!g_entries[i].used) return i;
+            if (victim == None || g_entries[i].lastUse < g_entries[victim].lastUse) victim = i;
+        }
+        Remove(victim);
+        return victim;
+    }
+
+    static void Insert(int drive, uint64_t parent, const char* name, int len,
+                       bool negative, uint64_t node, bool isDir) {
+        g_lock.Acquire();
+
+        // A concurrent resolver may have added it meanwhile
+        int32_t idx = Lookup(drive, parent, name, len);
+        if (idx == None) {
+            idx = GetSlot();
+            Entry& e = g_entries[idx];
+            memcpy(e.name, name, len);
+            e.name[len] = '\0';
+            e.drive = (int16_t)drive;
+            e.parent = parent;
+            e.used = true;
+
+            uint32_t h = HashKey(drive, parent, name, len);
+            e.hashNext = g_hash[h];
+            g_hash[h] = idx;
+        }
+
+        Entry& e = g_entries[idx];
+        e.negative = negative;
+        e.node = node;
+        e.isDir = isDir;
+        e.lastUse = ++g_clock;
+
+        g_lock.Release();
+    }
+
+    // -------------------------------------------------------------------------
+    // Public API
+    // -------------------------------------------------------------------------
+
+    void Initialize() {
+        for (uint32_t i = 0; i < HashBuckets; i++) g_hash[i] = None;
+
+        g_entries = (Entry*)Memory::g_heap->Request(MaxEntries * sizeof(Entry));
+        if (g_entries == nullptr) {
+            Kt::KernelLogStream(Kt::ERROR, "Dentry") << "Failed to allocate cache table";
+            return;
+        }
+        memset(g_entries, 0, MaxEntries * sizeof(Entry));
+
+        Kt::KernelLogStream(Kt::OK, "Dentry") << "Up to " << base::dec << (uint64_t)MaxEntries << " entries";
+    }
+
+    Result Resolve(int drive, const Vfs::FsDriver* driver, const char* path, uint64_t& outNode) {
+        if (g_entries == nullptr || driver->Lookup == nullptr || driver->OpenNode == nullptr) {
+            return Result::Uncached;
+        }
+
+        uint64_t node = Vfs::RootNode;
+        bool isDir = true;
+
+        while (*path == '/') path++;
+        while (*path) {
+            const char* name = path;
+            int len = 0;
+            while (path[len] && path[len] != '/') len++;
+            path += len;
+            while (*path == '/') path++;
+
+            if (len >= MaxNameLen) return Result::Uncached;
+            if (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.'))) return Result::Uncached;
+            if (!isDir) return Result::NotFound;
+
+            g_lock.Acquire();
+            int32_t idx = Lookup(drive, node, name, len);
+            if (idx != None) {
+                Entry& e = g_entries[idx];
+                e.lastUse = ++g_clock;
+                bool negative = e.negative;
+                node = e.node;
+                isDir = e.isDir;
+                g_lock.Release();
+
+                if (negative) return Result::NotFound;
+                continue;
+            }
+            g_lock.Release();
+
+            // Miss: ask the driver for this one component
+            char component[MaxNameLen];
+            memcpy(component, name, len);
+            component[len] = '\0';
+
+            uint64_t child = 0;
+            bool childIsDir = false;
+            int found = driver->Lookup(node, component, &child, &childIsDir);
+            if (found < 0) return Result::Uncached;
+
+            Insert(drive, node, name, len, found == 0, child, childIsDir);
+            if (found == 0) return Result::NotFound;
+
+            node = child;
+            isDir = childIsDir;
+        }
+
+        outNode = node;
+        return Result::Found;
+    }
+
+    void InvalidateDir(int drive, uint64_t dirNode) {
+        if (g_entries == nullptr) return;
+
+        g_lock.Acquire();
+        for (int32_t i = 0; i < MaxEntries; i++) {
+            if (g_entries[i].used && g_entries[i].drive == drive && g_entries[i].parent == dirNode) Remove(i);
+        }
+        g_lock.Release();
+    }
+
+    void InvalidateDrive(int drive) {
+        if (g_entries == nullptr) return;
+
+        g_lock.Acquire();
+        for (int32_t i = 0; i < MaxEntries; i++) {
+            if (g_entries[i].used && g_entries[i].drive == drive) Remove(i);
+        }
+        g_lock.Release();
+    }
+
+};
@@ -0,0 +1,37 @@
+/*
+    * DentryCache.hpp
+    * Path component cache for VFS path resolution
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#pragma once
+#include <cstdint>
+#include "Vfs.hpp"
+
+namespace Fs::DentryCache {
+
+    // Upper bound on cached (drive, parent, name) entries
+    static constexpr int MaxEntries = 512;
+
+    // Longer components are resolved by the driver every time
+    static constexpr int MaxNameLen = 48;
+
+    enum class Result {
+        Found,      // outNode holds the resolved node
+        NotFound,   // Path does not exist (possibly answered by a negative entry)
+        Uncached    // Driver has no lookup hooks or the path uses "." / ".."
+    };
+
+    void Initialize();
+
+    // Resolve a drive-local path one component at a time, consulting the
+    // cache and filling it from driver->Lookup on misses.
+    Result Resolve(int drive, const Vfs::FsDriver* driver, const char* path, uint64_t& outNode);
+
+    // Drop all entries whose parent is `dirNode` (its children changed)
+    void InvalidateDir(int drive, uint64_t dirNode);
+
+    // Drop every entry of a drive
+    void InvalidateDrive(int drive);
+
+};
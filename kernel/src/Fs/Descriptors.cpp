@@ -0,0 +1,92 @@
+/*
+    * Descriptors.cpp
+    * Per-process file descriptor tables over VFS handles
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#include "Descriptors.hpp"
+#include "Vfs.hpp"
+#include <Memory/Heap.hpp>
+#include <Libraries/Memory.hpp>
+
+namespace Fs::Descriptors {
+
+    // Lowest free descriptor, growing the table when every slot is taken
+    static int AllocSlot(Table& table) {
+        for (int i = 0; i < table.capacity; i++) {
+            if (table.slots[i] == nullptr) return i;
+        }
+        if (table.capacity >= MaxDescriptors) return -1;
+
+        int capacity = table.capacity ? table.capacity * 2 : InitialDescriptors;
+        auto** slots = (OpenFile**)Memory::g_heap->Request(capacity * sizeof(OpenFile*));
+        if (slots == nullptr) return -1;
+        memset(slots, 0, capacity * sizeof(OpenFile*));
+        if (table.slots != nullptr) {
+            memcpy(slots, table.slots, table.capacity * sizeof(OpenFile*));
+            Memory::g_heap->Free(table.slots);
+        }
+
+        int fd = table.capacity;
+        table.slots = slots;
+        table.capacity = capacity;
+        return fd;
+    }
+
+    static void Release(OpenFile* file) {
+        if (--file->refCount > 0) return;
+        Vfs::VfsClose(file->vfsHandle);
+        Memory::g_heap->Free(file);
+    }
+
+    int Install(Table& table, int vfsHandle) {
+        int fd = AllocSlot(table);
+        auto* file = fd >= 0 ? (OpenFile*)Memory::g_heap->Request(sizeof(OpenFile)) : nullptr;
+        if (file == nullptr) {
+            Vfs::VfsClose(vfsHandle);
+            return -1;
+        }
+
+        file->vfsHandle = vfsHandle;
+        file->refCount = 1;
+        file->position = 0;
+        table.slots[fd] = file;
+        return fd;
+    }
+
+    OpenFile* Get(Table& table, int fd) {
+        if (fd < 0 || fd >= table.capacity) return nullptr;
+        return table.slots[fd];
+    }
+
+    int Dup(Table& table, int fd) {
+        OpenFile* file = Get(table, fd);
+        if (file == nullptr) return -1;
+
+        int copy = AllocSlot(table);
+        if (copy < 0) return -1;
+
+        file->refCount++;
+        table.slots[copy] = file;
+        return copy;
+    }
+
+    int Close(Table& table, int fd) {
+        OpenFile* file = Get(table, fd);
+        if (file == nullptr) return -1;
+
+        table.slots[fd] = nullptr;
+        Release(file);
+        return 0;
+    }
+
+    void CloseAll(Table& table) {
+        for (int i = 0; i < table.capacity; i++) {
+            if (table.slots[i] != nullptr) Release(table.slots[i]);
+        }
+        if (table.slots != nullptr) Memory::g_heap->Free(table.slots);
+        table.slots = nullptr;
+        table.capacity = 0;
+    }
+
+}
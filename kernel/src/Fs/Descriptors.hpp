@@ -0,0 +1,44 @@
+/*
+    * Descriptors.hpp
+    * Per-process file descriptor tables over VFS handles
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#pragma once
+#include <cstdint>
+
+namespace Fs::Descriptors {
+
+    // A table starts at InitialDescriptors slots and doubles up to MaxDescriptors
+    static constexpr int InitialDescriptors = 16;
+    static constexpr int MaxDescriptors = 1024;
+
+    // An open file: one VFS handle and its current position, shared by all
+    // descriptors duplicated from the one that opened it
+    struct OpenFile {
+        int      vfsHandle;
+        int      refCount;
+        uint64_t position;
+    };
+
+    struct Table {
+        OpenFile** slots;       // Indexed by descriptor, nullptr = free
+        int        capacity;
+    };
+
+    // Bind an open VFS handle to the lowest free descriptor. On failure the
+    // handle is closed and -1 returned.
+    int Install(Table& table, int vfsHandle);
+
+    // The open file behind a descriptor, or nullptr
+    OpenFile* Get(Table& table, int fd);
+
+    // New descriptor sharing fd's handle and position, or -1
+    int Dup(Table& table, int fd);
+
+    int Close(Table& table, int fd);
+
+    // Close every descriptor and release the table (process exit)
+    void CloseAll(Table& table);
+
+}
@@ -7,9 +7,12 @@
 #include "Ext2.hpp"
 #include "FsProbe.hpp"
 #include <Drivers/Storage/BlockDevice.hpp>
+#include <Drivers/Storage/BlockCache.hpp>
 #include <Terminal/Terminal.hpp>
 #include <Libraries/Memory.hpp>
 #include <Memory/PageFrameAllocator.hpp>
+#include <Memory/Heap.hpp>
+#include <cstddef>
 
 using namespace Kt;
 
@@ -20,10 +23,30 @@ namespace Fs::Ext2 {
     // =========================================================================
 
     static constexpr int MaxInstances = 8;
-    static constexpr int MaxFilesPerInstance = 16;
+    static constexpr int FileChunkSize = 16;
+    static constexpr int MaxFilesPerInstance = 256;
     static constexpr int MaxDirEntries = 128;
     static constexpr int MaxNameLen = 256;
 
+    // In-memory inode cache per instance; must exceed MaxFilesPerInstance
+    // since open files pin their inodes
+    static constexpr int InodeCacheSize = MaxFilesPerInstance + 64;
+    static constexpr int InodeHashBuckets = 32;
+
+    // Blocks reserved ahead of a file's last allocation for sequential writes
+    static constexpr uint32_t PreallocBlocks = 32;
+
+    // Freed extents batched per instance before they are discarded
+    static constexpr int MaxPendingDiscards = 32;
+
+    // Block bitmaps kept in memory per instance; the least recently used
+    // clean one is dropped to load another
+    static constexpr uint32_t MaxCachedBitmaps = 64;
+
+    // Per-group dirty flags for the cached allocator state
+    static constexpr uint8_t GroupBitmapDirty = 0x01;
+    static constexpr uint8_t GroupDescDirty   = 0x02;
+
     static constexpr uint16_t EXT2_MAGIC = 0xEF53;
 
     // Inode types (from i_mode, upper 4 bits)
@@ -49,6 +72,22 @@ namespace Fs::Ext2 {
     // Special inode numbers
     static constexpr uint32_t EXT2_ROOT_INODE = 2;
 
+    // Hashed directory index (dir_index)
+    static constexpr uint32_t EXT2_FEATURE_COMPAT_DIR_INDEX = 0x0020;
+    static constexpr uint32_t EXT2_INDEX_FL = 0x00001000;
+    static constexpr uint32_t EXT2_FLAGS_SIGNED_HASH   = 0x0001;
+    static constexpr uint32_t EXT2_FLAGS_UNSIGNED_HASH = 0x0002;
+    static constexpr uint8_t DX_HASH_LEGACY   = 0;
+    static constexpr uint8_t DX_HASH_HALF_MD4 = 1;
+    static constexpr uint8_t DX_HASH_TEA      = 2;
+
+    // Group descriptor checksums and lazily initialized groups (uninit_bg)
+    static constexpr uint32_t EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER = 0x0001;
+    static constexpr uint32_t EXT2_FEATURE_RO_COMPAT_GDT_CSUM     = 0x0010;
+    static constexpr uint16_t EXT4_BG_INODE_UNINIT = 0x0001;  // Inode bitmap not written
+    static constexpr uint16_t EXT4_BG_BLOCK_UNINIT = 0x0002;  // Block bitmap implied by layout
+    static constexpr uint16_t EXT4_BG_INODE_ZEROED = 0x0004;  // Whole inode table zeroed
+
     // =========================================================================
     // On-disk structures
     // =========================================================================
@@ -88,6 +127,29 @@ namespace Fs::Ext2 {
         uint32_t s_feature_ro_compat;
         uint8_t  s_uuid[16];
         char     s_volume_name[16];
+        char     s_last_mounted[64];
+        uint32_t s_algorithm_usage_bitmap;
+        uint8_t  s_prealloc_blocks;
+        uint8_t  s_prealloc_dir_blocks;
+        uint16_t s_reserved_gdt_blocks;
+        uint8_t  s_journal_uuid[16];
+        uint32_t s_journal_inum;
+        uint32_t s_journal_dev;
+        uint32_t s_last_orphan;
+        uint32_t s_hash_seed[4];
+        uint8_t  s_def_hash_version;
+        uint8_t  s_jnl_backup_type;
+        uint16_t s_desc_size;
+        uint32_t s_default_mount_opts;
+        uint32_t s_first_meta_bg;
+        uint32_t s_mkfs_time;
+        uint32_t s_jnl_blocks[17];
+        uint32_t s_blocks_count_hi;
+        uint32_t s_r_blocks_count_hi;
+        uint32_t s_free_blocks_count_hi;
+        uint16_t s_min_extra_isize;
+        uint16_t s_want_extra_isize;
+        uint32_t s_flags;
         // ... more fields follow but are not needed
     } __attribute__((packed));
 
@@ -98,8 +160,12 @@ namespace Fs::Ext2 {
         uint16_t bg_free_blocks_count;
         uint16_t bg_free_inodes_count;
         uint16_t bg_used_dirs_count;
-        uint16_t bg_pad;
-        uint8_t  bg_reserved[12];
+        uint16_t bg_flags;              // EXT4_BG_*, honoured with GDT_CSUM
+        uint32_t bg_exclude_bitmap;
+        uint16_t bg_block_bitmap_csum;
+        uint16_t bg_inode_bitmap_csum;
+        uint16_t bg_itable_unused;      // Never-used inodes at the end of the table
+        uint16_t bg_checksum;
     } __attribute__((packed));
 
     struct Inode {
@@ -135,11 +201,38 @@ namespace Fs::Ext2 {
     // Types
     // =========================================================================
 
-    struct Ext2File {
-        bool     inUse;
-        uint32_t inodeNum;
+    struct CachedInode {
+        uint32_t inodeNum;      // 0 = empty slot
         Inode    inode;
-        bool     isDirectory;
+        int      refCount;      // Open handles holding this inode
+        bool     dirty;         // Newer than the on-disk inode table
+        uint32_t lastUse;
+        int16_t  hashNext;
+
+        // Preallocation window: free blocks already claimed in the cached
+        // bitmap (never on disk) for this inode's next sequential writes,
+        // returned on last close
+        uint32_t preallocStart;
+        uint32_t preallocCount;
+    };
+
+    struct Ext2File {
+        bool         inUse;
+        uint32_t     inodeNum;
+        CachedInode* node;      // Pinned in the instance's inode cache
+        bool         isDirectory;
+
+        // Block map cache: one leaf table of block pointers covering logical
+        // blocks [mapFirst, mapFirst + blockSize / 4), heap-allocated on first use
+        uint32_t* map;
+        uint32_t  mapFirst;
+        bool      mapValid;
+    };
+
+    // Run of freed blocks awaiting a device discard
+    struct DiscardExtent {
+        uint32_t start;
+        uint32_t count;
     };
 
     struct Ext2Instance {
@@ -158,20 +251,55 @@ namespace Fs::Ext2 {
         uint32_t groupCount;
         char     volumeLabel[17];
 
+        // Directory index parameters
+        bool     dirIndex;
+        uint32_t hashSeed[4];
+        uint8_t  defHashVersion;
+        bool     unsignedHash;
+
         // Block group descriptor table (cached in memory)
         BlockGroupDescriptor* bgdt;
         int bgdtPages;
+        uint32_t bgdtBlocks;
+
+        // uninit_bg: descriptors carry checksums and groups may be
+        // uninitialized; inode tables are zeroed a group per Sync()
+        bool     gdtCsum;
+        bool     sparseSuper;
+        uint16_t reservedGdtBlocks;
+        uint8_t  uuid[16];
+        uint32_t lazyInitGroup;
+
+        // Block bitmaps (per group, loaded on first use) and dirty flags;
+        // written back by FlushAllocator on close and Sync()
+        uint8_t** blockBitmaps;
+        uint8_t*  groupDirty;
+        uint32_t* bitmapUse;        // bitmapClock stamp of the last lookup
+        uint32_t  bitmapClock;
+        uint32_t  cachedBitmaps;
+
+        // Blocks freed since the last discard; sent on delete, Sync() and Trim
+        bool          canDiscard;
+        DiscardExtent pendingDiscards[MaxPendingDiscards];
+        int           pendingDiscardCount;
 
         // Temporary block buffer (one block, page-aligned)
         uint8_t* blockBuf;
         int      blockBufPages;
 
-        // Open file handles
-        Ext2File files[MaxFilesPerInstance];
+        // Inode cache (heap-allocated at mount), hashed by inode number
+        CachedInode* inodeCache;
+        int16_t      inodeHash[InodeHashBuckets];
+        uint32_t     inodeClock;
+
+        // Open file handles, heap-allocated FileChunkSize at a time. Chunks
+        // never move, so callers may hold a slot reference across I/O.
+        Ext2File* fileChunks[MaxFilesPerInstance / FileChunkSize];
+        int       fileCapacity;
 
-        // ReadDir name cache
-        char dirNames[MaxDirEntries][MaxNameLen];
-        int  dirNameCount;
+        // ReadDir name cache (packed, heap-allocated on first use)
+        char* dirNames;
+        int   dirNamesCapacity;
     };
 
     // =========================================================================
@@ -181,6 +309,10 @@ namespace Fs::Ext2 {
     static Ext2Instance g_instances[MaxInstances] = {};
     static int g_instanceCount = 0;
 
+    static Ext2File& FileSlot(Ext2Instance& inst, int handle) {
+        return inst.fileChunks[handle / FileChunkSize][handle % FileChunkSize];
+    }
+
     // =========================================================================
     // Low-level helpers
     // =========================================================================
@@ -220,11 +352,26 @@ namespace Fs::Ext2 {
                                 SectorsPerBlock(inst), buf);
     }
 
+    // CRC-16 (polynomial 0x8005, reflected) as used for descriptor checksums
+    static uint16_t Crc16(uint16_t crc, const uint8_t* data, uint32_t len) {
+        for (uint32_t i = 0; i < len; i++) {
+            crc ^= data[i];
+            for (int b = 0; b < 8; b++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+        return crc;
+    }
+
+    static uint16_t GroupChecksum(const uint8_t uuid[16], uint32_t g, const BlockGroupDescriptor& desc) {
+        uint16_t crc = Crc16(0xFFFF, uuid, 16);
+        crc = Crc16(crc, (const uint8_t*)&g, sizeof(g));
+        return Crc16(crc, (const uint8_t*)&desc, offsetof(BlockGroupDescriptor, bg_checksum));
+    }
+
     // =========================================================================
     // Inode operations
     // =========================================================================
 
-    static bool ReadInode(Ext2Instance& inst, uint32_t inodeNum, Inode* out) {
+    static bool ReadInodeFromDisk(Ext2Instance& inst, uint32_t inodeNum, Inode* out) {
         if (inodeNum == 0 || inodeNum > inst.totalInodes) return false;
 
         uint32_t group = (inodeNum - 1) / inst.inodesPerGroup;
@@ -243,7 +390,7 @@ namespace Fs::Ext2 {
         return true;
     }
 
-    static bool WriteInode(Ext2Instance& inst, uint32_t inodeNum, const Inode* inode) {
+    static bool WriteInodeToDisk(Ext2Instance& inst, uint32_t inodeNum, const Inode* inode) {
         if (inodeNum == 0 || inodeNum > inst.totalInodes) return false;
 
         uint32_t group = (inodeNum - 1) / inst.inodesPerGroup;
@@ -261,6 +408,139 @@ namespace Fs::Ext2 {
         return WriteBlock(inst, inodeTableBlock + blockOffset, inst.blockBuf);
     }
 
+    // Zero a whole on-disk inode record, including the part past struct
+    // Inode, for tables that may still hold stale data (uninit_bg)
+    static bool ClearInodeRecord(Ext2Instance& inst, uint32_t inodeNum) {
+        uint32_t group = (inodeNum - 1) / inst.inodesPerGroup;
+        uint32_t inodeByteOffset = ((inodeNum - 1) % inst.inodesPerGroup) * inst.inodeSize;
+        uint32_t block = inst.bgdt[group].bg_inode_table + inodeByteOffset / inst.blockSize;
+
+        if (!ReadBlock(inst, block, inst.blockBuf)) return false;
+        memset(inst.blockBuf + inodeByteOffset % inst.blockSize, 0, inst.inodeSize);
+        return WriteBlock(inst, block, inst.blockBuf);
+    }
+
+    // =========================================================================
+    // Inode cache
+    // =========================================================================
+
+    static CachedInode* LookupInode(Ext2Instance& inst, uint32_t inodeNum) {
+        for (int16_t i = inst.inodeHash[inodeNum % InodeHashBuckets]; i >= 0;
+             i = inst.inodeCache[i].hashNext) {
+            if (inst.inodeCache[i].inodeNum == inodeNum) return &inst.inodeCache[i];
+        }
+        return nullptr;
+    }
+
+    static void UnhashInode(Ext2Instance& inst, int16_t idx) {
+        int16_t* link = &inst.inodeHash[inst.inodeCache[idx].inodeNum % InodeHashBuckets];
+        while (*link >= 0) {
+            if (*link == idx) {
+                *link = inst.inodeCache[idx].hashNext;
+                break;
+            }
+            link = &inst.inodeCache[*link].hashNext;
+        }
+        inst.inodeCache[idx].inodeNum = 0;
+    }
+
+    // Claim a slot for `inodeNum`: an empty one, or the least recently used
+    // unpinned one (written back first if dirty). Contents are left to the caller.
+    static CachedInode* AllocateInodeSlot(Ext2Instance& inst, uint32_t inodeNum) {
+        int16_t victim = -1;
+        for (int16_t i = 0; i < InodeCacheSize; i++) {
+            auto& c = inst.inodeCache[i];
+            if (c.inodeNum == 0) {
+                victim = i;
+                break;
+            }
+            if (c.refCount > 0) continue;
+            if (victim < 0 || c.lastUse < inst.inodeCache[victim].lastUse) victim = i;
+        }
+        if (victim < 0) return nullptr;
+
+        auto& c = inst.inodeCache[victim];
+        if (c.inodeNum != 0) {
+            if (c.dirty && !WriteInodeToDisk(inst, c.inodeNum, &c.inode)) return nullptr;
+            UnhashInode(inst, victim);
+        }
+
+        uint32_t h = inodeNum % InodeHashBuckets;
+        c.inodeNum = inodeNum;
+        c.refCount = 0;
+        c.dirty = false;
+        c.preallocCount = 0;
+        c.hashNext = inst.inodeHash[h];
+        inst.inodeHash[h] = victim;
+        return &c;
+    }
+
+    // Find or load an inode. With `load` false a missing entry is created
+    // without reading the disk (the caller is about to overwrite it).
+    static CachedInode* GetCachedInode(Ext2Instance& inst, uint32_t inodeNum, bool load) {
+        if (!inst.inodeCache) return nullptr;
+
+        CachedInode* c = LookupInode(inst, inodeNum);
+        if (!c) {
+            c = AllocateInodeSlot(inst, inodeNum);
+            if (!c) return nullptr;
+            if (load && !ReadInodeFromDisk(inst, inodeNum, &c->inode)) {
+                UnhashInode(inst, (int16_t)(c - inst.inodeCache));
+                return nullptr;
+            }
+        }
+
+        c->lastUse = ++inst.inodeClock;
+        return c;
+    }
+
+    static bool ReadInode(Ext2Instance& inst, uint32_t inodeNum, Inode* out) {
+        if (inodeNum == 0 || inodeNum > inst.totalInodes) return false;
+
+        CachedInode* c = GetCachedInode(inst, inodeNum, true);
+        if (!c) return ReadInodeFromDisk(inst, inodeNum, out);
+
+        memcpy(out, &c->inode, sizeof(Inode));
+        return true;
+    }
+
+    // Update the cached copy only; the inode table is written back on
+    // eviction, when the last handle closes, or on Sync()
+    static bool WriteInode(Ext2Instance& inst, uint32_t inodeNum, const Inode* inode) {
+        if (inodeNum == 0 || inodeNum > inst.totalInodes) return false;
+
+        CachedInode* c = GetCachedInode(inst, inodeNum, false);
+        if (!c) return WriteInodeToDisk(inst, inodeNum, inode);
+
+        memcpy(&c->inode, inode, sizeof(Inode));
+        c->dirty = true;
+        return true;
+    }
+
+    // Pin an inode for an open handle
+    static CachedInode* HoldInode(Ext2Instance& inst, uint32_t inodeNum) {
+        if (inodeNum == 0 || inodeNum > inst.totalInodes) return nullptr;
+
+        CachedInode* c = GetCachedInode(inst, inodeNum, true);
+        if (c) c->refCount++;
+        return c;
+    }
+
+    static void ReleaseInode(Ext2Instance& inst, CachedInode* c) {
+        if (--c->refCount > 0 || !c->dirty) return;
+        if (WriteInodeToDisk(inst, c->inodeNum, &c->inode)) c->dirty = false;
+    }
+
+    static void FlushInodes(Ext2Instance& inst) {
+        if (!inst.inodeCache) return;
+        for (int i = 0; i < InodeCacheSize; i++) {
+            auto& c = inst.inodeCache[i];
+            if (c.inodeNum != 0 && c.dirty && WriteInodeToDisk(inst, c.inodeNum, &c.inode)) {
+                c.dirty = false;
+            }
+        }
+    }
+
     // =========================================================================
     // Block addressing — resolve logical block index to physical block number
     // =========================================================================
@@ -337,57 +617,396 @@ namespace Fs::Ext2 {
         return 0; // beyond addressable range
     }
 
+    // Find the leaf pointer table covering logical block `logicalIdx` (>= 12).
+    // Sets the first logical block it maps and its physical block (0 if the
+    // leaf has not been allocated). Returns false past the addressable range.
+    static bool ResolveLeaf(Ext2Instance& inst, const Inode& inode, uint32_t logicalIdx,
+                            uint32_t* leafFirst, uint32_t* leafBlock) {
+        uint32_t ptrsPerBlock = inst.blockSize / 4;
+        uint32_t rel = logicalIdx - 12;
+
+        // Single indirect
+        if (rel < ptrsPerBlock) {
+            *leafFirst = 12;
+            *leafBlock = inode.i_block[12];
+            return true;
+        }
+        rel -= ptrsPerBlock;
+        uint32_t base = 12 + ptrsPerBlock;
+
+        // Double indirect
+        uint32_t dblRange = ptrsPerBlock * ptrsPerBlock;
+        if (rel < dblRange) {
+            uint32_t idx1 = rel / ptrsPerBlock;
+            *leafFirst = base + idx1 * ptrsPerBlock;
+            *leafBlock = 0;
+            if (inode.i_block[13] == 0) return true;
+            if (!ReadBlock(inst, inode.i_block[13], inst.blockBuf)) return false;
+            memcpy(leafBlock, inst.blockBuf + idx1 * 4, 4);
+            return true;
+        }
+        rel -= dblRange;
+        base += dblRange;
+
+        // Triple indirect
+        uint32_t triRange = dblRange * ptrsPerBlock;
+        if (rel < triRange) {
+            uint32_t idx1 = rel / dblRange;
+            uint32_t idx2 = (rel % dblRange) / ptrsPerBlock;
+            *leafFirst = base + idx1 * dblRange + idx2 * ptrsPerBlock;
+            *leafBlock = 0;
+            if (inode.i_block[14] == 0) return true;
+            if (!ReadBlock(inst, inode.i_block[14], inst.blockBuf)) return false;
+
+            uint32_t dblBlock;
+            memcpy(&dblBlock, inst.blockBuf + idx1 * 4, 4);
+            if (dblBlock == 0) return true;
+            if (!ReadBlock(inst, dblBlock, inst.blockBuf)) return false;
+            memcpy(leafBlock, inst.blockBuf + idx2 * 4, 4);
+            return true;
+        }
+
+        return false;
+    }
+
+    // GetPhysicalBlock for an open file, through the file's cached leaf table.
+    // Sequential access re-reads indirect blocks once per leaf instead of once
+    // per data block.
+    static uint32_t MapBlock(Ext2Instance& inst, Ext2File& file, uint32_t logicalIdx) {
+        if (logicalIdx < 12) return file.node->inode.i_block[logicalIdx];
+
+        uint32_t ptrsPerBlock = inst.blockSize / 4;
+        if (file.mapValid && logicalIdx >= file.mapFirst && logicalIdx - file.mapFirst < ptrsPerBlock) {
+            return file.map[logicalIdx - file.mapFirst];
+        }
+
+        if (file.map == nullptr) {
+            file.map = (uint32_t*)Memory::g_heap->Request(inst.blockSize);
+            if (file.map == nullptr) return GetPhysicalBlock(inst, file.node->inode, logicalIdx);
+        }
+
+        file.mapValid = false;
+        uint32_t leafFirst, leafBlock;
+        if (!ResolveLeaf(inst, file.node->inode, logicalIdx, &leafFirst, &leafBlock)) return 0;
+
+        if (leafBlock == 0) {
+            memset(file.map, 0, inst.blockSize);
+        } else if (!ReadBlock(inst, leafBlock, file.map)) {
+            return 0;
+        }
+
+        file.mapFirst = leafFirst;
+        file.mapValid = true;
+        return file.map[logicalIdx - leafFirst];
+    }
+
+    // Length of the physically contiguous run starting at `logicalIdx`, at most
+    // `maxBlocks`. Returns 0 (and no block) if the first block is a hole.
+    static uint32_t MapRun(Ext2Instance& inst, Ext2File& file, uint32_t logicalIdx,
+                           uint32_t maxBlocks, uint32_t* physStart) {
+        uint32_t first = MapBlock(inst, file, logicalIdx);
+        *physStart = first;
+        if (first == 0) return 0;
+
+        uint32_t run = 1;
+        while (run < maxBlocks && MapBlock(inst, file, logicalIdx + run) == first + run) run++;
+        return run;
+    }
+
+    // Largest run worth coalescing: one request at the driver's transfer limit
+    static uint32_t MaxRunBlocks(const Ext2Instance& inst) {
+        auto* dev = Drivers::Storage::GetBlockDevice(inst.blockDevIndex);
+        uint32_t sectors = (dev && dev->MaxTransferSectors) ? dev->MaxTransferSectors : 128;
+        uint32_t blocks = sectors / SectorsPerBlock(inst);
+        return blocks ? blocks : 1;
+    }
+
+    // Drop cached block maps for every open handle on an inode
+    static void InvalidateBlockMaps(Ext2Instance& inst, uint32_t inodeNum) {
+        for (int i = 0; i < inst.fileCapacity; i++) {
+            if (FileSlot(inst, i).inUse && FileSlot(inst, i).inodeNum == inodeNum) {
+                FileSlot(inst, i).mapValid = false;
+            }
+        }
+    }
+
     // =========================================================================
     // Block allocation
     // =========================================================================
 
-    static uint32_t AllocateBlock(Ext2Instance& inst, uint32_t preferGroup) {
-        // Try the preferred group first, then scan all groups
-        for (uint32_t attempt = 0; attempt < inst.groupCount; attempt++) {
-            uint32_t g = (preferGroup + attempt) % inst.groupCount;
-            if (inst.bgdt[g].bg_free_blocks_count == 0) continue;
+    // Remember a freed block for the next FlushDiscards. Adjacent frees
+    // extend the last extent; once the list is full further frees are left
+    // for Trim to pick up.
+    static void QueueDiscard(Ext2Instance& inst, uint32_t block) {
+        if (!inst.canDiscard) return;
+
+        if (inst.pendingDiscardCount > 0) {
+            DiscardExtent& last = inst.pendingDiscards[inst.pendingDiscardCount - 1];
+            if (last.start + last.count == block) {
+                last.count++;
+                return;
+            }
+            if (last.start == block + 1) {
+                last.start--;
+                last.count++;
+                return;
+            }
+        }
+        if (inst.pendingDiscardCount >= MaxPendingDiscards) return;
+
+        inst.pendingDiscards[inst.pendingDiscardCount++] = { block, 1 };
+    }
+
+    // A pending block was allocated again before its discard went out; it
+    // must not be discarded once it holds data.
+    static void ClaimPending(Ext2Instance& inst, uint32_t block) {
+        for (int i = 0; i < inst.pendingDiscardCount; i++) {
+            DiscardExtent& e = inst.pendingDiscards[i];
+            if (block < e.start || block >= e.start + e.count) continue;
+
+            uint32_t tail = e.start + e.count - (block + 1);
+            e.count = block - e.start;
 
-            uint32_t bitmapBlock = inst.bgdt[g].bg_block_bitmap;
-            if (!ReadBlock(inst, bitmapBlock, inst.blockBuf)) continue;
+            if (tail > 0) {
+                if (e.count == 0) {
+                    e = { block + 1, tail };
+                    return;
+                }
+                // Split; with no room the tail is left for Trim
+                if (inst.pendingDiscardCount < MaxPendingDiscards) {
+                    inst.pendingDiscards[inst.pendingDiscardCount++] = { block + 1, tail };
+                }
+            }
+            if (e.count == 0) {
+                inst.pendingDiscards[i] = inst.pendingDiscards[--inst.pendingDiscardCount];
+            }
+            return;
+        }
+    }
 
-            uint32_t blocksInGroup = inst.blocksPerGroup;
-            // Last group may have fewer blocks
-            if (g == inst.groupCount - 1) {
-                uint32_t remaining = inst.totalBlocks - g * inst.blocksPerGroup;
-                if (remaining < blocksInGroup) blocksInGroup = remaining;
+    static bool DiscardBlocks(const Ext2Instance& inst, uint32_t start, uint32_t count) {
+        auto* dev = Drivers::Storage::GetBlockDevice(inst.blockDevIndex);
+        if (!dev || !dev->Discard) return false;
+        return dev->Discard(dev->Ctx, inst.partStartLba + BlockToPartSector(inst, start),
+                     (uint64_t)count * SectorsPerBlock(inst));
+    }
+
+    static uint32_t BlocksInGroup(const Ext2Instance& inst, uint32_t g) {
+        uint32_t blocksInGroup = inst.blocksPerGroup;
+        // Last group may have fewer blocks
+        if (g == inst.groupCount - 1) {
+            uint32_t remaining = inst.totalBlocks - inst.firstDataBlock - g * inst.blocksPerGroup;
+            if (remaining < blocksInGroup) blocksInGroup = remaining;
+        }
+        return blocksInGroup;
+    }
+
+    // Whether group `g` starts with a superblock and descriptor table copy
+    static bool HasSuperBackup(const Ext2Instance& inst, uint32_t g) {
+        if (g <= 1 || !inst.sparseSuper) return true;
+        static constexpr uint32_t bases[] = { 3, 5, 7 };
+        for (uint32_t base : bases) {
+            uint32_t n = g;
+            while (n % base == 0) n /= base;
+            if (n == 1) return true;
+        }
+        return false;
+    }
+
+    // The bitmap a BLOCK_UNINIT group implies: its superblock backup and
+    // descriptor copies, its own bitmaps and inode table, and the bits past
+    // the end of a short last group
+    static void BuildBlockBitmap(const Ext2Instance& inst, uint32_t g, uint8_t* bitmap) {
+        memset(bitmap, 0, inst.blockSize);
+        uint32_t groupStart = inst.firstDataBlock + g * inst.blocksPerGroup;
+        uint32_t groupBlocks = BlocksInGroup(inst, g);
+
+        auto mark = [&](uint32_t block, uint32_t count) {
+            for (uint32_t b = block; b < block + count; b++) {
+                if (b < groupStart || b - groupStart >= groupBlocks) continue;
+                bitmap[(b - groupStart) / 8] |= (uint8_t)(1 << ((b - groupStart) % 8));
             }
+        };
 
-            for (uint32_t bit = 0; bit < blocksInGroup; bit++) {
-                uint32_t byteIdx = bit / 8;
-                uint8_t bitMask = 1 << (bit % 8);
-                if (!(inst.blockBuf[byteIdx] & bitMask)) {
-                    // Found a free block — mark it used
-                    inst.blockBuf[byteIdx] |= bitMask;
-                    if (!WriteBlock(inst, bitmapBlock, inst.blockBuf)) continue;
+        const BlockGroupDescriptor& desc = inst.bgdt[g];
+        if (HasSuperBackup(inst, g)) mark(groupStart, 1 + inst.bgdtBlocks + inst.reservedGdtBlocks);
+        mark(desc.bg_block_bitmap, 1);
+        mark(desc.bg_inode_bitmap, 1);
+        mark(desc.bg_inode_table, (inst.inodesPerGroup * inst.inodeSize + inst.blockSize - 1) / inst.blockSize);
 
-                    inst.bgdt[g].bg_free_blocks_count--;
+        for (uint32_t bit = groupBlocks; bit < inst.blockSize * 8; bit++)
+            bitmap[bit / 8] |= (uint8_t)(1 << (bit % 8));
+    }
 
-                    // Write updated BGDT entry back to disk
-                    uint32_t bgdtBlock = inst.firstDataBlock + 1;
-                    uint32_t bgdtOffset = g * sizeof(BlockGroupDescriptor);
-                    uint32_t bgdtBlockIdx = bgdtBlock + bgdtOffset / inst.blockSize;
-                    uint32_t bgdtOffInBlock = bgdtOffset % inst.blockSize;
-
-                    uint8_t* tmpBuf = inst.blockBuf;
-                    if (ReadBlock(inst, bgdtBlockIdx, tmpBuf)) {
-                        memcpy(tmpBuf + bgdtOffInBlock, &inst.bgdt[g],
-                               sizeof(BlockGroupDescriptor));
-                        WriteBlock(inst, bgdtBlockIdx, tmpBuf);
-                    }
+    static void FlushAllocator(Ext2Instance& inst);
+
+    // Blocks of group `g` held in open inodes' preallocation windows, cleared
+    // from `bitmap` if it is not nullptr. Windows are set in the cached
+    // bitmap only; on disk they stay free, so a crash cannot leak them.
+    static uint32_t MaskPrealloc(Ext2Instance& inst, uint32_t g, uint8_t* bitmap) {
+        uint32_t groupStart = inst.firstDataBlock + g * inst.blocksPerGroup;
+        uint32_t groupEnd = groupStart + BlocksInGroup(inst, g);
+        uint32_t count = 0;
+
+        for (int i = 0; i < InodeCacheSize; i++) {
+            const CachedInode& c = inst.inodeCache[i];
+            if (c.inodeNum == 0 || c.preallocCount == 0) continue;
+
+            uint32_t start = c.preallocStart > groupStart ? c.preallocStart : groupStart;
+            uint32_t end = c.preallocStart + c.preallocCount;
+            if (end > groupEnd) end = groupEnd;
+            for (uint32_t block = start; block < end; block++) {
+                uint32_t bit = block - groupStart;
+                if (bitmap != nullptr) bitmap[bit / 8] &= (uint8_t)~(1 << (bit % 8));
+                count++;
+            }
+        }
+        return count;
+    }
 
-                    return inst.firstDataBlock + g * inst.blocksPerGroup + bit;
+    // Count the blocks of every preallocation window as free in the group
+    // descriptors (`release`), or take them back after a flush
+    static void ShiftPrealloc(Ext2Instance& inst, bool release) {
+        for (int i = 0; i < InodeCacheSize; i++) {
+            const CachedInode& c = inst.inodeCache[i];
+            if (c.inodeNum == 0 || c.preallocCount == 0) continue;
+
+            for (uint32_t k = 0; k < c.preallocCount; k++) {
+                uint32_t g = (c.preallocStart + k - inst.firstDataBlock) / inst.blocksPerGroup;
+                if (release) {
+                    inst.bgdt[g].bg_free_blocks_count++;
+                    inst.groupDirty[g] |= GroupDescDirty;
+                } else {
+                    inst.bgdt[g].bg_free_blocks_count--;
                 }
             }
         }
+    }
+
+    // Free the least recently used bitmap that has no unwritten changes.
+    // Bitmaps holding preallocation windows stay: the disk copy lacks them.
+    static bool EvictBlockBitmap(Ext2Instance& inst) {
+        uint32_t victim = inst.groupCount;
+        for (uint32_t g = 0; g < inst.groupCount; g++) {
+            if (inst.blockBitmaps[g] == nullptr || (inst.groupDirty[g] & GroupBitmapDirty)) continue;
+            if (victim != inst.groupCount &&
+                (int32_t)(inst.bitmapUse[g] - inst.bitmapUse[victim]) >= 0) continue;
+            if (MaskPrealloc(inst, g, nullptr) == 0) victim = g;
+        }
+        if (victim == inst.groupCount) return false;
+
+        Memory::g_pfa->Free(inst.blockBitmaps[victim], inst.blockBufPages);
+        inst.blockBitmaps[victim] = nullptr;
+        inst.cachedBitmaps--;
+        return true;
+    }
+
+    // Block bitmap of group `g`, read from disk on first use. The pointer is
+    // valid until the next call, which may evict it.
+    static uint8_t* GetBlockBitmap(Ext2Instance& inst, uint32_t g) {
+        inst.bitmapUse[g] = ++inst.bitmapClock;
+        if (inst.blockBitmaps[g] != nullptr) return inst.blockBitmaps[g];
+
+        // At the limit, write back dirty bitmaps if none is clean; past it
+        // only when even that fails
+        if (inst.cachedBitmaps >= MaxCachedBitmaps && !EvictBlockBitmap(inst)) {
+            FlushAllocator(inst);
+            EvictBlockBitmap(inst);
+        }
+
+        uint8_t* bitmap;
+        if (inst.blockBufPages == 1) {
+            bitmap = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+        } else {
+            bitmap = (uint8_t*)Memory::g_pfa->AllocateConsecutive(inst.blockBufPages);
+        }
+        if (!bitmap) return nullptr;
+
+        if (inst.gdtCsum && (inst.bgdt[g].bg_flags & EXT4_BG_BLOCK_UNINIT)) {
+            BuildBlockBitmap(inst, g, bitmap);
+            inst.bgdt[g].bg_flags &= ~EXT4_BG_BLOCK_UNINIT;
+            inst.groupDirty[g] |= GroupBitmapDirty | GroupDescDirty;
+        } else if (!ReadBlock(inst, inst.bgdt[g].bg_block_bitmap, bitmap)) {
+            Memory::g_pfa->Free(bitmap, inst.blockBufPages);
+            return nullptr;
+        }
+
+        inst.blockBitmaps[g] = bitmap;
+        inst.cachedBitmaps++;
+        return bitmap;
+    }
+
+    // First clear bit in [start, end), or -1
+    static int32_t FindFreeBit(const uint8_t* bitmap, uint32_t start, uint32_t end) {
+        uint32_t bit = start;
+        while (bit < end) {
+            if ((bit % 8) == 0 && bitmap[bit / 8] == 0xFF) {
+                bit += 8;
+                continue;
+            }
+            if (!(bitmap[bit / 8] & (1 << (bit % 8)))) return (int32_t)bit;
+            bit++;
+        }
+        return -1;
+    }
+
+    static uint32_t UseBit(Ext2Instance& inst, uint32_t g, uint8_t* bitmap, uint32_t bit) {
+        bitmap[bit / 8] |= (uint8_t)(1 << (bit % 8));
+        inst.bgdt[g].bg_free_blocks_count--;
+        inst.groupDirty[g] |= GroupBitmapDirty | GroupDescDirty;
+
+        uint32_t block = inst.firstDataBlock + g * inst.blocksPerGroup + bit;
+        if (inst.pendingDiscardCount > 0) ClaimPending(inst, block);
+        return block;
+    }
+
+    // Allocate a free block, as close after `goal` as possible when one is
+    // given. Bitmaps and descriptors change in memory only; FlushAllocator
+    // writes them back.
+    static uint32_t AllocateBlock(Ext2Instance& inst, uint32_t preferGroup, uint32_t goal = 0) {
+        uint32_t goalBit = 0;
+        if (goal > inst.firstDataBlock && goal < inst.totalBlocks) {
+            preferGroup = (goal - inst.firstDataBlock) / inst.blocksPerGroup;
+            goalBit = (goal - inst.firstDataBlock) % inst.blocksPerGroup;
+        }
+
+        // Try the preferred group first, then scan all groups
+        for (uint32_t attempt = 0; attempt < inst.groupCount; attempt++) {
+            uint32_t g = (preferGroup + attempt) % inst.groupCount;
+            if (inst.bgdt[g].bg_free_blocks_count == 0) continue;
+
+            uint8_t* bitmap = GetBlockBitmap(inst, g);
+            if (!bitmap) continue;
+
+            uint32_t blocksInGroup = BlocksInGroup(inst, g);
+            int32_t bit = -1;
+            if (attempt == 0 && goalBit != 0) bit = FindFreeBit(bitmap, goalBit, blocksInGroup);
+            if (bit < 0) bit = FindFreeBit(bitmap, 0, blocksInGroup);
+            if (bit < 0) continue;
+
+            return UseBit(inst, g, bitmap, (uint32_t)bit);
+        }
         return 0; // no free blocks
     }
 
-    static void FreeBlock(Ext2Instance& inst, uint32_t blockNum) {
+    // Allocate exactly `blockNum` if it is free
+    static bool TakeBlock(Ext2Instance& inst, uint32_t blockNum) {
+        if (blockNum < inst.firstDataBlock || blockNum >= inst.totalBlocks) return false;
+
+        uint32_t adjusted = blockNum - inst.firstDataBlock;
+        uint32_t g = adjusted / inst.blocksPerGroup;
+        uint32_t bit = adjusted % inst.blocksPerGroup;
+        if (g >= inst.groupCount || bit >= BlocksInGroup(inst, g)) return false;
+
+        uint8_t* bitmap = GetBlockBitmap(inst, g);
+        if (!bitmap || (bitmap[bit / 8] & (1 << (bit % 8)))) return false;
+
+        UseBit(inst, g, bitmap, bit);
+        return true;
+    }
+
+    // `discard` is false for blocks that never held data (preallocation)
+    static void FreeBlock(Ext2Instance& inst, uint32_t blockNum, bool discard = true) {
         if (blockNum < inst.firstDataBlock || blockNum >= inst.totalBlocks) return;
 
         uint32_t adjusted = blockNum - inst.firstDataBlock;
@@ -396,27 +1015,84 @@ namespace Fs::Ext2 {
 
         if (g >= inst.groupCount) return;
 
-        uint32_t bitmapBlock = inst.bgdt[g].bg_block_bitmap;
-        if (!ReadBlock(inst, bitmapBlock, inst.blockBuf)) return;
+        uint8_t* bitmap = GetBlockBitmap(inst, g);
+        if (!bitmap) return;
 
         uint32_t byteIdx = bit / 8;
         uint8_t bitMask = 1 << (bit % 8);
-        inst.blockBuf[byteIdx] &= ~bitMask;
-        WriteBlock(inst, bitmapBlock, inst.blockBuf);
+        if (!(bitmap[byteIdx] & bitMask)) return;
+        bitmap[byteIdx] &= ~bitMask;
 
         inst.bgdt[g].bg_free_blocks_count++;
+        inst.groupDirty[g] |= GroupBitmapDirty | GroupDescDirty;
+
+        if (discard) QueueDiscard(inst, blockNum);
+    }
 
-        // Write updated BGDT
+    // Write back dirty block bitmaps and the descriptor table blocks holding
+    // changed group descriptors
+    static void FlushAllocator(Ext2Instance& inst) {
         uint32_t bgdtBlock = inst.firstDataBlock + 1;
-        uint32_t bgdtOffset = g * sizeof(BlockGroupDescriptor);
-        uint32_t bgdtBlockIdx = bgdtBlock + bgdtOffset / inst.blockSize;
-        uint32_t bgdtOffInBlock = bgdtOffset % inst.blockSize;
+        uint32_t bgdtBytes = inst.groupCount * sizeof(BlockGroupDescriptor);
+        uint32_t lastDescBlock = 0xFFFFFFFF;
+
+        // Preallocation windows go out as free blocks
+        ShiftPrealloc(inst, true);
+
+        // Descriptors are written a table block at a time, so every changed
+        // one needs its checksum before the first write
+        for (uint32_t g = 0; inst.gdtCsum && g < inst.groupCount; g++) {
+            if (inst.groupDirty[g] & GroupDescDirty)
+                inst.bgdt[g].bg_checksum = GroupChecksum(inst.uuid, g, inst.bgdt[g]);
+        }
 
-        if (ReadBlock(inst, bgdtBlockIdx, inst.blockBuf)) {
-            memcpy(inst.blockBuf + bgdtOffInBlock, &inst.bgdt[g],
-                   sizeof(BlockGroupDescriptor));
-            WriteBlock(inst, bgdtBlockIdx, inst.blockBuf);
+        for (uint32_t g = 0; g < inst.groupCount; g++) {
+            uint8_t dirty = inst.groupDirty[g];
+            if (dirty == 0) continue;
+
+            if ((dirty & GroupBitmapDirty) && inst.blockBitmaps[g] != nullptr) {
+                memcpy(inst.blockBuf, inst.blockBitmaps[g], inst.blockSize);
+                MaskPrealloc(inst, g, inst.blockBuf);
+                if (!WriteBlock(inst, inst.bgdt[g].bg_block_bitmap, inst.blockBuf)) continue;
+            }
+            inst.groupDirty[g] &= ~GroupBitmapDirty;
+
+            if (!(dirty & GroupDescDirty)) continue;
+
+            // Descriptors sharing a table block go out in one write
+            uint32_t descBlock = g * sizeof(BlockGroupDescriptor) / inst.blockSize;
+            if (descBlock != lastDescBlock) {
+                uint32_t offset = descBlock * inst.blockSize;
+                uint32_t copyLen = bgdtBytes - offset;
+                if (copyLen > inst.blockSize) copyLen = inst.blockSize;
+
+                if (!ReadBlock(inst, bgdtBlock + descBlock, inst.blockBuf)) continue;
+                memcpy(inst.blockBuf, (uint8_t*)inst.bgdt + offset, copyLen);
+                if (!WriteBlock(inst, bgdtBlock + descBlock, inst.blockBuf)) continue;
+                lastDescBlock = descBlock;
+            }
+            inst.groupDirty[g] &= ~GroupDescDirty;
         }
+
+        ShiftPrealloc(inst, false);
+    }
+
+    // Send the batched discards. The inode, directory and bitmap updates
+    // that freed the blocks may still be dirty in the inode cache or the
+    // block cache; if a discard reached the device first, a crash would
+    // leave on-disk metadata pointing at erased blocks. So everything is
+    // written back first, and the discards wait if that fails.
+    static void FlushDiscards(Ext2Instance& inst) {
+        if (inst.pendingDiscardCount == 0) return;
+
+        FlushAllocator(inst);
+        FlushInodes(inst);
+        if (!Drivers::Storage::BlockCache::Flush(inst.blockDevIndex)) return;
+
+        for (int i = 0; i < inst.pendingDiscardCount; i++) {
+            DiscardBlocks(inst, inst.pendingDiscards[i].start, inst.pendingDiscards[i].count);
+        }
+        inst.pendingDiscardCount = 0;
     }
 
     // =========================================================================
@@ -428,31 +1104,36 @@ namespace Fs::Ext2 {
             uint32_t g = (preferGroup + attempt) % inst.groupCount;
             if (inst.bgdt[g].bg_free_inodes_count == 0) continue;
 
-            uint32_t bitmapBlock = inst.bgdt[g].bg_inode_bitmap;
-            if (!ReadBlock(inst, bitmapBlock, inst.blockBuf)) continue;
+            BlockGroupDescriptor& desc = inst.bgdt[g];
+            uint32_t bitmapBlock = desc.bg_inode_bitmap;
+            bool uninit = inst.gdtCsum && (desc.bg_flags & EXT4_BG_INODE_UNINIT);
+            if (uninit) {
+                // Never written: all free, with the padding past the last inode set
+                memset(inst.blockBuf, 0, inst.blockSize);
+                for (uint32_t bit = inst.inodesPerGroup; bit < inst.blockSize * 8; bit++)
+                    inst.blockBuf[bit / 8] |= (uint8_t)(1 << (bit % 8));
+            } else if (!ReadBlock(inst, bitmapBlock, inst.blockBuf)) {
+                continue;
+            }
 
             for (uint32_t bit = 0; bit < inst.inodesPerGroup; bit++) {
                 uint32_t byteIdx = bit / 8;
                 uint8_t bitMask = 1 << (bit % 8);
                 if (!(inst.blockBuf[byteIdx] & bitMask)) {
                     inst.blockBuf[byteIdx] |= bitMask;
-                    if (!WriteBlock(inst, bitmapBlock, inst.blockBuf)) continue;
-
-                    inst.bgdt[g].bg_free_inodes_count--;
+                    if (!WriteBlock(inst, bitmapBlock, inst.blockBuf)) break;
 
-                    // Write updated BGDT entry
-                    uint32_t bgdtBlock = inst.firstDataBlock + 1;
-                    uint32_t bgdtOffset = g * sizeof(BlockGroupDescriptor);
-                    uint32_t bgdtBlockIdx = bgdtBlock + bgdtOffset / inst.blockSize;
-                    uint32_t bgdtOffInBlock = bgdtOffset % inst.blockSize;
+                    desc.bg_free_inodes_count--;
+                    inst.groupDirty[g] |= GroupDescDirty;
 
-                    if (ReadBlock(inst, bgdtBlockIdx, inst.blockBuf)) {
-                        memcpy(inst.blockBuf + bgdtOffInBlock, &inst.bgdt[g],
-                               sizeof(BlockGroupDescriptor));
-                        WriteBlock(inst, bgdtBlockIdx, inst.blockBuf);
+                    uint32_t inodeNum = g * inst.inodesPerGroup + bit + 1; // inodes are 1-based
+                    if (inst.gdtCsum) {
+                        desc.bg_flags &= ~EXT4_BG_INODE_UNINIT;
+                        if (bit >= inst.inodesPerGroup - desc.bg_itable_unused)
+                            desc.bg_itable_unused = (uint16_t)(inst.inodesPerGroup - bit - 1);
+                        if (!(desc.bg_flags & EXT4_BG_INODE_ZEROED)) ClearInodeRecord(inst, inodeNum);
                     }
-
-                    return g * inst.inodesPerGroup + bit + 1; // inodes are 1-based
+                    return inodeNum;
                 }
             }
         }
@@ -476,17 +1157,7 @@ namespace Fs::Ext2 {
         WriteBlock(inst, bitmapBlock, inst.blockBuf);
 
         inst.bgdt[g].bg_free_inodes_count++;
-
-        uint32_t bgdtBlock = inst.firstDataBlock + 1;
-        uint32_t bgdtOffset = g * sizeof(BlockGroupDescriptor);
-        uint32_t bgdtBlockIdx = bgdtBlock + bgdtOffset / inst.blockSize;
-        uint32_t bgdtOffInBlock = bgdtOffset % inst.blockSize;
-
-        if (ReadBlock(inst, bgdtBlockIdx, inst.blockBuf)) {
-            memcpy(inst.blockBuf + bgdtOffInBlock, &inst.bgdt[g],
-                   sizeof(BlockGroupDescriptor));
-            WriteBlock(inst, bgdtBlockIdx, inst.blockBuf);
-        }
+        inst.groupDirty[g] |= GroupDescDirty;
     }
 
     // =========================================================================
@@ -568,6 +1239,70 @@ namespace Fs::Ext2 {
         return false;
     }
 
+    // SetPhysicalBlock for a newly allocated data block of an open file,
+    // keeping the file's block count and cached block maps in step
+    static bool AssignBlock(Ext2Instance& inst, Ext2File& file, uint32_t logicalIdx,
+                            uint32_t physBlock, uint32_t preferGroup) {
+        if (!SetPhysicalBlock(inst, file.node->inode, logicalIdx, physBlock, preferGroup)) return false;
+        file.node->inode.i_blocks += inst.blockSize / 512;
+
+        bool cached = file.mapValid && logicalIdx >= file.mapFirst
+            && logicalIdx - file.mapFirst < inst.blockSize / 4;
+        InvalidateBlockMaps(inst, file.inodeNum);
+        if (cached) {
+            file.map[logicalIdx - file.mapFirst] = physBlock;
+            file.mapValid = true;
+        }
+        return true;
+    }
+
+    // Return the unused part of an inode's preallocation window
+    static void DiscardPrealloc(Ext2Instance& inst, CachedInode* c) {
+        // Shrink the window before each free, so a flush in between (bitmap
+        // eviction) never counts a block twice
+        while (c->preallocCount > 0) {
+            c->preallocCount--;
+            FreeBlock(inst, c->preallocStart + c->preallocCount, false);
+        }
+    }
+
+    // Pick the physical block for a new logical block of an open file. The
+    // block following the previous logical block is preferred, and the free
+    // run after a fresh allocation is reserved for this inode so interleaved
+    // writers do not fragment each other. `prevPhys`, when set, is the block
+    // chosen for the previous logical block that is not linked in yet.
+    static uint32_t AllocateFileBlock(Ext2Instance& inst, Ext2File& file, uint32_t logicalIdx,
+                                      uint32_t preferGroup, uint32_t prevPhys = 0) {
+        CachedInode* c = file.node;
+
+        uint32_t goal = prevPhys != 0 ? prevPhys + 1 : 0;
+        if (goal == 0 && logicalIdx > 0) {
+            uint32_t prev = MapBlock(inst, file, logicalIdx - 1);
+            if (prev != 0) goal = prev + 1;
+        }
+
+        if (c->preallocCount > 0) {
+            if (goal == 0 || goal == c->preallocStart) {
+                // Leaving the window makes the block used on disk too
+                uint32_t g = (c->preallocStart - inst.firstDataBlock) / inst.blocksPerGroup;
+                inst.groupDirty[g] |= GroupBitmapDirty | GroupDescDirty;
+                c->preallocCount--;
+                return c->preallocStart++;
+            }
+            // Not sequential any more: the window would only fragment the file
+            DiscardPrealloc(inst, c);
+        }
+
+        uint32_t block = AllocateBlock(inst, preferGroup, goal);
+        if (block == 0) return 0;
+
+        c->preallocStart = block + 1;
+        while (c->preallocCount < PreallocBlocks && TakeBlock(inst, c->preallocStart + c->preallocCount)) {
+            c->preallocCount++;
+        }
+        return block;
+    }
+
     // Free all data blocks belonging to an inode (direct + indirect trees)
     static void FreeInodeBlocks(Ext2Instance& inst, Inode& inode) {
         uint32_t ptrsPerBlock = inst.blockSize / 4;
@@ -657,44 +1392,686 @@ namespace Fs::Ext2 {
                            char* fileName, int nameMax) {
         while (*path == '/') path++;
 
-        int len = 0;
-        while (path[len]) len++;
+        int len = 0;
+        while (path[len]) len++;
+
+        int lastSlash = -1;
+        for (int i = len - 1; i >= 0; i--) {
+            if (path[i] == '/') { lastSlash = i; break; }
+        }
+
+        if (lastSlash < 0) {
+            parentPath[0] = '\0';
+            int j = 0;
+            while (j < nameMax - 1 && path[j]) { fileName[j] = path[j]; j++; }
+            fileName[j] = '\0';
+        } else {
+            int j = 0;
+            for (int i = 0; i < lastSlash && j < parentMax - 1; i++) {
+                parentPath[j++] = path[i];
+            }
+            parentPath[j] = '\0';
+
+            j = 0;
+            for (int i = lastSlash + 1; i < len && j < nameMax - 1; i++) {
+                fileName[j++] = path[i];
+            }
+            fileName[j] = '\0';
+        }
+    }
+
+    // =========================================================================
+    // Directory blocks
+    // =========================================================================
+
+    struct ParsedEntry {
+        char     name[MaxNameLen];
+        uint32_t inodeNum;
+        uint8_t  fileType;
+    };
+
+    static uint32_t DirRecLen(uint32_t nameLen) {
+        return ((sizeof(DirEntry) + nameLen + 3) / 4) * 4; // 4-byte aligned
+    }
+
+    // Read or write logical block `logicalIdx` of a directory. GetPhysicalBlock
+    // uses inst.blockBuf for indirect block reads, so `buf` must be separate.
+    static bool ReadDirBlock(Ext2Instance& inst, const Inode& dirInode,
+                             uint32_t logicalIdx, uint8_t* buf) {
+        uint32_t physBlock = GetPhysicalBlock(inst, dirInode, logicalIdx);
+        if (physBlock == 0) return false;
+        return ReadBlock(inst, physBlock, buf);
+    }
+
+    static bool WriteDirBlock(Ext2Instance& inst, const Inode& dirInode,
+                              uint32_t logicalIdx, const uint8_t* buf) {
+        uint32_t physBlock = GetPhysicalBlock(inst, dirInode, logicalIdx);
+        if (physBlock == 0) return false;
+        return WriteBlock(inst, physBlock, buf);
+    }
+
+    // Search the first `length` bytes of a directory block for `name`
+    static bool FindInBlock(const uint8_t* dirBuf, uint32_t length, uint32_t blockSize,
+                            const char* name, ParsedEntry* out) {
+        uint32_t pos = 0;
+        while (pos + 8 <= length) {
+            const DirEntry* de = (const DirEntry*)(dirBuf + pos);
+            if (de->rec_len == 0) break;
+            if (de->rec_len < 8 || pos + de->rec_len > blockSize) break;
+
+            if (de->inode != 0 && de->name_len > 0) {
+                char entryName[MaxNameLen];
+                int nameLen = de->name_len;
+                if (nameLen >= MaxNameLen) nameLen = MaxNameLen - 1;
+                memcpy(entryName, (const uint8_t*)de + sizeof(DirEntry), nameLen);
+                entryName[nameLen] = '\0';
+
+                if (StrEqual(entryName, name)) {
+                    out->inodeNum = de->inode;
+                    out->fileType = de->file_type;
+                    memcpy(out->name, entryName, nameLen + 1);
+                    return true;
+                }
+            }
+
+            pos += de->rec_len;
+        }
+        return false;
+    }
+
+    // Place an entry in the first gap of a directory block large enough to
+    // hold it. Returns false if the block is full.
+    static bool InsertIntoBlock(uint8_t* dirBuf, uint32_t blockSize, uint32_t childInodeNum,
+                                const char* name, uint32_t nameLen, uint8_t fileType) {
+        uint32_t neededLen = DirRecLen(nameLen);
+        uint32_t pos = 0;
+        while (pos + 8 <= blockSize) {
+            DirEntry* de = (DirEntry*)(dirBuf + pos);
+            if (de->rec_len == 0) break;
+            if (de->rec_len < 8 || pos + de->rec_len > blockSize) break;
+
+            // Check if this entry has slack space we can use
+            uint32_t actualLen;
+            if (de->inode == 0) {
+                actualLen = 0; // unused entry — entire rec_len is available
+            } else {
+                actualLen = DirRecLen(de->name_len);
+            }
+
+            uint32_t slack = de->rec_len - actualLen;
+            if (slack >= neededLen) {
+                // Split this entry
+                if (de->inode != 0) {
+                    uint16_t oldRecLen = de->rec_len;
+                    de->rec_len = (uint16_t)actualLen;
+
+                    DirEntry* newDe = (DirEntry*)(dirBuf + pos + actualLen);
+                    newDe->inode = childInodeNum;
+                    newDe->rec_len = (uint16_t)(oldRecLen - actualLen);
+                    newDe->name_len = (uint8_t)nameLen;
+                    newDe->file_type = fileType;
+                    memcpy((uint8_t*)newDe + sizeof(DirEntry), name, nameLen);
+                } else {
+                    // Reuse this empty entry
+                    de->inode = childInodeNum;
+                    // Keep rec_len as-is
+                    de->name_len = (uint8_t)nameLen;
+                    de->file_type = fileType;
+                    memcpy((uint8_t*)de + sizeof(DirEntry), name, nameLen);
+                }
+                return true;
+            }
+
+            pos += de->rec_len;
+        }
+        return false;
+    }
+
+    // Unlink `name` from a directory block. Returns false if it is not there.
+    static bool RemoveFromBlock(uint8_t* dirBuf, uint32_t blockSize, const char* name) {
+        uint32_t pos = 0;
+        DirEntry* prevDe = nullptr;
+
+        while (pos + 8 <= blockSize) {
+            DirEntry* de = (DirEntry*)(dirBuf + pos);
+            if (de->rec_len == 0) break;
+            if (de->rec_len < 8 || pos + de->rec_len > blockSize) break;
+
+            if (de->inode != 0 && de->name_len > 0) {
+                char entryName[MaxNameLen];
+                int nameLen = de->name_len;
+                if (nameLen >= MaxNameLen) nameLen = MaxNameLen - 1;
+                memcpy(entryName, (uint8_t*)de + sizeof(DirEntry), nameLen);
+                entryName[nameLen] = '\0';
+
+                if (StrEqual(entryName, name)) {
+                    if (prevDe) {
+                        // Merge with previous entry
+                        prevDe->rec_len += de->rec_len;
+                    } else {
+                        // First entry in block — just zero the inode
+                        de->inode = 0;
+                    }
+                    return true;
+                }
+            }
+
+            prevDe = de;
+            pos += de->rec_len;
+        }
+        return false;
+    }
+
+    // Allocate a block and append it to a directory. The caller writes its
+    // contents and the updated inode.
+    static bool AppendDirBlock(Ext2Instance& inst, uint32_t dirInodeNum, Inode& dirInode,
+                               uint32_t* outLogical) {
+        uint32_t group = (dirInodeNum - 1) / inst.inodesPerGroup;
+        uint32_t newBlock = AllocateBlock(inst, group);
+        if (newBlock == 0) return false;
+
+        uint32_t logical = dirInode.i_size / inst.blockSize;
+        if (!SetPhysicalBlock(inst, dirInode, logical, newBlock, group)) {
+            FreeBlock(inst, newBlock);
+            return false;
+        }
+
+        dirInode.i_size += inst.blockSize;
+        dirInode.i_blocks += inst.blockSize / 512;
+        *outLogical = logical;
+        return true;
+    }
+
+    // =========================================================================
+    // Hashed directory index (htree)
+    // =========================================================================
+
+    // An indexed directory keeps (hash, block) pairs in block 0, disguised as
+    // a "." / ".." pair whose ".." entry spans the rest of the block, plus at
+    // most one level of interior nodes disguised as empty blocks. Leaves are
+    // ordinary directory blocks holding the names in their hash range, so
+    // drivers without dir_index still see a valid linear directory; they (and
+    // we, when the index is full) clear EXT2_INDEX_FL before modifying it.
+
+    struct DxRootInfo {
+        uint32_t reserved_zero;
+        uint8_t  hash_version;
+        uint8_t  info_length;       // 8
+        uint8_t  indirect_levels;
+        uint8_t  unused_flags;
+    } __attribute__((packed));
+
+    struct DxCountLimit {
+        uint16_t limit;
+        uint16_t count;
+    } __attribute__((packed));
+
+    struct DxEntry {
+        uint32_t hash;              // Entry 0 has none: DxCountLimit overlays it
+        uint32_t block;             // Logical block within the directory
+    } __attribute__((packed));
+
+    static constexpr uint32_t DxRootInfoOffset = 24;     // After "." and ".."
+    static constexpr uint32_t DxRootEntriesOffset = 32;
+    static constexpr uint32_t DxNodeEntriesOffset = 8;   // After the empty dirent
+
+    // Lowest index node on the path to a hash, as found by DxProbe
+    struct DxFrame {
+        uint32_t logical;           // Directory block holding the node
+        DxEntry* entries;           // Points into the caller's node buffer
+        uint32_t count;
+        uint32_t limit;
+        uint32_t at;                // Entry whose range covers the hash
+        uint32_t hash;
+        uint8_t  version;
+    };
+
+    // Leaf entry, for splitting by hash
+    struct DxMapEntry {
+        uint32_t hash;
+        uint16_t offset;
+    };
+
+    static bool IsIndexed(const Ext2Instance& inst, const Inode& dirInode) {
+        return inst.dirIndex && (dirInode.i_flags & EXT2_INDEX_FL);
+    }
+
+    // --- Name hashes, bit-compatible with the Linux ext2/3/4 implementation ---
+
+    static uint32_t Rol32(uint32_t x, int s) {
+        return (x << s) | (x >> (32 - s));
+    }
+
+    static void Str2HashBuf(const char* msg, int len, uint32_t* buf, int num, bool unsignedChars) {
+        uint32_t pad = (uint32_t)len | ((uint32_t)len << 8);
+        pad |= pad << 16;
+
+        uint32_t val = pad;
+        if (len > num * 4) len = num * 4;
+        for (int i = 0; i < len; i++) {
+            int c = unsignedChars ? (int)(uint8_t)msg[i] : (int)(int8_t)msg[i];
+            val = (uint32_t)c + (val << 8);
+            if ((i % 4) == 3) {
+                *buf++ = val;
+                val = pad;
+                num--;
+            }
+        }
+        if (--num >= 0) *buf++ = val;
+        while (--num >= 0) *buf++ = pad;
+    }
+
+    static void HalfMd4Transform(uint32_t buf[4], const uint32_t in[8]) {
+        auto F = [](uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); };
+        auto G = [](uint32_t x, uint32_t y, uint32_t z) { return (x & y) + ((x ^ y) & z); };
+        auto H = [](uint32_t x, uint32_t y, uint32_t z) { return x ^ y ^ z; };
+        constexpr uint32_t K2 = 0x5A827999;
+        constexpr uint32_t K3 = 0x6ED9EBA1;
+
+        uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+        a = Rol32(a + F(b, c, d) + in[0], 3);
+        d = Rol32(d + F(a, b, c) + in[1], 7);
+        c = Rol32(c + F(d, a, b) + in[2], 11);
+        b = Rol32(b + F(c, d, a) + in[3], 19);
+        a = Rol32(a + F(b, c, d) + in[4], 3);
+        d = Rol32(d + F(a, b, c) + in[5], 7);
+        c = Rol32(c + F(d, a, b) + in[6], 11);
+        b = Rol32(b + F(c, d, a) + in[7], 19);
+
+        a = Rol32(a + G(b, c, d) + in[1] + K2, 3);
+        d = Rol32(d + G(a, b, c) + in[3] + K2, 5);
+        c = Rol32(c + G(d, a, b) + in[5] + K2, 9);
+        b = Rol32(b + G(c, d, a) + in[7] + K2, 13);
+        a = Rol32(a + G(b, c, d) + in[0] + K2, 3);
+        d = Rol32(d + G(a, b, c) + in[2] + K2, 5);
+        c = Rol32(c + G(d, a, b) + in[4] + K2, 9);
+        b = Rol32(b + G(c, d, a) + in[6] + K2, 13);
+
+        a = Rol32(a + H(b, c, d) + in[3] + K3, 3);
+        d = Rol32(d + H(a, b, c) + in[7] + K3, 9);
+        c = Rol32(c + H(d, a, b) + in[2] + K3, 11);
+        b = Rol32(b + H(c, d, a) + in[6] + K3, 15);
+        a = Rol32(a + H(b, c, d) + in[1] + K3, 3);
+        d = Rol32(d + H(a, b, c) + in[5] + K3, 9);
+        c = Rol32(c + H(d, a, b) + in[0] + K3, 11);
+        b = Rol32(b + H(c, d, a) + in[4] + K3, 15);
+
+        buf[0] += a;
+        buf[1] += b;
+        buf[2] += c;
+        buf[3] += d;
+    }
+
+    static void TeaTransform(uint32_t buf[4], const uint32_t in[4]) {
+        uint32_t sum = 0;
+        uint32_t b0 = buf[0], b1 = buf[1];
+        uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+
+        for (int n = 0; n < 16; n++) {
+            sum += 0x9E3779B9;
+            b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+            b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+        }
+
+        buf[0] += b0;
+        buf[1] += b1;
+    }
+
+    static uint32_t LegacyHash(const char* name, int len, bool unsignedChars) {
+        uint32_t hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+        for (int i = 0; i < len; i++) {
+            int c = unsignedChars ? (int)(uint8_t)name[i] : (int)(int8_t)name[i];
+            uint32_t hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+            if (hash & 0x80000000) hash -= 0x7FFFFFFF;
+            hash1 = hash0;
+            hash0 = hash;
+        }
+        return hash0 << 1;
+    }
+
+    static uint32_t DirHash(const Ext2Instance& inst, uint8_t version, const char* name, int len) {
+        uint32_t buf[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+        if (inst.hashSeed[0] | inst.hashSeed[1] | inst.hashSeed[2] | inst.hashSeed[3]) {
+            memcpy(buf, inst.hashSeed, sizeof(buf));
+        }
+
+        uint32_t in[8];
+        uint32_t hash;
+        switch (version) {
+            case DX_HASH_LEGACY:
+                hash = LegacyHash(name, len, inst.unsignedHash);
+                break;
+            case DX_HASH_HALF_MD4:
+                for (const char* p = name; len > 0; len -= 32, p += 32) {
+                    Str2HashBuf(p, len, in, 8, inst.unsignedHash);
+                    HalfMd4Transform(buf, in);
+                }
+                hash = buf[1];
+                break;
+            case DX_HASH_TEA:
+                for (const char* p = name; len > 0; len -= 16, p += 16) {
+                    Str2HashBuf(p, len, in, 4, inst.unsignedHash);
+                    TeaTransform(buf, in);
+                }
+                hash = buf[0];
+                break;
+            default:
+                return 0;
+        }
+
+        // The low bit marks collision runs in index entries; the top value is reserved
+        hash &= ~1u;
+        if (hash == 0xFFFFFFFE) hash = 0xFFFFFFFC;
+        return hash;
+    }
+
+    // --- Index traversal ---
+
+    // Walk the index from the root to the node whose entry covers the hash of
+    // `name`; `nodeBuf` is left holding that node. Returns false if the index
+    // is damaged or uses features we do not handle.
+    static bool DxProbe(Ext2Instance& inst, const Inode& dirInode, const char* name,
+                        int nameLen, uint8_t* nodeBuf, DxFrame* frame) {
+        if (!ReadDirBlock(inst, dirInode, 0, nodeBuf)) return false;
+
+        const DxRootInfo* info = (const DxRootInfo*)(nodeBuf + DxRootInfoOffset);
+        if (info->reserved_zero != 0 || info->info_length != 8) return false;
+        if (info->hash_version > DX_HASH_TEA || info->indirect_levels > 1) return false;
+
+        uint8_t version = info->hash_version;
+        uint8_t levels = info->indirect_levels;
+        uint32_t hash = DirHash(inst, version, name, nameLen);
+
+        uint32_t logical = 0;
+        uint32_t offset = DxRootEntriesOffset;
+        for (uint8_t level = 0; ; level++) {
+            const DxCountLimit* cl = (const DxCountLimit*)(nodeBuf + offset);
+            if (cl->count == 0 || cl->count > cl->limit ||
+                cl->limit > (inst.blockSize - offset) / sizeof(DxEntry)) return false;
+
+            // Last entry whose hash is <= ours (entry 0 covers everything below entry 1)
+            DxEntry* entries = (DxEntry*)(nodeBuf + offset);
+            uint32_t lo = 1, hi = cl->count;
+            while (lo < hi) {
+                uint32_t mid = (lo + hi) / 2;
+                if (entries[mid].hash > hash) hi = mid;
+                else lo = mid + 1;
+            }
+            uint32_t at = lo - 1;
+
+            if (level == levels) {
+                frame->logical = logical;
+                frame->entries = entries;
+                frame->count = cl->count;
+                frame->limit = cl->limit;
+                frame->at = at;
+                frame->hash = hash;
+                frame->version = version;
+                return true;
+            }
+
+            logical = entries[at].block & 0x0FFFFFFF;
+            if (!ReadDirBlock(inst, dirInode, logical, nodeBuf)) return false;
+            offset = DxNodeEntriesOffset;
+        }
+    }
+
+    // Find the leaf holding `name`, leaving it in `dirBuf`. Returns 1 if found
+    // (with the leaf's logical block), 0 if absent, -1 if the index is unusable.
+    static int DxLookup(Ext2Instance& inst, const Inode& dirInode, const char* name,
+                        uint8_t* nodeBuf, uint8_t* dirBuf, ParsedEntry* out, uint32_t* outLeaf) {
+        int nameLen = 0;
+        while (name[nameLen]) nameLen++;
+
+        DxFrame frame;
+        if (!DxProbe(inst, dirInode, name, nameLen, nodeBuf, &frame)) return -1;
+
+        for (uint32_t at = frame.at; at < frame.count; at++) {
+            // Names sharing a hash may continue into the following leaf
+            if (at > frame.at && (frame.entries[at].hash & ~1u) != frame.hash) break;
+
+            uint32_t leaf = frame.entries[at].block & 0x0FFFFFFF;
+            if (!ReadDirBlock(inst, dirInode, leaf, dirBuf)) return -1;
+            if (FindInBlock(dirBuf, inst.blockSize, inst.blockSize, name, out)) {
+                *outLeaf = leaf;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // --- Index updates ---
+
+    // Hash the live entries of a leaf and sort them by hash. Returns the count.
+    static uint32_t DxMapLeaf(const Ext2Instance& inst, uint8_t version, const uint8_t* buf,
+                              DxMapEntry* map, bool skipDots) {
+        uint32_t count = 0;
+        uint32_t pos = 0;
+        while (pos + 8 <= inst.blockSize) {
+            const DirEntry* de = (const DirEntry*)(buf + pos);
+            if (de->rec_len < 8 || pos + de->rec_len > inst.blockSize) break;
+
+            const char* name = (const char*)de + sizeof(DirEntry);
+            bool isDot = de->name_len <= 2 && name[0] == '.' &&
+                         (de->name_len == 1 || name[1] == '.');
+            if (de->inode != 0 && de->name_len > 0 && !(skipDots && isDot)) {
+                map[count].hash = DirHash(inst, version, name, de->name_len);
+                map[count].offset = (uint16_t)pos;
+                count++;
+            }
+            pos += de->rec_len;
+        }
+
+        for (uint32_t i = 1; i < count; i++) {
+            DxMapEntry e = map[i];
+            uint32_t j = i;
+            while (j > 0 && map[j - 1].hash > e.hash) {
+                map[j] = map[j - 1];
+                j--;
+            }
+            map[j] = e;
+        }
+        return count;
+    }
+
+    // Write the entries of `map` (pointing into `src`) compactly into `dst`
+    static void DxPackLeaf(uint8_t* dst, const uint8_t* src, const DxMapEntry* map,
+                           uint32_t count, uint32_t blockSize) {
+        memset(dst, 0, blockSize);
+
+        uint32_t pos = 0;
+        DirEntry* last = nullptr;
+        for (uint32_t i = 0; i < count; i++) {
+            const DirEntry* de = (const DirEntry*)(src + map[i].offset);
+            uint32_t len = DirRecLen(de->name_len);
+            memcpy(dst + pos, de, sizeof(DirEntry) + de->name_len);
+            last = (DirEntry*)(dst + pos);
+            last->rec_len = (uint16_t)len;
+            pos += len;
+        }
+
+        if (last) {
+            last->rec_len = (uint16_t)(last->rec_len + blockSize - pos);
+        } else {
+            ((DirEntry*)dst)->rec_len = (uint16_t)blockSize;
+        }
+    }
+
+    // Split sorted entries into two leaves at the median. Returns the hash
+    // starting the upper leaf, with the low bit set if a run of equal hashes
+    // continues across the split.
+    static uint32_t DxSplit(const uint8_t* src, const DxMapEntry* map, uint32_t count,
+                            uint8_t* lower, uint8_t* upper, uint32_t blockSize) {
+        uint32_t split = count / 2;
+        uint32_t hash2 = count > 0 ? map[split].hash : 0;
+        bool continued = split > 0 && map[split - 1].hash == hash2;
+
+        DxPackLeaf(lower, src, map, split, blockSize);
+        DxPackLeaf(upper, src, map + split, count - split, blockSize);
+        return hash2 | (continued ? 1 : 0);
+    }
+
+    // Add an entry through the index, splitting its leaf when full.
+    // Returns 1 if added, 0 on I/O or allocation failure, -1 if the index
+    // cannot take it (damaged, or the index node is full).
+    static int DxAdd(Ext2Instance& inst, uint32_t dirInodeNum, Inode& dirInode,
+                     uint32_t childInodeNum, const char* name, uint32_t nameLen, uint8_t fileType) {
+        uint32_t blockSize = inst.blockSize;
+        uint8_t* nodeBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+        uint8_t* leafBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+        uint8_t* lower = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+        uint8_t* upper = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+        DxMapEntry* map = (DxMapEntry*)Memory::g_heap->Request((blockSize / 12 + 1) * sizeof(DxMapEntry));
+
+        int result = 0;
+        DxFrame frame;
+        uint32_t leaf = 0;
+        uint32_t newLeaf = 0;
+        uint32_t count = 0;
+        uint32_t hash2 = 0;
+        uint8_t* target = nullptr;
+
+        if (!nodeBuf || !leafBuf || !lower || !upper || !map) goto done;
+
+        if (!DxProbe(inst, dirInode, name, (int)nameLen, nodeBuf, &frame)) {
+            result = -1;
+            goto done;
+        }
+
+        leaf = frame.entries[frame.at].block & 0x0FFFFFFF;
+        if (!ReadDirBlock(inst, dirInode, leaf, leafBuf)) goto done;
 
-        int lastSlash = -1;
-        for (int i = len - 1; i >= 0; i--) {
-            if (path[i] == '/') { lastSlash = i; break; }
+        if (InsertIntoBlock(leafBuf, blockSize, childInodeNum, name, nameLen, fileType)) {
+            result = WriteDirBlock(inst, dirInode, leaf, leafBuf) ? 1 : 0;
+            goto done;
         }
 
-        if (lastSlash < 0) {
-            parentPath[0] = '\0';
-            int j = 0;
-            while (j < nameMax - 1 && path[j]) { fileName[j] = path[j]; j++; }
-            fileName[j] = '\0';
-        } else {
-            int j = 0;
-            for (int i = 0; i < lastSlash && j < parentMax - 1; i++) {
-                parentPath[j++] = path[i];
-            }
-            parentPath[j] = '\0';
+        // Leaf is full: split it by hash and index the upper half
+        if (frame.count >= frame.limit) {
+            result = -1;
+            goto done;
+        }
 
-            j = 0;
-            for (int i = lastSlash + 1; i < len && j < nameMax - 1; i++) {
-                fileName[j++] = path[i];
-            }
-            fileName[j] = '\0';
+        count = DxMapLeaf(inst, frame.version, leafBuf, map, false);
+        hash2 = DxSplit(leafBuf, map, count, lower, upper, blockSize);
+
+        target = frame.hash >= (hash2 & ~1u) ? upper : lower;
+        if (!InsertIntoBlock(target, blockSize, childInodeNum, name, nameLen, fileType)) goto done;
+
+        if (!AppendDirBlock(inst, dirInodeNum, dirInode, &newLeaf)) goto done;
+        if (!WriteDirBlock(inst, dirInode, newLeaf, upper)) goto done;
+        if (!WriteDirBlock(inst, dirInode, leaf, lower)) goto done;
+
+        memmove(&frame.entries[frame.at + 2], &frame.entries[frame.at + 1],
+                (frame.count - frame.at - 1) * sizeof(DxEntry));
+        frame.entries[frame.at + 1].hash = hash2;
+        frame.entries[frame.at + 1].block = newLeaf;
+        ((DxCountLimit*)frame.entries)->count = (uint16_t)(frame.count + 1);
+
+        if (!WriteDirBlock(inst, dirInode, frame.logical, nodeBuf)) goto done;
+        WriteInode(inst, dirInodeNum, &dirInode);
+        result = 1;
+
+    done:
+        if (map) Memory::g_heap->Free(map);
+        if (upper) Memory::g_pfa->Free(upper);
+        if (lower) Memory::g_pfa->Free(lower);
+        if (leafBuf) Memory::g_pfa->Free(leafBuf);
+        if (nodeBuf) Memory::g_pfa->Free(nodeBuf);
+        return result;
+    }
+
+    // Convert a full single-block directory to an indexed one: its entries
+    // move into two new hash-ordered leaves and block 0 becomes the root.
+    static bool DxMakeIndexed(Ext2Instance& inst, uint32_t dirInodeNum, Inode& dirInode) {
+        uint8_t version = inst.defHashVersion;
+        if (version > DX_HASH_TEA) return false;
+
+        uint32_t blockSize = inst.blockSize;
+        uint8_t* rootBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+        uint8_t* lower = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+        uint8_t* upper = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+        DxMapEntry* map = (DxMapEntry*)Memory::g_heap->Request((blockSize / 12 + 1) * sizeof(DxMapEntry));
+
+        bool ok = false;
+        uint32_t first = 0, second = 0;
+        uint32_t count = 0, hash2 = 0;
+        DirEntry dot, dotdot;
+        DirEntry* de;
+        DxRootInfo* info;
+        DxEntry* entries;
+
+        if (!rootBuf || !lower || !upper || !map) goto done;
+        if (!ReadDirBlock(inst, dirInode, 0, rootBuf)) goto done;
+
+        // "." and ".." must lead the block; they stay in the root
+        memcpy(&dot, rootBuf, sizeof(DirEntry));
+        if (dot.name_len != 1 || rootBuf[8] != '.' || dot.rec_len < 12 || dot.rec_len > blockSize - 12) goto done;
+        memcpy(&dotdot, rootBuf + dot.rec_len, sizeof(DirEntry));
+        if (dotdot.name_len != 2 || rootBuf[dot.rec_len + 8] != '.' || rootBuf[dot.rec_len + 9] != '.') goto done;
+
+        count = DxMapLeaf(inst, version, rootBuf, map, true);
+        hash2 = DxSplit(rootBuf, map, count, lower, upper, blockSize);
+
+        if (!AppendDirBlock(inst, dirInodeNum, dirInode, &first)) goto done;
+        if (!AppendDirBlock(inst, dirInodeNum, dirInode, &second)) {
+            // Keep the directory valid: the block already added stays empty
+            memset(lower, 0, blockSize);
+            ((DirEntry*)lower)->rec_len = (uint16_t)blockSize;
+            WriteDirBlock(inst, dirInode, first, lower);
+            WriteInode(inst, dirInodeNum, &dirInode);
+            goto done;
         }
+        if (!WriteDirBlock(inst, dirInode, first, lower)) goto done;
+        if (!WriteDirBlock(inst, dirInode, second, upper)) goto done;
+
+        // Rebuild block 0 as the index root
+        memset(rootBuf, 0, blockSize);
+        de = (DirEntry*)rootBuf;
+        de->inode = dot.inode;
+        de->rec_len = 12;
+        de->name_len = 1;
+        de->file_type = dot.file_type;
+        rootBuf[8] = '.';
+
+        de = (DirEntry*)(rootBuf + 12);
+        de->inode = dotdot.inode;
+        de->rec_len = (uint16_t)(blockSize - 12);
+        de->name_len = 2;
+        de->file_type = dotdot.file_type;
+        rootBuf[20] = '.';
+        rootBuf[21] = '.';
+
+        info = (DxRootInfo*)(rootBuf + DxRootInfoOffset);
+        info->hash_version = version;
+        info->info_length = 8;
+
+        entries = (DxEntry*)(rootBuf + DxRootEntriesOffset);
+        ((DxCountLimit*)entries)->limit = (uint16_t)((blockSize - DxRootEntriesOffset) / sizeof(DxEntry));
+        ((DxCountLimit*)entries)->count = 2;
+        entries[0].block = first;
+        entries[1].hash = hash2;
+        entries[1].block = second;
+
+        if (!WriteDirBlock(inst, dirInode, 0, rootBuf)) goto done;
+
+        dirInode.i_flags |= EXT2_INDEX_FL;
+        WriteInode(inst, dirInodeNum, &dirInode);
+        ok = true;
+
+    done:
+        if (map) Memory::g_heap->Free(map);
+        if (upper) Memory::g_pfa->Free(upper);
+        if (lower) Memory::g_pfa->Free(lower);
+        if (rootBuf) Memory::g_pfa->Free(rootBuf);
+        return ok;
     }
 
     // =========================================================================
     // Directory operations
     // =========================================================================
 
-    struct ParsedEntry {
-        char     name[MaxNameLen];
-        uint32_t inodeNum;
-        uint8_t  fileType;
-    };
-
     // Find a single entry by name in a directory inode.
     static bool FindInDirectory(Ext2Instance& inst, const Inode& dirInode,
                                  const char* name, ParsedEntry* out) {
@@ -707,37 +2084,31 @@ namespace Fs::Ext2 {
         uint8_t* dirBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
         if (!dirBuf) return false;
 
+        if (IsIndexed(inst, dirInode)) {
+            uint8_t* nodeBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+            if (nodeBuf) {
+                uint32_t leaf;
+                int found = DxLookup(inst, dirInode, name, nodeBuf, dirBuf, out, &leaf);
+                Memory::g_pfa->Free(nodeBuf);
+                if (found >= 0) {
+                    Memory::g_pfa->Free(dirBuf);
+                    return found == 1;
+                }
+            }
+            // Unusable index: fall back to a linear scan
+        }
+
         for (uint32_t bi = 0; bi < numBlocks; bi++) {
             uint32_t physBlock = GetPhysicalBlock(inst, dirInode, bi);
             if (physBlock == 0) continue;
             if (!ReadBlock(inst, physBlock, dirBuf)) continue;
 
-            uint32_t pos = 0;
             uint32_t remaining = dirSize - bi * blockSize;
             if (remaining > blockSize) remaining = blockSize;
 
-            while (pos + 8 <= remaining) {
-                DirEntry* de = (DirEntry*)(dirBuf + pos);
-                if (de->rec_len == 0) break;
-                if (de->rec_len < 8 || pos + de->rec_len > blockSize) break;
-
-                if (de->inode != 0 && de->name_len > 0) {
-                    char entryName[MaxNameLen];
-                    int nameLen = de->name_len;
-                    if (nameLen >= MaxNameLen) nameLen = MaxNameLen - 1;
-                    memcpy(entryName, (uint8_t*)de + sizeof(DirEntry), nameLen);
-                    entryName[nameLen] = '\0';
-
-                    if (StrEqual(entryName, name)) {
-                        out->inodeNum = de->inode;
-                        out->fileType = de->file_type;
-                        memcpy(out->name, entryName, nameLen + 1);
-                        Memory::g_pfa->Free(dirBuf);
-                        return true;
-                    }
-                }
-
-                pos += de->rec_len;
+            if (FindInBlock(dirBuf, remaining, blockSize, name, out)) {
+                Memory::g_pfa->Free(dirBuf);
+                return true;
             }
         }
 
@@ -804,7 +2175,17 @@ namespace Fs::Ext2 {
         uint32_t nameLen = 0;
         while (name[nameLen]) nameLen++;
 
-        uint32_t neededLen = ((sizeof(DirEntry) + nameLen + 3) / 4) * 4; // 4-byte aligned
+        if (dirInode.i_flags & EXT2_INDEX_FL) {
+            if (inst.dirIndex) {
+                int added = DxAdd(inst, dirInodeNum, dirInode, childInodeNum, name, nameLen, fileType);
+                if (added >= 0) return added == 1;
+            }
+
+            // Index full or unusable: drop it, the leaves are still a valid linear directory
+            dirInode.i_flags &= ~EXT2_INDEX_FL;
+            WriteInode(inst, dirInodeNum, &dirInode);
+        }
+
         uint32_t blockSize = inst.blockSize;
         uint32_t numBlocks = (dirInode.i_size + blockSize - 1) / blockSize;
 
@@ -817,51 +2198,19 @@ namespace Fs::Ext2 {
             if (physBlock == 0) continue;
             if (!ReadBlock(inst, physBlock, dirBuf)) continue;
 
-            uint32_t pos = 0;
-            while (pos + 8 <= blockSize) {
-                DirEntry* de = (DirEntry*)(dirBuf + pos);
-                if (de->rec_len == 0) break;
-                if (de->rec_len < 8 || pos + de->rec_len > blockSize) break;
-
-                // Check if this entry has slack space we can use
-                uint32_t actualLen;
-                if (de->inode == 0) {
-                    actualLen = 0; // unused entry — entire rec_len is available
-                } else {
-                    actualLen = ((sizeof(DirEntry) + de->name_len + 3) / 4) * 4;
-                }
-
-                uint32_t slack = de->rec_len - actualLen;
-                if (slack >= neededLen) {
-                    // Split this entry
-                    if (de->inode != 0) {
-                        uint16_t oldRecLen = de->rec_len;
-                        de->rec_len = (uint16_t)actualLen;
-
-                        DirEntry* newDe = (DirEntry*)(dirBuf + pos + actualLen);
-                        newDe->inode = childInodeNum;
-                        newDe->rec_len = (uint16_t)(oldRecLen - actualLen);
-                        newDe->name_len = (uint8_t)nameLen;
-                        newDe->file_type = fileType;
-                        memcpy((uint8_t*)newDe + sizeof(DirEntry), name, nameLen);
-                    } else {
-                        // Reuse this empty entry
-                        de->inode = childInodeNum;
-                        // Keep rec_len as-is
-                        de->name_len = (uint8_t)nameLen;
-                        de->file_type = fileType;
-                        memcpy((uint8_t*)de + sizeof(DirEntry), name, nameLen);
-                    }
-
-                    WriteBlock(inst, physBlock, dirBuf);
-                    Memory::g_pfa->Free(dirBuf);
-                    return true;
-                }
-
-                pos += de->rec_len;
+            if (InsertIntoBlock(dirBuf, blockSize, childInodeNum, name, nameLen, fileType)) {
+                WriteBlock(inst, physBlock, dirBuf);
+                Memory::g_pfa->Free(dirBuf);
+                return true;
             }
         }
 
+        // A full single-block directory grows an index instead of a second linear block
+        if (inst.dirIndex && numBlocks == 1 && DxMakeIndexed(inst, dirInodeNum, dirInode)) {
+            Memory::g_pfa->Free(dirBuf);
+            return DxAdd(inst, dirInodeNum, dirInode, childInodeNum, name, nameLen, fileType) == 1;
+        }
+
         // No space — allocate a new block for the directory
         uint32_t group = (dirInodeNum - 1) / inst.inodesPerGroup;
         uint32_t newBlock = AllocateBlock(inst, group);
@@ -911,42 +2260,31 @@ namespace Fs::Ext2 {
         uint8_t* dirBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
         if (!dirBuf) return false;
 
+        if (IsIndexed(inst, dirInode)) {
+            uint8_t* nodeBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+            if (nodeBuf) {
+                ParsedEntry entry;
+                uint32_t leaf = 0;
+                int found = DxLookup(inst, dirInode, name, nodeBuf, dirBuf, &entry, &leaf);
+                Memory::g_pfa->Free(nodeBuf);
+                if (found >= 0) {
+                    bool removed = found == 1 && RemoveFromBlock(dirBuf, blockSize, name) &&
+                                   WriteDirBlock(inst, dirInode, leaf, dirBuf);
+                    Memory::g_pfa->Free(dirBuf);
+                    return removed;
+                }
+            }
+        }
+
         for (uint32_t bi = 0; bi < numBlocks; bi++) {
             uint32_t physBlock = GetPhysicalBlock(inst, dirInode, bi);
             if (physBlock == 0) continue;
             if (!ReadBlock(inst, physBlock, dirBuf)) continue;
 
-            uint32_t pos = 0;
-            DirEntry* prevDe = nullptr;
-
-            while (pos + 8 <= blockSize) {
-                DirEntry* de = (DirEntry*)(dirBuf + pos);
-                if (de->rec_len == 0) break;
-                if (de->rec_len < 8 || pos + de->rec_len > blockSize) break;
-
-                if (de->inode != 0 && de->name_len > 0) {
-                    char entryName[MaxNameLen];
-                    int nameLen = de->name_len;
-                    if (nameLen >= MaxNameLen) nameLen = MaxNameLen - 1;
-                    memcpy(entryName, (uint8_t*)de + sizeof(DirEntry), nameLen);
-                    entryName[nameLen] = '\0';
-
-                    if (StrEqual(entryName, name)) {
-                        if (prevDe) {
-                            // Merge with previous entry
-                            prevDe->rec_len += de->rec_len;
-                        } else {
-                            // First entry in block — just zero the inode
-                            de->inode = 0;
-                        }
-                        WriteBlock(inst, physBlock, dirBuf);
-                        Memory::g_pfa->Free(dirBuf);
-                        return true;
-                    }
-                }
-
-                prevDe = de;
-                pos += de->rec_len;
+            if (RemoveFromBlock(dirBuf, blockSize, name)) {
+                WriteBlock(inst, physBlock, dirBuf);
+                Memory::g_pfa->Free(dirBuf);
+                return true;
             }
         }
 
@@ -1008,6 +2346,38 @@ namespace Fs::Ext2 {
     // FsDriver implementation functions
     // =========================================================================
 
+    // Free slot in the open-file table, adding a chunk (up to
+    // MaxFilesPerInstance) when every slot is taken
+    static int AllocFileSlot(Ext2Instance& self) {
+        for (int i = 0; i < self.fileCapacity; i++) {
+            if (!FileSlot(self, i).inUse) return i;
+        }
+        if (self.fileCapacity >= MaxFilesPerInstance) return -1;
+
+        auto* chunk = (Ext2File*)Memory::g_heap->Request(FileChunkSize * sizeof(Ext2File));
+        if (!chunk) return -1;
+        memset(chunk, 0, FileChunkSize * sizeof(Ext2File));
+
+        int slot = self.fileCapacity;
+        self.fileChunks[slot / FileChunkSize] = chunk;
+        self.fileCapacity += FileChunkSize;
+        return slot;
+    }
+
+    static int OpenInode(Ext2Instance& self, uint32_t inodeNum) {
+        int i = AllocFileSlot(self);
+        if (i < 0) return -1;
+
+        FileSlot(self, i).node = HoldInode(self, inodeNum);
+        if (!FileSlot(self, i).node) return -1;
+        FileSlot(self, i).inUse = true;
+        FileSlot(self, i).inodeNum = inodeNum;
+        FileSlot(self, i).isDirectory =
+            (FileSlot(self, i).node->inode.i_mode & IMODE_TYPE_MASK) == IMODE_DIR;
+        FileSlot(self, i).mapValid = false;
+        return i;
+    }
+
     static int OpenImpl(int inst, const char* path) {
         if (inst < 0 || inst >= g_instanceCount || !g_instances[inst].active) return -1;
         auto& self = g_instances[inst];
@@ -1016,74 +2386,128 @@ namespace Fs::Ext2 {
         Inode inode;
         if (!TraversePath(self, path, &inodeNum, &inode)) return -1;
 
-        for (int i = 0; i < MaxFilesPerInstance; i++) {
-            if (!self.files[i].inUse) {
-                self.files[i].inUse = true;
-                self.files[i].inodeNum = inodeNum;
-                self.files[i].inode = inode;
-                self.files[i].isDirectory =
-                    (inode.i_mode & IMODE_TYPE_MASK) == IMODE_DIR;
-                return i;
-            }
-        }
+        return OpenInode(self, inodeNum);
+    }
 
-        return -1;
+    // Nodes are inode numbers
+    static int LookupImpl(int inst, uint64_t dirNode, const char* name,
+                           uint64_t* outNode, bool* outIsDir) {
+        if (inst < 0 || inst >= g_instanceCount || !g_instances[inst].active) return -1;
+        auto& self = g_instances[inst];
+
+        uint32_t dirInodeNum = dirNode == Vfs::RootNode ? EXT2_ROOT_INODE : (uint32_t)dirNode;
+        Inode dirInode;
+        if (!ReadInode(self, dirInodeNum, &dirInode)) return -1;
+        if ((dirInode.i_mode & IMODE_TYPE_MASK) != IMODE_DIR) return 0;
+
+        ParsedEntry found;
+        if (!FindInDirectory(self, dirInode, name, &found)) return 0;
+
+        Inode inode;
+        if (!ReadInode(self, found.inodeNum, &inode)) return -1;
+
+        *outNode = found.inodeNum;
+        *outIsDir = (inode.i_mode & IMODE_TYPE_MASK) == IMODE_DIR;
+        return 1;
+    }
+
+    static int OpenNodeImpl(int inst, uint64_t node) {
+        if (inst < 0 || inst >= g_instanceCount || !g_instances[inst].active) return -1;
+        return OpenInode(g_instances[inst], node == Vfs::RootNode ? EXT2_ROOT_INODE : (uint32_t)node);
     }
 
     static int ReadImpl(int inst, int handle, uint8_t* buffer,
                          uint64_t offset, uint64_t size) {
         if (inst < 0 || inst >= g_instanceCount) return -1;
         auto& self = g_instances[inst];
-        if (handle < 0 || handle >= MaxFilesPerInstance || !self.files[handle].inUse) return -1;
+        if (handle < 0 || handle >= self.fileCapacity || !FileSlot(self, handle).inUse) return -1;
 
-        auto& file = self.files[handle];
+        auto& file = FileSlot(self, handle);
         if (file.isDirectory) return -1;
 
-        uint32_t fileSize = file.inode.i_size;
+        uint32_t fileSize = file.node->inode.i_size;
         if (offset >= fileSize) return 0;
         if (offset + size > fileSize) size = fileSize - offset;
         if (size == 0) return 0;
 
         uint32_t blockSize = self.blockSize;
+        uint32_t maxRun = MaxRunBlocks(self);
         uint64_t bytesRead = 0;
 
-        // We need a separate buffer for data reads since GetPhysicalBlock uses blockBuf
-        uint8_t* dataBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
-        if (!dataBuf) return -1;
+        // Bounce buffer for partial blocks, allocated on first use
+        uint8_t* dataBuf = nullptr;
 
         while (bytesRead < size) {
             uint32_t logicalBlock = (uint32_t)((offset + bytesRead) / blockSize);
             uint32_t blockOff = (uint32_t)((offset + bytesRead) % blockSize);
+            uint64_t remaining = size - bytesRead;
+
+            if (blockOff == 0 && remaining >= blockSize) {
+                // Whole blocks: one device request per physically contiguous run
+                uint64_t whole = remaining / blockSize;
+                uint32_t limit = whole < maxRun ? (uint32_t)whole : maxRun;
+                uint32_t physBlock;
+                uint32_t run = MapRun(self, file, logicalBlock, limit, &physBlock);
+                if (run == 0) break;
+
+                if (!ReadPartSectors(self, BlockToPartSector(self, physBlock),
+                                     run * SectorsPerBlock(self), buffer + bytesRead)) break;
+                bytesRead += (uint64_t)run * blockSize;
+                continue;
+            }
 
-            uint32_t physBlock = GetPhysicalBlock(self, file.inode, logicalBlock);
+            uint32_t physBlock = MapBlock(self, file, logicalBlock);
             if (physBlock == 0) break;
 
+            if (dataBuf == nullptr) {
+                dataBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+                if (!dataBuf) break;
+            }
             if (!ReadBlock(self, physBlock, dataBuf)) break;
 
             uint32_t available = blockSize - blockOff;
-            uint64_t toRead = size - bytesRead;
+            uint64_t toRead = remaining;
             if (toRead > available) toRead = available;
 
             memcpy(buffer + bytesRead, dataBuf + blockOff, toRead);
             bytesRead += toRead;
         }
 
-        Memory::g_pfa->Free(dataBuf);
+        if (dataBuf) Memory::g_pfa->Free(dataBuf);
         return (int)bytesRead;
     }
 
     static uint64_t GetSizeImpl(int inst, int handle) {
         if (inst < 0 || inst >= g_instanceCount) return 0;
         auto& self = g_instances[inst];
-        if (handle < 0 || handle >= MaxFilesPerInstance || !self.files[handle].inUse) return 0;
-        return self.files[handle].inode.i_size;
+        if (handle < 0 || handle >= self.fileCapacity || !FileSlot(self, handle).inUse) return 0;
+        return FileSlot(self, handle).node->inode.i_size;
+    }
+
+    static uint64_t GetFileIdImpl(int inst, int handle) {
+        if (inst < 0 || inst >= g_instanceCount) return 0;
+        auto& self = g_instances[inst];
+        if (handle < 0 || handle >= self.fileCapacity || !FileSlot(self, handle).inUse) return 0;
+        if (FileSlot(self, handle).isDirectory) return 0;
+        return FileSlot(self, handle).inodeNum;
     }
 
     static void CloseImpl(int inst, int handle) {
         if (inst < 0 || inst >= g_instanceCount) return;
         auto& self = g_instances[inst];
-        if (handle < 0 || handle >= MaxFilesPerInstance) return;
-        self.files[handle].inUse = false;
+        if (handle < 0 || handle >= self.fileCapacity) return;
+        auto& file = FileSlot(self, handle);
+        if (!file.inUse) return;
+        file.inUse = false;
+        file.mapValid = false;
+        if (file.node->refCount == 1) DiscardPrealloc(self, file.node);
+        ReleaseInode(self, file.node);
+        file.node = nullptr;
+        if (file.map != nullptr) {
+            Memory::g_heap->Free(file.map);
+            file.map = nullptr;
+        }
+        FlushAllocator(self);
     }
 
     static int ReadDirImpl(int inst, const char* path,
@@ -1100,89 +2524,228 @@ namespace Fs::Ext2 {
         int limit = maxEntries < MaxDirEntries ? maxEntries : MaxDirEntries;
         int count = ReadDirectoryEntries(self, inode, entries, limit);
 
-        self.dirNameCount = count;
+        // Size the packed name cache for this listing
+        int needed = 0;
+        for (int i = 0; i < count; i++) {
+            int len = 0;
+            while (entries[i].name[len] && len < MaxNameLen - 2) len++;
+            needed += len + 2;  // Room for a trailing '/' and the terminator
+        }
+        if (needed > self.dirNamesCapacity) {
+            if (self.dirNames != nullptr) Memory::g_heap->Free(self.dirNames);
+            self.dirNames = (char*)Memory::g_heap->Request(needed);
+            self.dirNamesCapacity = self.dirNames != nullptr ? needed : 0;
+            if (self.dirNames == nullptr) return -1;
+        }
+
+        // Copy names into persistent cache
+        char* out = self.dirNames;
         for (int i = 0; i < count; i++) {
             int j = 0;
             while (entries[i].name[j] && j < MaxNameLen - 2) {
-                self.dirNames[i][j] = entries[i].name[j];
+                out[j] = entries[i].name[j];
                 j++;
             }
             // Append trailing '/' for directories so userspace can distinguish them
-            if (entries[i].fileType == EXT2_FT_DIR && j < MaxNameLen - 1) {
-                self.dirNames[i][j++] = '/';
+            if (entries[i].fileType == EXT2_FT_DIR) {
+                out[j++] = '/';
             }
-            self.dirNames[i][j] = '\0';
-            outNames[i] = self.dirNames[i];
+            out[j] = '\0';
+            outNames[i] = out;
+            out += j + 1;
         }
 
         return count;
     }
 
+    // The cursor is the byte offset of the next directory record
+    static int ReadDirPlusImpl(int inst, const char* path, uint64_t* cursor,
+                               Vfs::DirEmitFn emit, void* ctx) {
+        if (inst < 0 || inst >= g_instanceCount) return -1;
+        auto& self = g_instances[inst];
+
+        uint32_t inodeNum;
+        Inode dirInode;
+        if (!TraversePath(self, path, &inodeNum, &dirInode)) return -1;
+        if ((dirInode.i_mode & IMODE_TYPE_MASK) != IMODE_DIR) return -1;
+
+        uint32_t dirSize = dirInode.i_size;
+        uint32_t blockSize = self.blockSize;
+        if (*cursor >= dirSize) return 0;
+
+        uint8_t* dirBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+        if (!dirBuf) return -1;
+
+        int result = 0;
+        uint32_t bi = (uint32_t)(*cursor / blockSize);
+        uint32_t pos = (uint32_t)(*cursor % blockSize);
+        for (; (uint64_t)bi * blockSize < dirSize; bi++, pos = 0) {
+            uint32_t physBlock = GetPhysicalBlock(self, dirInode, bi);
+            if (physBlock == 0 || !ReadBlock(self, physBlock, dirBuf)) continue;
+
+            uint32_t remaining = dirSize - bi * blockSize;
+            if (remaining > blockSize) remaining = blockSize;
+
+            while (pos + 8 <= remaining) {
+                DirEntry* de = (DirEntry*)(dirBuf + pos);
+                if (de->rec_len < 8 || pos + de->rec_len > blockSize) break;
+
+                const char* name = (const char*)de + sizeof(DirEntry);
+                int nameLen = de->name_len;
+                bool dot = name[0] == '.' && (nameLen == 1 || (nameLen == 2 && name[1] == '.'));
+
+                Inode child;
+                if (de->inode != 0 && nameLen > 0 && !dot && ReadInode(self, de->inode, &child)) {
+                    Vfs::DirEntryInfo info;
+                    info.Name = name;
+                    info.NameLen = nameLen;
+                    info.IsDirectory = (child.i_mode & IMODE_TYPE_MASK) == IMODE_DIR;
+                    info.Size = info.IsDirectory ? 0 : child.i_size;
+                    info.MTime = child.i_mtime;
+                    info.FileId = de->inode;
+                    if (!emit(ctx, info)) {
+                        result = 1;
+                        goto done;
+                    }
+                }
+
+                pos += de->rec_len;
+                *cursor = (uint64_t)bi * blockSize + pos;
+            }
+
+            // Past a damaged record, resume at the next block
+            *cursor = (uint64_t)(bi + 1) * blockSize;
+        }
+
+    done:
+        Memory::g_pfa->Free(dirBuf);
+        return result;
+    }
+
     static int WriteImpl(int inst, int handle, const uint8_t* buffer,
                           uint64_t offset, uint64_t size) {
         if (inst < 0 || inst >= g_instanceCount) return -1;
         auto& self = g_instances[inst];
-        if (handle < 0 || handle >= MaxFilesPerInstance || !self.files[handle].inUse) return -1;
+        if (handle < 0 || handle >= self.fileCapacity || !FileSlot(self, handle).inUse) return -1;
 
-        auto& file = self.files[handle];
+        auto& file = FileSlot(self, handle);
         if (file.isDirectory) return -1;
         if (size == 0) return 0;
 
         uint32_t blockSize = self.blockSize;
         uint32_t group = (file.inodeNum - 1) / self.inodesPerGroup;
 
-        // Allocate a separate buffer for data I/O
-        uint8_t* dataBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
-        if (!dataBuf) return -1;
-
+        uint32_t maxRun = MaxRunBlocks(self);
         uint64_t bytesWritten = 0;
 
+        // Bounce buffer for partial blocks, allocated on first use
+        uint8_t* dataBuf = nullptr;
+
+        // New block that broke the previous run; it opens the next one
+        uint32_t pending = 0;
+
         while (bytesWritten < size) {
             uint32_t logicalBlock = (uint32_t)((offset + bytesWritten) / blockSize);
             uint32_t blockOff = (uint32_t)((offset + bytesWritten) % blockSize);
+            uint64_t remaining = size - bytesWritten;
+
+            if (blockOff == 0 && remaining >= blockSize) {
+                // Whole blocks: map until the run breaks, then write it with
+                // one device request. Blocks filling holes are linked into the
+                // inode only once the write succeeded, so a run holds either
+                // mapped blocks or new ones, never both.
+                uint64_t whole = remaining / blockSize;
+                uint32_t limit = whole < maxRun ? (uint32_t)whole : maxRun;
+                uint32_t physStart = 0;
+                uint32_t run = 0;
+                bool fresh = false;
+
+                if (pending != 0) {
+                    physStart = pending;
+                    pending = 0;
+                    fresh = true;
+                    run = 1;
+                }
 
-            uint32_t physBlock = GetPhysicalBlock(self, file.inode, logicalBlock);
-
-            if (physBlock == 0) {
-                // Need to allocate a new block
-                physBlock = AllocateBlock(self, group);
-                if (physBlock == 0) break;
+                while (run < limit) {
+                    uint32_t physBlock = MapBlock(self, file, logicalBlock + run);
+                    bool isNew = physBlock == 0;
+                    if (isNew) {
+                        physBlock = AllocateFileBlock(self, file, logicalBlock + run, group,
+                                                      fresh ? physStart + run - 1 : 0);
+                        if (physBlock == 0) break;
+                    }
+                    if (run == 0) {
+                        physStart = physBlock;
+                        fresh = isNew;
+                    } else if (isNew != fresh || physBlock != physStart + run) {
+                        // Starts the next run
+                        if (isNew) pending = physBlock;
+                        break;
+                    }
+                    run++;
+                }
+                if (run == 0) break;
+
+                uint32_t done = WritePartSectors(self, BlockToPartSector(self, physStart),
+                                                 run * SectorsPerBlock(self), buffer + bytesWritten) ? run : 0;
+                if (fresh) {
+                    uint32_t linked = 0;
+                    while (linked < done && AssignBlock(self, file, logicalBlock + linked,
+                                                        physStart + linked, group)) linked++;
+                    for (uint32_t i = linked; i < run; i++) FreeBlock(self, physStart + i);
+                    done = linked;
+                }
 
-                // Zero the new block
-                memset(dataBuf, 0, blockSize);
-                WriteBlock(self, physBlock, dataBuf);
+                bytesWritten += (uint64_t)done * blockSize;
+                if (done < run) break;
+                continue;
+            }
 
-                if (!SetPhysicalBlock(self, file.inode, logicalBlock, physBlock, group)) {
-                    FreeBlock(self, physBlock);
-                    break;
-                }
-                file.inode.i_blocks += blockSize / 512;
+            if (dataBuf == nullptr) {
+                dataBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
+                if (!dataBuf) break;
             }
 
-            // Read existing block for partial writes
-            if (!ReadBlock(self, physBlock, dataBuf)) break;
+            uint32_t physBlock = MapBlock(self, file, logicalBlock);
+            bool isNew = physBlock == 0;
+            if (isNew) {
+                // New block: start from zeroes, nothing to read back. It is
+                // linked into the inode once written.
+                physBlock = AllocateFileBlock(self, file, logicalBlock, group);
+                if (physBlock == 0) break;
+                memset(dataBuf, 0, blockSize);
+            } else if (!ReadBlock(self, physBlock, dataBuf)) {
+                // Read existing block for partial writes
+                break;
+            }
 
             uint32_t available = blockSize - blockOff;
-            uint64_t toWrite = size - bytesWritten;
+            uint64_t toWrite = remaining;
             if (toWrite > available) toWrite = available;
 
             memcpy(dataBuf + blockOff, buffer + bytesWritten, toWrite);
-            if (!WriteBlock(self, physBlock, dataBuf)) break;
+            if (!WriteBlock(self, physBlock, dataBuf)
+                || (isNew && !AssignBlock(self, file, logicalBlock, physBlock, group))) {
+                if (isNew) FreeBlock(self, physBlock);
+                break;
+            }
 
             bytesWritten += toWrite;
         }
 
-        Memory::g_pfa->Free(dataBuf);
+        if (dataBuf) Memory::g_pfa->Free(dataBuf);
+        if (pending != 0) FreeBlock(self, pending, false);
 
         // Update file size if we wrote past the end
         uint64_t endPos = offset + bytesWritten;
-        if (endPos > file.inode.i_size) {
-            file.inode.i_size = (uint32_t)endPos;
+        if (endPos > file.node->inode.i_size) {
+            file.node->inode.i_size = (uint32_t)endPos;
         }
 
-        // Write updated inode to disk
+        // Inode goes back to disk when the last handle closes or on sync
         if (bytesWritten > 0) {
-            WriteInode(self, file.inodeNum, &file.inode);
+            file.node->dirty = true;
         }
 
         return (int)bytesWritten;
@@ -1216,18 +2779,9 @@ namespace Fs::Ext2 {
             existInode.i_size = 0;
             existInode.i_blocks = 0;
             WriteInode(self, existing.inodeNum, &existInode);
+            InvalidateBlockMaps(self, existing.inodeNum);
 
-            // Open a handle
-            for (int i = 0; i < MaxFilesPerInstance; i++) {
-                if (!self.files[i].inUse) {
-                    self.files[i].inUse = true;
-                    self.files[i].inodeNum = existing.inodeNum;
-                    self.files[i].inode = existInode;
-                    self.files[i].isDirectory = false;
-                    return i;
-                }
-            }
-            return -1;
+            return OpenInode(self, existing.inodeNum);
         }
 
         // Allocate a new inode
@@ -1249,18 +2803,7 @@ namespace Fs::Ext2 {
             return -1;
         }
 
-        // Open a handle
-        for (int i = 0; i < MaxFilesPerInstance; i++) {
-            if (!self.files[i].inUse) {
-                self.files[i].inUse = true;
-                self.files[i].inodeNum = newInodeNum;
-                self.files[i].inode = newInode;
-                self.files[i].isDirectory = false;
-                return i;
-            }
-        }
-
-        return -1;
+        return OpenInode(self, newInodeNum);
     }
 
     static int DeleteImpl(int inst, const char* path) {
@@ -1306,9 +2849,13 @@ namespace Fs::Ext2 {
         if (targetInode.i_links_count <= 0) {
             // Free all blocks and the inode
             FreeInodeBlocks(self, targetInode);
+            InvalidateBlockMaps(self, existing.inodeNum);
             targetInode.i_mode = 0;
             WriteInode(self, existing.inodeNum, &targetInode);
             FreeInode(self, existing.inodeNum);
+
+            // Writes the cleared inode and entry back before discarding
+            FlushDiscards(self);
         } else {
             WriteInode(self, existing.inodeNum, &targetInode);
         }
@@ -1417,24 +2964,47 @@ namespace Fs::Ext2 {
         uint32_t newGroup = (newInodeNum - 1) / self.inodesPerGroup;
         if (newGroup < self.groupCount) {
             self.bgdt[newGroup].bg_used_dirs_count++;
+            self.groupDirty[newGroup] |= GroupDescDirty;
+        }
+        FlushAllocator(self);
 
-            uint32_t bgdtBlock = self.firstDataBlock + 1;
-            uint32_t bgdtOffset = newGroup * sizeof(BlockGroupDescriptor);
-            uint32_t bgdtBlockIdx = bgdtBlock + bgdtOffset / self.blockSize;
-            uint32_t bgdtOffInBlock = bgdtOffset % self.blockSize;
+        return 0;
+    }
 
-            uint8_t* tmpBuf = (uint8_t*)Memory::g_pfa->AllocateZeroed();
-            if (tmpBuf) {
-                if (ReadBlock(self, bgdtBlockIdx, tmpBuf)) {
-                    memcpy(tmpBuf + bgdtOffInBlock, &self.bgdt[newGroup],
-                           sizeof(BlockGroupDescriptor));
-                    WriteBlock(self, bgdtBlockIdx, tmpBuf);
+    // Discard every free block of the volume. Returns bytes discarded.
+    static int64_t TrimImpl(int inst) {
+        if (inst < 0 || inst >= g_instanceCount || !g_instances[inst].active) return -1;
+        auto& self = g_instances[inst];
+        if (!self.canDiscard) return -1;
+
+        // Make the on-disk state match before freed blocks lose their data.
+        // Preallocation windows are marked used and so stay untouched.
+        FlushAllocator(self);
+        FlushInodes(self);
+        if (!Drivers::Storage::BlockCache::Flush(self.blockDevIndex)) return -1;
+        self.pendingDiscardCount = 0;
+
+        uint64_t discarded = 0;
+        for (uint32_t g = 0; g < self.groupCount; g++) {
+            if (self.bgdt[g].bg_free_blocks_count == 0) continue;
+
+            uint8_t* bitmap = GetBlockBitmap(self, g);
+            if (!bitmap) continue;
+
+            uint32_t blocksInGroup = BlocksInGroup(self, g);
+            uint32_t base = self.firstDataBlock + g * self.blocksPerGroup;
+            int32_t bit = FindFreeBit(bitmap, 0, blocksInGroup);
+            while (bit >= 0) {
+                uint32_t end = (uint32_t)bit + 1;
+                while (end < blocksInGroup && !(bitmap[end / 8] & (1 << (end % 8)))) end++;
+
+                if (DiscardBlocks(self, base + (uint32_t)bit, end - (uint32_t)bit)) {
+                    discarded += (uint64_t)(end - (uint32_t)bit) * self.blockSize;
                 }
-                Memory::g_pfa->Free(tmpBuf);
+                bit = FindFreeBit(bitmap, end, blocksInGroup);
             }
         }
-
-        return 0;
+        return (int64_t)discarded;
     }
 
     // =========================================================================
@@ -1451,6 +3021,11 @@ namespace Fs::Ext2 {
         static int Create(const char* p) { return CreateImpl(N, p); }
         static int Delete(const char* p) { return DeleteImpl(N, p); }
         static int Mkdir(const char* p) { return MkdirImpl(N, p); }
+        static uint64_t GetFileId(int h) { return GetFileIdImpl(N, h); }
+        static int Lookup(uint64_t d, const char* n, uint64_t* o, bool* i) { return LookupImpl(N, d, n, o, i); }
+        static int OpenNode(uint64_t n) { return OpenNodeImpl(N, n); }
+        static int64_t Trim() { return TrimImpl(N); }
+        static int ReadDirPlus(const char* p, uint64_t* c, Vfs::DirEmitFn e, void* x) { return ReadDirPlusImpl(N, p, c, e, x); }
     };
 
     template<int N>
@@ -1465,6 +3040,12 @@ namespace Fs::Ext2 {
             Thunks<N>::Create,
             Thunks<N>::Delete,
             Thunks<N>::Mkdir,
+            Thunks<N>::GetFileId,
+            Thunks<N>::Lookup,
+            Thunks<N>::OpenNode,
+            Thunks<N>::Trim,
+            nullptr,    // Map
+            Thunks<N>::ReadDirPlus,
         };
     }
 
@@ -1545,6 +3126,18 @@ namespace Fs::Ext2 {
             else break;
         }
 
+        // Index nodes are handled in single-page buffers
+        inst.dirIndex = (sb->s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) && blockSize <= 0x1000;
+        memcpy(inst.hashSeed, sb->s_hash_seed, sizeof(inst.hashSeed));
+        inst.defHashVersion = sb->s_def_hash_version;
+        inst.unsignedHash = (sb->s_flags & EXT2_FLAGS_UNSIGNED_HASH) != 0;
+
+        inst.gdtCsum = (sb->s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_GDT_CSUM) != 0;
+        inst.sparseSuper = (sb->s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER) != 0;
+        inst.reservedGdtBlocks = sb->s_reserved_gdt_blocks;
+        memcpy(inst.uuid, sb->s_uuid, sizeof(inst.uuid));
+        inst.lazyInitGroup = 0;
+
         // Allocate block buffer
         inst.blockBufPages = ((int)blockSize + 0xFFF) / 0x1000;
         if (inst.blockBufPages == 1) {
@@ -1578,6 +3171,7 @@ namespace Fs::Ext2 {
 
         // Read BGDT blocks
         uint32_t bgdtBlocks = (bgdtBytes + blockSize - 1) / blockSize;
+        inst.bgdtBlocks = bgdtBlocks;
         uint8_t* dst = (uint8_t*)inst.bgdt;
         for (uint32_t b = 0; b < bgdtBlocks; b++) {
             if (!ReadBlock(inst, bgdtStartBlock + b, inst.blockBuf)) {
@@ -1589,10 +3183,35 @@ namespace Fs::Ext2 {
             memcpy(dst + b * blockSize, inst.blockBuf, copyLen);
         }
 
-        // Clear file handles
-        for (int i = 0; i < MaxFilesPerInstance; i++) {
-            inst.files[i].inUse = false;
+        // Allocator state
+        inst.blockBitmaps = (uint8_t**)Memory::g_heap->Request(groupCount * sizeof(uint8_t*));
+        inst.groupDirty = (uint8_t*)Memory::g_heap->Request(groupCount);
+        inst.bitmapUse = (uint32_t*)Memory::g_heap->Request(groupCount * sizeof(uint32_t));
+        if (!inst.blockBitmaps || !inst.groupDirty || !inst.bitmapUse) {
+            inst.active = false;
+            return nullptr;
+        }
+        memset(inst.blockBitmaps, 0, groupCount * sizeof(uint8_t*));
+        memset(inst.groupDirty, 0, groupCount);
+        memset(inst.bitmapUse, 0, groupCount * sizeof(uint32_t));
+        inst.bitmapClock = 0;
+        inst.cachedBitmaps = 0;
+        inst.canDiscard = dev->Discard != nullptr;
+        inst.pendingDiscardCount = 0;
+
+        // Inode cache
+        inst.inodeCache = (CachedInode*)Memory::g_heap->Request(InodeCacheSize * sizeof(CachedInode));
+        if (!inst.inodeCache) {
+            inst.active = false;
+            return nullptr;
         }
+        memset(inst.inodeCache, 0, InodeCacheSize * sizeof(CachedInode));
+        for (int i = 0; i < InodeHashBuckets; i++) inst.inodeHash[i] = -1;
+        inst.inodeClock = 0;
+
+        // File handles are allocated on first open
+        memset(inst.fileChunks, 0, sizeof(inst.fileChunks));
+        inst.fileCapacity = 0;
 
         g_instanceCount++;
 
@@ -1603,6 +3222,56 @@ namespace Fs::Ext2 {
         return &g_drivers[idx];
     }
 
+    // Lazy inode table initialization: zero the never-used tail of one
+    // group's inode table and mark it zeroed. There are no kernel threads,
+    // so this advances a group per Sync() instead of in the background.
+    static void ZeroNextInodeTable(Ext2Instance& inst) {
+        if (!inst.gdtCsum) return;
+
+        auto* dev = Drivers::Storage::GetBlockDevice(inst.blockDevIndex);
+        if (!dev || !dev->WriteZeroes) return;
+
+        uint32_t inodesPerBlock = inst.blockSize / inst.inodeSize;
+        uint32_t tableBlocks = (inst.inodesPerGroup + inodesPerBlock - 1) / inodesPerBlock;
+
+        for (; inst.lazyInitGroup < inst.groupCount; inst.lazyInitGroup++) {
+            uint32_t g = inst.lazyInitGroup;
+            BlockGroupDescriptor& desc = inst.bgdt[g];
+            if (desc.bg_flags & EXT4_BG_INODE_ZEROED) continue;
+
+            // Blocks holding an inode below the unused tail may be live
+            uint32_t used = inst.inodesPerGroup - desc.bg_itable_unused;
+            uint32_t first = (used + inodesPerBlock - 1) / inodesPerBlock;
+            if (first < tableBlocks) {
+                uint32_t block = desc.bg_inode_table + first;
+                if (!dev->WriteZeroes(dev->Ctx, inst.partStartLba + BlockToPartSector(inst, block),
+                                      (uint64_t)(tableBlocks - first) * SectorsPerBlock(inst))) return;
+            }
+
+            desc.bg_flags |= EXT4_BG_INODE_ZEROED;
+            inst.groupDirty[g] |= GroupDescDirty;
+            inst.lazyInitGroup++;
+            FlushAllocator(inst);
+            return;
+        }
+    }
+
+    void Sync() {
+        for (int i = 0; i < g_instanceCount; i++) {
+            auto& inst = g_instances[i];
+            if (!inst.active) continue;
+
+            // Windows are not persistent; drop them so the bitmaps on disk are exact
+            for (int j = 0; j < InodeCacheSize; j++) {
+                if (inst.inodeCache[j].inodeNum != 0) DiscardPrealloc(inst, &inst.inodeCache[j]);
+            }
+            FlushAllocator(inst);
+            FlushInodes(inst);
+            FlushDiscards(inst);
+            ZeroNextInodeTable(inst);
+        }
+    }
+
     void RegisterProbe() {
         FsProbe::Register(Mount);
     }
@@ -1655,17 +3324,22 @@ namespace Fs::Ext2 {
         uint32_t bgdtBytes = groupCount * sizeof(BlockGroupDescriptor);
         uint32_t bgdtBlocks = (bgdtBytes + blockSize - 1) / blockSize;
 
-        // Allocate a block-sized buffer (1 page = 4K = blockSize)
-        uint8_t* buf = (uint8_t*)Memory::g_pfa->ReallocConsecutive(nullptr, 1);
+        // Nothing on the partition survives; let an SSD know up front
+        if (dev->Discard) dev->Discard(dev->Ctx, startLba, sectorCount);
+
+        // One page per block; the descriptor table is built whole and is the
+        // largest thing written, everything else needs at most three blocks
+        int bufPages = bgdtBlocks > 3 ? (int)bgdtBlocks : 3;
+        uint8_t* buf = (uint8_t*)Memory::g_pfa->ReallocConsecutive(nullptr, bufPages);
         if (!buf) return -1;
 
-        auto writeBlock = [&](uint32_t blockNum) -> bool {
+        auto writeBlocks = [&](uint32_t blockNum, uint32_t count) -> bool {
             uint64_t sector = startLba + (uint64_t)blockNum * sectorsPerBlock;
-            for (uint32_t s = 0; s < sectorsPerBlock; s++) {
-                if (!dev->WriteSectors(dev->Ctx, sector + s, 1, buf + s * 512))
-                    return false;
-            }
-            return true;
+            return dev->WriteSectors(dev->Ctx, sector, count * sectorsPerBlock, buf);
+        };
+        auto fail = [&]() -> int {
+            Memory::g_pfa->Free(buf, bufPages);
+            return -1;
         };
 
         // ---- Superblock (block 0, at byte offset 1024) ----
@@ -1700,9 +3374,11 @@ namespace Fs::Ext2 {
         sb->s_first_ino = 11;
         sb->s_inode_size = inodeSize;
         sb->s_block_group_nr = 0;
+        sb->s_feature_compat = EXT2_FEATURE_COMPAT_DIR_INDEX;
         sb->s_feature_incompat = 0x0002; // FILETYPE
+        sb->s_feature_ro_compat = EXT2_FEATURE_RO_COMPAT_GDT_CSUM;
 
-        // Generate UUID from RDTSC
+        // Generate UUID and directory hash seed from RDTSC
         uint32_t lo, hi;
         asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
         uint32_t seed = lo ^ hi;
@@ -1710,6 +3386,16 @@ namespace Fs::Ext2 {
             seed = seed * 1103515245 + 12345;
             sb->s_uuid[i] = (uint8_t)(seed >> 16);
         }
+        for (int i = 0; i < 4; i++) {
+            seed = seed * 1103515245 + 12345;
+            sb->s_hash_seed[i] = seed ^ ((seed >> 16) * 0x9E3779B9);
+        }
+        sb->s_def_hash_version = DX_HASH_HALF_MD4;
+        sb->s_flags = EXT2_FLAGS_SIGNED_HASH;
+
+        // Descriptor checksums are keyed on the UUID
+        uint8_t uuid[16];
+        memcpy(uuid, sb->s_uuid, sizeof(uuid));
 
         memset(sb->s_volume_name, 0, 16);
         if (volumeLabel) {
@@ -1717,52 +3403,51 @@ namespace Fs::Ext2 {
                 sb->s_volume_name[i] = volumeLabel[i];
         }
 
-        if (!writeBlock(0)) { Memory::g_pfa->Free(buf, 1); return -1; }
-
-        // ---- BGDT (block 1..) ----
-        for (uint32_t b = 0; b < bgdtBlocks; b++) {
-            memset(buf, 0, blockSize);
-
-            uint32_t entriesPerBlock = blockSize / sizeof(BlockGroupDescriptor);
-            uint32_t startEntry = b * entriesPerBlock;
+        if (!writeBlocks(0, 1)) return fail();
 
-            for (uint32_t e = 0; e < entriesPerBlock && (startEntry + e) < groupCount; e++) {
-                uint32_t g = startEntry + e;
-                BlockGroupDescriptor* bgd = (BlockGroupDescriptor*)(buf + e * sizeof(BlockGroupDescriptor));
+        // ---- BGDT (block 1..), one write ----
+        // Groups past the first are left uninitialized (uninit_bg): no inode
+        // bitmap, and no inode table contents until inodes are allocated or
+        // the driver zeroes the table lazily. That is what used to make
+        // formatting take minutes on large partitions.
+        memset(buf, 0, (uint64_t)bgdtBlocks * blockSize);
+        for (uint32_t g = 0; g < groupCount; g++) {
+            BlockGroupDescriptor* bgd = (BlockGroupDescriptor*)buf + g;
 
-                uint32_t groupBase = g * blocksPerGroup;
-                uint32_t metaStart = (g == 0) ? groupBase + 1 + bgdtBlocks : groupBase;
+            uint32_t groupBase = g * blocksPerGroup;
+            uint32_t metaStart = (g == 0) ? groupBase + 1 + bgdtBlocks : groupBase;
 
-                bgd->bg_block_bitmap = metaStart;
-                bgd->bg_inode_bitmap = metaStart + 1;
-                bgd->bg_inode_table  = metaStart + 2;
+            bgd->bg_block_bitmap = metaStart;
+            bgd->bg_inode_bitmap = metaStart + 1;
+            bgd->bg_inode_table  = metaStart + 2;
 
-                uint32_t groupBlocks = (g < groupCount - 1) ? blocksPerGroup
-                    : (totalBlocks - g * blocksPerGroup);
-                uint32_t overhead = 2 + inodeTableBlocks;
-                if (g == 0) overhead += 1 + bgdtBlocks + 1; // sb+bgdt + root data
-                bgd->bg_free_blocks_count = (uint16_t)(groupBlocks - overhead);
+            uint32_t groupBlocks = (g < groupCount - 1) ? blocksPerGroup
+                : (totalBlocks - g * blocksPerGroup);
+            uint32_t overhead = 2 + inodeTableBlocks;
+            if (g == 0) overhead += 1 + bgdtBlocks + 1; // sb+bgdt + root data
+            bgd->bg_free_blocks_count = (uint16_t)(groupBlocks - overhead);
 
-                if (g == 0) {
-                    bgd->bg_free_inodes_count = (uint16_t)(inodesPerGroup - reservedInodeCount);
-                    bgd->bg_used_dirs_count = 1;
-                } else {
-                    bgd->bg_free_inodes_count = (uint16_t)inodesPerGroup;
-                    bgd->bg_used_dirs_count = 0;
-                }
+            if (g == 0) {
+                bgd->bg_free_inodes_count = (uint16_t)(inodesPerGroup - reservedInodeCount);
+                bgd->bg_used_dirs_count = 1;
+                bgd->bg_itable_unused = (uint16_t)(inodesPerGroup - reservedInodeCount);
+            } else {
+                bgd->bg_free_inodes_count = (uint16_t)inodesPerGroup;
+                bgd->bg_used_dirs_count = 0;
+                bgd->bg_flags = EXT4_BG_INODE_UNINIT;
+                bgd->bg_itable_unused = (uint16_t)inodesPerGroup;
             }
-
-            if (!writeBlock(1 + b)) { Memory::g_pfa->Free(buf, 1); return -1; }
+            bgd->bg_checksum = GroupChecksum(uuid, g, *bgd);
         }
+        if (!writeBlocks(1, bgdtBlocks)) return fail();
 
-        // ---- Per-group bitmaps and inode tables ----
+        // ---- Per-group block bitmaps ----
         for (uint32_t g = 0; g < groupCount; g++) {
             uint32_t groupBase = g * blocksPerGroup;
             uint32_t metaStart = (g == 0) ? groupBase + 1 + bgdtBlocks : groupBase;
             uint32_t groupBlocks = (g < groupCount - 1) ? blocksPerGroup
                 : (totalBlocks - g * blocksPerGroup);
 
-            // Block bitmap
             memset(buf, 0, blockSize);
             uint32_t overhead = 2 + inodeTableBlocks;
             if (g == 0) overhead += 1 + bgdtBlocks;
@@ -1775,61 +3460,57 @@ namespace Fs::Ext2 {
             // Mark blocks beyond group end as used (last group)
             for (uint32_t bit = groupBlocks; bit < blocksPerGroup; bit++)
                 buf[bit / 8] |= (1 << (bit % 8));
-            if (!writeBlock(metaStart)) { Memory::g_pfa->Free(buf, 1); return -1; }
 
-            // Inode bitmap
-            memset(buf, 0, blockSize);
-            if (g == 0) {
-                for (uint32_t bit = 0; bit < reservedInodeCount; bit++)
-                    buf[bit / 8] |= (1 << (bit % 8));
-            }
-            if (!writeBlock(metaStart + 1)) { Memory::g_pfa->Free(buf, 1); return -1; }
-
-            // Inode table
-            for (uint32_t tb = 0; tb < inodeTableBlocks; tb++) {
-                memset(buf, 0, blockSize);
-
-                if (g == 0 && tb == 0) {
-                    // Root directory inode (inode 2 = index 1)
-                    uint32_t rootDataBlock = 1 + bgdtBlocks + 2 + inodeTableBlocks;
-                    Inode* ri = (Inode*)(buf + 1 * inodeSize);
-                    ri->i_mode = IMODE_DIR | 0x01FF;
-                    ri->i_size = blockSize;
-                    ri->i_links_count = 2;
-                    ri->i_blocks = blockSize / 512;
-                    ri->i_block[0] = rootDataBlock;
-                }
-
-                if (!writeBlock(metaStart + 2 + tb)) { Memory::g_pfa->Free(buf, 1); return -1; }
+            if (g != 0) {
+                if (!writeBlocks(metaStart, 1)) return fail();
+                continue;
             }
 
-            // Root directory data block (group 0 only)
-            if (g == 0) {
-                uint32_t rootDataBlock = 1 + bgdtBlocks + 2 + inodeTableBlocks;
-                memset(buf, 0, blockSize);
-
-                // "."
-                DirEntry* dot = (DirEntry*)buf;
-                dot->inode = EXT2_ROOT_INODE;
-                dot->rec_len = 12;
-                dot->name_len = 1;
-                dot->file_type = EXT2_FT_DIR;
-                buf[sizeof(DirEntry)] = '.';
-
-                // ".."
-                DirEntry* dotdot = (DirEntry*)(buf + 12);
-                dotdot->inode = EXT2_ROOT_INODE;
-                dotdot->rec_len = blockSize - 12;
-                dotdot->name_len = 2;
-                dotdot->file_type = EXT2_FT_DIR;
-                buf[12 + sizeof(DirEntry)] = '.';
-                buf[12 + sizeof(DirEntry) + 1] = '.';
-
-                if (!writeBlock(rootDataBlock)) { Memory::g_pfa->Free(buf, 1); return -1; }
-            }
+            // Group 0 also needs its inode bitmap and the inode table block
+            // holding the reserved inodes; all three are adjacent
+            uint8_t* inodeBitmap = buf + blockSize;
+            memset(inodeBitmap, 0, 2 * blockSize);
+            for (uint32_t bit = 0; bit < reservedInodeCount; bit++)
+                inodeBitmap[bit / 8] |= (1 << (bit % 8));
+            for (uint32_t bit = inodesPerGroup; bit < blockSize * 8; bit++)
+                inodeBitmap[bit / 8] |= (1 << (bit % 8));
+
+            // Root directory inode (inode 2 = index 1)
+            uint32_t rootDataBlock = 1 + bgdtBlocks + 2 + inodeTableBlocks;
+            Inode* ri = (Inode*)(buf + 2 * blockSize + 1 * inodeSize);
+            ri->i_mode = IMODE_DIR | 0x01FF;
+            ri->i_size = blockSize;
+            ri->i_links_count = 2;
+            ri->i_blocks = blockSize / 512;
+            ri->i_block[0] = rootDataBlock;
+
+            if (!writeBlocks(metaStart, 3)) return fail();
         }
 
-        Memory::g_pfa->Free(buf, 1);
+        // ---- Root directory data block ----
+        uint32_t rootDataBlock = 1 + bgdtBlocks + 2 + inodeTableBlocks;
+        memset(buf, 0, blockSize);
+
+        // "."
+        DirEntry* dot = (DirEntry*)buf;
+        dot->inode = EXT2_ROOT_INODE;
+        dot->rec_len = 12;
+        dot->name_len = 1;
+        dot->file_type = EXT2_FT_DIR;
+        buf[sizeof(DirEntry)] = '.';
+
+        // ".."
+        DirEntry* dotdot = (DirEntry*)(buf + 12);
+        dotdot->inode = EXT2_ROOT_INODE;
+        dotdot->rec_len = blockSize - 12;
+        dotdot->name_len = 2;
+        dotdot->file_type = EXT2_FT_DIR;
+        buf[12 + sizeof(DirEntry)] = '.';
+        buf[12 + sizeof(DirEntry) + 1] = '.';
+
+        if (!writeBlocks(rootDataBlock, 1)) return fail();
+
+        Memory::g_pfa->Free(buf, bufPages);
 
         KernelLogStream(OK, "Ext2") << "Formatted: " << (uint64_t)totalBlocks
             << " blocks (4K), " << (uint64_t)groupCount
@@ -14,6 +14,10 @@ namespace Fs::Ext2 {
     // Returns a FsDriver* on success, nullptr if not a valid ext2 volume.
     Vfs::FsDriver* Mount(int blockDevIndex, uint64_t startLba, uint64_t sectorCount);
 
+    // Write cached inodes of all mounted volumes back to their devices
+    // (into the block cache; flush that afterwards for durability).
+    void Sync();
+
     // Register Ext2::Mount as a filesystem probe with FsProbe.
     void RegisterProbe();
 
@@ -7,9 +7,11 @@
 #include "Fat32.hpp"
 #include "FsProbe.hpp"
 #include <Drivers/Storage/BlockDevice.hpp>
+#include <Drivers/Storage/BlockCache.hpp>
 #include <Terminal/Terminal.hpp>
 #include <Libraries/Memory.hpp>
 #include <Memory/PageFrameAllocator.hpp>
+#include <Memory/Heap.hpp>
 
 using namespace Kt;
 
@@ -20,7 +22,8 @@ namespace Fs::Fat32 {
     // =========================================================================
 
     static constexpr int MaxInstances = 8;
-    static constexpr int MaxFilesPerInstance = 16;
+    static constexpr int FileChunkSize = 16;
+    static constexpr int MaxFilesPerInstance = 256;
     static constexpr int MaxDirEntries = 128;
     static constexpr int MaxNameLen = 256;
 
@@ -38,10 +41,23 @@ namespace Fs::Fat32 {
     static constexpr uint32_t CLUSTER_BAD     = 0x0FFFFFF7;
     static constexpr uint32_t CLUSTER_END_MIN = 0x0FFFFFF8;
 
+    // Longest free run AllocateCluster looks for ahead of a growing file
+    static constexpr uint32_t MaxRunSearch = 1024;
+
+    // Freed cluster runs batched per instance before they are discarded
+    static constexpr int MaxPendingDiscards = 32;
+
     // =========================================================================
     // Types
     // =========================================================================
 
+    // Physically contiguous stretch of a cluster chain
+    struct ClusterRun {
+        uint32_t firstIdx;      // Chain index of the run's first cluster
+        uint32_t cluster;       // Its cluster number
+        uint32_t length;        // Clusters in the run
+    };
+
     struct Fat32File {
         bool     inUse;
         uint32_t firstCluster;
@@ -50,9 +66,19 @@ namespace Fs::Fat32 {
         // Location of the 32-byte SFN directory entry on disk
         uint64_t sfnPartSector;   // partition-relative sector
         uint32_t sfnOffInSector;  // byte offset within that sector
-        // Cached position for sequential access (avoids O(n²) chain walks)
-        uint32_t cachedClusterIdx;  // cluster index in chain
-        uint32_t cachedCluster;     // cluster number at that index
+        // Run map of the cluster chain, sorted by chain index: built on first
+        // use, extended as the handle appends, heap-allocated
+        ClusterRun* runs;
+        uint32_t    runCount;
+        uint32_t    runCapacity;
+        uint32_t    chainLength;  // Clusters covered by the map
+        bool        runsValid;
+    };
+
+    // Run of freed clusters awaiting a device discard
+    struct DiscardExtent {
+        uint32_t start;
+        uint32_t count;
     };
 
     struct Fat32Instance {
@@ -84,12 +110,33 @@ namespace Fs::Fat32 {
         int       fatCachePages;
         uint32_t  fatCacheEntries;  // number of valid 4-byte entries
 
-        // Open file handles
-        Fat32File files[MaxFilesPerInstance];
-
-        // ReadDir name cache
-        char dirNames[MaxDirEntries][MaxNameLen];
-        int  dirNameCount;
+        // FAT changes made in fatCache and not yet on disk, one bit per FAT
+        // sector (heap-allocated); written back by FlushFat on close and Sync()
+        uint64_t* fatDirty;
+
+        // Free-cluster bitmap derived from fatCache at mount, one bit per
+        // cluster number, set = in use (page-allocated)
+        uint64_t* usedMap;
+        int       usedMapPages;
+        uint32_t  freeCount;
+        uint32_t  nextFree;         // FSInfo next-free hint
+        uint16_t  fsInfoSector;     // 0 = none
+        bool      fsInfoDirty;
+
+        // Clusters freed since the last discard; sent on delete, truncate,
+        // Sync() and Trim. Only tracked alongside usedMap.
+        bool          canDiscard;
+        DiscardExtent pendingDiscards[MaxPendingDiscards];
+        int           pendingDiscardCount;
+
+        // Open file handles, heap-allocated FileChunkSize at a time. Chunks
+        // never move, so callers may hold a slot reference across I/O.
+        Fat32File* fileChunks[MaxFilesPerInstance / FileChunkSize];
+        int        fileCapacity;
+
+        // ReadDir name cache (packed, heap-allocated on first use)
+        char* dirNames;
+        int   dirNamesCapacity;
     };
 
     struct ParsedEntry {
@@ -109,6 +156,10 @@ namespace Fs::Fat32 {
     static Fat32Instance g_instances[MaxInstances] = {};
     static int g_instanceCount = 0;
 
+    static Fat32File& FileSlot(Fat32Instance& inst, int handle) {
+        return inst.fileChunks[handle / FileChunkSize][handle % FileChunkSize];
+    }
+
     // =========================================================================
     // Low-level helpers
     // =========================================================================
@@ -173,7 +224,97 @@ namespace Fs::Fat32 {
                                 inst.sectorsPerCluster, data);
     }
 
+    // Remember a freed cluster for the next FlushDiscards. Chains freed in
+    // order extend the last extent; once the list is full further frees are
+    // left for Trim to pick up.
+    static void QueueDiscard(Fat32Instance& inst, uint32_t cluster) {
+        if (inst.pendingDiscardCount > 0) {
+            DiscardExtent& last = inst.pendingDiscards[inst.pendingDiscardCount - 1];
+            if (last.start + last.count == cluster) {
+                last.count++;
+                return;
+            }
+            if (last.start == cluster + 1) {
+                last.start--;
+                last.count++;
+                return;
+            }
+        }
+        if (inst.pendingDiscardCount >= MaxPendingDiscards) return;
+
+        inst.pendingDiscards[inst.pendingDiscardCount++] = { cluster, 1 };
+    }
+
+    // A pending cluster was allocated again before its discard went out
+    static void ClaimPending(Fat32Instance& inst, uint32_t cluster) {
+        for (int i = 0; i < inst.pendingDiscardCount; i++) {
+            DiscardExtent& e = inst.pendingDiscards[i];
+            if (cluster < e.start || cluster >= e.start + e.count) continue;
+
+            uint32_t tail = e.start + e.count - (cluster + 1);
+            e.count = cluster - e.start;
+
+            if (tail > 0) {
+                if (e.count == 0) {
+                    e = { cluster + 1, tail };
+                    return;
+                }
+                // Split; with no room the tail is left for Trim
+                if (inst.pendingDiscardCount < MaxPendingDiscards) {
+                    inst.pendingDiscards[inst.pendingDiscardCount++] = { cluster + 1, tail };
+                }
+            }
+            if (e.count == 0) {
+                inst.pendingDiscards[i] = inst.pendingDiscards[--inst.pendingDiscardCount];
+            }
+            return;
+        }
+    }
+
+    static bool DiscardClusters(const Fat32Instance& inst, uint32_t first, uint32_t count) {
+        auto* dev = Drivers::Storage::GetBlockDevice(inst.blockDevIndex);
+        if (!dev || !dev->Discard) return false;
+        return dev->Discard(dev->Ctx, inst.partStartLba + ClusterToPartSector(inst, first),
+                            (uint64_t)count * inst.sectorsPerCluster);
+    }
+
+    static bool ClusterInUse(const Fat32Instance& inst, uint32_t cluster) {
+        return (inst.usedMap[cluster / 64] >> (cluster % 64)) & 1;
+    }
+
+    // Keep the free-cluster bitmap and count in step with a FAT entry change
+    static void TrackFree(Fat32Instance& inst, uint32_t cluster, uint32_t oldValue, uint32_t newValue) {
+        if (!inst.usedMap || cluster < 2 || cluster >= inst.clusterCount + 2) return;
+
+        bool wasFree = (oldValue & 0x0FFFFFFF) == CLUSTER_FREE;
+        bool isFree = (newValue & 0x0FFFFFFF) == CLUSTER_FREE;
+        if (wasFree == isFree) return;
+
+        if (isFree) {
+            inst.usedMap[cluster / 64] &= ~(1ULL << (cluster % 64));
+            inst.freeCount++;
+            if (inst.canDiscard) QueueDiscard(inst, cluster);
+        } else {
+            inst.usedMap[cluster / 64] |= 1ULL << (cluster % 64);
+            inst.freeCount--;
+            if (inst.pendingDiscardCount > 0) ClaimPending(inst, cluster);
+        }
+        inst.fsInfoDirty = true;
+    }
+
     static bool WriteFatEntry(Fat32Instance& inst, uint32_t cluster, uint32_t value) {
+        // With the FAT in memory the change is recorded there and its sector
+        // is written to every FAT copy by the next FlushFat
+        if (inst.fatCache && inst.fatDirty && cluster < inst.fatCacheEntries) {
+            uint32_t existing = inst.fatCache[cluster];
+            inst.fatCache[cluster] = (existing & 0xF0000000) | (value & 0x0FFFFFFF);
+            TrackFree(inst, cluster, existing, value);
+
+            uint32_t sector = cluster * 4 / inst.bytesPerSector;
+            inst.fatDirty[sector / 64] |= 1ULL << (sector % 64);
+            return true;
+        }
+
         uint32_t fatOffset = cluster * 4;
         uint32_t fatSector = fatOffset / inst.bytesPerSector;
         uint32_t entryOffset = fatOffset % inst.bytesPerSector;
@@ -203,7 +344,67 @@ namespace Fs::Fat32 {
         return true;
     }
 
-    static uint32_t AllocateCluster(Fat32Instance& inst) {
+    // Start of the first run of `wanted` free clusters at or after `start`,
+    // wrapping around the volume once. Falls back to the first free cluster
+    // seen when no run is long enough; 0 if the volume is full.
+    static uint32_t FindFreeClusters(const Fat32Instance& inst, uint32_t start, uint32_t wanted) {
+        uint32_t end = inst.clusterCount + 2;
+        if (start < 2 || start >= end) start = 2;
+        if (wanted > MaxRunSearch) wanted = MaxRunSearch;
+
+        uint32_t firstFree = 0;
+        uint32_t runStart = 0, runLength = 0;
+        uint32_t cluster = start;
+        for (uint32_t scanned = 0; scanned < end - 2; ) {
+            if (cluster == end) {
+                cluster = 2;
+                runLength = 0;  // Runs do not wrap
+            }
+
+            // Skip fully used words
+            if ((cluster % 64) == 0 && cluster + 64 <= end && inst.usedMap[cluster / 64] == ~0ULL) {
+                cluster += 64;
+                scanned += 64;
+                runLength = 0;
+                continue;
+            }
+
+            if (!ClusterInUse(inst, cluster)) {
+                if (firstFree == 0) firstFree = cluster;
+                if (runLength == 0) runStart = cluster;
+                if (++runLength >= wanted) return runStart;
+            } else {
+                runLength = 0;
+            }
+            cluster++;
+            scanned++;
+        }
+        return firstFree;
+    }
+
+    // Allocate a cluster and mark it end-of-chain. `goal` (usually the
+    // cluster after the chain's current tail) is taken when free; otherwise
+    // the search starts at the FSInfo next-free hint and prefers the start
+    // of a free run of `wanted` clusters so the caller can keep extending
+    // the chain contiguously.
+    static uint32_t AllocateCluster(Fat32Instance& inst, uint32_t goal = 0, uint32_t wanted = 1) {
+        if (inst.usedMap) {
+            if (inst.freeCount == 0) return 0;
+
+            uint32_t cluster;
+            if (goal >= 2 && goal < inst.clusterCount + 2 && !ClusterInUse(inst, goal)) {
+                cluster = goal;
+            } else {
+                cluster = FindFreeClusters(inst, inst.nextFree, wanted);
+            }
+            if (cluster == 0) return 0;
+
+            if (!WriteFatEntry(inst, cluster, 0x0FFFFFFF)) return 0;
+            inst.nextFree = cluster + 1;
+            inst.fsInfoDirty = true;
+            return cluster;
+        }
+
         // Fast path: scan the in-memory FAT cache
         if (inst.fatCache) {
             uint32_t limit = inst.clusterCount + 2;
@@ -241,6 +442,69 @@ namespace Fs::Fat32 {
         return 0;
     }
 
+    // Write dirty FAT sectors to every FAT copy, each stretch of adjacent
+    // dirty sectors in one request, then the FSInfo free count and hint
+    static void FlushFat(Fat32Instance& inst) {
+        if (inst.fatDirty) {
+            uint32_t sector = 0;
+            while (sector < inst.fatSize32) {
+                if (inst.fatDirty[sector / 64] == 0) {
+                    sector = (sector / 64 + 1) * 64;
+                    continue;
+                }
+                if (!((inst.fatDirty[sector / 64] >> (sector % 64)) & 1)) {
+                    sector++;
+                    continue;
+                }
+
+                uint32_t first = sector;
+                while (sector < inst.fatSize32 && ((inst.fatDirty[sector / 64] >> (sector % 64)) & 1)) sector++;
+                uint32_t count = sector - first;
+
+                const uint8_t* src = (const uint8_t*)inst.fatCache + (uint64_t)first * inst.bytesPerSector;
+                bool ok = true;
+                for (int f = 0; f < inst.numFats; f++) {
+                    uint64_t fatStart = inst.reservedSectors + (uint64_t)f * inst.fatSize32;
+                    if (!WritePartSectors(inst, fatStart + first, count, src)) ok = false;
+                }
+                if (!ok) continue;
+
+                for (uint32_t s = first; s < sector; s++) inst.fatDirty[s / 64] &= ~(1ULL << (s % 64));
+            }
+        }
+
+        if (inst.fsInfoDirty && inst.fsInfoSector != 0) {
+            uint8_t sectorBuf[512];
+            if (!ReadPartSectors(inst, inst.fsInfoSector, 1, sectorBuf)) return;
+
+            uint32_t sig1, sig2;
+            memcpy(&sig1, sectorBuf + 0, 4);
+            memcpy(&sig2, sectorBuf + 484, 4);
+            if (sig1 != 0x41615252 || sig2 != 0x61417272) return;
+
+            memcpy(sectorBuf + 488, &inst.freeCount, 4);
+            memcpy(sectorBuf + 492, &inst.nextFree, 4);
+            if (WritePartSectors(inst, inst.fsInfoSector, 1, sectorBuf)) inst.fsInfoDirty = false;
+        }
+    }
+
+    // Send the batched discards. The directory entry and FAT updates that
+    // freed the clusters may still be dirty in the FAT cache or the block
+    // cache; a discard reaching the device first would leave on-disk
+    // metadata pointing at erased clusters after a crash. So everything is
+    // written back first, and the discards wait if that fails.
+    static void FlushDiscards(Fat32Instance& inst) {
+        if (inst.pendingDiscardCount == 0) return;
+
+        FlushFat(inst);
+        if (!Drivers::Storage::BlockCache::Flush(inst.blockDevIndex)) return;
+
+        for (int i = 0; i < inst.pendingDiscardCount; i++) {
+            DiscardClusters(inst, inst.pendingDiscards[i].start, inst.pendingDiscards[i].count);
+        }
+        inst.pendingDiscardCount = 0;
+    }
+
     // Update the file size field in a file's SFN directory entry on disk
     static bool UpdateDirEntrySize(Fat32Instance& inst, const Fat32File& file) {
         uint8_t sectorBuf[512];
@@ -262,6 +526,111 @@ namespace Fs::Fat32 {
         return WritePartSectors(inst, file.sfnPartSector, 1, sectorBuf);
     }
 
+    // =========================================================================
+    // Cluster run map
+    // =========================================================================
+
+    // Append chain index `idx` (the next one) to a file's run map
+    static bool AppendRun(Fat32File& file, uint32_t idx, uint32_t cluster) {
+        if (file.runCount > 0) {
+            ClusterRun& last = file.runs[file.runCount - 1];
+            if (last.firstIdx + last.length == idx && last.cluster + last.length == cluster) {
+                last.length++;
+                file.chainLength = idx + 1;
+                return true;
+            }
+        }
+
+        if (file.runCount == file.runCapacity) {
+            uint32_t capacity = file.runCapacity ? file.runCapacity * 2 : 8;
+            ClusterRun* grown = (ClusterRun*)Memory::g_heap->Realloc(file.runs, capacity * sizeof(ClusterRun));
+            if (!grown) return false;
+            file.runs = grown;
+            file.runCapacity = capacity;
+        }
+
+        file.runs[file.runCount].firstIdx = idx;
+        file.runs[file.runCount].cluster = cluster;
+        file.runs[file.runCount].length = 1;
+        file.runCount++;
+        file.chainLength = idx + 1;
+        return true;
+    }
+
+    // Walk the whole chain once, collapsing it into contiguous runs
+    static bool BuildRunMap(Fat32Instance& inst, Fat32File& file) {
+        file.runCount = 0;
+        file.chainLength = 0;
+        file.runsValid = false;
+
+        uint32_t cluster = file.firstCluster;
+        for (uint32_t idx = 0; !IsEndOfChain(cluster) && idx <= inst.clusterCount; idx++) {
+            if (!AppendRun(file, idx, cluster)) return false;
+            cluster = GetNextCluster(inst, cluster);
+        }
+
+        file.runsValid = true;
+        return true;
+    }
+
+    // Cluster at chain index `idx`, and how many clusters starting there are
+    // physically contiguous. Returns 0 past the end of the chain.
+    static uint32_t MapCluster(Fat32Instance& inst, Fat32File& file, uint32_t idx,
+                               uint32_t* contiguous) {
+        if (!file.runsValid && !BuildRunMap(inst, file)) {
+            // No memory for the map: walk the chain
+            uint32_t cluster = file.firstCluster;
+            for (uint32_t i = 0; i < idx && !IsEndOfChain(cluster); i++) {
+                cluster = GetNextCluster(inst, cluster);
+            }
+            *contiguous = 1;
+            return IsEndOfChain(cluster) ? 0 : cluster;
+        }
+
+        if (idx >= file.chainLength) return 0;
+
+        // Last run starting at or before idx
+        uint32_t lo = 0, hi = file.runCount;
+        while (hi - lo > 1) {
+            uint32_t mid = (lo + hi) / 2;
+            if (file.runs[mid].firstIdx <= idx) lo = mid;
+            else hi = mid;
+        }
+
+        const ClusterRun& run = file.runs[lo];
+        *contiguous = run.length - (idx - run.firstIdx);
+        return run.cluster + (idx - run.firstIdx);
+    }
+
+    static uint32_t ChainLength(Fat32Instance& inst, Fat32File& file) {
+        if (file.runsValid || BuildRunMap(inst, file)) return file.chainLength;
+
+        uint32_t length = 0;
+        for (uint32_t cluster = file.firstCluster; !IsEndOfChain(cluster) && length <= inst.clusterCount; length++) {
+            cluster = GetNextCluster(inst, cluster);
+        }
+        return length;
+    }
+
+    // Record a cluster just linked at the end of this handle's chain
+    static void NoteAppended(Fat32File& file, uint32_t idx, uint32_t cluster) {
+        if (!file.runsValid) return;
+        if (idx != file.chainLength || !AppendRun(file, idx, cluster)) file.runsValid = false;
+    }
+
+    // Drop the run maps of every handle on the file whose SFN entry is at the
+    // given location, except `keep`
+    static void InvalidateRunMaps(Fat32Instance& inst, uint64_t sfnPartSector,
+                                  uint32_t sfnOffInSector, const Fat32File* keep) {
+        for (int i = 0; i < inst.fileCapacity; i++) {
+            auto& f = FileSlot(inst, i);
+            if (f.inUse && &f != keep && f.sfnPartSector == sfnPartSector &&
+                f.sfnOffInSector == sfnOffInSector) {
+                f.runsValid = false;
+            }
+        }
+    }
+
     // =========================================================================
     // Short name generation and LFN helpers for Create
     // =========================================================================
@@ -486,7 +855,7 @@ namespace Fs::Fat32 {
         }
 
         // No room — extend directory with a new cluster
-        uint32_t newCluster = AllocateCluster(self);
+        uint32_t newCluster = AllocateCluster(self, prevCluster != 0 ? prevCluster + 1 : 0);
         if (newCluster == 0) return {0, 0, false};
 
         // Link previous last cluster to new one
@@ -783,6 +1152,8 @@ namespace Fs::Fat32 {
             out->attributes = ATTR_DIRECTORY;
             out->name[0] = '/';
             out->name[1] = '\0';
+            out->sfnPartSector = 0;
+            out->sfnOffInSector = 0;
             return true;
         }
 
@@ -823,38 +1194,119 @@ namespace Fs::Fat32 {
     // FsDriver implementation functions
     // =========================================================================
 
+    // Free slot in the open-file table, adding a chunk (up to
+    // MaxFilesPerInstance) when every slot is taken
+    static int AllocFileSlot(Fat32Instance& self) {
+        for (int i = 0; i < self.fileCapacity; i++) {
+            if (!FileSlot(self, i).inUse) return i;
+        }
+        if (self.fileCapacity >= MaxFilesPerInstance) return -1;
+
+        auto* chunk = (Fat32File*)Memory::g_heap->Request(FileChunkSize * sizeof(Fat32File));
+        if (!chunk) return -1;
+        memset(chunk, 0, FileChunkSize * sizeof(Fat32File));
+
+        int slot = self.fileCapacity;
+        self.fileChunks[slot / FileChunkSize] = chunk;
+        self.fileCapacity += FileChunkSize;
+        return slot;
+    }
+
+    // Open a handle on the file whose SFN entry is at the given location
+    static int OpenFile(Fat32Instance& self, uint32_t firstCluster, uint32_t fileSize,
+                        bool isDirectory, uint64_t sfnPartSector, uint32_t sfnOffInSector) {
+        int i = AllocFileSlot(self);
+        if (i < 0) return -1;
+
+        FileSlot(self, i).inUse = true;
+        FileSlot(self, i).firstCluster = firstCluster;
+        FileSlot(self, i).fileSize = fileSize;
+        FileSlot(self, i).isDirectory = isDirectory;
+        FileSlot(self, i).sfnPartSector = sfnPartSector;
+        FileSlot(self, i).sfnOffInSector = sfnOffInSector;
+        FileSlot(self, i).runsValid = false;
+        return i;
+    }
+
+    static int OpenEntry(Fat32Instance& self, const ParsedEntry& entry) {
+        return OpenFile(self, entry.firstCluster, entry.fileSize,
+                        (entry.attributes & ATTR_DIRECTORY) != 0,
+                        entry.sfnPartSector, entry.sfnOffInSector);
+    }
+
     static int OpenImpl(int inst, const char* path) {
         if (inst < 0 || inst >= g_instanceCount || !g_instances[inst].active) return -1;
 
         ParsedEntry entry;
         if (!TraversePath(inst, path, &entry)) return -1;
 
-        // Find a free file handle
+        return OpenEntry(g_instances[inst], entry);
+    }
+
+    // Nodes are 1 + the partition-wide index of the file's 32-byte SFN entry
+    static uint64_t EntryNode(const Fat32Instance& self, const ParsedEntry& entry) {
+        return (entry.sfnPartSector * self.bytesPerSector + entry.sfnOffInSector) / 32 + 1;
+    }
+
+    static bool ReadNodeEntry(int inst, uint64_t node, ParsedEntry* out) {
         auto& self = g_instances[inst];
-        for (int i = 0; i < MaxFilesPerInstance; i++) {
-            if (!self.files[i].inUse) {
-                self.files[i].inUse = true;
-                self.files[i].firstCluster = entry.firstCluster;
-                self.files[i].fileSize = entry.fileSize;
-                self.files[i].isDirectory = (entry.attributes & ATTR_DIRECTORY) != 0;
-                self.files[i].sfnPartSector = entry.sfnPartSector;
-                self.files[i].sfnOffInSector = entry.sfnOffInSector;
-                self.files[i].cachedClusterIdx = 0;
-                self.files[i].cachedCluster = entry.firstCluster;
-                return i;
-            }
-        }
+        if (node == Vfs::RootNode) return TraversePath(inst, "", out);
+
+        uint64_t byteOff = (node - 1) * 32;
+        uint64_t sector = byteOff / self.bytesPerSector;
+        uint32_t offInSector = (uint32_t)(byteOff % self.bytesPerSector);
+
+        uint8_t sectorBuf[512];
+        if (!ReadPartSectors(self, sector, 1, sectorBuf)) return false;
+
+        uint8_t* e = sectorBuf + offInSector;
+        if (e[0] == 0x00 || e[0] == 0xE5) return false;
+
+        uint16_t clHi, clLo;
+        memcpy(&clHi, e + 20, 2);
+        memcpy(&clLo, e + 26, 2);
+        out->firstCluster = ((uint32_t)clHi << 16) | (uint32_t)clLo;
+        memcpy(&out->fileSize, e + 28, 4);
+        out->attributes = e[11];
+        ParseShortName(e, out->name);
+        out->sfnPartSector = sector;
+        out->sfnOffInSector = offInSector;
+        return true;
+    }
+
+    static int LookupImpl(int inst, uint64_t dirNode, const char* name,
+                           uint64_t* outNode, bool* outIsDir) {
+        if (inst < 0 || inst >= g_instanceCount || !g_instances[inst].active) return -1;
+        auto& self = g_instances[inst];
+
+        ParsedEntry dir;
+        if (!ReadNodeEntry(inst, dirNode, &dir)) return -1;
+        if (!(dir.attributes & ATTR_DIRECTORY)) return 0;
 
-        return -1; // no free handle
+        ParsedEntry found;
+        if (!FindInDirectory(inst, dir.firstCluster, name, &found)) return 0;
+
+        *outNode = EntryNode(self, found);
+        *outIsDir = (found.attributes & ATTR_DIRECTORY) != 0;
+        return 1;
+    }
+
+    static int OpenNodeImpl(int inst, uint64_t node) {
+        if (inst < 0 || inst >= g_instanceCount || !g_instances[inst].active) return -1;
+
+        ParsedEntry entry;
+        if (!ReadNodeEntry(inst, node, &entry)) return -1;
+
+        return OpenEntry(g_instances[inst], entry);
     }
 
     static int ReadImpl(int inst, int handle, uint8_t* buffer,
                          uint64_t offset, uint64_t size) {
         if (inst < 0 || inst >= g_instanceCount) return -1;
         auto& self = g_instances[inst];
-        if (handle < 0 || handle >= MaxFilesPerInstance || !self.files[handle].inUse) return -1;
+        if (handle < 0 || handle >= self.fileCapacity || !FileSlot(self, handle).inUse) return -1;
 
-        auto& file = self.files[handle];
+        auto& file = FileSlot(self, handle);
 
         // Directories don't have a meaningful fileSize for reading
         if (file.isDirectory) return -1;
@@ -864,46 +1316,37 @@ namespace Fs::Fat32 {
         if (size == 0) return 0;
 
         uint32_t clusterSize = self.clusterSize;
-        uint32_t startClusterIdx = (uint32_t)(offset / clusterSize);
+        uint32_t clusterIdx = (uint32_t)(offset / clusterSize);
         uint32_t clusterOff = (uint32_t)(offset % clusterSize);
 
-        // Walk cluster chain to starting cluster (use cache if possible)
-        uint32_t cluster;
-        uint32_t startFrom = 0;
-        if (file.cachedCluster >= 2 && file.cachedClusterIdx <= startClusterIdx) {
-            cluster = file.cachedCluster;
-            startFrom = file.cachedClusterIdx;
-        } else {
-            cluster = file.firstCluster;
-        }
-        for (uint32_t i = startFrom; i < startClusterIdx; i++) {
-            cluster = GetNextCluster(self, cluster);
-            if (IsEndOfChain(cluster)) return 0;
-        }
-
-        // Read data cluster by cluster
         uint64_t bytesRead = 0;
-        uint32_t lastCluster = cluster;
-        while (bytesRead < size && !IsEndOfChain(cluster)) {
+        while (bytesRead < size) {
+            uint32_t contiguous = 0;
+            uint32_t cluster = MapCluster(self, file, clusterIdx, &contiguous);
+            if (cluster == 0) break;
+
+            uint64_t remaining = size - bytesRead;
+            if (clusterOff == 0 && remaining >= clusterSize) {
+                // Whole clusters of this run go straight to the caller in one request
+                uint64_t whole = remaining / clusterSize;
+                uint32_t count = whole < contiguous ? (uint32_t)whole : contiguous;
+                if (!ReadPartSectors(self, ClusterToPartSector(self, cluster),
+                                     count * self.sectorsPerCluster, buffer + bytesRead)) break;
+                bytesRead += (uint64_t)count * clusterSize;
+                clusterIdx += count;
+                continue;
+            }
+
             if (!ReadCluster(self, cluster)) break;
 
             uint32_t available = clusterSize - clusterOff;
-            uint64_t toRead = size - bytesRead;
+            uint64_t toRead = remaining;
             if (toRead > available) toRead = available;
 
             memcpy(buffer + bytesRead, self.clusterBuf + clusterOff, toRead);
             bytesRead += toRead;
             clusterOff = 0; // subsequent clusters start from offset 0
-
-            lastCluster = cluster;
-            cluster = GetNextCluster(self, cluster);
-        }
-
-        // Update cache
-        if (bytesRead > 0 && lastCluster >= 2) {
-            uint32_t endClusterIdx = (uint32_t)((offset + bytesRead - 1) / clusterSize);
-            file.cachedClusterIdx = endClusterIdx;
-            file.cachedCluster = lastCluster;
+            clusterIdx++;
         }
 
         return (int)bytesRead;
@@ -912,15 +1355,31 @@ namespace Fs::Fat32 {
     static uint64_t GetSizeImpl(int inst, int handle) {
         if (inst < 0 || inst >= g_instanceCount) return 0;
         auto& self = g_instances[inst];
-        if (handle < 0 || handle >= MaxFilesPerInstance || !self.files[handle].inUse) return 0;
-        return self.files[handle].fileSize;
+        if (handle < 0 || handle >= self.fileCapacity || !FileSlot(self, handle).inUse) return 0;
+        return FileSlot(self, handle).fileSize;
+    }
+
+    static uint64_t GetFileIdImpl(int inst, int handle) {
+        if (inst < 0 || inst >= g_instanceCount) return 0;
+        auto& self = g_instances[inst];
+        if (handle < 0 || handle >= self.fileCapacity || !FileSlot(self, handle).inUse) return 0;
+        if (FileSlot(self, handle).isDirectory) return 0;
+        return FileSlot(self, handle).firstCluster;
     }
 
     static void CloseImpl(int inst, int handle) {
         if (inst < 0 || inst >= g_instanceCount) return;
         auto& self = g_instances[inst];
-        if (handle < 0 || handle >= MaxFilesPerInstance) return;
-        self.files[handle].inUse = false;
+        if (handle < 0 || handle >= self.fileCapacity) return;
+        auto& file = FileSlot(self, handle);
+        file.inUse = false;
+        file.runsValid = false;
+        if (file.runs != nullptr) {
+            Memory::g_heap->Free(file.runs);
+            file.runs = nullptr;
+            file.runCapacity = 0;
+        }
+        FlushFat(self);
     }
 
     static int ReadDirImpl(int inst, const char* path,
@@ -936,100 +1395,234 @@ namespace Fs::Fat32 {
         int limit = maxEntries < MaxDirEntries ? maxEntries : MaxDirEntries;
         int count = ReadDirectory(inst, dirEntry.firstCluster, entries, limit);
 
+        // Size the packed name cache for this listing
+        int needed = 0;
+        for (int i = 0; i < count; i++) {
+            int len = 0;
+            while (entries[i].name[len] && len < MaxNameLen - 2) len++;
+            needed += len + 2;  // Room for a trailing '/' and the terminator
+        }
+        if (needed > self.dirNamesCapacity) {
+            if (self.dirNames != nullptr) Memory::g_heap->Free(self.dirNames);
+            self.dirNames = (char*)Memory::g_heap->Request(needed);
+            self.dirNamesCapacity = self.dirNames != nullptr ? needed : 0;
+            if (self.dirNames == nullptr) return -1;
+        }
+
         // Copy names into persistent cache
-        self.dirNameCount = count;
+        char* out = self.dirNames;
         for (int i = 0; i < count; i++) {
             int j = 0;
             while (entries[i].name[j] && j < MaxNameLen - 2) {
-                self.dirNames[i][j] = entries[i].name[j];
+                out[j] = entries[i].name[j];
                 j++;
             }
             // Append trailing '/' for directories so userspace can distinguish them
-            if ((entries[i].attributes & ATTR_DIRECTORY) && j < MaxNameLen - 1) {
-                self.dirNames[i][j++] = '/';
+            if (entries[i].attributes & ATTR_DIRECTORY) {
+                out[j++] = '/';
             }
-            self.dirNames[i][j] = '\0';
-            outNames[i] = self.dirNames[i];
+            out[j] = '\0';
+            outNames[i] = out;
+            out += j + 1;
         }
 
         return count;
     }
 
+    // FAT write date/time (local time, 2-second resolution) to Unix seconds
+    static uint64_t FatTimeToUnix(uint16_t date, uint16_t time) {
+        if (date == 0) return 0;
+
+        int64_t y = 1980 + (date >> 9);
+        int64_t m = (date >> 5) & 0x0F;
+        int64_t d = date & 0x1F;
+        if (m < 1 || m > 12 || d < 1) return 0;
+
+        // Days since 1970-01-01 in the proleptic Gregorian calendar
+        if (m <= 2) y--;
+        int64_t era = y / 400;
+        int64_t yoe = y - era * 400;
+        int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        int64_t days = era * 146097 + doe - 719468;
+
+        return (uint64_t)(days * 86400 + (time >> 11) * 3600 + ((time >> 5) & 0x3F) * 60 + (time & 0x1F) * 2);
+    }
+
+    // The cursor is the index of the next 32-byte slot in the directory chain
+    static int ReadDirPlusImpl(int inst, const char* path, uint64_t* cursor,
+                               Vfs::DirEmitFn emit, void* ctx) {
+        if (inst < 0 || inst >= g_instanceCount) return -1;
+        auto& self = g_instances[inst];
+
+        ParsedEntry dirEntry;
+        if (!TraversePath(inst, path, &dirEntry)) return -1;
+        if (!(dirEntry.attributes & ATTR_DIRECTORY)) return -1;
+
+        int perCluster = (int)(self.clusterSize / 32);
+        uint64_t base = *cursor - *cursor % perCluster;    // Slot index of `cluster`
+        uint32_t cluster = dirEntry.firstCluster;
+        for (uint64_t skip = base / perCluster; skip > 0 && !IsEndOfChain(cluster); skip--) {
+            cluster = GetNextCluster(self, cluster);
+        }
+
+        uint16_t lfnBuf[MaxNameLen];
+        bool hasLfn = false;
+        char name[MaxNameLen];
+
+        for (int i = (int)(*cursor - base); !IsEndOfChain(cluster); i = 0, base += perCluster) {
+            if (!ReadCluster(self, cluster)) return -1;
+
+            for (; i < perCluster; i++) {
+                uint8_t* e = self.clusterBuf + i * 32;
+                if (e[0] == 0x00) return 0;     // end of directory
+
+                uint8_t attr = e[11];
+                if (e[0] == 0xE5 || (attr != ATTR_LFN && (attr & ATTR_VOLUME_ID))) {
+                    hasLfn = false;
+                } else if (attr == ATTR_LFN) {
+                    int seqNum = e[0] & 0x1F;
+                    if (e[0] & 0x40) {
+                        for (int k = 0; k < MaxNameLen; k++) lfnBuf[k] = 0;
+                        hasLfn = true;
+                    }
+                    if (hasLfn && seqNum >= 1 && seqNum <= 20) {
+                        uint16_t chars[13];
+                        ExtractLfnChars(e, chars);
+                        int offset = (seqNum - 1) * 13;
+                        for (int k = 0; k < 13 && offset + k < MaxNameLen; k++) {
+                            lfnBuf[offset + k] = chars[k];
+                        }
+                    }
+                    // Resuming mid-name would lose it, so the cursor stays put
+                    continue;
+                } else {
+                    if (hasLfn) {
+                        Utf16ToAscii(lfnBuf, MaxNameLen, name);
+                    } else {
+                        ParseShortName(e, name);
+                    }
+                    hasLfn = false;
+
+                    bool dot = name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+                    if (!dot) {
+                        uint16_t clusterHi, clusterLo, wrtTime, wrtDate;
+                        uint32_t fileSize;
+                        memcpy(&wrtTime, e + 22, 2);
+                        memcpy(&wrtDate, e + 24, 2);
+                        memcpy(&clusterHi, e + 20, 2);
+                        memcpy(&clusterLo, e + 26, 2);
+                        memcpy(&fileSize, e + 28, 4);
+
+                        Vfs::DirEntryInfo info;
+                        info.Name = name;
+                        info.NameLen = 0;
+                        while (name[info.NameLen]) info.NameLen++;
+                        info.IsDirectory = (attr & ATTR_DIRECTORY) != 0;
+                        info.Size = info.IsDirectory ? 0 : fileSize;
+                        info.MTime = FatTimeToUnix(wrtDate, wrtTime);
+                        info.FileId = ((uint32_t)clusterHi << 16) | clusterLo;
+                        if (!emit(ctx, info)) return 1;
+                    }
+                }
+
+                *cursor = base + i + 1;
+            }
+
+            cluster = GetNextCluster(self, cluster);
+        }
+
+        return 0;
+    }
+
     static int WriteImpl(int inst, int handle, const uint8_t* buffer,
                           uint64_t offset, uint64_t size) {
         if (inst < 0 || inst >= g_instanceCount) return -1;
         auto& self = g_instances[inst];
-        if (handle < 0 || handle >= MaxFilesPerInstance || !self.files[handle].inUse) return -1;
+        if (handle < 0 || handle >= self.fileCapacity || !FileSlot(self, handle).inUse) return -1;
 
-        auto& file = self.files[handle];
+        auto& file = FileSlot(self, handle);
         if (file.isDirectory) return -1;
         if (size == 0) return 0;
 
         uint32_t clusterSize = self.clusterSize;
+        uint64_t bytesWritten = 0;
+        bool extended = false;
+        uint32_t clusterIdx, clusterOff, chainLength, idx;
+        uint32_t cluster = 0, prevCluster = 0, contiguous = 0;
+
+        // Last cluster index this write touches, to size contiguous allocations
+        uint32_t lastIdx = (uint32_t)((offset + size - 1) / clusterSize);
 
         // If file has no clusters yet, allocate the first one
         if (file.firstCluster < 2) {
-            uint32_t cl = AllocateCluster(self);
+            uint32_t cl = AllocateCluster(self, 0, lastIdx + 1);
             if (cl == 0) return -1;
             file.firstCluster = cl;
+            file.runsValid = false;
+            extended = true;
             // Zero the new cluster
             memset(self.clusterBuf, 0, clusterSize);
             WriteClusterData(self, cl, self.clusterBuf);
             UpdateDirEntry(self, file);
         }
 
-        uint64_t bytesWritten = 0;
-
-        // Walk cluster chain to the starting cluster for this offset
-        uint32_t clusterIdx = (uint32_t)(offset / clusterSize);
-        uint32_t clusterOff = (uint32_t)(offset % clusterSize);
+        // Seek through the run map; past the end of the chain, start from its
+        // last cluster and extend it with zeroed clusters
+        clusterIdx = (uint32_t)(offset / clusterSize);
+        clusterOff = (uint32_t)(offset % clusterSize);
 
-        // Use cached position if we can skip ahead
-        uint32_t cluster;
-        uint32_t prevCluster = 0;
-        uint32_t startIdx = 0;
-        if (file.cachedCluster >= 2 && file.cachedClusterIdx <= clusterIdx) {
-            cluster = file.cachedCluster;
-            startIdx = file.cachedClusterIdx;
-        } else {
-            cluster = file.firstCluster;
-        }
+        chainLength = ChainLength(self, file);
+        if (chainLength == 0) return -1;
+        idx = clusterIdx < chainLength ? clusterIdx : chainLength - 1;
+        cluster = MapCluster(self, file, idx, &contiguous);
+        if (idx > 0) prevCluster = MapCluster(self, file, idx - 1, &contiguous);
 
-        for (uint32_t i = startIdx; i < clusterIdx; i++) {
+        for (; idx < clusterIdx; idx++) {
             prevCluster = cluster;
             uint32_t next = GetNextCluster(self, cluster);
             if (IsEndOfChain(next)) {
                 // Need to extend the chain
-                next = AllocateCluster(self);
+                next = AllocateCluster(self, cluster + 1, lastIdx - idx);
                 if (next == 0) goto done;
                 WriteFatEntry(self, cluster, next);
                 memset(self.clusterBuf, 0, clusterSize);
                 WriteClusterData(self, next, self.clusterBuf);
+                NoteAppended(file, idx + 1, next);
+                extended = true;
             }
             cluster = next;
         }
 
         // Write data cluster by cluster
         while (bytesWritten < size) {
+            bool fresh = false;
             if (IsEndOfChain(cluster) || cluster < 2) {
-                // Allocate a new cluster and link it
-                uint32_t newCl = AllocateCluster(self);
+                // Allocate a new cluster, preferably right after the previous one, and link it
+                uint32_t newCl = AllocateCluster(self, prevCluster != 0 ? prevCluster + 1 : 0,
+                                                 lastIdx - idx + 1);
                 if (newCl == 0) goto done;
                 if (prevCluster != 0) {
                     WriteFatEntry(self, prevCluster, newCl);
                 }
-                memset(self.clusterBuf, 0, clusterSize);
-                WriteClusterData(self, newCl, self.clusterBuf);
+                NoteAppended(file, idx, newCl);
+                extended = true;
                 cluster = newCl;
+                fresh = true;
             }
 
-            // Read existing cluster data (for partial writes)
-            if (!ReadCluster(self, cluster)) goto done;
-
             uint32_t available = clusterSize - clusterOff;
             uint64_t toWrite = size - bytesWritten;
             if (toWrite > available) toWrite = available;
 
+            // New clusters start from zeroes; existing ones are read back
+            // unless the write covers them completely
+            if (fresh) {
+                memset(self.clusterBuf, 0, clusterSize);
+            } else if (toWrite < clusterSize && !ReadCluster(self, cluster)) {
+                goto done;
+            }
+
             memcpy(self.clusterBuf + clusterOff, buffer + bytesWritten, toWrite);
 
             if (!WriteClusterData(self, cluster, self.clusterBuf)) goto done;
@@ -1039,15 +1632,12 @@ namespace Fs::Fat32 {
 
             prevCluster = cluster;
             cluster = GetNextCluster(self, cluster);
+            idx++;
         }
 
     done:
-        // Update cached position for sequential access
-        if (bytesWritten > 0 && prevCluster >= 2) {
-            uint32_t endClusterIdx = (uint32_t)((offset + bytesWritten - 1) / clusterSize);
-            file.cachedClusterIdx = endClusterIdx;
-            file.cachedCluster = prevCluster;
-        }
+        // Other handles on this file must rebuild their maps
+        if (extended) InvalidateRunMaps(self, file.sfnPartSector, file.sfnOffInSector, &file);
 
         // Update file size if we wrote past the end
         uint64_t endPos = offset + bytesWritten;
@@ -1089,6 +1679,7 @@ namespace Fs::Fat32 {
                 WriteFatEntry(self, cl, CLUSTER_FREE);
                 cl = next;
             }
+            InvalidateRunMaps(self, existing.sfnPartSector, existing.sfnOffInSector, nullptr);
 
             // Update directory entry: zero size, zero first cluster
             uint8_t sectorBuf[512];
@@ -1100,22 +1691,10 @@ namespace Fs::Fat32 {
             memcpy(e + 26, &zero16, 2); // cluster low
             memcpy(e + 28, &zero32, 4); // file size
             if (!WritePartSectors(self, existing.sfnPartSector, 1, sectorBuf)) return -1;
+            FlushDiscards(self);
 
             // Open a handle to it
-            for (int i = 0; i < MaxFilesPerInstance; i++) {
-                if (!self.files[i].inUse) {
-                    self.files[i].inUse = true;
-                    self.files[i].firstCluster = 0;
-                    self.files[i].fileSize = 0;
-                    self.files[i].isDirectory = false;
-                    self.files[i].sfnPartSector = existing.sfnPartSector;
-                    self.files[i].sfnOffInSector = existing.sfnOffInSector;
-                    self.files[i].cachedClusterIdx = 0;
-                    self.files[i].cachedCluster = 0;
-                    return i;
-                }
-            }
-            return -1;
+            return OpenFile(self, 0, 0, false, existing.sfnPartSector, existing.sfnOffInSector);
         }
 
         // Generate 8.3 short name
@@ -1190,25 +1769,10 @@ namespace Fs::Fat32 {
         uint32_t sfnOff = (pos.offsetInSec + lfnCount * 32) % self.bytesPerSector;
 
         // Open a handle
-        for (int i = 0; i < MaxFilesPerInstance; i++) {
-            if (!self.files[i].inUse) {
-                self.files[i].inUse = true;
-                self.files[i].firstCluster = 0;
-                self.files[i].fileSize = 0;
-                self.files[i].isDirectory = false;
-                self.files[i].sfnPartSector = sfnSector;
-                self.files[i].sfnOffInSector = sfnOff;
-                self.files[i].cachedClusterIdx = 0;
-                self.files[i].cachedCluster = 0;
-                return i;
-            }
-        }
-
-        return -1;
+        return OpenFile(self, 0, 0, false, sfnSector, sfnOff);
     }
 
-    static int DeleteImpl(int inst, const char* path) {
-        if (inst < 0 || inst >= g_instanceCount || !g_instances[inst].active) return -1;
+    static int RemoveEntry(int inst, const char* path) {
         auto& self = g_instances[inst];
 
         // Split path into parent directory and filename
@@ -1339,6 +1903,16 @@ namespace Fs::Fat32 {
         return 0;
     }
 
+    static int DeleteImpl(int inst, const char* path) {
+        if (inst < 0 || inst >= g_instanceCount || !g_instances[inst].active) return -1;
+
+        // The chain is freed before the entry is marked deleted, so its
+        // discards wait until the entry is gone
+        int result = RemoveEntry(inst, path);
+        if (result == 0) FlushDiscards(g_instances[inst]);
+        return result;
+    }
+
     // =========================================================================
     // Mkdir — create a directory
     // =========================================================================
@@ -1469,6 +2043,44 @@ namespace Fs::Fat32 {
         return 0;
     }
 
+    // =========================================================================
+    // Trim — discard all free clusters
+    // =========================================================================
+
+    static int64_t TrimImpl(int inst) {
+        if (inst < 0 || inst >= g_instanceCount || !g_instances[inst].active) return -1;
+        auto& self = g_instances[inst];
+        if (!self.canDiscard) return -1;
+
+        // Freed clusters must be free on disk before they lose their data
+        FlushFat(self);
+        if (!Drivers::Storage::BlockCache::Flush(self.blockDevIndex)) return -1;
+        self.pendingDiscardCount = 0;
+
+        uint64_t discarded = 0;
+        uint32_t end = self.clusterCount + 2;
+        uint32_t cluster = 2;
+        while (cluster < end) {
+            if ((cluster % 64) == 0 && cluster + 64 <= end && self.usedMap[cluster / 64] == ~0ULL) {
+                cluster += 64;
+                continue;
+            }
+            if (ClusterInUse(self, cluster)) {
+                cluster++;
+                continue;
+            }
+
+            uint32_t runEnd = cluster + 1;
+            while (runEnd < end && !ClusterInUse(self, runEnd)) runEnd++;
+
+            if (DiscardClusters(self, cluster, runEnd - cluster)) {
+                discarded += (uint64_t)(runEnd - cluster) * self.clusterSize;
+            }
+            cluster = runEnd;
+        }
+        return (int64_t)discarded;
+    }
+
     // =========================================================================
     // Template thunks — generate unique function pointers per instance
     // =========================================================================
@@ -1483,6 +2095,11 @@ namespace Fs::Fat32 {
         static int Create(const char* p) { return CreateImpl(N, p); }
         static int Delete(const char* p) { return DeleteImpl(N, p); }
         static int Mkdir(const char* p) { return MkdirImpl(N, p); }
+        static uint64_t GetFileId(int h) { return GetFileIdImpl(N, h); }
+        static int Lookup(uint64_t d, const char* n, uint64_t* o, bool* i) { return LookupImpl(N, d, n, o, i); }
+        static int OpenNode(uint64_t n) { return OpenNodeImpl(N, n); }
+        static int64_t Trim() { return TrimImpl(N); }
+        static int ReadDirPlus(const char* p, uint64_t* c, Vfs::DirEmitFn e, void* x) { return ReadDirPlusImpl(N, p, c, e, x); }
     };
 
     template<int N>
@@ -1497,6 +2114,12 @@ namespace Fs::Fat32 {
             Thunks<N>::Create,
             Thunks<N>::Delete,
             Thunks<N>::Mkdir,
+            Thunks<N>::GetFileId,
+            Thunks<N>::Lookup,
+            Thunks<N>::OpenNode,
+            Thunks<N>::Trim,
+            nullptr,    // Map
+            Thunks<N>::ReadDirPlus,
         };
     }
 
@@ -1509,6 +2132,51 @@ namespace Fs::Fat32 {
     // BPB validation and mount
     // =========================================================================
 
+    // Derive the free-cluster bitmap from the FAT cache and pick up the
+    // FSInfo next-free hint. Without it allocation scans fatCache directly
+    // and FAT updates are written through.
+    static void BuildFreeMap(Fat32Instance& inst) {
+        uint32_t end = inst.clusterCount + 2;
+        if (end > inst.fatCacheEntries) return;
+
+        uint32_t words = (end + 63) / 64;
+        uint32_t dirtyWords = (inst.fatSize32 + 63) / 64;
+        inst.usedMapPages = (int)(((uint64_t)words * 8 + 0xFFF) / 0x1000);
+        inst.usedMap = (uint64_t*)Memory::g_pfa->ReallocConsecutive(nullptr, inst.usedMapPages);
+        inst.fatDirty = (uint64_t*)Memory::g_heap->Request(dirtyWords * 8);
+        if (!inst.usedMap || !inst.fatDirty) {
+            if (inst.usedMap) Memory::g_pfa->Free(inst.usedMap, inst.usedMapPages);
+            if (inst.fatDirty) Memory::g_heap->Free(inst.fatDirty);
+            inst.usedMap = nullptr;
+            inst.fatDirty = nullptr;
+            return;
+        }
+        memset(inst.fatDirty, 0, dirtyWords * 8);
+
+        // Clusters 0 and 1 and the padding past the last cluster count as used
+        memset(inst.usedMap, 0xFF, words * 8);
+        inst.freeCount = 0;
+        for (uint32_t cluster = 2; cluster < end; cluster++) {
+            if ((inst.fatCache[cluster] & 0x0FFFFFFF) == CLUSTER_FREE) {
+                inst.usedMap[cluster / 64] &= ~(1ULL << (cluster % 64));
+                inst.freeCount++;
+            }
+        }
+
+        if (inst.fsInfoSector != 0) {
+            uint8_t sectorBuf[512];
+            uint32_t sig1, sig2, hint;
+            if (ReadPartSectors(inst, inst.fsInfoSector, 1, sectorBuf)) {
+                memcpy(&sig1, sectorBuf + 0, 4);
+                memcpy(&sig2, sectorBuf + 484, 4);
+                memcpy(&hint, sectorBuf + 492, 4);
+                if (sig1 == 0x41615252 && sig2 == 0x61417272 && hint >= 2 && hint < end) {
+                    inst.nextFree = hint;
+                }
+            }
+        }
+    }
+
     Vfs::FsDriver* Mount(int blockDevIndex, uint64_t startLba, uint64_t sectorCount) {
         if (g_instanceCount >= MaxInstances) return nullptr;
 
@@ -1640,10 +2308,18 @@ namespace Fs::Fat32 {
             }
         }
 
-        // Clear file handles
-        for (int i = 0; i < MaxFilesPerInstance; i++) {
-            inst.files[i].inUse = false;
-        }
+        // Free-cluster bitmap and deferred FAT writes, both built on the FAT cache
+        uint16_t fsInfoSector;
+        memcpy(&fsInfoSector, bpb + 48, 2);
+        inst.fsInfoSector = (fsInfoSector != 0 && fsInfoSector < reservedSectors) ? fsInfoSector : 0;
+        inst.nextFree = 2;
+        if (inst.fatCache) BuildFreeMap(inst);
+        inst.canDiscard = inst.usedMap != nullptr && dev->Discard != nullptr;
+        inst.pendingDiscardCount = 0;
+
+        // File handles are allocated on first open
+        memset(inst.fileChunks, 0, sizeof(inst.fileChunks));
+        inst.fileCapacity = 0;
 
         g_instanceCount++;
 
@@ -1654,6 +2330,14 @@ namespace Fs::Fat32 {
         return &g_drivers[idx];
     }
 
+    void Sync() {
+        for (int i = 0; i < g_instanceCount; i++) {
+            if (!g_instances[i].active) continue;
+            FlushFat(g_instances[i]);
+            FlushDiscards(g_instances[i]);
+        }
+    }
+
     void RegisterProbe() {
         FsProbe::Register(Mount);
     }
@@ -1709,6 +2393,16 @@ namespace Fs::Fat32 {
 
         uint32_t rootCluster = 2; // first data cluster
 
+        // --- Clear the volume ---
+        // Discard everything, then zero the reserved sectors, both FATs and
+        // the root directory cluster in one request (a device command where
+        // the drive has one, otherwise large writes)
+        if (dev->Discard) dev->Discard(dev->Ctx, startLba, sectorCount);
+        if (!dev->WriteZeroes(dev->Ctx, startLba, (uint64_t)dataStart + sectorsPerCluster)) {
+            KernelLogStream(ERROR, "FAT32") << "Failed to clear metadata area";
+            return -1;
+        }
+
         // --- Build boot sector (BPB) ---
         uint8_t bpb[512];
         memset(bpb, 0, 512);
@@ -1809,14 +2503,6 @@ namespace Fs::Fat32 {
             return -1;
         }
 
-        // --- Zero out remaining reserved sectors ---
-        uint8_t zeroBuf[512];
-        memset(zeroBuf, 0, 512);
-        for (uint16_t s = 2; s < reservedSectors; s++) {
-            if (s == backupBootSector || s == 7) continue; // already written
-            dev->WriteSectors(dev->Ctx, startLba + s, 1, zeroBuf);
-        }
-
         // --- Write FAT tables ---
         // First sector of each FAT: media byte + EOC for clusters 0,1 + EOC for root dir (cluster 2)
         uint8_t fatFirstSector[512];
@@ -1828,22 +2514,12 @@ namespace Fs::Fat32 {
         for (int f = 0; f < numFats; f++) {
             uint64_t fatStart = startLba + reservedSectors + (uint64_t)f * fatSize;
 
-            // Write first sector with media byte + root cluster entry
+            // Write first sector with media byte + root cluster entry; the
+            // rest of the FAT was zeroed above
             if (!dev->WriteSectors(dev->Ctx, fatStart, 1, fatFirstSector)) {
                 KernelLogStream(ERROR, "FAT32") << "Failed to write FAT " << f;
                 return -1;
             }
-
-            // Zero remaining FAT sectors
-            for (uint32_t s = 1; s < fatSize; s++) {
-                dev->WriteSectors(dev->Ctx, fatStart + s, 1, zeroBuf);
-            }
-        }
-
-        // --- Zero root directory cluster ---
-        uint64_t rootSector = startLba + dataStart;
-        for (uint8_t s = 0; s < sectorsPerCluster; s++) {
-            dev->WriteSectors(dev->Ctx, rootSector + s, 1, zeroBuf);
         }
 
         KernelLogStream(OK, "FAT32") << "Formatted: " << (uint64_t)clusterCount
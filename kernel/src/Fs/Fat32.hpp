@@ -14,6 +14,10 @@ namespace Fs::Fat32 {
     // Returns a FsDriver* on success, nullptr if not a valid FAT32 volume.
     Vfs::FsDriver* Mount(int blockDevIndex, uint64_t startLba, uint64_t sectorCount);
 
+    // Write deferred FAT and FSInfo updates of all mounted volumes back to
+    // their devices (into the block cache; flush that afterwards for durability).
+    void Sync();
+
     // Register Fat32::Mount as a filesystem probe with FsProbe.
     void RegisterProbe();
 
@@ -0,0 +1,390 @@
+/*
+    * PageCache.cpp
+    * File data page cache with sequential readahead
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#include "PageCache.hpp"
+#include <Memory/PageFrameAllocator.hpp>
+#include <Memory/Heap.hpp>
+#include <Libraries/Memory.hpp>
+#include <CppLib/Spinlock.hpp>
+#include <CppLib/Stream.hpp>
+#include <Terminal/Terminal.hpp>
+
+namespace Fs::PageCache {
+
+    static constexpr int32_t None = -1;
+
+    // Cached pages are clean copies of file data: writes go to the driver
+    // first and then invalidate the affected range.
+    struct Page {
+        uint8_t* data;
+        uint64_t fileId;
+        uint64_t index;         // Page number within the file
+        int32_t  hashNext;
+        int32_t  lruPrev;       // Towards most recently used
+        int32_t  lruNext;       // Towards least recently used
+        int16_t  drive;
+        bool     used;
+    };
+
+    static Page* g_pages = nullptr;
+    static int32_t* g_hash = nullptr;
+    static uint32_t g_hashMask = 0;
+    static int g_capacity = 0;
+
+    static int32_t g_lruHead = None;
+    static int32_t g_lruTail = None;
+    static int32_t g_freeList = None;   // Chained through hashNext
+
+    // Readahead lands here in one driver call before being split into pages
+    static uint8_t* g_scratch = nullptr;
+
+    static kcp::Spinlock g_lock;
+
+    // -------------------------------------------------------------------------
+    // Hash and LRU lists
+    // -------------------------------------------------------------------------
+
+    static uint32_t HashKey(int drive, uint64_t fileId, uint64_t index) {
+        uint64_t h = (fileId * 0x9E3779B97F4A7C15ULL) ^ (index * 0xC2B2AE3D27D4EB4FULL) ^ (uint64_t)drive;
+        return (uint32_t)(h >> 32) & g_hashMask;
+    }
+
+    static int32_t Lookup(int drive, uint64_t fileId, uint64_t index) {
+        for (int32_t i = g_hash[HashKey(drive, fileId, index)]; i != None; i = g_pages[i].hashNext) {
+            const Page& p = g_pages[i];
+            if (p.drive == drive && p.fileId == fileId && p.index == index) return i;
+        }
+        return None;
+    }
+
+    static void HashInsert(int32_t idx) {
+        uint32_t h = HashKey(g_pages[idx].drive, g_pages[idx].fileId, g_pages[idx].index);
+        g_pages[idx].hashNext = g_hash[h];
+        g_hash[h] = idx;
+    }
+
+    static void HashRemove(int32_t idx) {
+        int32_t* link = &g_hash[HashKey(g_pages[idx].drive, g_pages[idx].fileId, g_pages[idx].index)];
+        while (*link != None) {
+            if (*link == idx) {
+                *link = g_pages[idx].hashNext;
+                return;
+            }
+            link = &g_pages[*link].hashNext;
+        }
+    }
+
+    static void LruUnlink(int32_t idx) {
+        Page& p = g_pages[idx];
+        if (p.lruPrev != None) g_pages[p.lruPrev].lruNext = p.lruNext;
+        else g_lruHead = p.lruNext;
+        if (p.lruNext != None) g_pages[p.lruNext].lruPrev = p.lruPrev;
+        else g_lruTail = p.lruPrev;
+        p.lruPrev = p.lruNext = None;
+    }
+
+    static void LruPushFront(int32_t idx) {
+        Page& p = g_pages[idx];
+        p.lruPrev = None;
+        p.lruNext = g_lruHead;
+        if (g_lruHead != None) g_pages[g_lruHead].lruPrev = idx;
+        g_lruHead = idx;
+        if (g_lruTail == None) g_lruTail = idx;
+    }
+
+    static void Touch(int32_t idx) {
+        if (g_lruHead == idx) return;
+        LruUnlink(idx);
+        LruPushFront(idx);
+    }
+
+    // -------------------------------------------------------------------------
+    // Page allocation
+    // -------------------------------------------------------------------------
+
+    // Unlink a cached page and put its header on the free list (keeping the frame)
+    static void Evict(int32_t idx) {
+        HashRemove(idx);
+        LruUnlink(idx);
+        g_pages[idx].used = false;
+        g_pages[idx].hashNext = g_freeList;
+        g_freeList = idx;
+    }
+
+    static int32_t GetPage() {
+        if (g_freeList != None) {
+            int32_t idx = g_freeList;
+            Page& p = g_pages[idx];
+            if (p.data == nullptr) {
+                p.data = (uint8_t*)Memory::g_pfa->Allocate();
+            }
+            if (p.data != nullptr) {
+                g_freeList = p.hashNext;
+                return idx;
+            }
+        }
+
+        // Full (or out of frames): recycle the least recently used page
+        int32_t idx = g_lruTail;
+        if (idx == None) return None;
+        Evict(idx);
+        g_freeList = g_pages[idx].hashNext;
+        return idx;
+    }
+
+    static void PutPage(int32_t idx) {
+        g_pages[idx].used = false;
+        g_pages[idx].hashNext = g_freeList;
+        g_freeList = idx;
+    }
+
+    // -------------------------------------------------------------------------
+    // Readahead
+    // -------------------------------------------------------------------------
+
+    // Load page `index` plus up to `count - 1` following pages in a single
+    // driver request. Stops early at pages that are already cached.
+    // Returns the slot for `index`, or None if the read failed.
+    static int32_t Fill(int drive, uint64_t fileId, const Vfs::FsDriver* driver, int localHandle,
+                        uint64_t fileSize, uint64_t index, uint32_t count) {
+        uint64_t filePages = (fileSize + PageSize - 1) / PageSize;
+        if (index + count > filePages) count = (uint32_t)(filePages - index);
+        if (count > MaxReadahead) count = MaxReadahead;
+        if (g_scratch == nullptr) count = 1;
+
+        int32_t slots[MaxReadahead];
+        uint32_t n = 0;
+        while (n < count) {
+            if (n > 0 && Lookup(drive, fileId, index + n) != None) break;
+            int32_t idx = GetPage();
+            if (idx == None) break;
+            slots[n++] = idx;
+        }
+        if (n == 0) return None;
+
+        uint64_t offset = index * PageSize;
+        uint64_t bytes = (uint64_t)n * PageSize;
+        if (offset + bytes > fileSize) bytes = fileSize - offset;
+
+        uint8_t* target = n == 1 ? g_pages[slots[0]].data : g_scratch;
+        int got = driver->Read(localHandle, target, offset, bytes);
+        if (got < 0 || (uint64_t)got != bytes) {
+            for (uint32_t i = 0; i < n; i++) PutPage(slots[i]);
+            return None;
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            Page& p = g_pages[slots[i]];
+            uint64_t chunk = bytes - (uint64_t)i * PageSize;
+            if (chunk > PageSize) chunk = PageSize;
+
+            if (target == g_scratch) memcpy(p.data, g_scratch + i * PageSize, chunk);
+            if (chunk < PageSize) memset(p.data + chunk, 0, PageSize - chunk);
+
+            p.drive = (int16_t)drive;
+            p.fileId = fileId;
+            p.index = index + i;
+            p.used = true;
+            HashInsert(slots[i]);
+            LruPushFront(slots[i]);
+        }
+
+        // The page the caller asked for should be the most recently used
+        Touch(slots[0]);
+        return slots[0];
+    }
+
+    // -------------------------------------------------------------------------
+    // Public API
+    // -------------------------------------------------------------------------
+
+    void Initialize() {
+        Montauk::MemStats stats;
+        Memory::g_pfa->GetStats(&stats);
+
+        int capacity = (int)(stats.totalBytes / 16 / PageSize);
+        if (capacity < 64) capacity = 64;
+        if (capacity > MaxPages) capacity = MaxPages;
+
+        uint32_t buckets = 1;
+        while (buckets < (uint32_t)capacity) buckets <<= 1;
+
+        g_pages = (Page*)Memory::g_heap->Request(capacity * sizeof(Page));
+        g_hash = (int32_t*)Memory::g_heap->Request(buckets * sizeof(int32_t));
+        if (g_pages == nullptr || g_hash == nullptr) {
+            Kt::KernelLogStream(Kt::ERROR, "PageCache") << "Failed to allocate cache tables";
+            return;
+        }
+
+        for (uint32_t i = 0; i < buckets; i++) g_hash[i] = None;
+        for (int i = capacity - 1; i >= 0; i--) {
+            g_pages[i] = {};
+            g_pages[i].lruPrev = g_pages[i].lruNext = None;
+            g_pages[i].hashNext = g_freeList;
+            g_freeList = i;
+        }
+
+        g_scratch = (uint8_t*)Memory::g_pfa->ReallocConsecutive(nullptr, MaxReadahead);
+        g_hashMask = buckets - 1;
+        g_capacity = capacity;
+
+        Kt::KernelLogStream(Kt::OK, "PageCache") << "Up to " << base::dec << (uint64_t)capacity
+            << " pages, readahead " << (uint64_t)InitialReadahead << "-" << (uint64_t)MaxReadahead;
+    }
+
+    int Read(int drive, uint64_t fileId, const Vfs::FsDriver* driver, int localHandle,
+             uint64_t fileSize, uint8_t* buffer, uint64_t offset, uint64_t size,
+             Readahead& ra) {
+        if (g_capacity == 0) return driver->Read(localHandle, buffer, offset, size);
+
+        if (offset >= fileSize) return 0;
+        uint64_t end = offset + size;
+        if (end > fileSize || end < offset) end = fileSize;
+
+        // Grow the window while the reader stays sequential, drop it otherwise
+        if (offset == ra.nextOffset) {
+            ra.window = ra.window == 0 ? InitialReadahead : ra.window * 2;
+            if (ra.window > MaxReadahead) ra.window = MaxReadahead;
+        } else {
+            ra.window = 0;
+        }
+        ra.nextOffset = end;
+
+        uint64_t lastPage = (end - 1) / PageSize;
+        uint64_t pos = offset;
+
+        g_lock.Acquire();
+
+        while (pos < end) {
+            uint64_t index = pos / PageSize;
+            int32_t idx = Lookup(drive, fileId, index);
+            if (idx != None) {
+                Touch(idx);
+            } else {
+                uint64_t count = lastPage - index + 1;
+                if (count < ra.window) count = ra.window;
+                if (count > MaxReadahead) count = MaxReadahead;
+                idx = Fill(drive, fileId, driver, localHandle, fileSize, index, (uint32_t)count);
+            }
+
+            if (idx == None) {
+                // Could not cache; serve the rest straight from the driver
+                g_lock.Release();
+                int got = driver->Read(localHandle, buffer + (pos - offset), pos, end - pos);
+                if (got < 0) return pos > offset ? (int)(pos - offset) : -1;
+                return (int)(pos - offset + got);
+            }
+
+            uint64_t pageOff = pos % PageSize;
+            uint64_t chunk = PageSize - pageOff;
+            if (chunk > end - pos) chunk = end - pos;
+            memcpy(buffer + (pos - offset), g_pages[idx].data + pageOff, chunk);
+            pos += chunk;
+        }
+
+        g_lock.Release();
+        return (int)(end - offset);
+    }
+
+    int ReadThrough(int drive, uint64_t fileId, const Vfs::FsDriver* driver, int localHandle,
+                    uint64_t fileSize, uint8_t* buffer, uint64_t offset, uint64_t size) {
+        if (g_capacity == 0) return driver->Read(localHandle, buffer, offset, size);
+
+        if (offset >= fileSize) return 0;
+        uint64_t end = offset + size;
+        if (end > fileSize || end < offset) end = fileSize;
+
+        uint64_t pos = offset;
+        while (pos < end) {
+            uint64_t pageOff = pos % PageSize;
+            uint64_t chunk = PageSize - pageOff;
+            if (chunk > end - pos) chunk = end - pos;
+
+            g_lock.Acquire();
+            int32_t idx = Lookup(drive, fileId, pos / PageSize);
+            if (idx != None) {
+                Touch(idx);
+                memcpy(buffer + (pos - offset), g_pages[idx].data + pageOff, chunk);
+                g_lock.Release();
+                pos += chunk;
+                continue;
+            }
+
+            // Extend the miss to the next cached page or the end of the range
+            uint64_t runEnd = pos + chunk;
+            while (runEnd < end && Lookup(drive, fileId, runEnd / PageSize) == None) {
+                runEnd += PageSize;
+            }
+            g_lock.Release();
+            if (runEnd > end) runEnd = end;
+
+            int got = driver->Read(localHandle, buffer + (pos - offset), pos, runEnd - pos);
+            if (got < 0) return pos > offset ? (int)(pos - offset) : -1;
+            pos += got;
+            if ((uint64_t)got < runEnd - (pos - got)) break;
+        }
+
+        return (int)(pos - offset);
+    }
+
+    void Invalidate(int drive, uint64_t fileId, uint64_t offset, uint64_t size) {
+        if (g_capacity == 0 || size == 0) return;
+
+        uint64_t first = offset / PageSize;
+        uint64_t last = (offset + size - 1) / PageSize;
+        if (offset + size < offset || last - first >= (uint64_t)g_capacity) {
+            InvalidateFile(drive, fileId);
+            return;
+        }
+
+        g_lock.Acquire();
+        for (uint64_t index = first; index <= last; index++) {
+            int32_t idx = Lookup(drive, fileId, index);
+            if (idx != None) Evict(idx);
+        }
+        g_lock.Release();
+    }
+
+    void InvalidateFile(int drive, uint64_t fileId) {
+        if (g_capacity == 0) return;
+
+        g_lock.Acquire();
+        for (int i = 0; i < g_capacity; i++) {
+            if (g_pages[i].used && g_pages[i].drive == drive && g_pages[i].fileId == fileId) Evict(i);
+        }
+        g_lock.Release();
+    }
+
+    void InvalidateDrive(int drive) {
+        if (g_capacity == 0) return;
+
+        g_lock.Acquire();
+        for (int i = 0; i < g_capacity; i++) {
+            if (g_pages[i].used && g_pages[i].drive == drive) Evict(i);
+        }
+        g_lock.Release();
+    }
+
+    int Shrink(int pages) {
+        // Called from allocation paths, possibly while Fill() is allocating
+        if (g_capacity == 0 || !g_lock.TryAcquire()) return 0;
+
+        int freed = 0;
+        while (g_lruTail != None && freed < pages) {
+            int32_t idx = g_lruTail;
+            Evict(idx);
+
+            // The header stays on the free list; GetPage() allocates a new frame
+            Memory::g_pfa->Free(g_pages[idx].data);
+            g_pages[idx].data = nullptr;
+            freed++;
+        }
+
+        g_lock.Release();
+        return freed;
+    }
+
+};
@@ -0,0 +1,53 @@
+/*
+    * PageCache.hpp
+    * File data page cache with sequential readahead
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#pragma once
+#include <cstdint>
+#include "Vfs.hpp"
+
+namespace Fs::PageCache {
+
+    static constexpr uint64_t PageSize = 0x1000;
+
+    // Readahead window bounds, in pages
+    static constexpr uint32_t InitialReadahead = 4;
+    static constexpr uint32_t MaxReadahead = 32;
+
+    // Upper bound on cached pages; the actual limit is scaled to system RAM
+    static constexpr int MaxPages = 8192;
+
+    // Per-handle access pattern, owned by the VFS handle table
+    struct Readahead {
+        uint64_t nextOffset;    // Where a sequential reader would continue
+        uint32_t window;        // Current window in pages, 0 = random access
+    };
+
+    void Initialize();
+
+    // Read through the cache. fileId identifies the file within the drive and
+    // must be stable while the file exists. Returns bytes read or -1.
+    int Read(int drive, uint64_t fileId, const Vfs::FsDriver* driver, int localHandle,
+             uint64_t fileSize, uint8_t* buffer, uint64_t offset, uint64_t size,
+             Readahead& ra);
+
+    // Bulk read for one-shot streams such as file copies: cached pages are
+    // used, each uncached run goes to the driver in a single request and is
+    // not inserted, so the stream does not evict the working set.
+    int ReadThrough(int drive, uint64_t fileId, const Vfs::FsDriver* driver, int localHandle,
+                    uint64_t fileSize, uint8_t* buffer, uint64_t offset, uint64_t size);
+
+    // Drop cached pages overlapping [offset, offset + size) of a file
+    void Invalidate(int drive, uint64_t fileId, uint64_t offset, uint64_t size);
+
+    // Drop every cached page of a file, or of a whole drive
+    void InvalidateFile(int drive, uint64_t fileId);
+    void InvalidateDrive(int drive);
+
+    // Return up to `pages` cached pages to the page frame allocator.
+    // Safe to call from allocation paths.
+    int Shrink(int pages);
+
+};
@@ -1,6 +1,6 @@
 /*
     * Ramdisk.cpp
-    * USTAR tar-based ramdisk filesystem backed by Limine modules
+    * Ramdisk filesystem backed by Limine modules (USTAR or compressed image)
     * Copyright (c) 2025 Daniel Hammer
 */
 
@@ -8,12 +8,48 @@
 #include <Terminal/Terminal.hpp>
 #include <Libraries/String.hpp>
 #include <Libraries/Memory.hpp>
+#include <Libraries/Lz4.hpp>
 #include <Memory/Heap.hpp>
+#include <Memory/PageFrameAllocator.hpp>
 
 namespace Fs::Ramdisk {
 
+    // Parent index of top-level entries, and "no such entry"
+    static constexpr int RootDir = -1;
+    static constexpr int Missing = -2;
+
     static FileEntry fileTable[MaxFiles];
-    static int fileCount = 0;
+    static int slotCount = 0;       // Slots ever used; deleted ones are reused
+    static int fileCount = 0;       // Live entries
+
+    // Compressed image format, written by scripts/packramdisk.c
+    static constexpr char PackedMagic[8] = { 'M', 'T', 'K', 'R', 'A', 'M', 'Z', '1' };
+    static constexpr uint32_t PackedStored = 0x80000000;   // Block kept uncompressed
+
+    struct PackedHeader {
+        char     magic[8];
+        uint32_t entryCount;
+        uint32_t blockSize;
+    } __attribute__((packed));
+
+    struct PackedEntry {
+        char     name[MaxNameLen];
+        uint8_t  type;              // 0 = file, 1 = directory
+        uint8_t  reserved[3];
+        uint32_t blockCount;
+        uint64_t size;
+        uint64_t dataOffset;        // Block size table, then the blocks
+        uint32_t mtime;
+    } __attribute__((packed));
+
+    static_assert(sizeof(PackedEntry) == 128);
+
+    static const uint8_t* moduleEnd = nullptr;
+    static uint32_t packedBlockSize = 0;
+
+    static int16_t hashBuckets[HashBuckets];
+    static int16_t rootFirstChild = -1;
+    static int16_t rootLastChild = -1;
 
     static uint64_t OctalToUint(const char* str, int len) {
         uint64_t result = 0;
@@ -23,38 +59,183 @@ namespace Fs::Ramdisk {
         return result;
     }
 
-    static bool StrEqual(const char* a, const char* b) {
-        while (*a && *b) {
-            if (*a != *b) return false;
-            a++;
-            b++;
-        }
-        return *a == *b;
-    }
-
     static int StrLen(const char* s) {
         int n = 0;
         while (s[n]) n++;
         return n;
     }
 
-    static bool StartsWith(const char* str, const char* prefix) {
-        while (*prefix) {
-            if (*str != *prefix) return false;
-            str++;
-            prefix++;
+    // =========================================================================
+    // Path index
+    // =========================================================================
+
+    // Length of a path without its trailing '/'
+    static int KeyLen(const char* name) {
+        int len = StrLen(name);
+        while (len > 0 && name[len - 1] == '/') len--;
+        return len;
+    }
+
+    // FNV-1a
+    static uint32_t HashPath(const char* path, int len) {
+        uint32_t h = 2166136261u;
+        for (int i = 0; i < len; i++) {
+            h ^= (uint8_t)path[i];
+            h *= 16777619u;
         }
-        return true;
+        return h & (HashBuckets - 1);
     }
 
-    void Initialize(void* moduleData, uint64_t moduleSize) {
-        Kt::KernelLogStream(Kt::OK, "Ramdisk") << "Parsing USTAR archive (" << moduleSize << " bytes)";
+    // Skip the leading '/' and measure the path without trailing slashes
+    static void Normalize(const char*& path, int& len) {
+        if (path[0] == '/') path++;
+        len = KeyLen(path);
+    }
 
-        uint8_t* ptr = (uint8_t*)moduleData;
-        uint8_t* end = ptr + moduleSize;
-        fileCount = 0;
+    static int LastSlash(const char* path, int len) {
+        for (int i = len - 1; i >= 0; i--) {
+            if (path[i] == '/') return i;
+        }
+        return -1;
+    }
+
+    static int Find(const char* path, int len) {
+        for (int i = hashBuckets[HashPath(path, len)]; i >= 0; i = fileTable[i].hashNext) {
+            const char* name = fileTable[i].name;
+            if (KeyLen(name) == len && memcmp(name, path, len) == 0) return i;
+        }
+        return Missing;
+    }
+
+    // Directory that would hold `path`: RootDir, an index, or Missing
+    static int FindParent(const char* path, int len) {
+        int slash = LastSlash(path, len);
+        if (slash < 0) return RootDir;
+
+        int dir = Find(path, slash);
+        if (dir == Missing || !fileTable[dir].isDirectory) return Missing;
+        return dir;
+    }
+
+    static int16_t& FirstChild(int dir) {
+        return dir == RootDir ? rootFirstChild : fileTable[dir].firstChild;
+    }
+
+    static int16_t& LastChild(int dir) {
+        return dir == RootDir ? rootLastChild : fileTable[dir].lastChild;
+    }
+
+    static void Link(int i, int parent) {
+        FileEntry& entry = fileTable[i];
+        uint32_t bucket = HashPath(entry.name, KeyLen(entry.name));
+        entry.hashNext = hashBuckets[bucket];
+        hashBuckets[bucket] = (int16_t)i;
+
+        // Children keep archive / creation order
+        entry.parent = (int16_t)parent;
+        entry.nextSibling = -1;
+        if (LastChild(parent) >= 0) {
+            fileTable[LastChild(parent)].nextSibling = (int16_t)i;
+        } else {
+            FirstChild(parent) = (int16_t)i;
+        }
+        LastChild(parent) = (int16_t)i;
+    }
+
+    static void Unlink(int i) {
+        FileEntry& entry = fileTable[i];
+
+        int16_t* link = &hashBuckets[HashPath(entry.name, KeyLen(entry.name))];
+        while (*link != i) link = &fileTable[*link].hashNext;
+        *link = entry.hashNext;
+
+        int16_t prev = -1;
+        link = &FirstChild(entry.parent);
+        while (*link != i) {
+            prev = *link;
+            link = &fileTable[*link].nextSibling;
+        }
+        *link = entry.nextSibling;
+        if (LastChild(entry.parent) == i) LastChild(entry.parent) = prev;
+    }
+
+    // New entry for `path` (len excludes any trailing '/') under `parent`
+    static int AddEntry(const char* path, int len, bool isDirectory, int parent) {
+        if (len + (isDirectory ? 1 : 0) >= MaxNameLen) return Missing;
+
+        int i = 0;
+        while (i < slotCount && fileTable[i].inUse) i++;
+        if (i == MaxFiles) return Missing;
+        if (i == slotCount) slotCount++;
+
+        FileEntry& entry = fileTable[i];
+        memcpy(entry.name, path, len);
+        if (isDirectory) entry.name[len++] = '/';
+        entry.name[len] = '\0';
+
+        entry.data = nullptr;
+        entry.size = 0;
+        entry.capacity = 0;
+        entry.mtime = 0;
+        entry.isDirectory = isDirectory;
+        entry.heapAllocated = false;
+        entry.inUse = true;
+        entry.packed = nullptr;
+        entry.packedBlocks = 0;
+        entry.openCount = 0;
+        entry.inflated = false;
+        entry.mapped = false;
+        entry.firstChild = -1;
+        entry.lastChild = -1;
+
+        Link(i, parent);
+        fileCount++;
+        return i;
+    }
+
+    // Archives need not list every directory; create the missing ones
+    static int EnsureDirectory(const char* path, int len) {
+        if (len == 0) return RootDir;
 
-        while (ptr + 512 <= end && fileCount < MaxFiles) {
+        int i = Find(path, len);
+        if (i != Missing) return fileTable[i].isDirectory ? i : Missing;
+
+        int slash = LastSlash(path, len);
+        int parent = slash < 0 ? RootDir : EnsureDirectory(path, slash);
+        if (parent == Missing) return Missing;
+        return AddEntry(path, len, true, parent);
+    }
+
+    static bool ValidHandle(int handle) {
+        return handle >= 0 && handle < slotCount && fileTable[handle].inUse;
+    }
+
+    // =========================================================================
+    // Archive parsing
+    // =========================================================================
+
+    // Enter one archive member. `name` excludes any trailing '/'. Later
+    // members of the same path replace earlier ones, as with tar -x.
+    static bool AddMember(const char* name, int nameLen, bool isDirectory, int& dropped) {
+        int i = Find(name, nameLen);
+        if (i == Missing) {
+            int slash = LastSlash(name, nameLen);
+            int parent = slash < 0 ? RootDir : EnsureDirectory(name, slash);
+            if (parent != Missing) i = AddEntry(name, nameLen, isDirectory, parent);
+        } else if (fileTable[i].isDirectory != isDirectory) {
+            // A path cannot change between file and directory
+            i = Missing;
+        }
+
+        if (i == Missing) {
+            dropped++;
+            return false;
+        }
+        return true;
+    }
+
+    static void ParseUstar(uint8_t* ptr, uint8_t* end, int& dropped) {
+        while (ptr + 512 <= end) {
             // Check for end-of-archive (two consecutive zero blocks)
             bool allZero = true;
             for (int i = 0; i < 512; i++) {
@@ -73,93 +254,197 @@ namespace Fs::Ramdisk {
                 break;
             }
 
-            // File name at offset 0 (100 bytes)
+            // File name at offset 0 (100 bytes, not necessarily terminated)
             const char* name = (const char*)ptr;
+            int nameLen = 0;
+            while (nameLen < MaxNameLen && name[nameLen] != '\0') nameLen++;
+
             // File size at offset 124 (12 bytes, octal ASCII)
             uint64_t size = OctalToUint((const char*)(ptr + 124), 12);
+            // Modification time at offset 136 (12 bytes, octal ASCII)
+            uint32_t mtime = (uint32_t)OctalToUint((const char*)(ptr + 136), 12);
             // Type flag at offset 156
             char typeFlag = (char)ptr[156];
+            bool isDirectory = (typeFlag == '5');
 
-            FileEntry& entry = fileTable[fileCount];
+            // Data starts at next 512-byte block
+            uint8_t* data = ptr + 512;
 
-            // Copy name
-            int nameLen = 0;
-            while (nameLen < MaxNameLen - 1 && name[nameLen] != '\0') {
-                entry.name[nameLen] = name[nameLen];
-                nameLen++;
-            }
-            entry.name[nameLen] = '\0';
-
-            // Strip leading "./" if present
-            if (entry.name[0] == '.' && entry.name[1] == '/') {
-                char temp[MaxNameLen];
-                int srcIdx = 2;
-                int dstIdx = 0;
-                while (entry.name[srcIdx] && dstIdx < MaxNameLen - 1) {
-                    temp[dstIdx++] = entry.name[srcIdx++];
-                }
-                temp[dstIdx] = '\0';
-                for (int i = 0; i <= dstIdx; i++) {
-                    entry.name[i] = temp[i];
-                }
+            // Advance past header + data (rounded up to 512-byte blocks)
+            uint64_t dataBlocks = (size + 511) / 512;
+            ptr += 512 + dataBlocks * 512;
+
+            // Strip leading "./" and trailing slashes
+            if (nameLen >= 2 && name[0] == '.' && name[1] == '/') {
+                name += 2;
+                nameLen -= 2;
             }
+            while (nameLen > 0 && name[nameLen - 1] == '/') nameLen--;
 
-            entry.isDirectory = (typeFlag == '5');
+            // Skip entries that are just the root "." or empty name
+            if (nameLen == 0 || (nameLen == 1 && name[0] == '.')) continue;
+
+            if (!AddMember(name, nameLen, isDirectory, dropped)) continue;
+
+            FileEntry& entry = fileTable[Find(name, nameLen)];
+            entry.mtime = mtime;
+            if (isDirectory) continue;
+
+            entry.data = data;
             entry.size = size;
             entry.capacity = size;
-            entry.heapAllocated = false;
+        }
+    }
 
-            // Data starts at next 512-byte block
-            entry.data = ptr + 512;
+    static void ParsePacked(uint8_t* base, uint64_t moduleSize, int& dropped) {
+        const PackedHeader* hdr = (const PackedHeader*)base;
+        uint64_t tableEnd = sizeof(PackedHeader) + (uint64_t)hdr->entryCount * sizeof(PackedEntry);
+        if (tableEnd > moduleSize || hdr->blockSize == 0 || hdr->blockSize > 0xFFFF) {
+            Kt::KernelLogStream(Kt::ERROR, "Ramdisk") << "Corrupt compressed image header";
+            return;
+        }
+        packedBlockSize = hdr->blockSize;
 
-            // Skip entries that are just the root "." or empty name
-            if (entry.name[0] == '\0' || (entry.name[0] == '.' && entry.name[1] == '\0')) {
-                // Advance past header + data blocks
-                uint64_t dataBlocks = (size + 511) / 512;
-                ptr += 512 + dataBlocks * 512;
+        const PackedEntry* table = (const PackedEntry*)(base + sizeof(PackedHeader));
+        for (uint32_t n = 0; n < hdr->entryCount; n++) {
+            const PackedEntry& pe = table[n];
+
+            int nameLen = 0;
+            while (nameLen < MaxNameLen && pe.name[nameLen] != '\0') nameLen++;
+            while (nameLen > 0 && pe.name[nameLen - 1] == '/') nameLen--;
+            if (nameLen == 0) continue;
+
+            bool isDirectory = pe.type == 1;
+            if (!AddMember(pe.name, nameLen, isDirectory, dropped)) continue;
+            if (isDirectory) {
+                fileTable[Find(pe.name, nameLen)].mtime = pe.mtime;
                 continue;
             }
 
-            fileCount++;
+            // Block table and blocks are bounds-checked again on inflation
+            uint64_t blocks = (pe.size + packedBlockSize - 1) / packedBlockSize;
+            if (pe.blockCount != blocks
+                || (blocks > 0 && pe.dataOffset + blocks * 4 > moduleSize)) {
+                Kt::KernelLogStream(Kt::WARNING, "Ramdisk") << "Corrupt entry " << (uint64_t)n << ", skipped";
+                dropped++;
+                continue;
+            }
 
-            // Advance past header + data (rounded up to 512-byte blocks)
-            uint64_t dataBlocks = (size + 511) / 512;
-            ptr += 512 + dataBlocks * 512;
+            FileEntry& entry = fileTable[Find(pe.name, nameLen)];
+            entry.mtime = pe.mtime;
+            entry.data = nullptr;
+            entry.size = pe.size;
+            entry.capacity = 0;
+            entry.packed = blocks > 0 ? base + pe.dataOffset : nullptr;
+            entry.packedBlocks = (uint32_t)blocks;
         }
-
-        Kt::KernelLogStream(Kt::OK, "Ramdisk") << "Loaded " << fileCount << " entries";
     }
 
-    int Open(const char* path) {
-        // Normalize: skip leading '/'
-        if (path[0] == '/') path++;
+    // Decompress a packed file into page-aligned memory. The packed source is
+    // kept, so the copy can be dropped when the file is closed.
+    static bool Inflate(FileEntry& entry) {
+        if (entry.packed == nullptr || entry.inflated) return true;
+
+        uint64_t pages = (entry.size + 0xFFF) / 0x1000;
+        uint8_t* buf = (uint8_t*)(pages == 1
+            ? Memory::g_pfa->Allocate()
+            : Memory::g_pfa->AllocateConsecutive((int)pages));
+        if (buf == nullptr) {
+            Kt::KernelLogStream(Kt::ERROR, "Ramdisk") << "Out of memory inflating " << entry.name;
+            return false;
+        }
 
-        for (int i = 0; i < fileCount; i++) {
-            if (StrEqual(fileTable[i].name, path)) {
-                return i;
+        const uint32_t* sizes = (const uint32_t*)entry.packed;
+        const uint8_t* src = entry.packed + (uint64_t)entry.packedBlocks * 4;
+        for (uint32_t b = 0; b < entry.packedBlocks; b++) {
+            uint64_t done = (uint64_t)b * packedBlockSize;
+            int expected = (int)(entry.size - done < packedBlockSize ? entry.size - done : packedBlockSize);
+            uint32_t len = sizes[b] & ~PackedStored;
+
+            bool ok = src + len <= moduleEnd;
+            if (ok && (sizes[b] & PackedStored)) {
+                ok = (int)len == expected;
+                if (ok) memcpy(buf + done, src, len);
+            } else if (ok) {
+                ok = Lib::Lz4::Decompress(src, (int)len, buf + done, expected) == expected;
             }
-            // Also try matching with trailing slash stripped from table entry
-            int entryLen = StrLen(fileTable[i].name);
-            if (entryLen > 0 && fileTable[i].name[entryLen - 1] == '/') {
-                // Compare without trailing slash
-                bool match = true;
-                int pathLen = StrLen(path);
-                if (pathLen == entryLen - 1) {
-                    for (int j = 0; j < pathLen; j++) {
-                        if (path[j] != fileTable[i].name[j]) {
-                            match = false;
-                            break;
-                        }
-                    }
-                    if (match) return i;
-                }
+
+            if (!ok) {
+                Kt::KernelLogStream(Kt::ERROR, "Ramdisk") << "Corrupt block " << (uint64_t)b << " in " << entry.name;
+                Memory::g_pfa->Free(buf, pages);
+                return false;
             }
+            src += len;
         }
-        return -1;
+
+        entry.data = buf;
+        entry.capacity = pages * 0x1000;
+        entry.inflated = true;
+        return true;
+    }
+
+    // Free the inflated copy of a packed file. Pages handed out by Map() are
+    // kept: the ELF loader shares them with processes, which do not track
+    // them, so a mapped file stays resident for the life of the kernel.
+    static void ReleaseInflated(FileEntry& entry) {
+        if (!entry.inflated) return;
+        if (!entry.mapped) Memory::g_pfa->Free(entry.data, (int)(entry.capacity / 0x1000));
+        entry.data = nullptr;
+        entry.capacity = 0;
+        entry.inflated = false;
+        entry.mapped = false;
+    }
+
+    // The file is rewritten or removed: its packed contents are gone for good
+    static void DropPacked(FileEntry& entry) {
+        ReleaseInflated(entry);
+        entry.packed = nullptr;
+        entry.packedBlocks = 0;
+    }
+
+    void Initialize(void* moduleData, uint64_t moduleSize) {
+        uint8_t* base = (uint8_t*)moduleData;
+        bool packed = moduleSize >= sizeof(PackedHeader) && memcmp(base, PackedMagic, 8) == 0;
+        Kt::KernelLogStream(Kt::OK, "Ramdisk") << "Parsing " << (packed ? "compressed image" : "USTAR archive")
+            << " (" << moduleSize << " bytes)";
+
+        slotCount = 0;
+        fileCount = 0;
+        rootFirstChild = -1;
+        rootLastChild = -1;
+        for (int i = 0; i < HashBuckets; i++) hashBuckets[i] = -1;
+        moduleEnd = base + moduleSize;
+
+        int dropped = 0;
+        if (packed) {
+            ParsePacked(base, moduleSize, dropped);
+        } else {
+            ParseUstar(base, base + moduleSize, dropped);
+        }
+
+        if (dropped > 0) {
+            Kt::KernelLogStream(Kt::WARNING, "Ramdisk") << "Skipped " << dropped << " entries (table full or bad path)";
+        }
+        Kt::KernelLogStream(Kt::OK, "Ramdisk") << "Loaded " << fileCount << " entries";
+    }
+
+    // =========================================================================
+    // FsDriver interface
+    // =========================================================================
+
+    int Open(const char* path) {
+        int len;
+        Normalize(path, len);
+        if (len == 0) return -1;
+
+        int i = Find(path, len);
+        if (i == Missing || !Inflate(fileTable[i])) return -1;
+        fileTable[i].openCount++;
+        return i;
     }
 
     int Read(int handle, uint8_t* buffer, uint64_t offset, uint64_t size) {
-        if (handle < 0 || handle >= fileCount) return -1;
+        if (!ValidHandle(handle)) return -1;
 
         const FileEntry& entry = fileTable[handle];
         if (offset >= entry.size) return 0;
@@ -174,68 +459,71 @@ namespace Fs::Ramdisk {
     }
 
     uint64_t GetSize(int handle) {
-        if (handle < 0 || handle >= fileCount) return 0;
+        if (!ValidHandle(handle)) return 0;
         return fileTable[handle].size;
     }
 
     void Close(int handle) {
-        // No-op for ramdisk: files are memory-mapped and read-only
-        (void)handle;
+        if (!ValidHandle(handle)) return;
+
+        FileEntry& entry = fileTable[handle];
+        if (entry.openCount > 0 && --entry.openCount == 0 && !entry.mapped) {
+            ReleaseInflated(entry);
+        }
     }
 
     int ReadDir(const char* path, const char** outNames, int maxEntries) {
-        // Normalize path: skip leading '/'
-        if (path[0] == '/') path++;
+        int len;
+        Normalize(path, len);
+
+        int dir = RootDir;
+        if (len > 0) {
+            dir = Find(path, len);
+            if (dir == Missing || !fileTable[dir].isDirectory) return 0;
+        }
 
-        int pathLen = StrLen(path);
         int count = 0;
+        for (int i = FirstChild(dir); i >= 0 && count < maxEntries; i = fileTable[i].nextSibling) {
+            outNames[count++] = fileTable[i].name;
+        }
+        return count;
+    }
 
-        for (int i = 0; i < fileCount && count < maxEntries; i++) {
-            const char* entryName = fileTable[i].name;
-
-            if (pathLen == 0) {
-                // Root directory: find entries without '/' in them (or only trailing '/')
-                bool hasSlash = false;
-                int entryLen = StrLen(entryName);
-                for (int j = 0; j < entryLen; j++) {
-                    if (entryName[j] == '/' && j < entryLen - 1) {
-                        hasSlash = true;
-                        break;
-                    }
-                }
-                if (!hasSlash) {
-                    outNames[count++] = entryName;
-                }
-            } else {
-                // Subdirectory: match entries starting with "path/"
-                // and that are direct children (no additional '/' beyond the prefix)
-                if (!StartsWith(entryName, path)) continue;
-
-                // Check that path prefix is followed by '/'
-                char separator = entryName[pathLen];
-                if (separator != '/') continue;
-
-                // Check it's a direct child (no more '/' except trailing)
-                const char* rest = entryName + pathLen + 1;
-                int restLen = StrLen(rest);
-                bool hasDeepSlash = false;
-                for (int j = 0; j < restLen; j++) {
-                    if (rest[j] == '/' && j < restLen - 1) {
-                        hasDeepSlash = true;
-                        break;
-                    }
-                }
-                if (!hasDeepSlash && restLen > 0) {
-                    outNames[count++] = entryName;
-                }
-            }
+    int ReadDirPlus(const char* path, uint64_t* cursor, Vfs::DirEmitFn emit, void* ctx) {
+        int len;
+        Normalize(path, len);
+
+        int dir = RootDir;
+        if (len > 0) {
+            dir = Find(path, len);
+            if (dir == Missing || !fileTable[dir].isDirectory) return -1;
         }
 
-        return count;
+        // The cursor counts children; the list is append-only apart from deletes
+        uint64_t skip = *cursor;
+        int i = FirstChild(dir);
+        for (; i >= 0 && skip > 0; i = fileTable[i].nextSibling) skip--;
+
+        for (; i >= 0; i = fileTable[i].nextSibling) {
+            const FileEntry& entry = fileTable[i];
+            int nameLen = KeyLen(entry.name);
+            int slash = LastSlash(entry.name, nameLen);
+
+            Vfs::DirEntryInfo info;
+            info.Name = entry.name + slash + 1;
+            info.NameLen = nameLen - slash - 1;
+            info.IsDirectory = entry.isDirectory;
+            info.Size = entry.isDirectory ? 0 : entry.size;
+            info.MTime = entry.mtime;
+            info.FileId = (uint64_t)i + 1;
+            if (!emit(ctx, info)) return 1;
+            (*cursor)++;
+        }
+        return 0;
     }
 
     int Write(int handle, const uint8_t* buffer, uint64_t offset, uint64_t size) {
-        if (handle < 0 || handle >= fileCount) return -1;
+        if (!ValidHandle(handle)) return -1;
         if (buffer == nullptr || size == 0) return 0;
 
         FileEntry& entry = fileTable[handle];
@@ -259,6 +547,7 @@ namespace Fs::Ramdisk {
             if (entry.data && entry.size > 0) {
                 memcpy(newBuf, entry.data, entry.size);
             }
+            DropPacked(entry);
 
             entry.data = newBuf;
             entry.capacity = newCap;
@@ -293,120 +582,143 @@ namespace Fs::Ramdisk {
 
     int Create(const char* path) {
         if (path == nullptr) return -1;
-        if (fileCount >= MaxFiles) return -1;
-
-        // Normalize: skip leading '/'
-        if (path[0] == '/') path++;
 
-        // Check if file already exists
-        for (int i = 0; i < fileCount; i++) {
-            if (StrEqual(fileTable[i].name, path)) {
-                // File exists — truncate it
-                FileEntry& entry = fileTable[i];
-                if (!entry.heapAllocated) {
-                    uint8_t* newBuf = (uint8_t*)Memory::g_heap->Request(256);
-                    if (newBuf == nullptr) return -1;
-                    entry.data = newBuf;
-                    entry.capacity = 256;
-                    entry.heapAllocated = true;
-                }
-                entry.size = 0;
-                entry.isDirectory = false;
-                return i;
+        int len;
+        Normalize(path, len);
+        if (len == 0) return -1;
+
+        int i = Find(path, len);
+        if (i != Missing) {
+            // File exists — truncate it
+            FileEntry& entry = fileTable[i];
+            if (entry.isDirectory) return -1;
+            if (!entry.heapAllocated) {
+                uint8_t* newBuf = (uint8_t*)Memory::g_heap->Request(256);
+                if (newBuf == nullptr) return -1;
+                DropPacked(entry);
+                entry.data = newBuf;
+                entry.capacity = 256;
+                entry.heapAllocated = true;
             }
+            entry.size = 0;
+            entry.openCount++;
+            return i;
         }
 
-        // Create new file entry
-        FileEntry& entry = fileTable[fileCount];
-
-        int nameLen = 0;
-        while (nameLen < MaxNameLen - 1 && path[nameLen] != '\0') {
-            entry.name[nameLen] = path[nameLen];
-            nameLen++;
-        }
-        entry.name[nameLen] = '\0';
+        int parent = FindParent(path, len);
+        if (parent == Missing) return -1;
 
         uint8_t* buf = (uint8_t*)Memory::g_heap->Request(256);
         if (buf == nullptr) return -1;
 
+        i = AddEntry(path, len, false, parent);
+        if (i == Missing) {
+            Memory::g_heap->Free(buf);
+            return -1;
+        }
+
+        FileEntry& entry = fileTable[i];
         entry.data = buf;
-        entry.size = 0;
         entry.capacity = 256;
-        entry.isDirectory = false;
         entry.heapAllocated = true;
-
-        return fileCount++;
+        entry.openCount = 1;
+        return i;
     }
 
     int Delete(const char* path) {
         if (path == nullptr) return -1;
-        if (path[0] == '/') path++;
 
-        for (int i = 0; i < fileCount; i++) {
-            if (StrEqual(fileTable[i].name, path)) {
-                // Free heap-allocated data
-                if (fileTable[i].heapAllocated && fileTable[i].data) {
-                    Memory::g_heap->Free(fileTable[i].data);
-                }
+        int len;
+        Normalize(path, len);
+        if (len == 0) return -1;
 
-                // Shift remaining entries down
-                for (int j = i; j < fileCount - 1; j++) {
-                    fileTable[j] = fileTable[j + 1];
-                }
-                fileCount--;
-                return 0;
-            }
+        int i = Find(path, len);
+        if (i == Missing) return -1;  // not found
+
+        // Only empty directories can go
+        FileEntry& entry = fileTable[i];
+        if (entry.isDirectory && entry.firstChild >= 0) return -1;
+
+        // Free heap-allocated data
+        if (entry.heapAllocated && entry.data) {
+            Memory::g_heap->Free(entry.data);
         }
-        return -1;  // not found
+        DropPacked(entry);
+
+        // The slot is reused, so handles and nodes of other entries stay valid
+        Unlink(i);
+        entry.inUse = false;
+        entry.data = nullptr;
+        entry.packed = nullptr;
+        entry.heapAllocated = false;
+        fileCount--;
+        return 0;
     }
 
     int Mkdir(const char* path) {
         if (path == nullptr) return -1;
-        if (fileCount >= MaxFiles) return -1;
-        if (path[0] == '/') path++;
+
+        int len;
+        Normalize(path, len);
+        if (len == 0) return 0;
 
         // Check if directory already exists
-        for (int i = 0; i < fileCount; i++) {
-            if (StrEqual(fileTable[i].name, path) && fileTable[i].isDirectory) {
-                return 0;  // already exists
-            }
-            // Also check with trailing slash
-            int pathLen = StrLen(path);
-            int entryLen = StrLen(fileTable[i].name);
-            if (entryLen == pathLen + 1 && fileTable[i].name[entryLen - 1] == '/' &&
-                fileTable[i].isDirectory) {
-                bool match = true;
-                for (int j = 0; j < pathLen; j++) {
-                    if (path[j] != fileTable[i].name[j]) { match = false; break; }
-                }
-                if (match) return 0;
-            }
-        }
+        int i = Find(path, len);
+        if (i != Missing) return fileTable[i].isDirectory ? 0 : -1;
+
+        int parent = FindParent(path, len);
+        if (parent == Missing) return -1;
 
-        // Create directory entry (stored with trailing slash for tar convention)
-        FileEntry& entry = fileTable[fileCount];
+        // Stored with trailing slash for tar convention
+        return AddEntry(path, len, true, parent) == Missing ? -1 : 0;
+    }
 
-        int nameLen = 0;
-        while (nameLen < MaxNameLen - 2 && path[nameLen] != '\0') {
-            entry.name[nameLen] = path[nameLen];
-            nameLen++;
+    int GetFileCount() {
+        return fileCount;
+    }
+
+    int Lookup(uint64_t dirNode, const char* name, uint64_t* outNode, bool* outIsDir) {
+        // Build "dir/name" and look it up in the path index
+        char path[MaxNameLen];
+        int len = 0;
+        if (dirNode != 0) {
+            int dir = (int)dirNode - 1;
+            if (!ValidHandle(dir) || !fileTable[dir].isDirectory) return -1;
+            len = KeyLen(fileTable[dir].name);
+            memcpy(path, fileTable[dir].name, len);
+            path[len++] = '/';
         }
-        // Add trailing slash
-        entry.name[nameLen++] = '/';
-        entry.name[nameLen] = '\0';
 
-        entry.data = nullptr;
-        entry.size = 0;
-        entry.capacity = 0;
-        entry.isDirectory = true;
-        entry.heapAllocated = false;
+        int nameLen = StrLen(name);
+        if (len + nameLen >= MaxNameLen) return 0;
+        memcpy(path + len, name, nameLen);
+        len += nameLen;
 
-        fileCount++;
-        return 0;
+        int i = Find(path, len);
+        if (i == Missing) return 0;
+
+        *outNode = (uint64_t)i + 1;
+        *outIsDir = fileTable[i].isDirectory;
+        return 1;
     }
 
-    int GetFileCount() {
-        return fileCount;
+    int OpenNode(uint64_t node) {
+        // The root has no entry of its own
+        if (node == 0) return -1;
+
+        int i = (int)node - 1;
+        if (!ValidHandle(i) || !Inflate(fileTable[i])) return -1;
+        fileTable[i].openCount++;
+        return i;
+    }
+
+    const uint8_t* Map(int handle) {
+        if (!ValidHandle(handle)) return nullptr;
+
+        FileEntry& entry = fileTable[handle];
+        if (entry.isDirectory || entry.heapAllocated) return nullptr;
+        if (entry.inflated) entry.mapped = true;
+        return entry.data;
     }
 
 }
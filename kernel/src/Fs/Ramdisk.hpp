@@ -1,25 +1,47 @@
 /*
     * Ramdisk.hpp
-    * USTAR tar-based ramdisk filesystem backed by Limine modules
+    * Ramdisk filesystem backed by Limine modules (USTAR or compressed image)
     * Copyright (c) 2025 Daniel Hammer
 */
 
 #pragma once
 #include <cstdint>
 #include <cstddef>
+#include <Fs/Vfs.hpp>
 
 namespace Fs::Ramdisk {
 
     static constexpr int MaxFiles = 256;
     static constexpr int MaxNameLen = 100;
 
+    // Path index buckets (power of two)
+    static constexpr int HashBuckets = 128;
+
     struct FileEntry {
-        char name[MaxNameLen];
+        char name[MaxNameLen];      // Full path; directories keep the tar trailing '/'
         uint8_t* data;
         uint64_t size;
         uint64_t capacity;
+        uint32_t mtime;             // Unix seconds from the archive, 0 if unknown
         bool isDirectory;
         bool heapAllocated;
+        bool inUse;
+
+        // Compressed images: the file's block size table followed by its
+        // blocks in the module. Inflated into `data` on open and freed again
+        // on the last close, unless Map() handed the pages out.
+        const uint8_t* packed;
+        uint32_t packedBlocks;
+        uint16_t openCount;
+        bool inflated;              // `data` holds pages from the inflater
+        bool mapped;                // Inflated pages are in use for good
+
+        // Path index chain and directory tree, as fileTable indices (-1 = none)
+        int16_t hashNext;
+        int16_t parent;             // -1 = root
+        int16_t firstChild;
+        int16_t lastChild;
+        int16_t nextSibling;
     };
 
     void Initialize(void* moduleData, uint64_t moduleSize);
@@ -32,8 +54,18 @@ namespace Fs::Ramdisk {
     void Close(int handle);
 
     int ReadDir(const char* path, const char** outNames, int maxEntries);
+    int ReadDirPlus(const char* path, uint64_t* cursor, Vfs::DirEmitFn emit, void* ctx);
     int Delete(const char* path);
     int Mkdir(const char* path);
     int GetFileCount();
 
+    // Dentry cache hooks; a node is its entry's index + 1 (0 = root)
+    int Lookup(uint64_t dirNode, const char* name, uint64_t* outNode, bool* outIsDir);
+    int OpenNode(uint64_t node);
+
+    // Contents of a file still backed by the boot module, which stays resident
+    // and unchanged; an inflated copy is kept from then on. nullptr for
+    // directories and files rewritten since boot.
+    const uint8_t* Map(int handle);
+
 }
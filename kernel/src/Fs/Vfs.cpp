@@ -5,6 +5,11 @@
 */
 
 #include "Vfs.hpp"
+#include "PageCache.hpp"
+#include "DentryCache.hpp"
+#include <Libraries/Memory.hpp>
+#include <Memory/Heap.hpp>
+#include <Memory/PageFrameAllocator.hpp>
 #include <Terminal/Terminal.hpp>
 
 namespace Fs::Vfs {
@@ -13,10 +18,19 @@ namespace Fs::Vfs {
         bool inUse;
         int driveNumber;
         int localHandle;
+        PageCache::Readahead readahead;
     };
 
     static FsDriver* driveTable[MaxDrives];
-    static HandleEntry handleTable[MaxHandles];
+
+    // Chunks are never moved or freed, so an entry reference stays valid
+    // while its owner blocks in driver I/O and other tasks open files
+    static HandleEntry* handleChunks[MaxHandles / HandleChunkSize];
+    static int handleCapacity = 0;
+
+    static HandleEntry& Entry(int handle) {
+        return handleChunks[handle / HandleChunkSize][handle % HandleChunkSize];
+    }
 
     // Parse "N:/path" into drive number and local path.
     // Returns true on success, sets outDrive and outPath.
@@ -43,28 +57,84 @@ namespace Fs::Vfs {
         return true;
     }
 
+    static uint64_t GetFileId(int drive, int localHandle) {
+        if (driveTable[drive]->GetFileId == nullptr) return 0;
+        return driveTable[drive]->GetFileId(localHandle);
+    }
+
+    // Open a local path, resolving through the dentry cache when the driver
+    // supports it. Known-missing paths fail without reaching the driver.
+    static int OpenLocal(int drive, const char* localPath) {
+        FsDriver* driver = driveTable[drive];
+
+        uint64_t node;
+        switch (DentryCache::Resolve(drive, driver, localPath, node)) {
+            case DentryCache::Result::Found:    return driver->OpenNode(node);
+            case DentryCache::Result::NotFound: return -1;
+            default:                            return driver->Open(localPath);
+        }
+    }
+
+    // The children of the directory containing `localPath` are changing
+    static void InvalidateParent(int drive, const char* localPath) {
+        char parent[256];
+        int last = 0;
+        int len = 0;
+        for (; localPath[len]; len++) {
+            if (localPath[len] == '/' && localPath[len + 1] != '\0' && localPath[len + 1] != '/') last = len;
+        }
+
+        uint64_t node;
+        if (last < (int)sizeof(parent)) {
+            memcpy(parent, localPath, last);
+            parent[last] = '\0';
+            if (DentryCache::Resolve(drive, driveTable[drive], parent, node) == DentryCache::Result::Found) {
+                DentryCache::InvalidateDir(drive, node);
+                return;
+            }
+        }
+        DentryCache::InvalidateDrive(drive);
+    }
+
+    static bool ValidHandle(int handle) {
+        return handle >= 0 && handle < handleCapacity && Entry(handle).inUse;
+    }
+
     static int AllocHandle() {
-        for (int i = 0; i < MaxHandles; i++) {
-            if (!handleTable[i].inUse) return i;
+        for (int i = 0; i < handleCapacity; i++) {
+            if (!Entry(i).inUse) return i;
         }
-        return -1;
+        if (handleCapacity >= MaxHandles) return -1;
+
+        auto* chunk = (HandleEntry*)Memory::g_heap->Request(HandleChunkSize * sizeof(HandleEntry));
+        if (chunk == nullptr) return -1;
+        memset(chunk, 0, HandleChunkSize * sizeof(HandleEntry));
+
+        int handle = handleCapacity;
+        handleChunks[handle / HandleChunkSize] = chunk;
+        handleCapacity += HandleChunkSize;
+        return handle;
     }
 
     void Initialize() {
         for (int i = 0; i < MaxDrives; i++) {
             driveTable[i] = nullptr;
         }
-        for (int i = 0; i < MaxHandles; i++) {
-            handleTable[i].inUse = false;
-        }
 
-        Kt::KernelLogStream(Kt::OK, "VFS") << "Initialized (" << MaxDrives << " drives, " << MaxHandles << " handles)";
+        PageCache::Initialize();
+        DentryCache::Initialize();
+
+        Kt::KernelLogStream(Kt::OK, "VFS") << "Initialized (" << MaxDrives << " drives, " << MaxHandles << " handles max)";
     }
 
     int RegisterDrive(int driveNumber, FsDriver* driver) {
         if (driveNumber < 0 || driveNumber >= MaxDrives) return -1;
         if (driver == nullptr) return -1;
 
+        // A remount or reformat must not see the previous volume's pages
+        PageCache::InvalidateDrive(driveNumber);
+        DentryCache::InvalidateDrive(driveNumber);
+
         driveTable[driveNumber] = driver;
         Kt::KernelLogStream(Kt::OK, "VFS") << "Registered drive " << driveNumber;
         return 0;
@@ -84,7 +154,7 @@ namespace Fs::Vfs {
             return -1;
         }
 
-        int localHandle = driveTable[drive]->Open(localPath);
+        int localHandle = OpenLocal(drive, localPath);
         if (localHandle < 0) return -1;
 
         int globalHandle = AllocHandle();
@@ -94,41 +164,133 @@ namespace Fs::Vfs {
             return -1;
         }
 
-        handleTable[globalHandle].inUse = true;
-        handleTable[globalHandle].driveNumber = drive;
-        handleTable[globalHandle].localHandle = localHandle;
+        Entry(globalHandle).inUse = true;
+        Entry(globalHandle).driveNumber = drive;
+        Entry(globalHandle).localHandle = localHandle;
+        Entry(globalHandle).readahead = {};
 
         return globalHandle;
     }
 
     int VfsRead(int handle, uint8_t* buffer, uint64_t offset, uint64_t size) {
-        if (handle < 0 || handle >= MaxHandles || !handleTable[handle].inUse) return -1;
+        if (!ValidHandle(handle)) return -1;
+
+        HandleEntry& entry = Entry(handle);
+        FsDriver* driver = driveTable[entry.driveNumber];
 
-        HandleEntry& entry = handleTable[handle];
-        return driveTable[entry.driveNumber]->Read(entry.localHandle, buffer, offset, size);
+        uint64_t fileId = GetFileId(entry.driveNumber, entry.localHandle);
+        if (fileId == 0) return driver->Read(entry.localHandle, buffer, offset, size);
+
+        return PageCache::Read(entry.driveNumber, fileId, driver, entry.localHandle,
+                               driver->GetSize(entry.localHandle), buffer, offset, size,
+                               entry.readahead);
     }
 
     uint64_t VfsGetSize(int handle) {
-        if (handle < 0 || handle >= MaxHandles || !handleTable[handle].inUse) return 0;
+        if (!ValidHandle(handle)) return 0;
 
-        HandleEntry& entry = handleTable[handle];
+        HandleEntry& entry = Entry(handle);
         return driveTable[entry.driveNumber]->GetSize(entry.localHandle);
     }
 
+    const uint8_t* VfsMap(int handle) {
+        if (!ValidHandle(handle)) return nullptr;
+
+        HandleEntry& entry = Entry(handle);
+        FsDriver* driver = driveTable[entry.driveNumber];
+        if (driver->Map == nullptr) return nullptr;
+        return driver->Map(entry.localHandle);
+    }
+
     void VfsClose(int handle) {
-        if (handle < 0 || handle >= MaxHandles || !handleTable[handle].inUse) return;
+        if (!ValidHandle(handle)) return;
 
-        HandleEntry& entry = handleTable[handle];
+        HandleEntry& entry = Entry(handle);
         driveTable[entry.driveNumber]->Close(entry.localHandle);
         entry.inUse = false;
     }
 
     int VfsWrite(int handle, const uint8_t* buffer, uint64_t offset, uint64_t size) {
-        if (handle < 0 || handle >= MaxHandles || !handleTable[handle].inUse) return -1;
+        if (!ValidHandle(handle)) return -1;
+
+        HandleEntry& entry = Entry(handle);
+        FsDriver* driver = driveTable[entry.driveNumber];
+        if (driver->Write == nullptr) return -1;
+
+        uint64_t oldSize = driver->GetSize(entry.localHandle);
+        int result = driver->Write(entry.localHandle, buffer, offset, size);
+
+        // Cached pages are clean copies; drop everything the write touched,
+        // including the old tail page when the file was extended past it.
+        // The id is taken afterwards since a first write may assign it.
+        uint64_t fileId = GetFileId(entry.driveNumber, entry.localHandle);
+        if (fileId != 0) {
+            uint64_t start = offset < oldSize ? offset : oldSize;
+            PageCache::Invalidate(entry.driveNumber, fileId, start, offset + size - start);
+        }
+        return result;
+    }
+
+    int64_t VfsCopyRange(int srcHandle, uint64_t srcOffset, int dstHandle, uint64_t dstOffset, uint64_t size) {
+        if (!ValidHandle(srcHandle) || !ValidHandle(dstHandle)) return -1;
+
+        HandleEntry& src = Entry(srcHandle);
+        FsDriver* srcDriver = driveTable[src.driveNumber];
+        uint64_t srcSize = srcDriver->GetSize(src.localHandle);
+        if (srcOffset >= srcSize) return 0;
+        if (size > srcSize - srcOffset) size = srcSize - srcOffset;
+
+        // Copying forwards within one file would read back what it just wrote
+        HandleEntry& dst = Entry(dstHandle);
+        uint64_t srcId = GetFileId(src.driveNumber, src.localHandle);
+        bool sameFile = srcHandle == dstHandle ||
+            (srcId != 0 && dst.driveNumber == src.driveNumber &&
+             GetFileId(dst.driveNumber, dst.localHandle) == srcId);
+        if (sameFile && srcOffset < dstOffset + size && dstOffset < srcOffset + size) return -1;
+
+        // Resident sources are written straight from their backing memory.
+        // Otherwise copy through a bounce buffer, down to a single page when
+        // memory is too fragmented for a large one.
+        const uint8_t* mapped = VfsMap(srcHandle);
+        uint8_t* bounce = nullptr;
+        int bouncePages = 0;
+        uint64_t chunkSize = (uint64_t)CopyChunkPages * 0x1000;
+        if (mapped == nullptr) {
+            bouncePages = CopyChunkPages;
+            bounce = (uint8_t*)Memory::g_pfa->AllocateConsecutive(bouncePages);
+            if (bounce == nullptr) {
+                bouncePages = 1;
+                bounce = (uint8_t*)Memory::g_pfa->Allocate();
+            }
+            if (bounce == nullptr) return -1;
+            chunkSize = (uint64_t)bouncePages * 0x1000;
+        }
+
+        uint64_t done = 0;
+        while (done < size) {
+            uint64_t chunk = size - done < chunkSize ? size - done : chunkSize;
+            const uint8_t* data;
+
+            if (mapped != nullptr) {
+                data = mapped + srcOffset + done;
+            } else {
+                int got = srcId != 0
+                    ? PageCache::ReadThrough(src.driveNumber, srcId, srcDriver, src.localHandle,
+                                             srcSize, bounce, srcOffset + done, chunk)
+                    : srcDriver->Read(src.localHandle, bounce, srcOffset + done, chunk);
+                if (got <= 0) break;
+                chunk = (uint64_t)got;
+                data = bounce;
+            }
+
+            int written = VfsWrite(dstHandle, data, dstOffset + done, chunk);
+            if (written > 0) done += (uint64_t)written;
+            if (written < 0 || (uint64_t)written < chunk) break;
+        }
 
-        HandleEntry& entry = handleTable[handle];
-        if (driveTable[entry.driveNumber]->Write == nullptr) return -1;
-        return driveTable[entry.driveNumber]->Write(entry.localHandle, buffer, offset, size);
+        if (bounce != nullptr) Memory::g_pfa->Free(bounce, bouncePages);
+        if (done == 0 && size > 0) return -1;
+        return (int64_t)done;
     }
 
     int VfsCreate(const char* path) {
@@ -147,8 +309,22 @@ namespace Fs::Vfs {
 
         if (driveTable[drive]->Create == nullptr) return -1;
 
+        // Create truncates an existing file, which can change its id (FAT32
+        // drops the first cluster), so resolve the cached pages' id first
+        uint64_t oldId = 0;
+        int existing = OpenLocal(drive, localPath);
+        if (existing >= 0) {
+            oldId = GetFileId(drive, existing);
+            driveTable[drive]->Close(existing);
+        }
+
         int localHandle = driveTable[drive]->Create(localPath);
         if (localHandle < 0) return -1;
+        InvalidateParent(drive, localPath);
+
+        uint64_t fileId = GetFileId(drive, localHandle);
+        if (oldId != 0) PageCache::InvalidateFile(drive, oldId);
+        if (fileId != 0 && fileId != oldId) PageCache::InvalidateFile(drive, fileId);
 
         int globalHandle = AllocHandle();
         if (globalHandle < 0) {
@@ -156,9 +332,10 @@ namespace Fs::Vfs {
             return -1;
         }
 
-        handleTable[globalHandle].inUse = true;
-        handleTable[globalHandle].driveNumber = drive;
-        handleTable[globalHandle].localHandle = localHandle;
+        Entry(globalHandle).inUse = true;
+        Entry(globalHandle).driveNumber = drive;
+        Entry(globalHandle).localHandle = localHandle;
+        Entry(globalHandle).readahead = {};
 
         return globalHandle;
     }
@@ -173,7 +350,26 @@ namespace Fs::Vfs {
 
         if (driveTable[drive]->Delete == nullptr) return -1;
 
-        return driveTable[drive]->Delete(localPath);
+        // Resolve the file id first: a later file may reuse the inode or cluster
+        uint64_t fileId = 0;
+        int localHandle = OpenLocal(drive, localPath);
+        if (localHandle >= 0) {
+            fileId = GetFileId(drive, localHandle);
+            driveTable[drive]->Close(localHandle);
+        }
+
+        // Likewise for the node, which may have cached (negative) children
+        uint64_t node;
+        bool hasNode = DentryCache::Resolve(drive, driveTable[drive], localPath, node)
+            == DentryCache::Result::Found;
+
+        int result = driveTable[drive]->Delete(localPath);
+        if (result >= 0) {
+            if (fileId != 0) PageCache::InvalidateFile(drive, fileId);
+            if (hasNode) DentryCache::InvalidateDir(drive, node);
+            InvalidateParent(drive, localPath);
+        }
+        return result;
     }
 
     int VfsMkdir(const char* path) {
@@ -184,7 +380,9 @@ namespace Fs::Vfs {
         if (drive < 0 || drive >= MaxDrives || driveTable[drive] == nullptr) return -1;
         if (driveTable[drive]->Mkdir == nullptr) return -1;
 
-        return driveTable[drive]->Mkdir(localPath);
+        int result = driveTable[drive]->Mkdir(localPath);
+        if (result >= 0) InvalidateParent(drive, localPath);
+        return result;
     }
 
     int VfsDriveList(int* outDrives, int maxEntries) {
@@ -197,6 +395,12 @@ namespace Fs::Vfs {
         return count;
     }
 
+    int64_t VfsTrim(int drive) {
+        if (drive < 0 || drive >= MaxDrives || driveTable[drive] == nullptr) return -1;
+        if (driveTable[drive]->Trim == nullptr) return -1;
+        return driveTable[drive]->Trim();
+    }
+
     int VfsReadDir(const char* path, const char** outNames, int maxEntries) {
         int drive;
         const char* localPath;
@@ -214,4 +418,15 @@ namespace Fs::Vfs {
         return driveTable[drive]->ReadDir(localPath, outNames, maxEntries);
     }
 
+    int VfsReadDirPlus(const char* path, uint64_t* cursor, DirEmitFn emit, void* ctx) {
+        int drive;
+        const char* localPath;
+
+        if (!ParsePath(path, drive, localPath)) return -1;
+        if (drive < 0 || drive >= MaxDrives || driveTable[drive] == nullptr) return -1;
+        if (driveTable[drive]->ReadDirPlus == nullptr) return -1;
+
+        return driveTable[drive]->ReadDirPlus(localPath, cursor, emit, ctx);
+    }
+
 }
@@ -11,7 +11,29 @@
 namespace Fs::Vfs {
 
     static constexpr int MaxDrives = 16;
-    static constexpr int MaxHandles = 64;
+    // The handle table grows HandleChunkSize entries at a time up to MaxHandles
+    static constexpr int HandleChunkSize = 64;
+    static constexpr int MaxHandles = 4096;
+
+    // VfsCopyRange moves data through a bounce buffer of this many pages
+    static constexpr int CopyChunkPages = 256;
+
+    // Node id of a drive's root directory for FsDriver::Lookup/OpenNode
+    static constexpr uint64_t RootNode = 0;
+
+    // One entry reported by FsDriver::ReadDirPlus
+    struct DirEntryInfo {
+        const char* Name;           // Base name, not terminated
+        int         NameLen;
+        bool        IsDirectory;
+        uint64_t    Size;
+        uint64_t    MTime;          // Unix seconds, 0 if unknown
+        uint64_t    FileId;         // Inode, first cluster or node; 0 if none
+    };
+
+    // Receives directory entries. Returns false to stop the listing, in
+    // which case the entry was not consumed and is reported again on resume.
+    using DirEmitFn = bool (*)(void* ctx, const DirEntryInfo& info);
 
     struct FsDriver {
         int (*Open)(const char* path);
@@ -23,6 +45,33 @@ namespace Fs::Vfs {
         int (*Create)(const char* path);
         int (*Delete)(const char* path);
         int (*Mkdir)(const char* path);
+
+        // Optional: stable identifier of an open file within the drive
+        // (inode, first cluster). Files with id 0 bypass the page cache.
+        uint64_t (*GetFileId)(int handle);
+
+        // Optional: resolve one path component for the dentry cache. Nodes
+        // are driver-defined ids that stay valid until the entry is deleted.
+        // Returns 1 if found, 0 if the name does not exist, -1 on error.
+        int (*Lookup)(uint64_t dirNode, const char* name, uint64_t* outNode, bool* outIsDir);
+
+        // Optional: open a node returned by Lookup (RootNode = root directory)
+        int (*OpenNode)(uint64_t node);
+
+        // Optional: discard all free space on the underlying device.
+        // Returns bytes discarded, or -1 if the device cannot discard.
+        int64_t (*Trim)();
+
+        // Optional: the file's contents when they stay resident and unchanged
+        // for the life of the kernel, so callers can use them in place.
+        // nullptr when the file cannot be mapped.
+        const uint8_t* (*Map)(int handle);
+
+        // Optional: list a directory with per-entry metadata, starting at
+        // *cursor (a driver-defined position, 0 = first entry) and stopping
+        // when emit returns false. *cursor is left just past the last
+        // consumed entry. Returns 1 if entries remain, 0 at the end, -1 on error.
+        int (*ReadDirPlus)(const char* path, uint64_t* cursor, DirEmitFn emit, void* ctx);
     };
 
     void Initialize();
@@ -41,4 +90,17 @@ namespace Fs::Vfs {
     // Returns number of registered drives, fills outDrives[] with their indices
     int VfsDriveList(int* outDrives, int maxEntries);
 
+    // Discard the free space of a drive. Returns bytes discarded or -1.
+    int64_t VfsTrim(int drive);
+
+    // Copy `size` bytes between two open files, which may be on different
+    // drives. Returns bytes copied (short at the source's end) or -1.
+    int64_t VfsCopyRange(int srcHandle, uint64_t srcOffset, int dstHandle, uint64_t dstOffset, uint64_t size);
+
+    // Zero-copy view of an open file (see FsDriver::Map), or nullptr
+    const uint8_t* VfsMap(int handle);
+
+    // Resumable directory listing (see FsDriver::ReadDirPlus)
+    int VfsReadDirPlus(const char* path, uint64_t* cursor, DirEmitFn emit, void* ctx);
+
 }
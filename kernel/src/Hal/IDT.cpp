@@ -12,6 +12,7 @@
 #include <CppLib/Stream.hpp>
 #include <Memory/PageFrameAllocator.hpp>
 #include <Sched/Scheduler.hpp>
+#include <Memory/Zram.hpp>
 
 namespace Hal {
     constexpr auto InterruptGate = 0x8E;
@@ -90,6 +91,40 @@ namespace Hal {
         }
     }
 
+    // Page faults get a dedicated handler so that user pages compressed out
+    // by Zram can be restored transparently, whether the access came from the
+    // process itself or from the kernel touching a user buffer.
+    __attribute__((interrupt)) void PageFaultHandler(System::PanicFrame* frame, uint64_t errorCode)
+    {
+        uint64_t cr2;
+        asm volatile("mov %%cr2, %0" : "=r"(cr2));
+
+        auto* proc = Sched::GetCurrentProcessPtr();
+        if (!(errorCode & 1) && proc != nullptr && cr2 < Memory::Zram::UserSpaceEnd) {
+            if (Memory::Zram::HandleFault(proc->pml4Phys, cr2)) {
+                return;
+            }
+        }
+
+        // Genuine fault: re-enable interrupts (this is an interrupt gate) and
+        // handle it like every other exception.
+        asm volatile("sti");
+
+        if ((frame->CS & 3) == 3 && proc != nullptr) {
+            Kt::KernelLogStream(Kt::ERROR, "Exception")
+                << ExceptionStrings[14] << " in process \""
+                << proc->name << "\" (pid " << proc->pid
+                << ") at " << base::hex << cr2 << " - process terminated";
+            Sched::ExitProcess();
+            __builtin_unreachable();
+        } else {
+            // Panic expects the frame to start at the error code
+            auto* panicFrame = (System::PanicFrame*)((uint64_t*)frame - 1);
+            panicFrame->InterruptVector = 14;
+            Panic(ExceptionStrings[14], panicFrame);
+        }
+    }
+
     void LoadIDT(IDTRStruct& idtr) {
         asm("lidt %0" : : "m"(idtr));
     }
@@ -147,6 +182,9 @@ namespace Hal {
 
         SetHandler<0, 31>::run();
 
+        // CR2 must not be clobbered by a nested fault before it is read
+        IDTEncodeInterrupt(14, (void*)PageFaultHandler, InterruptGate);
+
         Kt::KernelLogStream(Kt::OK, "Hal") << "Created exception interrupt vectors";
 
         LoadIDT(IDTR);
@@ -0,0 +1,189 @@
+/*
+    * Lz4.cpp
+    * LZ4 block format compressor/decompressor
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#include "Lz4.hpp"
+#include "Memory.hpp"
+
+namespace Lib::Lz4 {
+
+    static constexpr int HashLog = 12;
+    static constexpr int MinMatch = 4;
+    static constexpr int LastLiterals = 5;   // Block must end with >= 5 literals
+    static constexpr int MfLimit = 12;       // Last match must start >= 12 bytes before end
+
+    static inline uint32_t Read32(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    static inline uint32_t Hash(uint32_t seq) {
+        return (seq * 2654435761u) >> (32 - HashLog);
+    }
+
+    // Write a length continuation (the part above the 4-bit token nibble).
+    static inline uint8_t* WriteLength(uint8_t* op, int len) {
+        while (len >= 255) {
+            *op++ = 255;
+            len -= 255;
+        }
+        *op++ = (uint8_t)len;
+        return op;
+    }
+
+    int Compress(const uint8_t* src, int srcSize, uint8_t* dst, int dstCapacity,
+                 uint16_t* hashTable) {
+        if (srcSize < 0 || srcSize > MaxInputSize) return 0;
+
+        const uint8_t* ip = src;
+        const uint8_t* anchor = src;
+        const uint8_t* end = src + srcSize;
+        const uint8_t* matchLimit = end - LastLiterals;
+        const uint8_t* mfLimit = end - MfLimit;
+
+        uint8_t* op = dst;
+        uint8_t* opEnd = dst + dstCapacity;
+
+        if (srcSize >= MfLimit) {
+            memset(hashTable, 0, HashTableSize * sizeof(uint16_t));
+            ip++;
+
+            while (ip < mfLimit) {
+                uint32_t seq = Read32(ip);
+                uint32_t h = Hash(seq);
+                const uint8_t* ref = src + hashTable[h];
+                hashTable[h] = (uint16_t)(ip - src);
+
+                if (ref >= ip || Read32(ref) != seq) {
+                    ip++;
+                    continue;
+                }
+
+                // Extend the match backwards over pending literals
+                while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                    ip--;
+                    ref--;
+                }
+
+                // Extend forwards
+                const uint8_t* mp = ip + MinMatch;
+                const uint8_t* rp = ref + MinMatch;
+                while (mp < matchLimit && *mp == *rp) {
+                    mp++;
+                    rp++;
+                }
+
+                int litLen = (int)(ip - anchor);
+                int matchLen = (int)(mp - ip) - MinMatch;
+
+                // Worst case: token + literal length bytes + literals + offset + match length bytes
+                if (op + 1 + litLen / 255 + 1 + litLen + 2 + matchLen / 255 + 1 > opEnd) {
+                    return 0;
+                }
+
+                uint8_t* token = op++;
+                if (litLen >= 15) {
+                    *token = 15 << 4;
+                    op = WriteLength(op, litLen - 15);
+                } else {
+                    *token = (uint8_t)(litLen << 4);
+                }
+                memcpy(op, anchor, litLen);
+                op += litLen;
+
+                uint16_t offset = (uint16_t)(ip - ref);
+                *op++ = (uint8_t)(offset & 0xFF);
+                *op++ = (uint8_t)(offset >> 8);
+
+                if (matchLen >= 15) {
+                    *token |= 15;
+                    op = WriteLength(op, matchLen - 15);
+                } else {
+                    *token |= (uint8_t)matchLen;
+                }
+
+                ip = mp;
+                anchor = ip;
+            }
+        }
+
+        // Trailing literals
+        int litLen = (int)(end - anchor);
+        if (op + 1 + litLen / 255 + 1 + litLen > opEnd) {
+            return 0;
+        }
+
+        uint8_t* token = op++;
+        if (litLen >= 15) {
+            *token = 15 << 4;
+            op = WriteLength(op, litLen - 15);
+        } else {
+            *token = (uint8_t)(litLen << 4);
+        }
+        memcpy(op, anchor, litLen);
+        op += litLen;
+
+        return (int)(op - dst);
+    }
+
+    int Decompress(const uint8_t* src, int srcSize, uint8_t* dst, int dstCapacity) {
+        const uint8_t* ip = src;
+        const uint8_t* ipEnd = src + srcSize;
+        uint8_t* op = dst;
+        uint8_t* opEnd = dst + dstCapacity;
+
+        while (ip < ipEnd) {
+            uint8_t token = *ip++;
+
+            // Literals
+            size_t litLen = token >> 4;
+            if (litLen == 15) {
+                uint8_t b;
+                do {
+                    if (ip >= ipEnd) return -1;
+                    b = *ip++;
+                    litLen += b;
+                } while (b == 255);
+            }
+
+            if (litLen > (size_t)(ipEnd - ip) || litLen > (size_t)(opEnd - op)) return -1;
+            memcpy(op, ip, litLen);
+            op += litLen;
+            ip += litLen;
+
+            // The last sequence carries literals only
+            if (ip >= ipEnd) break;
+
+            if (ipEnd - ip < 2) return -1;
+            size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > (size_t)(op - dst)) return -1;
+
+            size_t matchLen = token & 15;
+            if (matchLen == 15) {
+                uint8_t b;
+                do {
+                    if (ip >= ipEnd) return -1;
+                    b = *ip++;
+                    matchLen += b;
+                } while (b == 255);
+            }
+            matchLen += MinMatch;
+
+            if (matchLen > (size_t)(opEnd - op)) return -1;
+
+            // Byte-wise copy: source and destination may overlap
+            const uint8_t* match = op - offset;
+            for (size_t i = 0; i < matchLen; i++) {
+                op[i] = match[i];
+            }
+            op += matchLen;
+        }
+
+        return (int)(op - dst);
+    }
+
+};
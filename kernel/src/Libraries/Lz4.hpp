@@ -0,0 +1,29 @@
+/*
+    * Lz4.hpp
+    * LZ4 block format compressor/decompressor
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace Lib::Lz4 {
+
+    // Number of hash table entries the compressor needs (caller-provided
+    // so that it can live in static storage instead of the kernel stack).
+    static constexpr int HashTableSize = 4096;
+
+    // Largest input accepted by Compress (match offsets are 16-bit).
+    static constexpr int MaxInputSize = 0xFFFF;
+
+    // Compress src into dst using the LZ4 block format.
+    // Returns the compressed size, or 0 if the output does not fit in dstCapacity.
+    int Compress(const uint8_t* src, int srcSize, uint8_t* dst, int dstCapacity,
+                 uint16_t* hashTable);
+
+    // Decompress an LZ4 block. Returns the decompressed size, or -1 if the
+    // input is malformed or the output would exceed dstCapacity.
+    int Decompress(const uint8_t* src, int srcSize, uint8_t* dst, int dstCapacity);
+
+};
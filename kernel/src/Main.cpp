@@ -19,6 +19,8 @@
 #include <Hal/IDT.hpp>
 #include <Memory/PageFrameAllocator.hpp>
 #include <Memory/Paging.hpp>
+#include <Memory/Zram.hpp>
+#include <Drivers/Storage/BlockCache.hpp>
 #include <ACPI/ACPI.hpp>
 #include <ACPI/AcpiShutdown.hpp>
 #include <ACPI/AcpiEvents.hpp>
@@ -112,6 +114,9 @@ extern "C" void kmain() {
 
     heap.Walk();
 
+    Memory::Zram::Initialize();
+    Drivers::Storage::BlockCache::Initialize();
+
 
 #if defined (__x86_64__)
     Hal::IDTInitialize();
@@ -204,7 +209,13 @@ extern "C" void kmain() {
             Fs::Ramdisk::Write,
             Fs::Ramdisk::Create,
             Fs::Ramdisk::Delete,
-            Fs::Ramdisk::Mkdir
+            Fs::Ramdisk::Mkdir,
+            nullptr,    // Already in RAM, no page cache
+            Fs::Ramdisk::Lookup,
+            Fs::Ramdisk::OpenNode,
+            nullptr,
+            Fs::Ramdisk::Map,
+            Fs::Ramdisk::ReadDirPlus
         };
         Fs::Vfs::RegisterDrive(0, &ramdiskDriver);
     }
@@ -220,6 +231,16 @@ extern "C" void kmain() {
 
     Sched::Initialize();
 
+    // Footprint report: image (text/data/bss) plus frames handed out during init
+    {
+        Montauk::MemStats stats;
+        Memory::g_pfa->GetStats(&stats);
+        uint64_t imageBytes = (uint64_t)&KernelEndSymbol - (uint64_t)&KernelStartSymbol;
+        Kt::KernelLogStream(OK, "Mem") << "Kernel footprint: " << kcp::dec
+            << imageBytes / 1024 << " KiB static, "
+            << stats.usedBytes / 1024 << " KiB dynamic";
+    }
+
     Kt::SuppressKernelLog();
     Sched::Spawn("0:/os/init.elf");
 
@@ -6,6 +6,9 @@
 
 #include "PageFrameAllocator.hpp"
 #include "HHDM.hpp"
+#include "Zram.hpp"
+#include <Drivers/Storage/BlockCache.hpp>
+#include <Fs/PageCache.hpp>
 #include <Libraries/Memory.hpp>
 #include <Terminal/Terminal.hpp>
 #include <CppLib/Spinlock.hpp>
@@ -26,7 +29,7 @@ namespace Memory {
         Kt::KernelLogStream(Kt::DEBUG, "PageFrameAllocator") << "New pool size: " << section.size;
     }
 
-    void* PageFrameAllocator::Allocate() {
+    void* PageFrameAllocator::TryAllocate() {
         Lock.Acquire();
 
         Page* current = head.next;
@@ -61,6 +64,20 @@ namespace Memory {
         return nullptr;
     }
 
+    void* PageFrameAllocator::Allocate() {
+        void* page = TryAllocate();
+        if (page != nullptr) return page;
+
+        // Out of frames: drop cached file pages and clean disk blocks first,
+        // then compress cold user pages, and try once more
+        if (Fs::PageCache::Shrink(Zram::ReclaimBatch) > 0
+            || Drivers::Storage::BlockCache::Shrink(Zram::ReclaimBatch) > 0
+            || Zram::Reclaim(Zram::ReclaimBatch) > 0) {
+            page = TryAllocate();
+        }
+        return page;
+    }
+
     void* PageFrameAllocator::AllocateZeroed() {
         auto page = Allocate();
         if (page == nullptr) return nullptr;
@@ -69,13 +86,12 @@ namespace Memory {
         return page;
     }
 
-    void* PageFrameAllocator::ReallocConsecutive(void* ptr, int n) {
+    void* PageFrameAllocator::TryAllocateConsecutive(size_t needed) {
         Lock.Acquire();
 
         // Search the free list for a single contiguous region >= n pages.
         // The old implementation assumed N consecutive Allocate() calls gave
         // adjacent pages, which breaks when individual pages are freed back.
-        size_t needed = (size_t)n * 0x1000;
         Page* current = head.next;
         Page* prev = &head;
 
@@ -92,12 +108,6 @@ namespace Memory {
                 }
 
                 Lock.Release();
-
-                if (ptr != nullptr) {
-                    memcpy(base, ptr, 0x1000);  // copy one page (ptr is always a single page)
-                    Free(ptr);
-                }
-
                 return base;
             }
             prev = current;
@@ -105,10 +115,40 @@ namespace Memory {
         }
 
         Lock.Release();
-        Panic("PageFrameAllocator: no contiguous region available", nullptr);
         return nullptr;
     }
 
+    void* PageFrameAllocator::AllocateConsecutive(int n) {
+        size_t needed = (size_t)n * 0x1000;
+        void* base = TryAllocateConsecutive(needed);
+
+        // Reclaimed frames are scattered, so a few rounds may be needed
+        // before they coalesce into a large enough run.
+        for (int attempt = 0; base == nullptr && attempt < 4; attempt++) {
+            int freed = Fs::PageCache::Shrink(n + Zram::ReclaimBatch);
+            freed += Drivers::Storage::BlockCache::Shrink(n + Zram::ReclaimBatch);
+            freed += Zram::Reclaim(n + Zram::ReclaimBatch);
+            if (freed == 0) break;
+            base = TryAllocateConsecutive(needed);
+        }
+        return base;
+    }
+
+    void* PageFrameAllocator::ReallocConsecutive(void* ptr, int n) {
+        void* base = AllocateConsecutive(n);
+        if (base == nullptr) {
+            Panic("PageFrameAllocator: no contiguous region available", nullptr);
+            return nullptr;
+        }
+
+        if (ptr != nullptr) {
+            memcpy(base, ptr, 0x1000);  // copy one page (ptr is always a single page)
+            Free(ptr);
+        }
+
+        return base;
+    }
+
     // Core free implementation: sorted-insert with coalescing.
     // The free list is kept sorted by address so adjacent blocks can be merged,
     // preventing fragmentation from accumulating over time.
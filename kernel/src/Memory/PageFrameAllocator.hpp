@@ -22,12 +22,15 @@ namespace Memory {
         LargestSection g_section;
 
         void FreeRange(void* ptr, std::size_t size);
+        void* TryAllocate();
+        void* TryAllocateConsecutive(std::size_t bytes);
 public:
         PageFrameAllocator(LargestSection section);
 
         void* Allocate();
         void* AllocateZeroed();
         void* ReallocConsecutive(void* ptr, int n);
+        void* AllocateConsecutive(int n);   // nullptr instead of a panic on failure
         void Free(void* ptr);
         void Free(void* ptr, int n);
 
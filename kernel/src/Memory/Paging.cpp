@@ -2,6 +2,7 @@
 #include <Memory/PageFrameAllocator.hpp>
 #include <Common/Panic.hpp>
 #include <Memory/HHDM.hpp>
+#include <Memory/Zram.hpp>
 
 namespace Memory::VMM {
     Paging* g_paging = nullptr;
@@ -183,7 +184,8 @@ namespace Memory::VMM {
         return newPml4Phys;
     }
 
-    bool Paging::MapUserIn(std::uint64_t pml4Phys, std::uint64_t physicalAddress, std::uint64_t virtualAddress) {
+    bool Paging::MapUserIn(std::uint64_t pml4Phys, std::uint64_t physicalAddress, std::uint64_t virtualAddress,
+                           bool anonymous) {
         if (virtualAddress % 0x1000 != 0 || physicalAddress % 0x1000 != 0) {
             Panic("Non-aligned address in Paging::MapUserIn!", nullptr);
         }
@@ -218,13 +220,26 @@ namespace Memory::VMM {
         if (!pml1) return false;
 
         PageTableEntry* pageEntry = (PageTableEntry*)Memory::HHDM(&pml1->entries[va.GetPageIndex()]);
+        if (Zram::IsSwapped(pageEntry)) {
+            Zram::Release(pageEntry->Address);
+        }
         pageEntry->Present = true;
         pageEntry->Writable = true;
         pageEntry->Supervisor = 1;
+        pageEntry->Available = anonymous ? Zram::PteAnonymous : 0;
         pageEntry->Address = physicalAddress >> 12;
         return true;
     }
 
+    bool Paging::MapUserInShared(std::uint64_t pml4Phys, std::uint64_t physicalAddress, std::uint64_t virtualAddress) {
+        if (!MapUserIn(pml4Phys, physicalAddress, virtualAddress)) return false;
+
+        PageTableEntry* pageEntry = GetUserPte(pml4Phys, virtualAddress);
+        pageEntry->Writable = false;
+        pageEntry->Available = Zram::PteShared;
+        return true;
+    }
+
     bool Paging::MapUserInWC(std::uint64_t pml4Phys, std::uint64_t physicalAddress, std::uint64_t virtualAddress) {
         if (virtualAddress % 0x1000 != 0 || physicalAddress % 0x1000 != 0) {
             Panic("Non-aligned address in Paging::MapUserInWC!", nullptr);
@@ -266,7 +281,7 @@ namespace Memory::VMM {
         return true;
     }
 
-    void Paging::UnmapUserIn(std::uint64_t pml4Phys, std::uint64_t virtualAddress) {
+    PageTableEntry* Paging::GetUserPte(std::uint64_t pml4Phys, std::uint64_t virtualAddress) {
         VirtualAddress va(virtualAddress);
 
         // Walk without allocating — if any level is absent, nothing is mapped.
@@ -278,13 +293,25 @@ namespace Memory::VMM {
 
         PageTable* pml4 = (PageTable*)pml4Phys;
         auto pml3 = walkRead(pml4, va.GetL4Index());
-        if (!pml3) return;
+        if (!pml3) return nullptr;
         auto pml2 = walkRead(pml3, va.GetL3Index());
-        if (!pml2) return;
+        if (!pml2) return nullptr;
         auto pml1 = walkRead(pml2, va.GetL2Index());
-        if (!pml1) return;
+        if (!pml1) return nullptr;
 
-        PageTableEntry* pageEntry = (PageTableEntry*)Memory::HHDM(&pml1->entries[va.GetPageIndex()]);
+        return (PageTableEntry*)Memory::HHDM(&pml1->entries[va.GetPageIndex()]);
+    }
+
+    void Paging::UnmapUserIn(std::uint64_t pml4Phys, std::uint64_t virtualAddress) {
+        PageTableEntry* pageEntry = GetUserPte(pml4Phys, virtualAddress);
+        if (pageEntry == nullptr) return;
+
+        // A compressed-out page has no frame to invalidate, just a zram slot
+        if (Zram::IsSwapped(pageEntry)) {
+            Zram::Release(pageEntry->Address);
+            *(uint64_t*)pageEntry = 0;
+            return;
+        }
         if (!pageEntry->Present) return;
 
         // Clear the entire 8-byte PTE
@@ -324,10 +351,15 @@ namespace Memory::VMM {
                     // Free all leaf physical pages
                     for (int i1 = 0; i1 < 512; i1++) {
                         PageTableEntry* pte = (PageTableEntry*)Memory::HHDM(&pt->entries[i1]);
+                        if (Zram::IsSwapped(pte)) {
+                            Zram::Release(pte->Address);
+                            continue;
+                        }
                         if (!pte->Present) continue;
 
-                        // Skip MMIO/WC pages (not PFA-managed)
+                        // Skip MMIO/WC and shared pages (not PFA-managed)
                         if (pte->WriteThrough || pte->CacheDisabled) continue;
+                        if (pte->Available & Zram::PteShared) continue;
 
                         uint64_t pagePhys = (uint64_t)pte->Address << 12;
                         if (pagePhys != 0) {
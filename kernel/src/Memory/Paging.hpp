@@ -104,11 +104,21 @@ public:
         static std::uint64_t CreateUserPML4();
 
         // Map a page into an arbitrary PML4 (specified by physical address) with User bit set.
-        static bool MapUserIn(std::uint64_t pml4Phys, std::uint64_t physicalAddress, std::uint64_t virtualAddress);
+        // Anonymous pages (heap, stack, loaded ELF segments) may later be compressed out by Zram.
+        static bool MapUserIn(std::uint64_t pml4Phys, std::uint64_t physicalAddress, std::uint64_t virtualAddress,
+                              bool anonymous = false);
+
+        // Map a read-only page whose frame the address space does not own
+        // (ramdisk module memory). FreeUserHalf leaves the frame alone.
+        static bool MapUserInShared(std::uint64_t pml4Phys, std::uint64_t physicalAddress, std::uint64_t virtualAddress);
 
         // Map a page into an arbitrary PML4 with User + Write-Combining attributes.
         static bool MapUserInWC(std::uint64_t pml4Phys, std::uint64_t physicalAddress, std::uint64_t virtualAddress);
 
+        // Look up the leaf PTE for a user address without allocating page tables.
+        // Returns an HHDM pointer to the entry, or nullptr if no page table covers it.
+        static PageTableEntry* GetUserPte(std::uint64_t pml4Phys, std::uint64_t virtualAddress);
+
         // Unmap a single page from an arbitrary PML4 (clears PTE + invalidates TLB).
         static void UnmapUserIn(std::uint64_t pml4Phys, std::uint64_t virtualAddress);
 
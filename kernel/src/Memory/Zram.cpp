@@ -0,0 +1,398 @@
+/*
+    * Zram.cpp
+    * Compressed in-RAM swap for anonymous user pages
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#include "Zram.hpp"
+#include "HHDM.hpp"
+#include "PageFrameAllocator.hpp"
+#include <Sched/Scheduler.hpp>
+#include <Libraries/Lz4.hpp>
+#include <Libraries/Memory.hpp>
+#include <CppLib/Spinlock.hpp>
+#include <Terminal/Terminal.hpp>
+#include <CppLib/Stream.hpp>
+
+namespace Memory::Zram {
+
+    using VMM::PageTable;
+    using VMM::PageTableEntry;
+
+    // Compressed pages are packed bump-style into pool pages. A pool page is
+    // handed back to the PFA once every object stored in it has been released.
+    struct PoolHeader {
+        uint32_t live;  // Objects still referenced
+        uint32_t used;  // Bytes consumed, including this header
+    };
+
+    // One slot per swapped-out page; the slot index is stored in the PTE.
+    struct Slot {
+        uint64_t page;      // Pool page (HHDM virtual), 0 for an all-zero page
+        uint16_t offset;
+        uint16_t length;
+        uint32_t nextFree;
+    };
+
+    static constexpr int SlotsPerPage = 0x1000 / sizeof(Slot);
+    static constexpr int SlotDirSize = 1024;    // 256K slots = 1 GiB of swapped user memory
+    static constexpr uint32_t NoSlot = 0xFFFFFFFF;
+    static constexpr uint64_t PhysMask = 0xFFFFFFFFFFULL;
+
+    static Slot* g_slotDir[SlotDirSize] = {};
+    static uint32_t g_slotPages = 0;
+    static uint32_t g_freeSlot = NoSlot;
+
+    static uint8_t* g_openPool = nullptr;
+
+    static uint8_t g_scratch[0x1000];
+    static uint16_t g_hashTable[Lib::Lz4::HashTableSize];
+
+    static kcp::Spinlock g_lock;
+    static bool g_busy = false;
+    static bool g_ready = false;
+
+    // Clock hand: process slot and virtual address the next scan resumes at
+    static int g_handProc = 0;
+    static uint64_t g_handVa = 0;
+
+    static uint64_t g_storedPages = 0;
+    static uint64_t g_poolPages = 0;
+
+    // -------------------------------------------------------------------------
+    // Slot table
+    // -------------------------------------------------------------------------
+
+    static Slot* GetSlot(uint32_t idx) {
+        return &g_slotDir[idx / SlotsPerPage][idx % SlotsPerPage];
+    }
+
+    static bool GrowSlots() {
+        if (g_slotPages >= SlotDirSize) return false;
+
+        Slot* page = (Slot*)g_pfa->AllocateZeroed();
+        if (page == nullptr) return false;
+
+        g_slotDir[g_slotPages] = page;
+        uint32_t base = g_slotPages * SlotsPerPage;
+        for (int i = SlotsPerPage - 1; i >= 0; i--) {
+            page[i].nextFree = g_freeSlot;
+            g_freeSlot = base + i;
+        }
+        g_slotPages++;
+        return true;
+    }
+
+    static uint32_t AllocSlot() {
+        if (g_freeSlot == NoSlot && !GrowSlots()) return NoSlot;
+        uint32_t idx = g_freeSlot;
+        g_freeSlot = GetSlot(idx)->nextFree;
+        return idx;
+    }
+
+    static void FreeSlot(uint32_t idx) {
+        GetSlot(idx)->nextFree = g_freeSlot;
+        g_freeSlot = idx;
+    }
+
+    // -------------------------------------------------------------------------
+    // Compressed pool
+    // -------------------------------------------------------------------------
+
+    static void FreePoolIfEmpty(uint8_t* pool) {
+        if (pool == nullptr || ((PoolHeader*)pool)->live != 0) return;
+        g_pfa->Free(pool);
+        g_poolPages--;
+    }
+
+    // Append `len` bytes to the open pool page. If the PFA has nothing left,
+    // `victim` (the frame being reclaimed) becomes the new pool page and
+    // victimUsed is set so the caller does not free it.
+    static void Store(Slot* slot, const uint8_t* data, int len, uint8_t* victim, bool& victimUsed) {
+        victimUsed = false;
+
+        if (g_openPool == nullptr || ((PoolHeader*)g_openPool)->used + len > 0x1000) {
+            uint8_t* fresh = (uint8_t*)g_pfa->Allocate();
+            if (fresh == nullptr) {
+                fresh = victim;
+                victimUsed = true;
+            }
+
+            uint8_t* old = g_openPool;
+            g_openPool = fresh;
+            FreePoolIfEmpty(old);
+
+            auto* hdr = (PoolHeader*)fresh;
+            hdr->live = 0;
+            hdr->used = sizeof(PoolHeader);
+            g_poolPages++;
+        }
+
+        auto* hdr = (PoolHeader*)g_openPool;
+        memcpy(g_openPool + hdr->used, data, len);
+
+        slot->page = (uint64_t)g_openPool;
+        slot->offset = (uint16_t)hdr->used;
+        slot->length = (uint16_t)len;
+
+        hdr->used += len;
+        hdr->live++;
+    }
+
+    static void DropSlot(uint32_t idx) {
+        Slot* slot = GetSlot(idx);
+        if (slot->page != 0) {
+            uint8_t* pool = (uint8_t*)slot->page;
+            auto* hdr = (PoolHeader*)pool;
+            hdr->live--;
+            if (hdr->live == 0) {
+                if (pool == g_openPool) {
+                    hdr->used = sizeof(PoolHeader);
+                } else {
+                    FreePoolIfEmpty(pool);
+                }
+            }
+        }
+        slot->page = 0;
+        FreeSlot(idx);
+        g_storedPages--;
+    }
+
+    // -------------------------------------------------------------------------
+    // Swap out
+    // -------------------------------------------------------------------------
+
+    static bool IsZeroPage(const uint8_t* page) {
+        const uint64_t* p = (const uint64_t*)page;
+        for (int i = 0; i < 0x1000 / 8; i++) {
+            if (p[i] != 0) return false;
+        }
+        return true;
+    }
+
+    // Compress the page behind `pte` and replace the mapping with a swap entry.
+    // Returns true if a frame was returned to the PFA.
+    static bool SwapOut(PageTableEntry* pte, uint64_t va, bool isCurrent) {
+        uint8_t* frame = (uint8_t*)HHDM((pte->Address & PhysMask) << 12);
+
+        bool zero = IsZeroPage(frame);
+        int len = 0;
+        if (!zero) {
+            len = Lib::Lz4::Compress(frame, 0x1000, g_scratch, MaxStoredSize, g_hashTable);
+            if (len == 0) return false;     // Incompressible, leave resident
+        }
+
+        uint32_t idx = AllocSlot();
+        if (idx == NoSlot) return false;
+
+        Slot* slot = GetSlot(idx);
+        bool victimUsed = false;
+        if (zero) {
+            slot->page = 0;
+            slot->offset = 0;
+            slot->length = 0;
+        } else {
+            Store(slot, g_scratch, len, frame, victimUsed);
+        }
+
+        PageTableEntry entry = *pte;
+        entry.Present = 0;
+        entry.Accessed = 0;
+        entry.Available = PteAnonymous | PteSwapped;
+        entry.Address = idx;
+        *pte = entry;
+
+        if (isCurrent) {
+            asm volatile("invlpg (%0)" :: "r"(va) : "memory");
+        }
+
+        g_storedPages++;
+        if (victimUsed) return false;
+
+        g_pfa->Free(frame);
+        return true;
+    }
+
+    // Walk the user half of one address space from `va` upward. Recently used
+    // pages get their accessed bit cleared (second chance); cold ones are
+    // compressed. On return `va` is where the scan stopped, or 0 if it wrapped.
+    static int ScanAddressSpace(uint64_t pml4Phys, bool isCurrent, uint64_t& va, int budget) {
+        PageTable* pml4 = (PageTable*)pml4Phys;
+        int freed = 0;
+
+        uint64_t s4 = (va >> 39) & 0x1FF;
+        uint64_t s3 = (va >> 30) & 0x1FF;
+        uint64_t s2 = (va >> 21) & 0x1FF;
+        uint64_t s1 = (va >> 12) & 0x1FF;
+
+        for (uint64_t i4 = s4; i4 < 256; i4++, s3 = s2 = s1 = 0) {
+            auto* pml4e = (PageTableEntry*)HHDM(&pml4->entries[i4]);
+            if (!pml4e->Present) continue;
+            auto* pdpt = (PageTable*)((pml4e->Address & PhysMask) << 12);
+
+            for (uint64_t i3 = s3; i3 < 512; i3++, s2 = s1 = 0) {
+                auto* pdpte = (PageTableEntry*)HHDM(&pdpt->entries[i3]);
+                if (!pdpte->Present || pdpte->LargerPages) continue;
+                auto* pd = (PageTable*)((pdpte->Address & PhysMask) << 12);
+
+                for (uint64_t i2 = s2; i2 < 512; i2++, s1 = 0) {
+                    auto* pde = (PageTableEntry*)HHDM(&pd->entries[i2]);
+                    if (!pde->Present || pde->LargerPages) continue;
+                    auto* pt = (PageTable*)((pde->Address & PhysMask) << 12);
+
+                    for (uint64_t i1 = s1; i1 < 512; i1++) {
+                        uint64_t pageVa = (i4 << 39) | (i3 << 30) | (i2 << 21) | (i1 << 12);
+                        if (freed >= budget) {
+                            va = pageVa;
+                            return freed;
+                        }
+
+                        auto* pte = (PageTableEntry*)HHDM(&pt->entries[i1]);
+                        if (!pte->Present || !(pte->Available & PteAnonymous)) continue;
+                        if (pte->WriteThrough || pte->CacheDisabled) continue;
+
+                        if (pte->Accessed) {
+                            pte->Accessed = 0;
+                            if (isCurrent) {
+                                asm volatile("invlpg (%0)" :: "r"(pageVa) : "memory");
+                            }
+                            continue;
+                        }
+
+                        if (SwapOut(pte, pageVa, isCurrent)) freed++;
+                    }
+                }
+            }
+        }
+
+        va = 0;
+        return freed;
+    }
+
+    // -------------------------------------------------------------------------
+    // Public API
+    // -------------------------------------------------------------------------
+
+    void Initialize() {
+        if (!GrowSlots()) {
+            Kt::KernelLogStream(Kt::WARNING, "Zram") << "No memory for slot table, swap disabled";
+            return;
+        }
+        g_ready = true;
+        Kt::KernelLogStream(Kt::OK, "Zram") << "Compressed swap ready ("
+            << (uint64_t)SlotDirSize * SlotsPerPage << " slots)";
+    }
+
+    int Reclaim(int pages) {
+        if (!g_ready || pages <= 0) return 0;
+
+        uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+
+        // Allocations made while reclaiming must not recurse back in here
+        if (g_busy) {
+            asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+            return 0;
+        }
+
+        g_lock.Acquire();
+        g_busy = true;
+
+        uint64_t cr3 = VMM::GetCR3() & ~0xFFFULL;
+        int freed = 0;
+
+        // Two full revolutions at most: the first may only clear accessed bits
+        for (int visits = 0; visits <= 2 * Sched::MaxProcesses; visits++) {
+            auto* proc = Sched::GetProcessSlot(g_handProc);
+            bool alive = proc != nullptr && proc->pml4Phys != 0
+                && (proc->state == Sched::ProcessState::Ready
+                    || proc->state == Sched::ProcessState::Running);
+
+            if (alive) {
+                freed += ScanAddressSpace(proc->pml4Phys, proc->pml4Phys == cr3,
+                                          g_handVa, pages - freed);
+                if (freed >= pages) break;
+            }
+
+            g_handVa = 0;
+            g_handProc = (g_handProc + 1) % Sched::MaxProcesses;
+        }
+
+        g_busy = false;
+        g_lock.Release();
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+
+        if (freed > 0) {
+            Kt::KernelLogStream(Kt::DEBUG, "Zram") << "Reclaimed " << (uint64_t)freed
+                << " page(s), " << g_storedPages << " stored in " << g_poolPages << " pool page(s)";
+        }
+        return freed;
+    }
+
+    bool HandleFault(uint64_t pml4Phys, uint64_t va) {
+        if (!g_ready || va >= UserSpaceEnd) return false;
+        va &= ~0xFFFULL;
+
+        PageTableEntry* pte = VMM::Paging::GetUserPte(pml4Phys, va);
+        if (pte == nullptr || !IsSwapped(pte)) return false;
+
+        // Take the frame before locking: the allocation may itself reclaim
+        uint8_t* frame = (uint8_t*)g_pfa->Allocate();
+        if (frame == nullptr) return false;
+
+        uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        g_lock.Acquire();
+
+        bool ok = false;
+        if (IsSwapped(pte)) {
+            uint32_t idx = (uint32_t)pte->Address;
+            Slot* slot = GetSlot(idx);
+
+            if (slot->page == 0) {
+                memset(frame, 0, 0x1000);
+                ok = true;
+            } else {
+                int n = Lib::Lz4::Decompress((uint8_t*)slot->page + slot->offset, slot->length,
+                                             frame, 0x1000);
+                ok = (n == 0x1000);
+            }
+
+            if (ok) {
+                DropSlot(idx);
+
+                PageTableEntry entry = *pte;
+                entry.Present = 1;
+                entry.Accessed = 1;
+                entry.Available = PteAnonymous;
+                entry.Address = SubHHDM(frame) >> 12;
+                *pte = entry;
+
+                asm volatile("invlpg (%0)" :: "r"(va) : "memory");
+            } else {
+                Kt::KernelLogStream(Kt::ERROR, "Zram") << "Corrupt compressed page at "
+                    << base::hex << va;
+            }
+        }
+
+        g_lock.Release();
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+
+        if (!ok) g_pfa->Free(frame);
+        return ok;
+    }
+
+    void Release(uint64_t slot) {
+        uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        g_lock.Acquire();
+
+        if (slot < (uint64_t)g_slotPages * SlotsPerPage) {
+            DropSlot((uint32_t)slot);
+        }
+
+        g_lock.Release();
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+    }
+
+};
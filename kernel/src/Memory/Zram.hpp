@@ -0,0 +1,43 @@
+/*
+    * Zram.hpp
+    * Compressed in-RAM swap for anonymous user pages
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#pragma once
+#include <cstdint>
+#include "Paging.hpp"
+
+namespace Memory::Zram {
+
+    // Software bits in PageTableEntry::Available
+    static constexpr std::uint8_t PteAnonymous = (1 << 0);  // Private user page, may be compressed out
+    static constexpr std::uint8_t PteSwapped   = (1 << 1);  // Not present; Address holds a zram slot index
+    static constexpr std::uint8_t PteShared    = (1 << 2);  // Frame owned elsewhere (ramdisk module); never freed
+
+    static constexpr std::uint64_t UserSpaceEnd = 0x0000800000000000ULL;
+
+    // Pages reclaimed per attempt when the page frame allocator runs dry
+    static constexpr int ReclaimBatch = 32;
+
+    // Pages that do not compress below this size stay resident
+    static constexpr int MaxStoredSize = 3072;
+
+    void Initialize();
+
+    // Compress up to `pages` cold anonymous user pages and return their frames
+    // to the page frame allocator. Returns the number of frames freed.
+    int Reclaim(int pages);
+
+    // Restore a compressed page after a not-present fault at `va`.
+    // Returns false if the address was not swapped out.
+    bool HandleFault(std::uint64_t pml4Phys, std::uint64_t va);
+
+    // Drop the compressed copy referenced by a swapped PTE (process exit / free).
+    void Release(std::uint64_t slot);
+
+    inline bool IsSwapped(const VMM::PageTableEntry* pte) {
+        return !pte->Present && (pte->Available & PteSwapped);
+    }
+
+};
@@ -222,14 +222,14 @@ namespace Net::Socket {
         if (!ValidFd(fd, pid)) return -1;
         if (g_sockets[fd].Type != SOCK_TCP) return -1;
         if (g_sockets[fd].TcpConn == nullptr) return -1;
-        return Tcp::Send(g_sockets[fd].TcpConn, data, (uint16_t)len);
+        return Tcp::Send(g_sockets[fd].TcpConn, data, len);
     }
 
     int Recv(int fd, uint8_t* buf, uint32_t maxLen, int pid) {
         if (!ValidFd(fd, pid)) return -1;
         if (g_sockets[fd].Type != SOCK_TCP) return -1;
         if (g_sockets[fd].TcpConn == nullptr) return -1;
-        return Tcp::ReceiveNonBlocking(g_sockets[fd].TcpConn, buf, (uint16_t)maxLen);
+        return Tcp::ReceiveNonBlocking(g_sockets[fd].TcpConn, buf, maxLen);
     }
 
     int SendTo(int fd, const uint8_t* data, uint32_t len,
@@ -9,6 +9,7 @@
 #include <Net/ByteOrder.hpp>
 #include <Net/NetConfig.hpp>
 #include <Libraries/Memory.hpp>
+#include <Memory/Heap.hpp>
 #include <Terminal/Terminal.hpp>
 #include <CppLib/Stream.hpp>
 #include <CppLib/Spinlock.hpp>
@@ -18,13 +19,48 @@ using namespace Kt;
 
 namespace Net::Tcp {
 
-    // Receive buffer size per connection
-    static constexpr uint16_t RECV_BUFFER_SIZE = 4096;
-    static constexpr uint16_t WINDOW_SIZE = 4096;
+    // Buffer sizes per connection. The receive buffer starts small and
+    // doubles while the application keeps it full, up to RECV_BUFFER_MAX.
+    static constexpr uint32_t SEND_BUFFER_SIZE = 128 * 1024;
+    static constexpr uint32_t RECV_BUFFER_INITIAL = 16 * 1024;
+    static constexpr uint32_t RECV_BUFFER_MAX = 256 * 1024;
+    static constexpr uint8_t  RECV_WINDOW_SHIFT = 3;
+    static_assert((0xFFFFu << RECV_WINDOW_SHIFT) >= RECV_BUFFER_MAX,
+                  "Window shift too small for the largest receive buffer");
+
     static constexpr uint32_t MAX_CONNECTIONS = 16;
-    static constexpr uint64_t RETRANSMIT_TIMEOUT_MS = 1000;
+    static constexpr uint16_t DEFAULT_MSS = 1460;       // Ethernet MTU - 40
+    static constexpr uint16_t DEFAULT_PEER_MSS = 536;   // RFC 9293 3.7.1
+    static constexpr uint32_t INITIAL_WINDOW_SEGMENTS = 10;  // RFC 6928
+    static constexpr uint32_t MAX_CWND = 16 * 1024 * 1024;
+
+    // Retransmission timer (RFC 6298)
+    static constexpr uint32_t INITIAL_RTO_MS = 1000;
+    static constexpr uint32_t MIN_RTO_MS = 200;
+    static constexpr uint32_t MAX_RTO_MS = 60000;
     static constexpr int      MAX_RETRANSMITS = 5;
-    static constexpr uint64_t TIME_WAIT_MS = 2000;
+    static constexpr uint64_t TICK_INTERVAL_MS = 10;
+
+    // Blocking calls give up once the peer stops making progress
+    static constexpr uint64_t SEND_STALL_MS = 30000;
+    static constexpr uint64_t CLOSE_STALL_MS = 5000;
+
+    // Option kinds
+    static constexpr uint8_t OPT_END = 0;
+    static constexpr uint8_t OPT_NOP = 1;
+    static constexpr uint8_t OPT_MSS = 2;
+    static constexpr uint8_t OPT_WSCALE = 3;
+    static constexpr uint8_t OPT_TIMESTAMP = 8;
+    static constexpr uint8_t TIMESTAMP_OPTION_SIZE = 12;  // NOP NOP TS(10)
+
+    // Options carried by an incoming segment
+    struct Options {
+        uint16_t Mss;           // 0 if absent
+        int      WindowScale;   // -1 if absent
+        bool     HasTimestamp;
+        uint32_t TsVal;
+        uint32_t TsEcr;
+    };
 
     struct Connection {
         State    CurrentState;
@@ -33,28 +69,64 @@ namespace Net::Tcp {
         uint32_t RemoteIp;
         uint16_t RemotePort;
 
-        // Sequence numbers
-        uint32_t SendNext;    // Next sequence number to send
+        // Send sequence space
         uint32_t SendUnack;   // Oldest unacknowledged sequence number
-        uint32_t RecvNext;    // Next expected sequence number from remote
-
-        // Receive buffer (ring buffer)
-        uint8_t  RecvBuffer[RECV_BUFFER_SIZE];
-        uint16_t RecvHead;    // Read position
-        uint16_t RecvTail;    // Write position
-        uint16_t RecvCount;   // Bytes in buffer
-
-        // Retransmission tracking
-        uint8_t  RetransmitBuffer[1500];
-        uint16_t RetransmitLen;
+        uint32_t SendNext;    // Next sequence number to send
+        uint32_t SendMax;     // Highest sequence number sent so far
+        uint32_t SendWindow;  // Peer's advertised window in bytes (scaled)
+        uint32_t SendWl1;     // Segment seq/ack of the last window update
+        uint32_t SendWl2;
+        uint16_t SendMss;     // Payload bytes per segment after options
+
+        // Send buffer (ring buffer). Holds everything from SendUnack up to
+        // the last byte queued by the application; the first
+        // SendNext - SendUnack bytes are in flight.
+        uint8_t* SendBuffer;
+        uint32_t SendHead;    // Ring offset of SendUnack
+        uint32_t SendCount;   // Bytes queued and not yet acknowledged
+        bool     FinPending;  // Close() wants a FIN after the queued data
+        bool     FinSent;
+
+        // Congestion control (RFC 5681)
+        uint32_t Cwnd;
+        uint32_t Ssthresh;
+        int      DupAcks;
+
+        // Retransmission timer (RFC 6298). Srtt == 0 means no sample yet.
         uint64_t RetransmitTime;
         int      RetransmitCount;
+        uint32_t Rto;
+        uint32_t Srtt;
+        uint32_t RttVar;
+        bool     RttTiming;   // Timing one segment when timestamps are off
+        uint32_t RttSeq;
+        uint64_t RttStart;
+        int      ProbeCount;  // Zero window probes sent without a reply
+
+        // Receive buffer (ring buffer). Data buffers are heap-allocated the
+        // first time a slot carries a connection and kept for reuse.
+        uint32_t RecvNext;    // Next expected sequence number from remote
+        uint8_t* RecvBuffer;
+        uint32_t RecvCapacity;
+        uint32_t RecvHead;    // Read position
+        uint32_t RecvTail;    // Write position
+        uint32_t RecvCount;   // Bytes in buffer
+        uint32_t RecvEdge;    // Right edge of the last advertised window
+
+        // RFC 7323 window scaling and timestamps, fixed at the handshake
+        bool     WindowScaling;
+        uint8_t  SendScale;   // Shift applied to the peer's window field
+        uint8_t  RecvScale;   // Shift applied to ours
+        bool     Timestamps;
+        uint32_t TsRecent;    // Peer's TSval, echoed back in TSecr
 
         // For Listen/Accept
         bool     PendingAccept;
         uint32_t PendingRemoteIp;
         uint16_t PendingRemotePort;
         uint32_t PendingSeq;
+        uint16_t PendingWindow;
+        Options  PendingOptions;
 
         bool     Active;
 
@@ -63,6 +135,20 @@ namespace Net::Tcp {
 
     static Connection g_connections[MAX_CONNECTIONS] = {};
     static kcp::Spinlock g_connectionsLock;
+    static uint64_t g_lastTick = 0;
+
+    // Sequence number comparisons modulo 2^32
+    static bool SeqLt(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+    static bool SeqLe(uint32_t a, uint32_t b) { return (int32_t)(a - b) <= 0; }
+    static bool SeqGt(uint32_t a, uint32_t b) { return (int32_t)(a - b) > 0; }
+    static bool SeqGe(uint32_t a, uint32_t b) { return (int32_t)(a - b) >= 0; }
+
+    static uint32_t Min(uint32_t a, uint32_t b) { return a < b ? a : b; }
+    static uint32_t Max(uint32_t a, uint32_t b) { return a > b ? a : b; }
+
+    static uint32_t Now32() {
+        return (uint32_t)Timekeeping::GetMilliseconds();
+    }
 
     // Simple ISN generator using timer
     static uint32_t GenerateISN() {
@@ -94,11 +180,24 @@ namespace Net::Tcp {
         return nullptr;
     }
 
+    // Drop a connection that cannot continue (reset by the peer, or its
+    // retransmissions ran out). Connection lock held.
+    static void Abort(Connection* conn) {
+        conn->CurrentState = State::Closed;
+        conn->Active = false;
+    }
+
     static Connection* AllocateConnection() {
         for (uint32_t i = 0; i < MAX_CONNECTIONS; i++) {
             if (!g_connections[i].Active) {
                 Connection* c = &g_connections[i];
+                uint8_t* recvBuffer = c->RecvBuffer;
+                uint32_t recvCapacity = c->RecvCapacity;
+                uint8_t* sendBuffer = c->SendBuffer;
                 memset(c, 0, sizeof(Connection));
+                c->RecvBuffer = recvBuffer;
+                c->RecvCapacity = recvCapacity;
+                c->SendBuffer = sendBuffer;
                 c->Active = true;
                 c->CurrentState = State::Closed;
                 return c;
@@ -107,25 +206,135 @@ namespace Net::Tcp {
         return nullptr;
     }
 
-    static bool SendSegment(Connection* conn, uint8_t flags,
-                             const uint8_t* payload, uint16_t payloadLen) {
-        uint8_t packet[1500];
+    // Listeners never carry data, so only Accept/Connect pay for buffers.
+    // Called from process context; the receive path runs in the NIC interrupt.
+    static bool AllocateBuffers(Connection* conn) {
+        if (conn->RecvBuffer == nullptr) {
+            conn->RecvBuffer = (uint8_t*)Memory::g_heap->Request(RECV_BUFFER_INITIAL);
+            conn->RecvCapacity = RECV_BUFFER_INITIAL;
+        }
+        if (conn->SendBuffer == nullptr) {
+            conn->SendBuffer = (uint8_t*)Memory::g_heap->Request(SEND_BUFFER_SIZE);
+        }
+        return conn->RecvBuffer != nullptr && conn->SendBuffer != nullptr;
+    }
+
+    // Set up the per-connection transfer state once both sides' options
+    // are known (SYN-ACK received or about to be sent)
+    static void InitTransfer(Connection* conn, const Options& peer) {
+        uint16_t mss = peer.Mss != 0 ? peer.Mss : DEFAULT_PEER_MSS;
+        if (mss > DEFAULT_MSS) {
+            mss = DEFAULT_MSS;
+        }
+
+        conn->WindowScaling = conn->WindowScaling && peer.WindowScale >= 0;
+        if (conn->WindowScaling) {
+            conn->SendScale = peer.WindowScale > 14 ? 14 : (uint8_t)peer.WindowScale;
+            conn->RecvScale = RECV_WINDOW_SHIFT;
+        } else {
+            conn->SendScale = 0;
+            conn->RecvScale = 0;
+        }
+
+        conn->Timestamps = conn->Timestamps && peer.HasTimestamp;
+        if (conn->Timestamps) {
+            conn->TsRecent = peer.TsVal;
+            mss -= TIMESTAMP_OPTION_SIZE;
+        }
+
+        conn->SendMss = mss;
+        conn->Cwnd = INITIAL_WINDOW_SEGMENTS * mss;
+        conn->Ssthresh = MAX_CWND;
+    }
+
+    static void ParseOptions(const uint8_t* opt, uint32_t len, Options& out) {
+        out.Mss = 0;
+        out.WindowScale = -1;
+        out.HasTimestamp = false;
+        out.TsVal = 0;
+        out.TsEcr = 0;
+
+        uint32_t i = 0;
+        while (i < len) {
+            uint8_t kind = opt[i];
+            if (kind == OPT_END) {
+                break;
+            }
+            if (kind == OPT_NOP) {
+                i++;
+                continue;
+            }
+            if (i + 1 >= len || opt[i + 1] < 2 || i + opt[i + 1] > len) {
+                break;
+            }
+
+            uint8_t size = opt[i + 1];
+            const uint8_t* v = opt + i + 2;
+            if (kind == OPT_MSS && size == 4) {
+                out.Mss = (uint16_t)((v[0] << 8) | v[1]);
+            } else if (kind == OPT_WSCALE && size == 3) {
+                out.WindowScale = v[0];
+            } else if (kind == OPT_TIMESTAMP && size == 10) {
+                out.HasTimestamp = true;
+                out.TsVal = ((uint32_t)v[0] << 24) | ((uint32_t)v[1] << 16) |
+                            ((uint32_t)v[2] << 8) | v[3];
+                out.TsEcr = ((uint32_t)v[4] << 24) | ((uint32_t)v[5] << 16) |
+                            ((uint32_t)v[6] << 8) | v[7];
+            }
+            i += size;
+        }
+    }
+
+    static void PutTimestamp(uint8_t* opt, uint32_t tsVal, uint32_t tsEcr) {
+        opt[0] = OPT_NOP;
+        opt[1] = OPT_NOP;
+        opt[2] = OPT_TIMESTAMP;
+        opt[3] = 10;
+        uint32_t val = Htonl(tsVal);
+        uint32_t ecr = Htonl(tsEcr);
+        memcpy(opt + 4, &val, 4);
+        memcpy(opt + 8, &ecr, 4);
+    }
+
+    // Window field for an outgoing segment. SYN windows are never scaled.
+    static uint16_t AdvertiseWindow(Connection* conn, bool syn) {
+        uint32_t space = conn->RecvCapacity - conn->RecvCount;
+        uint8_t shift = syn ? 0 : conn->RecvScale;
+
+        uint32_t window = space >> shift;
+
+        // Never shrink the window: keep offering what was promised before.
+        // RecvEdge is reset at the handshake, so it lies within one window
+        // of RecvNext here.
+        if (!syn && SeqLt(conn->RecvNext + (window << shift), conn->RecvEdge)) {
+            window = (conn->RecvEdge - conn->RecvNext) >> shift;
+        }
+        if (window > 0xFFFF) {
+            window = 0xFFFF;
+        }
+
+        conn->RecvEdge = conn->RecvNext + (window << shift);
+        return (uint16_t)window;
+    }
+
+    // Fill in the header, checksum and hand the segment to IPv4.
+    // `optLen` bytes of options must already follow the header.
+    static bool Emit(Connection* conn, uint8_t* packet, uint8_t flags, uint32_t seq,
+                     uint16_t window, uint8_t optLen, uint16_t payloadLen) {
         Header* hdr = (Header*)packet;
+        uint16_t headerLen = HEADER_SIZE + optLen;
 
         hdr->SrcPort = Htons(conn->LocalPort);
         hdr->DstPort = Htons(conn->RemotePort);
-        hdr->SeqNum = Htonl(conn->SendNext);
-        hdr->AckNum = Htonl(conn->RecvNext);
-        hdr->DataOffset = (HEADER_SIZE / 4) << 4;
+        hdr->SeqNum = Htonl(seq);
+        hdr->AckNum = (flags & FLAG_ACK) ? Htonl(conn->RecvNext) : 0;
+        hdr->DataOffset = (uint8_t)((headerLen / 4) << 4);
         hdr->Flags = flags;
-        hdr->Window = Htons(WINDOW_SIZE);
+        hdr->Window = Htons(window);
         hdr->Checksum = 0;
         hdr->UrgentPtr = 0;
 
-        uint16_t totalLen = HEADER_SIZE + payloadLen;
-        if (payload != nullptr && payloadLen > 0) {
-            memcpy(packet + HEADER_SIZE, payload, payloadLen);
-        }
+        uint16_t totalLen = headerLen + payloadLen;
 
         // Calculate checksum with pseudo-header
         hdr->Checksum = Ipv4::PseudoHeaderChecksum(
@@ -135,6 +344,63 @@ namespace Net::Tcp {
         return Ipv4::Send(conn->RemoteIp, Ipv4::PROTO_TCP, packet, totalLen);
     }
 
+    // Send a segment starting at `seq`. The payload is taken from the send
+    // buffer, `offset` bytes past SendUnack.
+    static bool SendSegment(Connection* conn, uint8_t flags, uint32_t seq,
+                             uint32_t offset, uint16_t payloadLen) {
+        uint8_t packet[1500];
+        uint8_t optLen = 0;
+
+        if (conn->Timestamps) {
+            PutTimestamp(packet + HEADER_SIZE, Now32(), conn->TsRecent);
+            optLen = TIMESTAMP_OPTION_SIZE;
+        }
+
+        if (payloadLen > 0) {
+            uint8_t* dst = packet + HEADER_SIZE + optLen;
+            uint32_t pos = (conn->SendHead + offset) % SEND_BUFFER_SIZE;
+            uint32_t first = Min(payloadLen, SEND_BUFFER_SIZE - pos);
+            memcpy(dst, conn->SendBuffer + pos, first);
+            if (first < payloadLen) {
+                memcpy(dst + first, conn->SendBuffer, payloadLen - first);
+            }
+        }
+
+        return Emit(conn, packet, flags, seq, AdvertiseWindow(conn, false),
+                    optLen, payloadLen);
+    }
+
+    static void SendAck(Connection* conn) {
+        SendSegment(conn, FLAG_ACK, conn->SendNext, 0, 0);
+    }
+
+    // Send SYN or SYN-ACK with our MSS, plus window scale and timestamps
+    // when they are being offered (SYN) or were offered by the peer (SYN-ACK)
+    static bool SendSyn(Connection* conn, uint8_t flags, uint32_t seq) {
+        uint8_t packet[HEADER_SIZE + 20];
+        uint8_t* opt = packet + HEADER_SIZE;
+        uint8_t n = 0;
+
+        opt[n++] = OPT_MSS;
+        opt[n++] = 4;
+        opt[n++] = (uint8_t)(DEFAULT_MSS >> 8);
+        opt[n++] = (uint8_t)(DEFAULT_MSS & 0xFF);
+
+        if (conn->WindowScaling) {
+            opt[n++] = OPT_NOP;
+            opt[n++] = OPT_WSCALE;
+            opt[n++] = 3;
+            opt[n++] = RECV_WINDOW_SHIFT;
+        }
+
+        if (conn->Timestamps) {
+            PutTimestamp(opt + n, Now32(), (flags & FLAG_ACK) ? conn->TsRecent : 0);
+            n += TIMESTAMP_OPTION_SIZE;
+        }
+
+        return Emit(conn, packet, flags, seq, AdvertiseWindow(conn, true), n, 0);
+    }
+
     // Send a RST to an unexpected packet
     static void SendReset(uint32_t destIp, uint16_t destPort, uint16_t srcPort,
                            uint32_t seqNum, uint32_t ackNum) {
@@ -158,14 +424,255 @@ namespace Net::Tcp {
         Ipv4::Send(destIp, Ipv4::PROTO_TCP, packet, HEADER_SIZE);
     }
 
-    static void RecvBufferWrite(Connection* conn, const uint8_t* data, uint16_t len) {
-        for (uint16_t i = 0; i < len && conn->RecvCount < RECV_BUFFER_SIZE; i++) {
-            conn->RecvBuffer[conn->RecvTail] = data[i];
-            conn->RecvTail = (conn->RecvTail + 1) % RECV_BUFFER_SIZE;
-            conn->RecvCount++;
+    // -------------------------------------------------------------------------
+    // Output engine (connection lock held)
+    // -------------------------------------------------------------------------
+
+    // Transmit queued data while the peer's window and the congestion window
+    // allow it, then the FIN once everything queued has gone out
+    static void Output(Connection* conn) {
+        if (conn->SendBuffer == nullptr || conn->CurrentState == State::Closed) {
+            return;
+        }
+
+        while (true) {
+            uint32_t inFlight = conn->SendNext - conn->SendUnack;
+            uint32_t sentData = Min(inFlight, conn->SendCount);  // Excludes a FIN
+            uint32_t unsent = conn->SendCount - sentData;
+
+            if (unsent == 0) {
+                if (conn->FinPending && !conn->FinSent) {
+                    if (inFlight == 0) {
+                        conn->RetransmitTime = Timekeeping::GetMilliseconds();
+                    }
+                    SendSegment(conn, FLAG_FIN | FLAG_ACK, conn->SendNext, 0, 0);
+                    conn->SendNext++;
+                    conn->FinSent = true;
+                    if (SeqGt(conn->SendNext, conn->SendMax)) {
+                        conn->SendMax = conn->SendNext;
+                    }
+                }
+                return;
+            }
+
+            uint32_t window = Min(conn->SendWindow, conn->Cwnd);
+            if (inFlight >= window) {
+                return;
+            }
+
+            uint32_t len = Min(Min(unsent, conn->SendMss), window - inFlight);
+
+            // Sender-side silly window avoidance: wait for the window to open
+            // instead of trickling out small segments while data is in flight
+            if (len < conn->SendMss && len < unsent && inFlight > 0) {
+                return;
+            }
+
+            uint8_t flags = FLAG_ACK;
+            if (len == unsent) {
+                flags |= FLAG_PSH;
+            }
+
+            if (!SendSegment(conn, flags, conn->SendNext, sentData, (uint16_t)len)) {
+                return;
+            }
+
+            uint64_t now = Timekeeping::GetMilliseconds();
+            if (inFlight == 0) {
+                conn->RetransmitTime = now;
+            }
+            if (!conn->Timestamps && !conn->RttTiming) {
+                conn->RttTiming = true;
+                conn->RttSeq = conn->SendNext + len;
+                conn->RttStart = now;
+            }
+            conn->SendNext += len;
+            if (SeqGt(conn->SendNext, conn->SendMax)) {
+                conn->SendMax = conn->SendNext;
+            }
         }
     }
 
+    static void UpdateRtt(Connection* conn, uint32_t rtt) {
+        if (rtt == 0) {
+            rtt = 1;
+        }
+
+        if (conn->Srtt == 0) {
+            conn->Srtt = rtt;
+            conn->RttVar = rtt / 2;
+        } else {
+            uint32_t delta = conn->Srtt > rtt ? conn->Srtt - rtt : rtt - conn->Srtt;
+            conn->RttVar = (3 * conn->RttVar + delta) / 4;
+            conn->Srtt = (7 * conn->Srtt + rtt) / 8;
+        }
+
+        uint32_t rto = conn->Srtt + Max(4 * conn->RttVar, TICK_INTERVAL_MS);
+        conn->Rto = rto < MIN_RTO_MS ? MIN_RTO_MS : (rto > MAX_RTO_MS ? MAX_RTO_MS : rto);
+    }
+
+    // Handle the acknowledgment and window fields of a synchronized segment
+    static void ProcessAck(Connection* conn, uint32_t seqNum, uint32_t ackNum,
+                           uint16_t windowField, uint32_t payloadLen, const Options& opts) {
+        if (SeqGt(ackNum, conn->SendMax)) {
+            // Acknowledges something never sent
+            SendAck(conn);
+            return;
+        }
+
+        uint32_t window = (uint32_t)windowField << conn->SendScale;
+        uint64_t now = Timekeeping::GetMilliseconds();
+
+        if (SeqGt(ackNum, conn->SendUnack)) {
+            uint32_t acked = ackNum - conn->SendUnack;
+            uint32_t dataAcked = Min(acked, conn->SendCount);
+
+            conn->SendHead = (conn->SendHead + dataAcked) % SEND_BUFFER_SIZE;
+            conn->SendCount -= dataAcked;
+            conn->SendUnack = ackNum;
+
+            // After a timeout rewound SendNext, ACKs can still cover data
+            // (or the FIN) sent before it; resume from there
+            if (SeqGt(ackNum, conn->SendNext)) {
+                conn->SendNext = ackNum;
+            }
+            if (acked > dataAcked) {
+                conn->FinSent = true;
+            }
+            conn->DupAcks = 0;
+            conn->RetransmitCount = 0;
+            conn->RetransmitTime = now;
+
+            if (opts.HasTimestamp && conn->Timestamps && opts.TsEcr != 0) {
+                UpdateRtt(conn, Now32() - opts.TsEcr);
+            } else if (conn->RttTiming && SeqGe(ackNum, conn->RttSeq)) {
+                conn->RttTiming = false;
+                UpdateRtt(conn, (uint32_t)(now - conn->RttStart));
+            }
+
+            if (conn->Cwnd < conn->Ssthresh) {
+                conn->Cwnd += Min(acked, conn->SendMss);
+            } else {
+                conn->Cwnd += Max(1, (uint32_t)conn->SendMss * conn->SendMss / conn->Cwnd);
+            }
+            if (conn->Cwnd > MAX_CWND) {
+                conn->Cwnd = MAX_CWND;
+            }
+        } else if (ackNum == conn->SendUnack && payloadLen == 0 &&
+                   window == conn->SendWindow && conn->SendNext != conn->SendUnack) {
+            // Three duplicate ACKs: retransmit the first unacknowledged segment
+            // without waiting for the timer (RFC 5681 3.2)
+            if (++conn->DupAcks == 3) {
+                uint32_t inFlight = conn->SendNext - conn->SendUnack;
+                conn->Ssthresh = Max(inFlight / 2, 2 * (uint32_t)conn->SendMss);
+                conn->Cwnd = conn->Ssthresh;
+                conn->RttTiming = false;
+
+                uint32_t len = Min(conn->SendCount, conn->SendMss);
+                if (len > 0) {
+                    SendSegment(conn, FLAG_ACK, conn->SendUnack, 0, (uint16_t)len);
+                    conn->RetransmitTime = now;
+                }
+            }
+        }
+
+        // Take the window from the most recent segment (RFC 9293 3.10.7.4)
+        if (SeqLt(conn->SendWl1, seqNum) ||
+            (conn->SendWl1 == seqNum && SeqGe(ackNum, conn->SendWl2))) {
+            if (window > 0 && conn->SendWindow == 0) {
+                conn->ProbeCount = 0;
+            }
+            conn->SendWindow = window;
+            conn->SendWl1 = seqNum;
+            conn->SendWl2 = ackNum;
+        }
+    }
+
+    // Copy in-order data into the receive ring. Returns the bytes accepted,
+    // which is less than `len` when the buffer is full.
+    static uint32_t RecvBufferWrite(Connection* conn, const uint8_t* data, uint32_t len) {
+        if (conn->RecvBuffer == nullptr) {
+            return 0;
+        }
+
+        len = Min(len, conn->RecvCapacity - conn->RecvCount);
+        uint32_t first = Min(len, conn->RecvCapacity - conn->RecvTail);
+        memcpy(conn->RecvBuffer + conn->RecvTail, data, first);
+        if (first < len) {
+            memcpy(conn->RecvBuffer, data + first, len - first);
+        }
+
+        conn->RecvTail = (conn->RecvTail + len) % conn->RecvCapacity;
+        conn->RecvCount += len;
+        return len;
+    }
+
+    static uint32_t RecvBufferRead(Connection* conn, uint8_t* buffer, uint32_t size) {
+        uint32_t len = Min(size, conn->RecvCount);
+        uint32_t first = Min(len, conn->RecvCapacity - conn->RecvHead);
+        memcpy(buffer, conn->RecvBuffer + conn->RecvHead, first);
+        if (first < len) {
+            memcpy(buffer + first, conn->RecvBuffer, len - first);
+        }
+
+        conn->RecvHead = (conn->RecvHead + len) % conn->RecvCapacity;
+        conn->RecvCount -= len;
+        return len;
+    }
+
+    // Accept the payload and FIN of a segment. Anything not at RecvNext is
+    // dropped; the ACK sent back doubles as the duplicate ACK the peer
+    // needs for fast retransmit. Returns true if a FIN was consumed.
+    static bool ProcessData(Connection* conn, uint32_t seqNum, uint8_t flags,
+                            const uint8_t* payload, uint32_t payloadLen, const Options& opts) {
+        uint32_t lastAck = conn->RecvNext;
+        bool fin = (flags & FLAG_FIN) != 0;
+
+        if (payloadLen == 0 && !fin) {
+            if (opts.HasTimestamp && conn->Timestamps && SeqLe(seqNum, lastAck)) {
+                conn->TsRecent = opts.TsVal;
+            }
+            return false;
+        }
+
+        // Trim bytes we already have
+        uint32_t segSeq = seqNum;
+        if (SeqLt(seqNum, conn->RecvNext)) {
+            uint32_t dup = conn->RecvNext - seqNum;
+            if (dup > payloadLen) {
+                // Entirely old, including any FIN
+                payloadLen = 0;
+                fin = false;
+            } else {
+                payload += dup;
+                payloadLen -= dup;
+            }
+            seqNum = conn->RecvNext;
+        }
+
+        bool consumedFin = false;
+        if (seqNum == conn->RecvNext) {
+            uint32_t accepted = RecvBufferWrite(conn, payload, payloadLen);
+            conn->RecvNext += accepted;
+            if (fin && accepted == payloadLen) {
+                conn->RecvNext++;
+                consumedFin = true;
+            }
+        }
+
+        // RFC 7323 4.3: remember TSval from segments covering the last ACK
+        if (opts.HasTimestamp && conn->Timestamps && SeqLe(segSeq, lastAck)) {
+            conn->TsRecent = opts.TsVal;
+        }
+
+        SendAck(conn);
+        return consumedFin;
+    }
+
+    // -------------------------------------------------------------------------
+    // Segment arrival
+    // -------------------------------------------------------------------------
+
     void Initialize() {
         for (uint32_t i = 0; i < MAX_CONNECTIONS; i++) {
             g_connections[i].Active = false;
@@ -191,6 +698,7 @@ namespace Net::Tcp {
         uint16_t dstPort = Ntohs(hdr->DstPort);
         uint32_t seqNum  = Ntohl(hdr->SeqNum);
         uint32_t ackNum  = Ntohl(hdr->AckNum);
+        uint16_t window  = Ntohs(hdr->Window);
         uint8_t  flags   = hdr->Flags;
         uint8_t  dataOff = (hdr->DataOffset >> 4) * 4;
 
@@ -201,6 +709,9 @@ namespace Net::Tcp {
         const uint8_t* payload = data + dataOff;
         uint16_t payloadLen = length - dataOff;
 
+        Options opts;
+        ParseOptions(data + HEADER_SIZE, dataOff - HEADER_SIZE, opts);
+
         // Find existing connection
         Connection* conn = FindConnection(srcIp, srcPort, dstPort);
 
@@ -215,6 +726,8 @@ namespace Net::Tcp {
                     listener->PendingRemoteIp = srcIp;
                     listener->PendingRemotePort = srcPort;
                     listener->PendingSeq = seqNum;
+                    listener->PendingWindow = window;
+                    listener->PendingOptions = opts;
                     listener->Lock.Release();
                     return;
                 }
@@ -238,8 +751,7 @@ namespace Net::Tcp {
 
         // RST handling
         if (flags & FLAG_RST) {
-            conn->CurrentState = State::Closed;
-            conn->Active = false;
+            Abort(conn);
             conn->Lock.Release();
             return;
         }
@@ -250,11 +762,18 @@ namespace Net::Tcp {
                 if ((flags & (FLAG_SYN | FLAG_ACK)) == (FLAG_SYN | FLAG_ACK)) {
                     if (ackNum == conn->SendNext) {
                         conn->RecvNext = seqNum + 1;
+                        conn->RecvEdge = conn->RecvNext;
                         conn->SendUnack = ackNum;
+                        InitTransfer(conn, opts);
+
+                        // Windows in SYN segments are never scaled
+                        conn->SendWindow = window;
+                        conn->SendWl1 = seqNum;
+                        conn->SendWl2 = ackNum;
                         conn->CurrentState = State::Established;
 
                         // Send ACK
-                        SendSegment(conn, FLAG_ACK, nullptr, 0);
+                        SendAck(conn);
                     }
                 }
                 break;
@@ -262,71 +781,54 @@ namespace Net::Tcp {
 
             case State::SynReceived: {
                 // Expecting ACK to complete handshake
-                if (flags & FLAG_ACK) {
-                    if (ackNum == conn->SendNext) {
-                        conn->SendUnack = ackNum;
-                        conn->CurrentState = State::Established;
-                    }
+                if (!(flags & FLAG_ACK) || ackNum != conn->SendNext) {
+                    break;
                 }
-                break;
+                conn->SendUnack = ackNum;
+                conn->SendWindow = (uint32_t)window << conn->SendScale;
+                conn->SendWl1 = seqNum;
+                conn->SendWl2 = ackNum;
+                conn->CurrentState = State::Established;
+                if (payloadLen == 0 && !(flags & FLAG_FIN)) {
+                    break;
+                }
+                [[fallthrough]];
             }
 
-            case State::Established: {
-                // Handle incoming data
+            case State::Established:
+            case State::FinWait1:
+            case State::FinWait2:
+            case State::CloseWait:
+            case State::LastAck: {
                 if (flags & FLAG_ACK) {
-                    conn->SendUnack = ackNum;
-                }
-
-                if (payloadLen > 0 && seqNum == conn->RecvNext) {
-                    RecvBufferWrite(conn, payload, payloadLen);
-                    conn->RecvNext += payloadLen;
-
-                    // Send ACK
-                    SendSegment(conn, FLAG_ACK, nullptr, 0);
+                    ProcessAck(conn, seqNum, ackNum, window, payloadLen, opts);
                 }
 
-                if (flags & FLAG_FIN) {
-                    conn->RecvNext = seqNum + payloadLen + 1;
-                    conn->CurrentState = State::CloseWait;
-
-                    // Send ACK for the FIN
-                    SendSegment(conn, FLAG_ACK, nullptr, 0);
+                bool finAcked = conn->FinSent && conn->SendUnack == conn->SendNext;
+                if (conn->CurrentState == State::LastAck) {
+                    if (finAcked) {
+                        conn->CurrentState = State::Closed;
+                        conn->Active = false;
+                        break;
+                    }
+                } else if (conn->CurrentState == State::FinWait1 && finAcked) {
+                    conn->CurrentState = State::FinWait2;
                 }
-                break;
-            }
 
-            case State::FinWait1: {
-                if (flags & FLAG_ACK) {
-                    conn->SendUnack = ackNum;
-                    if (flags & FLAG_FIN) {
-                        conn->RecvNext = seqNum + 1;
-                        conn->CurrentState = State::TimeWait;
-                        SendSegment(conn, FLAG_ACK, nullptr, 0);
-                    } else {
-                        conn->CurrentState = State::FinWait2;
+                // Data is only accepted until the peer has sent its FIN
+                if (conn->CurrentState == State::Established ||
+                    conn->CurrentState == State::FinWait1 ||
+                    conn->CurrentState == State::FinWait2) {
+                    if (ProcessData(conn, seqNum, flags, payload, payloadLen, opts)) {
+                        conn->CurrentState = conn->CurrentState == State::Established
+                                           ? State::CloseWait : State::TimeWait;
                     }
-                } else if (flags & FLAG_FIN) {
-                    conn->RecvNext = seqNum + 1;
-                    conn->CurrentState = State::TimeWait;
-                    SendSegment(conn, FLAG_ACK, nullptr, 0);
+                } else if (payloadLen > 0 || (flags & FLAG_FIN)) {
+                    // Retransmission of something already acknowledged
+                    SendAck(conn);
                 }
-                break;
-            }
 
-            case State::FinWait2: {
-                if (flags & FLAG_FIN) {
-                    conn->RecvNext = seqNum + 1;
-                    conn->CurrentState = State::TimeWait;
-                    SendSegment(conn, FLAG_ACK, nullptr, 0);
-                }
-                break;
-            }
-
-            case State::LastAck: {
-                if (flags & FLAG_ACK) {
-                    conn->CurrentState = State::Closed;
-                    conn->Active = false;
-                }
+                Output(conn);
                 break;
             }
 
@@ -342,6 +844,94 @@ namespace Net::Tcp {
         conn->Lock.Release();
     }
 
+    // -------------------------------------------------------------------------
+    // Timers
+    // -------------------------------------------------------------------------
+
+    static void OnTimer(Connection* conn, uint64_t now) {
+        uint32_t inFlight = conn->SendNext - conn->SendUnack;
+
+        if (inFlight > 0) {
+            if (now - conn->RetransmitTime < conn->Rto) {
+                return;
+            }
+
+            if (++conn->RetransmitCount > MAX_RETRANSMITS) {
+                Abort(conn);
+                return;
+            }
+
+            // Go back to the oldest unacknowledged byte and restart from a
+            // single segment (RFC 5681 3.1)
+            conn->Ssthresh = Max(inFlight / 2, 2 * (uint32_t)conn->SendMss);
+            conn->Cwnd = conn->SendMss;
+            conn->Rto = Min(conn->Rto * 2, MAX_RTO_MS);
+            conn->DupAcks = 0;
+            conn->RttTiming = false;
+            conn->SendNext = conn->SendUnack;
+            conn->FinSent = false;
+            conn->RetransmitTime = now;
+
+            // A zero window would keep Output() from sending anything
+            uint32_t window = conn->SendWindow;
+            if (window == 0) {
+                conn->SendWindow = 1;
+            }
+            Output(conn);
+            conn->SendWindow = window;
+            return;
+        }
+
+        // Persist timer: probe a closed window so a lost window update
+        // cannot stall the connection
+        bool waiting = conn->SendCount > 0 || (conn->FinPending && !conn->FinSent);
+        if (waiting && conn->SendWindow == 0) {
+            uint32_t interval = Min(conn->Rto << Min(conn->ProbeCount, 6), MAX_RTO_MS);
+            if (now - conn->RetransmitTime >= interval) {
+                SendSegment(conn, FLAG_ACK, conn->SendUnack - 1, 0, 0);
+                conn->RetransmitTime = now;
+                conn->ProbeCount++;
+            }
+        }
+    }
+
+    void Tick() {
+        uint64_t now = Timekeeping::GetMilliseconds();
+        if (now - g_lastTick < TICK_INTERVAL_MS) {
+            return;
+        }
+        g_lastTick = now;
+
+        for (uint32_t i = 0; i < MAX_CONNECTIONS; i++) {
+            Connection* conn = &g_connections[i];
+            if (!conn->Active || conn->SendBuffer == nullptr || conn->SendMss == 0) {
+                continue;
+            }
+
+            // Skip connections busy in process context; the next tick retries
+            if (!conn->Lock.TryAcquire()) {
+                continue;
+            }
+
+            switch (conn->CurrentState) {
+                case State::Established:
+                case State::FinWait1:
+                case State::CloseWait:
+                case State::LastAck:
+                    OnTimer(conn, now);
+                    break;
+                default:
+                    break;
+            }
+
+            conn->Lock.Release();
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // Connection setup
+    // -------------------------------------------------------------------------
+
     Connection* Listen(uint16_t port) {
         g_connectionsLock.Acquire();
         Connection* conn = AllocateConnection();
@@ -374,6 +964,8 @@ namespace Net::Tcp {
                 uint32_t remoteIp = listener->PendingRemoteIp;
                 uint16_t remotePort = listener->PendingRemotePort;
                 uint32_t remoteSeq = listener->PendingSeq;
+                uint16_t remoteWindow = listener->PendingWindow;
+                Options remoteOptions = listener->PendingOptions;
                 listener->Lock.Release();
 
                 // Allocate a new connection for this client
@@ -384,41 +976,42 @@ namespace Net::Tcp {
                 if (conn == nullptr) {
                     return nullptr;
                 }
+                if (!AllocateBuffers(conn)) {
+                    conn->Active = false;
+                    return nullptr;
+                }
+
+                uint64_t flags;
+                asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+                conn->Lock.Acquire();
 
                 conn->LocalIp = Net::GetIpAddress();
                 conn->LocalPort = listener->LocalPort;
                 conn->RemoteIp = remoteIp;
                 conn->RemotePort = remotePort;
                 conn->RecvNext = remoteSeq + 1;
+                conn->RecvEdge = conn->RecvNext;
+                conn->Rto = INITIAL_RTO_MS;
+
+                // Scaling and timestamps are used only if the SYN offered them
+                conn->WindowScaling = true;
+                conn->Timestamps = true;
+                InitTransfer(conn, remoteOptions);
+                conn->SendWindow = remoteWindow;
 
                 uint32_t isn = GenerateISN();
-                conn->SendNext = isn;
                 conn->SendUnack = isn;
+                conn->SendNext = isn + 1;
+                conn->SendMax = conn->SendNext;
+                conn->SendWl1 = remoteSeq;
+                conn->SendWl2 = isn;
                 conn->CurrentState = State::SynReceived;
 
                 // Send SYN-ACK
-                conn->SendNext = isn + 1;
-                {
-                    // Manually build the SYN-ACK with ISN as seqnum
-                    uint8_t packet[HEADER_SIZE];
-                    Header* hdr = (Header*)packet;
-
-                    hdr->SrcPort = Htons(conn->LocalPort);
-                    hdr->DstPort = Htons(conn->RemotePort);
-                    hdr->SeqNum = Htonl(isn);
-                    hdr->AckNum = Htonl(conn->RecvNext);
-                    hdr->DataOffset = (HEADER_SIZE / 4) << 4;
-                    hdr->Flags = FLAG_SYN | FLAG_ACK;
-                    hdr->Window = Htons(WINDOW_SIZE);
-                    hdr->Checksum = 0;
-                    hdr->UrgentPtr = 0;
-
-                    hdr->Checksum = Ipv4::PseudoHeaderChecksum(
-                        conn->LocalIp, conn->RemoteIp, Ipv4::PROTO_TCP,
-                        HEADER_SIZE, packet, HEADER_SIZE);
-
-                    Ipv4::Send(conn->RemoteIp, Ipv4::PROTO_TCP, packet, HEADER_SIZE);
-                }
+                SendSyn(conn, FLAG_SYN | FLAG_ACK, isn);
+
+                conn->Lock.Release();
+                asm volatile("push %0; popfq" :: "r"(flags) : "memory");
 
                 // Wait for ACK to complete the handshake
                 for (int i = 0; i < 100; i++) {
@@ -445,38 +1038,34 @@ namespace Net::Tcp {
         if (conn == nullptr) {
             return nullptr;
         }
+        if (!AllocateBuffers(conn)) {
+            conn->Active = false;
+            return nullptr;
+        }
 
         conn->LocalIp = Net::GetIpAddress();
         conn->LocalPort = srcPort;
         conn->RemoteIp = destIp;
         conn->RemotePort = destPort;
+        conn->Rto = INITIAL_RTO_MS;
+
+        // Offer window scaling and timestamps; the SYN-ACK decides
+        conn->WindowScaling = true;
+        conn->Timestamps = true;
 
         uint32_t isn = GenerateISN();
         conn->SendNext = isn + 1;
+        conn->SendMax = conn->SendNext;
         conn->SendUnack = isn;
         conn->CurrentState = State::SynSent;
 
         // Send SYN
-        {
-            uint8_t packet[HEADER_SIZE];
-            Header* hdr = (Header*)packet;
-
-            hdr->SrcPort = Htons(conn->LocalPort);
-            hdr->DstPort = Htons(conn->RemotePort);
-            hdr->SeqNum = Htonl(isn);
-            hdr->AckNum = 0;
-            hdr->DataOffset = (HEADER_SIZE / 4) << 4;
-            hdr->Flags = FLAG_SYN;
-            hdr->Window = Htons(WINDOW_SIZE);
-            hdr->Checksum = 0;
-            hdr->UrgentPtr = 0;
-
-            hdr->Checksum = Ipv4::PseudoHeaderChecksum(
-                conn->LocalIp, conn->RemoteIp, Ipv4::PROTO_TCP,
-                HEADER_SIZE, packet, HEADER_SIZE);
-
-            Ipv4::Send(conn->RemoteIp, Ipv4::PROTO_TCP, packet, HEADER_SIZE);
-        }
+        uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        conn->Lock.Acquire();
+        SendSyn(conn, FLAG_SYN, isn);
+        conn->Lock.Release();
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory");
 
         // Wait for SYN-ACK
         for (int attempt = 0; attempt < MAX_RETRANSMITS; attempt++) {
@@ -487,27 +1076,14 @@ namespace Net::Tcp {
                 Timekeeping::Sleep(50);
             }
 
+            asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+            conn->Lock.Acquire();
             if (conn->CurrentState == State::SynSent) {
                 // Retransmit SYN
-                uint8_t packet[HEADER_SIZE];
-                Header* hdr = (Header*)packet;
-
-                hdr->SrcPort = Htons(conn->LocalPort);
-                hdr->DstPort = Htons(conn->RemotePort);
-                hdr->SeqNum = Htonl(isn);
-                hdr->AckNum = 0;
-                hdr->DataOffset = (HEADER_SIZE / 4) << 4;
-                hdr->Flags = FLAG_SYN;
-                hdr->Window = Htons(WINDOW_SIZE);
-                hdr->Checksum = 0;
-                hdr->UrgentPtr = 0;
-
-                hdr->Checksum = Ipv4::PseudoHeaderChecksum(
-                    conn->LocalIp, conn->RemoteIp, Ipv4::PROTO_TCP,
-                    HEADER_SIZE, packet, HEADER_SIZE);
-
-                Ipv4::Send(conn->RemoteIp, Ipv4::PROTO_TCP, packet, HEADER_SIZE);
+                SendSyn(conn, FLAG_SYN, isn);
             }
+            conn->Lock.Release();
+            asm volatile("push %0; popfq" :: "r"(flags) : "memory");
         }
 
         // Failed to connect
@@ -515,104 +1091,137 @@ namespace Net::Tcp {
         return nullptr;
     }
 
-    int Send(Connection* conn, const uint8_t* data, uint16_t length) {
-        if (conn == nullptr || conn->CurrentState != State::Established) {
+    // -------------------------------------------------------------------------
+    // Data transfer
+    // -------------------------------------------------------------------------
+
+    int Send(Connection* conn, const uint8_t* data, uint32_t length) {
+        if (conn == nullptr || conn->SendBuffer == nullptr ||
+            (conn->CurrentState != State::Established &&
+             conn->CurrentState != State::CloseWait)) {
             return -1;
         }
 
-        // Phase 1: Send data segments with interrupts disabled (lock-safe)
-        uint64_t flags;
-        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
-        conn->Lock.Acquire();
-
-        constexpr uint16_t MSS = 1460;
-        uint16_t sent = 0;
+        // Copy into the send buffer as space frees up. The output engine and
+        // the timer tick take care of transmission and retransmission.
+        uint32_t queued = 0;
+        uint64_t lastProgress = Timekeeping::GetMilliseconds();
 
-        while (sent < length) {
-            uint16_t segLen = length - sent;
-            if (segLen > MSS) {
-                segLen = MSS;
-            }
+        while (true) {
+            uint64_t flags;
+            asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+            conn->Lock.Acquire();
 
-            bool ok = SendSegment(conn, FLAG_ACK | FLAG_PSH, data + sent, segLen);
-            if (!ok) {
+            if (conn->CurrentState != State::Established &&
+                conn->CurrentState != State::CloseWait) {
                 conn->Lock.Release();
                 asm volatile("push %0; popfq" :: "r"(flags) : "memory");
-                return sent > 0 ? sent : -1;
+                return queued > 0 ? (int)queued : -1;
             }
 
-            conn->SendNext += segLen;
+            uint32_t len = Min(length - queued, SEND_BUFFER_SIZE - conn->SendCount);
+            if (len > 0) {
+                uint32_t pos = (conn->SendHead + conn->SendCount) % SEND_BUFFER_SIZE;
+                uint32_t first = Min(len, SEND_BUFFER_SIZE - pos);
+                memcpy(conn->SendBuffer + pos, data + queued, first);
+                if (first < len) {
+                    memcpy(conn->SendBuffer, data + queued + first, len - first);
+                }
+                conn->SendCount += len;
+                queued += len;
+                Output(conn);
+            }
+
+            conn->Lock.Release();
+            asm volatile("push %0; popfq" :: "r"(flags) : "memory");
 
-            // Store for retransmission
-            if (segLen <= sizeof(conn->RetransmitBuffer)) {
-                memcpy(conn->RetransmitBuffer, data + sent, segLen);
-                conn->RetransmitLen = segLen;
-                conn->RetransmitTime = Timekeeping::GetMilliseconds();
-                conn->RetransmitCount = 0;
+            if (queued == length) {
+                return (int)queued;
             }
 
-            sent += segLen;
+            uint64_t now = Timekeeping::GetMilliseconds();
+            if (len > 0) {
+                lastProgress = now;
+            } else if (now - lastProgress > SEND_STALL_MS) {
+                return queued > 0 ? (int)queued : -1;
+            }
+            Timekeeping::Sleep(1);
+        }
+    }
+
+    // Double the receive buffer when the application lets it run nearly
+    // full, so the advertised window keeps up with fast senders.
+    // Called from process context without the lock held.
+    static void GrowRecvBuffer(Connection* conn) {
+        uint32_t capacity = conn->RecvCapacity;
+        if (capacity >= RECV_BUFFER_MAX || conn->RecvCount < capacity / 4 * 3) {
+            return;
+        }
+
+        uint32_t newCapacity = capacity * 2;
+        uint8_t* newBuffer = (uint8_t*)Memory::g_heap->Request(newCapacity);
+        if (newBuffer == nullptr) {
+            return;
+        }
+
+        uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        conn->Lock.Acquire();
+
+        uint8_t* oldBuffer = nullptr;
+        if (conn->RecvCapacity == capacity) {
+            uint32_t count = conn->RecvCount;
+            RecvBufferRead(conn, newBuffer, count);
+            oldBuffer = conn->RecvBuffer;
+            conn->RecvBuffer = newBuffer;
+            conn->RecvCapacity = newCapacity;
+            conn->RecvHead = 0;
+            conn->RecvTail = count;
+            conn->RecvCount = count;
         }
 
         conn->Lock.Release();
         asm volatile("push %0; popfq" :: "r"(flags) : "memory");
 
-        // Phase 2: Wait for ACK without holding the lock (interrupts enabled)
-        uint64_t startTime = Timekeeping::GetMilliseconds();
-        while (conn->SendUnack != conn->SendNext) {
-            uint64_t now = Timekeeping::GetMilliseconds();
-            if ((now - startTime) > (RETRANSMIT_TIMEOUT_MS * MAX_RETRANSMITS)) {
-                break;
-            }
-            if ((now - conn->RetransmitTime) > RETRANSMIT_TIMEOUT_MS && conn->RetransmitLen > 0) {
-                conn->RetransmitCount++;
-                if (conn->RetransmitCount > MAX_RETRANSMITS) {
-                    break;
-                }
-                // Retransmit with brief interrupt-disabled window
-                asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
-                conn->Lock.Acquire();
-                uint32_t savedNext = conn->SendNext;
-                conn->SendNext = conn->SendUnack;
-                SendSegment(conn, FLAG_ACK | FLAG_PSH,
-                           conn->RetransmitBuffer, conn->RetransmitLen);
-                conn->SendNext = savedNext;
-                conn->RetransmitTime = Timekeeping::GetMilliseconds();
-                conn->Lock.Release();
-                asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+        Memory::g_heap->Free(oldBuffer != nullptr ? oldBuffer : newBuffer);
+    }
+
+    // Read buffered data (lock held). Tells the peer once the window has
+    // opened by a useful amount, since it may be waiting on a closed window.
+    static uint32_t ReadLocked(Connection* conn, uint8_t* buffer, uint32_t bufferSize) {
+        uint32_t read = RecvBufferRead(conn, buffer, bufferSize);
+
+        if (read > 0 && (conn->CurrentState == State::Established ||
+                         conn->CurrentState == State::FinWait1 ||
+                         conn->CurrentState == State::FinWait2)) {
+            uint32_t edge = conn->RecvNext + (conn->RecvCapacity - conn->RecvCount);
+            uint32_t threshold = Min(conn->RecvCapacity / 2, 2 * (uint32_t)DEFAULT_MSS);
+            if (SeqGe(edge, conn->RecvEdge + threshold)) {
+                SendAck(conn);
             }
-            Timekeeping::Sleep(10);
         }
-
-        return sent;
+        return read;
     }
 
-    int Receive(Connection* conn, uint8_t* buffer, uint16_t bufferSize) {
+    int Receive(Connection* conn, uint8_t* buffer, uint32_t bufferSize) {
         if (conn == nullptr) {
             return -1;
         }
 
         // Block until data is available or connection is closing
         while (true) {
+            GrowRecvBuffer(conn);
+
             uint64_t flags;
             asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
             conn->Lock.Acquire();
 
             if (conn->RecvCount > 0) {
-                uint16_t toRead = conn->RecvCount;
-                if (toRead > bufferSize) {
-                    toRead = bufferSize;
-                }
-
-                for (uint16_t i = 0; i < toRead; i++) {
-                    buffer[i] = conn->RecvBuffer[conn->RecvHead];
-                    conn->RecvHead = (conn->RecvHead + 1) % RECV_BUFFER_SIZE;
-                }
-                conn->RecvCount -= toRead;
+                uint32_t toRead = ReadLocked(conn, buffer, bufferSize);
 
                 conn->Lock.Release();
                 asm volatile("push %0; popfq" :: "r"(flags) : "memory");
-                return toRead;
+                return (int)toRead;
             }
 
             if (conn->CurrentState == State::CloseWait ||
@@ -629,11 +1238,13 @@ namespace Net::Tcp {
         }
     }
 
-    int ReceiveNonBlocking(Connection* conn, uint8_t* buffer, uint16_t bufferSize) {
+    int ReceiveNonBlocking(Connection* conn, uint8_t* buffer, uint32_t bufferSize) {
         if (conn == nullptr) {
             return -1;
         }
 
+        GrowRecvBuffer(conn);
+
         // Disable interrupts while holding the lock to prevent deadlock
         // with OnPacketReceived (called from the network interrupt handler)
         uint64_t flags;
@@ -643,17 +1254,7 @@ namespace Net::Tcp {
 
         int result;
         if (conn->RecvCount > 0) {
-            uint16_t toRead = conn->RecvCount;
-            if (toRead > bufferSize) {
-                toRead = bufferSize;
-            }
-
-            for (uint16_t i = 0; i < toRead; i++) {
-                buffer[i] = conn->RecvBuffer[conn->RecvHead];
-                conn->RecvHead = (conn->RecvHead + 1) % RECV_BUFFER_SIZE;
-            }
-            conn->RecvCount -= toRead;
-            result = toRead;
+            result = (int)ReadLocked(conn, buffer, bufferSize);
         } else if (conn->CurrentState == State::CloseWait ||
                    conn->CurrentState == State::Closed ||
                    conn->CurrentState == State::TimeWait) {
@@ -678,38 +1279,30 @@ namespace Net::Tcp {
         conn->Lock.Acquire();
 
         switch (conn->CurrentState) {
-            case State::Established: {
-                conn->CurrentState = State::FinWait1;
-                SendSegment(conn, FLAG_FIN | FLAG_ACK, nullptr, 0);
-                conn->SendNext++;
+            case State::Established:
+            case State::CloseWait: {
+                // The FIN follows whatever is still queued for sending
+                conn->CurrentState = conn->CurrentState == State::Established
+                                   ? State::FinWait1 : State::LastAck;
+                conn->FinPending = true;
+                Output(conn);
                 conn->Lock.Release();
                 asm volatile("push %0; popfq" :: "r"(flags) : "memory");
 
-                // Wait for close to complete
-                for (int i = 0; i < 100; i++) {
+                // Wait for close to complete while the peer keeps acknowledging
+                uint32_t lastUnack = conn->SendUnack;
+                uint64_t lastProgress = Timekeeping::GetMilliseconds();
+                while (Timekeeping::GetMilliseconds() - lastProgress < CLOSE_STALL_MS) {
                     if (conn->CurrentState == State::TimeWait ||
-                        conn->CurrentState == State::Closed) {
+                        conn->CurrentState == State::Closed ||
+                        !conn->Active) {
                         break;
                     }
-                    Timekeeping::Sleep(50);
-                }
-                conn->Active = false;
-                return;
-            }
-
-            case State::CloseWait: {
-                conn->CurrentState = State::LastAck;
-                SendSegment(conn, FLAG_FIN | FLAG_ACK, nullptr, 0);
-                conn->SendNext++;
-                conn->Lock.Release();
-                asm volatile("push %0; popfq" :: "r"(flags) : "memory");
-
-                // Wait for final ACK
-                for (int i = 0; i < 100; i++) {
-                    if (conn->CurrentState == State::Closed) {
-                        break;
+                    if (conn->SendUnack != lastUnack) {
+                        lastUnack = conn->SendUnack;
+                        lastProgress = Timekeeping::GetMilliseconds();
                     }
-                    Timekeeping::Sleep(50);
+                    Timekeeping::Sleep(10);
                 }
                 conn->Active = false;
                 return;
@@ -64,15 +64,16 @@ namespace Net::Tcp {
     // Actively connect to a remote host:port. Returns connection in Established state or nullptr.
     Connection* Connect(uint32_t destIp, uint16_t destPort, uint16_t srcPort);
 
-    // Send data on an established connection. Returns number of bytes sent.
-    int Send(Connection* conn, const uint8_t* data, uint16_t length);
+    // Queue data on an established connection. Blocks while the send buffer
+    // is full. Returns number of bytes queued, or -1 if nothing could be.
+    int Send(Connection* conn, const uint8_t* data, uint32_t length);
 
     // Receive data from an established connection. Returns number of bytes received.
     // Blocks until data is available or connection is closed.
-    int Receive(Connection* conn, uint8_t* buffer, uint16_t bufferSize);
+    int Receive(Connection* conn, uint8_t* buffer, uint32_t bufferSize);
 
     // Non-blocking receive. Returns bytes read, 0 if no data available, or -1 on closed/error.
-    int ReceiveNonBlocking(Connection* conn, uint8_t* buffer, uint16_t bufferSize);
+    int ReceiveNonBlocking(Connection* conn, uint8_t* buffer, uint32_t bufferSize);
 
     // Close a TCP connection gracefully
     void Close(Connection* conn);
@@ -80,4 +81,7 @@ namespace Net::Tcp {
     // Get the state of a connection
     State GetState(Connection* conn);
 
+    // Run retransmission and zero window probe timers (called from the timer interrupt)
+    void Tick();
+
 }
@@ -415,6 +415,22 @@ namespace Pci {
         return addr;
     }
 
+    uint64_t ReadBar(uint8_t bus, uint8_t device, uint8_t function, int index) {
+        if (index < 0 || index > 5) return 0;
+
+        uint8_t reg = (uint8_t)(PCI_REG_BAR0 + index * 4);
+        uint32_t barLow = LegacyRead32(bus, device, function, reg);
+        if (barLow & 0x01) return 0;
+
+        uint64_t addr = barLow & 0xFFFFFFF0u;
+        if ((barLow & 0x06) == 0x04 && index < 5) {
+            uint32_t barHigh = LegacyRead32(bus, device, function, (uint8_t)(reg + 4));
+            addr |= ((uint64_t)barHigh << 32);
+        }
+
+        return addr;
+    }
+
     void EnableBusMaster(uint8_t bus, uint8_t device, uint8_t function) {
         uint16_t cmd = LegacyRead16(bus, device, function, (uint8_t)PCI_REG_COMMAND);
         cmd |= PCI_CMD_MEM_SPACE | PCI_CMD_BUS_MASTER;
@@ -64,15 +64,22 @@ namespace Sched {
             return 0;
         }
 
-        // Read entire file into a heap buffer
-        uint8_t* fileData = (uint8_t*)Memory::g_heap->Request(fileSize);
-        if (fileData == nullptr) {
-            Kt::KernelLogStream(Kt::ERROR, "ELF") << "Failed to allocate " << fileSize << " bytes for file";
-            Fs::Vfs::VfsClose(handle);
-            return 0;
-        }
+        // Files resident in memory (the ramdisk) are used in place; anything
+        // else is read into a heap buffer
+        const uint8_t* image = Fs::Vfs::VfsMap(handle);
+        uint8_t* fileData = nullptr;
+        if (image == nullptr) {
+            fileData = (uint8_t*)Memory::g_heap->Request(fileSize);
+            if (fileData == nullptr) {
+                Kt::KernelLogStream(Kt::ERROR, "ELF") << "Failed to allocate " << fileSize << " bytes for file";
+                Fs::Vfs::VfsClose(handle);
+                return 0;
+            }
 
-        Fs::Vfs::VfsRead(handle, fileData, 0, fileSize);
+            Fs::Vfs::VfsRead(handle, fileData, 0, fileSize);
+            image = fileData;
+        }
+        bool mapped = fileData == nullptr;
         Fs::Vfs::VfsClose(handle);
 
         // Prevent the optimizer from reordering the VfsRead store past the
@@ -80,15 +87,15 @@ namespace Sched {
         asm volatile("" ::: "memory");
 
         // Validate ELF header
-        Elf64Header* hdr = (Elf64Header*)fileData;
+        const Elf64Header* hdr = (const Elf64Header*)image;
         if (!ValidateElfHeader(hdr)) {
-            Memory::g_heap->Free(fileData);
+            if (fileData) Memory::g_heap->Free(fileData);
             return 0;
         }
 
         // Process program headers
         for (uint16_t i = 0; i < hdr->e_phnum; i++) {
-            Elf64ProgramHeader* phdr = (Elf64ProgramHeader*)(fileData + hdr->e_phoff + i * hdr->e_phentsize);
+            const Elf64ProgramHeader* phdr = (const Elf64ProgramHeader*)(image + hdr->e_phoff + i * hdr->e_phentsize);
 
             if (phdr->p_type != PT_LOAD) {
                 continue;
@@ -103,21 +110,39 @@ namespace Sched {
             uint64_t segEnd = (phdr->p_vaddr + phdr->p_memsz + 0xFFF) & ~0xFFFULL;
             uint64_t numPages = (segEnd - segBase) / 0x1000;
 
+            uint64_t segFileStart = phdr->p_vaddr;
+            uint64_t segFileEnd = phdr->p_vaddr + phdr->p_filesz;
+            bool shareable = mapped && !(phdr->p_flags & PF_W);
+
             for (uint64_t p = 0; p < numPages; p++) {
+                uint64_t virtAddr = segBase + p * 0x1000;
+
+                // Read-only pages lying wholly inside a page-aligned stretch of
+                // the resident image are mapped in place rather than copied
+                if (shareable && virtAddr >= segFileStart && virtAddr + 0x1000 <= segFileEnd) {
+                    const uint8_t* src = image + phdr->p_offset + (virtAddr - phdr->p_vaddr);
+                    if (((uint64_t)src & 0xFFF) == 0) {
+                        if (!Memory::VMM::Paging::MapUserInShared(pml4Phys, Memory::SubHHDM((uint64_t)src), virtAddr)) {
+                            Kt::KernelLogStream(Kt::ERROR, "ELF") << "Failed to map page";
+                            return 0;
+                        }
+                        continue;
+                    }
+                }
+
                 void* page = Memory::g_pfa->AllocateZeroed();
                 if (page == nullptr) {
                     Kt::KernelLogStream(Kt::ERROR, "ELF") << "Out of physical pages";
-                    Memory::g_heap->Free(fileData);
+                    if (fileData) Memory::g_heap->Free(fileData);
                     return 0;
                 }
 
                 uint64_t physAddr = Memory::SubHHDM((uint64_t)page);
-                uint64_t virtAddr = segBase + p * 0x1000;
 
                 // Map into the process's PML4 with User bit set
-                if (!Memory::VMM::Paging::MapUserIn(pml4Phys, physAddr, virtAddr)) {
+                if (!Memory::VMM::Paging::MapUserIn(pml4Phys, physAddr, virtAddr, true)) {
                     Kt::KernelLogStream(Kt::ERROR, "ELF") << "Failed to map page";
-                    Memory::g_heap->Free(fileData);
+                    if (fileData) Memory::g_heap->Free(fileData);
                     return 0;
                 }
 
@@ -125,9 +150,6 @@ namespace Sched {
                 uint64_t pageStart = virtAddr;
                 uint64_t pageEnd = virtAddr + 0x1000;
 
-                uint64_t segFileStart = phdr->p_vaddr;
-                uint64_t segFileEnd = phdr->p_vaddr + phdr->p_filesz;
-
                 uint64_t copyStart = (pageStart > segFileStart) ? pageStart : segFileStart;
                 uint64_t copyEnd = (pageEnd < segFileEnd) ? pageEnd : segFileEnd;
 
@@ -137,14 +159,14 @@ namespace Sched {
                     uint64_t copySize = copyEnd - copyStart;
 
                     uint8_t* dst = (uint8_t*)Memory::HHDM(physAddr) + dstOffset;
-                    uint8_t* src = fileData + srcOffset;
+                    const uint8_t* src = image + srcOffset;
                     memcpy(dst, src, copySize);
                 }
             }
         }
 
         uint64_t entryPoint = hdr->e_entry;
-        Memory::g_heap->Free(fileData);
+        if (fileData) Memory::g_heap->Free(fileData);
 
         return entryPoint;
     }
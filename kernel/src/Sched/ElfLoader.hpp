@@ -38,6 +38,7 @@ namespace Sched {
     };
 
     static constexpr uint32_t PT_LOAD    = 1;
+    static constexpr uint32_t PF_W       = 2;
     static constexpr uint16_t ET_EXEC    = 2;
     static constexpr uint16_t EM_X86_64  = 62;
 
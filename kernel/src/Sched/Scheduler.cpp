@@ -164,7 +164,7 @@ namespace Sched {
                 return -1;
             }
             uint64_t physAddr = Memory::SubHHDM((uint64_t)page);
-            if (!Memory::VMM::Paging::MapUserIn(pml4Phys, physAddr, userStackBase + i * 0x1000)) {
+            if (!Memory::VMM::Paging::MapUserIn(pml4Phys, physAddr, userStackBase + i * 0x1000, true)) {
                 Kt::KernelLogStream(Kt::ERROR, "Sched") << "Failed to map user stack page";
                 Memory::g_pfa->Free(page);
                 cleanupOnFail();
@@ -243,6 +243,7 @@ namespace Sched {
             proc.args[i] = '\0';
         }
 
+        proc.files = {};
         proc.redirected = false;
         proc.parentPid = -1;
         proc.outBuf = nullptr;
@@ -370,6 +371,8 @@ namespace Sched {
         // Clean up any windows owned by this process (unmaps pixel pages from desktop)
         WinServer::CleanupProcess(proc.pid);
 
+        Fs::Descriptors::CloseAll(proc.files);
+
         // Free I/O redirect buffers (kernel-allocated pages)
         if (proc.outBuf) {
             Memory::g_pfa->Free(proc.outBuf);
@@ -7,6 +7,7 @@
 #pragma once
 #include <cstdint>
 #include <Api/Syscall.hpp>
+#include <Fs/Descriptors.hpp>
 
 namespace Sched {
 
@@ -41,6 +42,9 @@ namespace Sched {
         uint64_t heapNext;        // Simple bump allocator for user heap
         char args[256];           // Command-line arguments (set by parent via Spawn)
 
+        // Open files; closed on exit
+        Fs::Descriptors::Table files = {};
+
         // I/O redirection for GUI terminal
         bool redirected = false;
         int parentPid = -1;
@@ -14,6 +14,7 @@
 #include <Drivers/Net/E1000E.hpp>
 #include <Drivers/USB/Xhci.hpp>
 #include <Drivers/USB/HidKeyboard.hpp>
+#include <Net/Tcp.hpp>
 
 using namespace Kt;
 
@@ -40,7 +41,7 @@ namespace Timekeeping {
 
     static bool g_schedEnabled = false;
 
-    // Timer IRQ handler: increment tick count, poll NIC, and drive scheduler
+    // Timer IRQ handler: increment tick count, poll NIC, run TCP timers, and drive scheduler
     static void TimerHandler(uint8_t) {
         g_tickCount = g_tickCount + 1;
 
@@ -49,6 +50,7 @@ namespace Timekeeping {
         Drivers::Net::E1000E::Poll();
         Drivers::USB::Xhci::ProcessDeferredWork();
         Drivers::USB::HidKeyboard::Tick();
+        Net::Tcp::Tick();
 
         if (g_schedEnabled) {
             Sched::Tick();
@@ -132,10 +132,35 @@ namespace montauk {
     }
     inline uint64_t getsize(int handle) { return (uint64_t)syscall1(Montauk::SYS_GETSIZE, (uint64_t)handle); }
     inline void close(int handle) { syscall1(Montauk::SYS_CLOSE, (uint64_t)handle); }
+
+    // Descriptors are per process. read() and fwrite() take explicit offsets;
+    // readv() at POS_CURRENT reads from the descriptor's position and advances it.
+    inline int64_t seek(int fd, int64_t off, int whence) {
+        return (int64_t)syscall3(Montauk::SYS_SEEK, (uint64_t)fd, (uint64_t)off, (uint64_t)whence);
+    }
+    inline int64_t copy_range(int src, uint64_t srcOff, int dst, uint64_t dstOff, uint64_t size) {
+        return (int64_t)syscall5(Montauk::SYS_COPYRANGE, (uint64_t)src, srcOff, (uint64_t)dst, dstOff, size);
+    }
+    inline int dup(int fd) { return (int)syscall1(Montauk::SYS_DUP, (uint64_t)fd); }
+    inline int64_t readv(int fd, const Montauk::IoVec* iov, int count, uint64_t off = Montauk::POS_CURRENT) {
+        return (int64_t)syscall4(Montauk::SYS_READV, (uint64_t)fd, (uint64_t)iov, (uint64_t)count, off);
+    }
+    // Legacy listing: each call maps a page for the names that is only
+    // released when the process exits. Use readdir_plus() in new code.
     inline int readdir(const char* path, const char** names, int max) {
         return (int)syscall3(Montauk::SYS_READDIR, (uint64_t)path, (uint64_t)names, (uint64_t)max);
     }
 
+    // Fill buf with DirRecords starting at *cursor (0 = first entry). Returns
+    // bytes written and advances the cursor; 0 once the listing is complete.
+    inline int64_t readdir_plus(const char* path, uint64_t* cursor, void* buf, uint64_t size) {
+        return (int64_t)syscall4(Montauk::SYS_READDIRPLUS, (uint64_t)path, (uint64_t)cursor, (uint64_t)buf, size);
+    }
+    inline const char* dirent_name(const Montauk::DirRecord* rec) { return (const char*)(rec + 1); }
+    inline const Montauk::DirRecord* dirent_next(const Montauk::DirRecord* rec) {
+        return (const Montauk::DirRecord*)((const uint8_t*)rec + rec->recLen);
+    }
+
     // File write/create
     inline int fwrite(int handle, const uint8_t* buf, uint64_t off, uint64_t size) {
         return (int)syscall4(Montauk::SYS_FWRITE, (uint64_t)handle, (uint64_t)buf, off, size);
@@ -339,6 +364,12 @@ namespace montauk {
     inline int fs_format(const Montauk::FsFormatParams* params) {
         return (int)syscall1(Montauk::SYS_FSFORMAT, (uint64_t)params);
     }
+    inline int sync() {
+        return (int)syscall0(Montauk::SYS_SYNC);
+    }
+    inline int64_t fs_trim(int drive) {
+        return (int64_t)syscall1(Montauk::SYS_FSTRIM, (uint64_t)drive);
+    }
 
     // Audio
     inline int audio_open(uint32_t sampleRate, uint8_t channels, uint8_t bitsPerSample) {
@@ -140,68 +140,23 @@ static void filemanager_read_drives(FileManagerState* fm) {
 
 static void filemanager_read_dir(FileManagerState* fm) {
     fm->at_drives_root = false;
-    const char* names[64];
-    fm->entry_count = montauk::readdir(fm->current_path, names, 64);
-    if (fm->entry_count < 0) fm->entry_count = 0;
-
-    // readdir returns full paths from the VFS (e.g. "man/fetch.1" instead
-    // of just "fetch.1").  Compute the prefix to strip so we get basenames.
-    const char* after_drive = fm->current_path;
-    for (int k = 0; after_drive[k]; k++) {
-        if (after_drive[k] == ':' && after_drive[k + 1] == '/') {
-            after_drive += k + 2;
-            break;
-        }
-    }
-    char prefix[256] = {0};
-    int prefix_len = 0;
-    if (after_drive[0] != '\0') {
-        montauk::strcpy(prefix, after_drive);
-        prefix_len = montauk::slen(prefix);
-        if (prefix_len > 0 && prefix[prefix_len - 1] != '/') {
-            prefix[prefix_len++] = '/';
-            prefix[prefix_len] = '\0';
-        }
-    }
-
-    for (int i = 0; i < fm->entry_count; i++) {
-        const char* raw = names[i];
-        // Strip directory prefix if it matches
-        if (prefix_len > 0) {
-            bool match = true;
-            for (int k = 0; k < prefix_len; k++) {
-                if (raw[k] != prefix[k]) { match = false; break; }
-            }
-            if (match) raw += prefix_len;
-        }
-        montauk::strncpy(fm->entry_names[i], raw, 63);
-        int len = montauk::slen(fm->entry_names[i]);
-
-        // Detect directory
-        if (len > 0 && fm->entry_names[i][len - 1] == '/') {
-            fm->is_dir[i] = true;
-            fm->entry_names[i][len - 1] = '\0';
-        } else {
-            fm->is_dir[i] = false;
-        }
-
-        fm->entry_types[i] = detect_file_type(fm->entry_names[i], fm->is_dir[i]);
+    fm->entry_count = 0;
 
-        // Get file size
-        fm->entry_sizes[i] = 0;
-        if (!fm->is_dir[i]) {
-            char fullpath[512];
-            montauk::strcpy(fullpath, fm->current_path);
-            int plen = montauk::slen(fullpath);
-            if (plen > 0 && fullpath[plen - 1] != '/') {
-                str_append(fullpath, "/", 512);
-            }
-            str_append(fullpath, fm->entry_names[i], 512);
-            int fd = montauk::open(fullpath);
-            if (fd >= 0) {
-                fm->entry_sizes[i] = (int)montauk::getsize(fd);
-                montauk::close(fd);
-            }
+    // One listing call returns names, types and sizes, so no per-file opens
+    static uint8_t buf[4096];
+    uint64_t cursor = 0;
+    while (fm->entry_count < 64) {
+        int64_t n = montauk::readdir_plus(fm->current_path, &cursor, buf, sizeof(buf));
+        if (n <= 0) break;
+
+        auto* rec = (const Montauk::DirRecord*)buf;
+        auto* end = (const Montauk::DirRecord*)(buf + n);
+        for (; rec < end && fm->entry_count < 64; rec = montauk::dirent_next(rec)) {
+            int i = fm->entry_count++;
+            montauk::strncpy(fm->entry_names[i], montauk::dirent_name(rec), 63);
+            fm->is_dir[i] = rec->type == Montauk::DIRENT_DIR;
+            fm->entry_types[i] = detect_file_type(fm->entry_names[i], fm->is_dir[i]);
+            fm->entry_sizes[i] = (int)rec->size;
         }
     }
 
@@ -252,52 +207,27 @@ static bool filemanager_delete_recursive(const char* path) {
     // Try deleting as a file (or empty directory) first
     if (montauk::fdelete(path) == 0) return true;
 
-    // If that failed, it may be a non-empty directory — enumerate and delete children
-    const char* names[64];
-    int count = montauk::readdir(path, names, 64);
-    if (count < 0) return false;
-
-    // Compute the prefix to strip (readdir returns paths relative to drive root)
-    const char* after_drive = path;
-    for (int k = 0; after_drive[k]; k++) {
-        if (after_drive[k] == ':' && after_drive[k + 1] == '/') {
-            after_drive += k + 2;
-            break;
-        }
-    }
-    char prefix[256] = {0};
-    int prefix_len = 0;
-    if (after_drive[0] != '\0') {
-        montauk::strcpy(prefix, after_drive);
-        prefix_len = montauk::slen(prefix);
-        if (prefix_len > 0 && prefix[prefix_len - 1] != '/') {
-            prefix[prefix_len++] = '/';
-            prefix[prefix_len] = '\0';
-        }
-    }
-
-    for (int i = 0; i < count; i++) {
-        const char* raw = names[i];
-        if (prefix_len > 0) {
-            bool match = true;
-            for (int k = 0; k < prefix_len; k++) {
-                if (raw[k] != prefix[k]) { match = false; break; }
-            }
-            if (match) raw += prefix_len;
+    // If that failed, it may be a non-empty directory — delete its children.
+    // Deleting shifts the listing, so every pass starts from the beginning.
+    for (;;) {
+        uint8_t buf[2048];
+        uint64_t cursor = 0;
+        int64_t n = montauk::readdir_plus(path, &cursor, buf, sizeof(buf));
+        if (n <= 0) break;
+
+        bool progress = false;
+        auto* end = (const Montauk::DirRecord*)(buf + n);
+        for (auto* rec = (const Montauk::DirRecord*)buf; rec < end; rec = montauk::dirent_next(rec)) {
+            char child[512];
+            montauk::strcpy(child, path);
+            int plen = montauk::slen(child);
+            if (plen > 0 && child[plen - 1] != '/')
+                str_append(child, "/", 512);
+            str_append(child, montauk::dirent_name(rec), 512);
+
+            if (filemanager_delete_recursive(child)) progress = true;
         }
-
-        char child[512];
-        montauk::strcpy(child, path);
-        int plen = montauk::slen(child);
-        if (plen > 0 && child[plen - 1] != '/')
-            str_append(child, "/", 512);
-        str_append(child, raw, 512);
-
-        // Strip trailing slash if present (directory marker)
-        int clen = montauk::slen(child);
-        if (clen > 0 && child[clen - 1] == '/') child[clen - 1] = '\0';
-
-        filemanager_delete_recursive(child);
+        if (!progress) break;
     }
 
     // Now the directory should be empty — delete it
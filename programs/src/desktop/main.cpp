@@ -12,40 +12,30 @@
 // App Manifest Scanning
 // ============================================================================
 
-// Extract the basename from a readdir entry.
-// readdir returns full paths from drive root (e.g. "apps/doom/") —
-// strip the directory prefix and any trailing slash to get just "doom".
-static void extract_basename(char* out, int outSz, const char* entry) {
-    // Strip trailing slash
-    int len = montauk::slen(entry);
-    while (len > 0 && entry[len - 1] == '/') len--;
-
-    // Find last slash before that
-    int last_slash = -1;
-    for (int i = 0; i < len; i++) {
-        if (entry[i] == '/') last_slash = i;
-    }
-
-    const char* base = (last_slash >= 0) ? entry + last_slash + 1 : entry;
-    int base_len = len - (last_slash >= 0 ? last_slash + 1 : 0);
-    if (base_len >= outSz) base_len = outSz - 1;
-    montauk::memcpy(out, base, base_len);
-    out[base_len] = '\0';
-}
-
 void desktop_scan_apps(DesktopState* ds) {
     ds->external_app_count = 0;
 
     // Ensure the apps directory exists
     montauk::fmkdir("0:/apps");
 
-    const char* entries[32];
-    int count = montauk::readdir("0:/apps", entries, 32);
+    // Collect the app directory names
+    char dirs[32][64];
+    int count = 0;
+    uint8_t buf[2048];
+    uint64_t cursor = 0;
+    while (count < 32) {
+        int64_t n = montauk::readdir_plus("0:/apps", &cursor, buf, sizeof(buf));
+        if (n <= 0) break;
+
+        auto* end = (const Montauk::DirRecord*)(buf + n);
+        for (auto* rec = (const Montauk::DirRecord*)buf; rec < end && count < 32; rec = montauk::dirent_next(rec)) {
+            if (rec->type != Montauk::DIRENT_DIR) continue;
+            montauk::strncpy(dirs[count++], montauk::dirent_name(rec), sizeof(dirs[0]));
+        }
+    }
 
     for (int i = 0; i < count && ds->external_app_count < MAX_EXTERNAL_APPS; i++) {
-        // readdir returns paths like "apps/doom/" — extract just "doom"
-        char dirname[64];
-        extract_basename(dirname, sizeof(dirname), entries[i]);
+        const char* dirname = dirs[i];
         if (dirname[0] == '\0') continue;
 
         // Try to open the manifest in this app directory
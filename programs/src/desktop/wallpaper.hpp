@@ -142,72 +142,49 @@ struct WallpaperFileList {
 inline void wallpaper_scan_dir(const char* dir_path, WallpaperFileList* list) {
     list->count = 0;
 
-    const char* raw_names[64];
-    int total = montauk::readdir(dir_path, raw_names, 64);
-    if (total <= 0) return;
-
-    // Compute prefix to strip (readdir returns full paths from VFS root)
-    const char* after_drive = dir_path;
-    for (int k = 0; after_drive[k]; k++) {
-        if (after_drive[k] == ':' && after_drive[k + 1] == '/') {
-            after_drive += k + 2;
-            break;
-        }
-    }
-    char prefix[256] = {0};
-    int prefix_len = 0;
-    if (after_drive[0] != '\0') {
-        montauk::strcpy(prefix, after_drive);
-        prefix_len = montauk::slen(prefix);
-        if (prefix_len > 0 && prefix[prefix_len - 1] != '/') {
-            prefix[prefix_len++] = '/';
-            prefix[prefix_len] = '\0';
-        }
-    }
-
     auto to_lower = [](char c) -> char {
         return (c >= 'A' && c <= 'Z') ? (char)(c + 32) : c;
     };
 
-    for (int i = 0; i < total && list->count < WALLPAPER_MAX_FILES; i++) {
-        const char* name = raw_names[i];
-
-        // Strip prefix
-        if (prefix_len > 0) {
-            bool match = true;
-            for (int k = 0; k < prefix_len; k++) {
-                if (name[k] != prefix[k]) { match = false; break; }
+    static uint8_t buf[4096];
+    uint64_t cursor = 0;
+    for (;;) {
+        int64_t n = montauk::readdir_plus(dir_path, &cursor, buf, sizeof(buf));
+        if (n <= 0) return;
+
+        auto* end = (const Montauk::DirRecord*)(buf + n);
+        for (auto* rec = (const Montauk::DirRecord*)buf; rec < end; rec = montauk::dirent_next(rec)) {
+            if (list->count >= WALLPAPER_MAX_FILES) return;
+
+            // Skip directories
+            if (rec->type == Montauk::DIRENT_DIR) continue;
+
+            const char* name = montauk::dirent_name(rec);
+            int nlen = montauk::slen(name);
+
+            // Check for .jpg
+            bool is_jpeg = false;
+            if (nlen >= 4 &&
+                to_lower(name[nlen - 4]) == '.' &&
+                to_lower(name[nlen - 3]) == 'j' &&
+                to_lower(name[nlen - 2]) == 'p' &&
+                to_lower(name[nlen - 1]) == 'g') {
+                is_jpeg = true;
+            }
+            // Check for .jpeg
+            if (!is_jpeg && nlen >= 5 &&
+                to_lower(name[nlen - 5]) == '.' &&
+                to_lower(name[nlen - 4]) == 'j' &&
+                to_lower(name[nlen - 3]) == 'p' &&
+                to_lower(name[nlen - 2]) == 'e' &&
+                to_lower(name[nlen - 1]) == 'g') {
+                is_jpeg = true;
             }
-            if (match) name += prefix_len;
-        }
-
-        int nlen = montauk::slen(name);
-
-        // Skip directories
-        if (nlen > 0 && name[nlen - 1] == '/') continue;
-
-        // Check for .jpg
-        bool is_jpeg = false;
-        if (nlen >= 4 &&
-            to_lower(name[nlen - 4]) == '.' &&
-            to_lower(name[nlen - 3]) == 'j' &&
-            to_lower(name[nlen - 2]) == 'p' &&
-            to_lower(name[nlen - 1]) == 'g') {
-            is_jpeg = true;
-        }
-        // Check for .jpeg
-        if (!is_jpeg && nlen >= 5 &&
-            to_lower(name[nlen - 5]) == '.' &&
-            to_lower(name[nlen - 4]) == 'j' &&
-            to_lower(name[nlen - 3]) == 'p' &&
-            to_lower(name[nlen - 2]) == 'e' &&
-            to_lower(name[nlen - 1]) == 'g') {
-            is_jpeg = true;
-        }
 
-        if (is_jpeg) {
-            montauk::strncpy(list->names[list->count], name, 63);
-            list->count++;
+            if (is_jpeg) {
+                montauk::strncpy(list->names[list->count], name, 63);
+                list->count++;
+            }
         }
     }
 }
@@ -88,6 +88,8 @@ static void dd_draw_general(uint32_t* px, int bw, int bh, DiskDetailState* dd) {
     const char* typeStr = "Unknown";
     if (dd->info.type == 1) typeStr = "SATA";
     else if (dd->info.type == 2) typeStr = "SATAPI";
+    else if (dd->info.type == 3) typeStr = "NVMe";
+    else if (dd->info.type == 4) typeStr = "VirtIO";
     table_row("Type", typeStr);
 
     snprintf(line, sizeof(line), "%d", (int)dd->info.port);
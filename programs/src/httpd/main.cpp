@@ -320,33 +320,25 @@ static int generate_dir_listing(char* buf, int bufSize, const char* urlPath, con
     }
 
     // List directory entries
-    const char* entries[64];
-    int count = montauk::readdir(vfsDir, entries, 64);
-
-    // Find the prefix to strip from entry names
-    // vfsDir is like "0:/" or "0:/subdir"
-    // entries come back as "subdir/file" for "0:/subdir"
-    // or "file" for "0:/"
-    // The prefix in entry names is the part after "0:/"
-    const char* dirRel = vfsDir + 3; // skip "0:/"
-    int dirRelLen = slen(dirRel);
-
-    for (int i = 0; i < count && pos < bufSize - 128; i++) {
-        // Extract just the filename portion
-        const char* name = entries[i];
-        // If directory is not root, entries have "dir/name" format — strip the dir prefix
-        if (dirRelLen > 0 && starts_with(name, dirRel)) {
-            name = name + dirRelLen;
-            if (*name == '/') name++;
+    static uint8_t dirBuf[4096];
+    uint64_t cursor = 0;
+    while (pos < bufSize - 128) {
+        int64_t n = montauk::readdir_plus(vfsDir, &cursor, dirBuf, sizeof(dirBuf));
+        if (n <= 0) break;
+
+        auto* end = (const Montauk::DirRecord*)(dirBuf + n);
+        for (auto* rec = (const Montauk::DirRecord*)dirBuf; rec < end && pos < bufSize - 128; rec = montauk::dirent_next(rec)) {
+            // Directories get a trailing '/' so relative links resolve inside them
+            const char* slash = rec->type == Montauk::DIRENT_DIR ? "/" : "";
+            const char* name = montauk::dirent_name(rec);
+
+            // Build the URL for this entry (HTML-escape the name)
+            char esc_name[256];
+            html_escape(name, esc_name, sizeof(esc_name));
+            pos += snprintf(buf + pos, bufSize - pos,
+                "<li><a href=\"%s%s%s\">%s%s</a></li>\n",
+                urlPath, name, slash, esc_name, slash);
         }
-        if (*name == '\0') continue;
-
-        // Build the URL for this entry (HTML-escape the name)
-        char esc_name[256];
-        html_escape(name, esc_name, sizeof(esc_name));
-        pos += snprintf(buf + pos, bufSize - pos,
-            "<li><a href=\"%s%s\">%s</a></li>\n",
-            urlPath, name, esc_name);
     }
 
     pos += snprintf(buf + pos, bufSize - pos,
@@ -486,9 +478,9 @@ static void handle_client(int clientFd) {
             }
         } else {
             // Try as directory
-            const char* entries[64];
-            int count = montauk::readdir(vfsPath, entries, 64);
-            if (count >= 0) {
+            uint8_t probe[512];
+            uint64_t cursor = 0;
+            if (montauk::readdir_plus(vfsPath, &cursor, probe, sizeof(probe)) >= 0) {
                 // Make sure urlPath ends with /
                 char urlPath[256];
                 int up = 0;
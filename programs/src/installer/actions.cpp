@@ -105,14 +105,9 @@ static bool copy_file(const char* src_path, const char* dst_path) {
         return true;
     }
 
-    // Use large buffer for faster copies (256 KB)
-    static constexpr uint64_t CHUNK = 256 * 1024;
-    uint8_t* buf = (uint8_t*)montauk::malloc(CHUNK);
-    if (!buf) {
-        montauk::close(dst);
-        montauk::close(src);
-        return false;
-    }
+    // The kernel copies between the handles directly; the chunk size only
+    // sets how often progress is reported (4 MB)
+    static constexpr uint64_t CHUNK = 4 * 1024 * 1024;
 
     // Show progress for large files (> 1 MB)
     bool show_progress = (size > 1024 * 1024);
@@ -124,13 +119,10 @@ static bool copy_file(const char* src_path, const char* dst_path) {
         uint64_t to_read = size - offset;
         if (to_read > CHUNK) to_read = CHUNK;
 
-        int rd = montauk::read(src, buf, offset, to_read);
-        if (rd <= 0) { ok = false; break; }
-
-        int wr = montauk::fwrite(dst, buf, offset, rd);
-        if (wr < rd) { ok = false; break; }
+        int64_t copied = montauk::copy_range(src, offset, dst, offset, to_read);
+        if (copied <= 0) { ok = false; break; }
 
-        offset += rd;
+        offset += copied;
 
         if (show_progress) {
             uint64_t cur_mb = offset / (1024 * 1024);
@@ -146,7 +138,6 @@ static bool copy_file(const char* src_path, const char* dst_path) {
         }
     }
 
-    montauk::mfree(buf);
     montauk::close(dst);
     montauk::close(src);
     return ok;
@@ -163,16 +154,7 @@ static int g_dirs_created;
 // If skip_toplevel is non-null, skip that directory name at the top level.
 static bool copy_recursive(const char* src_dir, const char* dst_dir,
                             const char* skip_toplevel = nullptr) {
-    const char* names[256];
-    int count = montauk::readdir(src_dir, names, 256);
-    if (count < 0) return true; // not a directory or empty, skip
-
-    // Ramdisk readdir returns names relative to the drive root with the
-    // full internal path (e.g., for readdir("0:/os"), names come back as
-    // "os/init.elf", "os/shell.elf", etc.).  We need to strip the prefix
-    // that corresponds to the local path portion of src_dir.
-    //
-    // Find the local path after the "N:/" prefix.
+    // Local path after the "N:/" prefix, to recognise the apps directory
     const char* src_local = src_dir;
     for (int k = 0; src_local[k]; k++) {
         if (src_local[k] == ':') {
@@ -181,87 +163,72 @@ static bool copy_recursive(const char* src_dir, const char* dst_dir,
             break;
         }
     }
-    int prefix_len = slen(src_local);
-    // If prefix is non-empty, we also skip the trailing '/'
-    if (prefix_len > 0 && src_local[prefix_len - 1] != '/') prefix_len++;
 
-    for (int i = 0; i < count; i++) {
-        const char* raw_name = names[i];
+    uint8_t buf[2048];
+    uint64_t cursor = 0;
+    for (;;) {
+        int64_t n = montauk::readdir_plus(src_dir, &cursor, buf, sizeof(buf));
+        if (n <= 0) break; // not a directory, or no entries left
 
-        // Strip prefix to get basename
-        const char* basename = raw_name;
-        if (prefix_len > 0 && slen(raw_name) > prefix_len) {
-            basename = raw_name + prefix_len;
-        }
+        auto* end = (const Montauk::DirRecord*)(buf + n);
+        for (auto* rec = (const Montauk::DirRecord*)buf; rec < end; rec = montauk::dirent_next(rec)) {
+            const char* basename = montauk::dirent_name(rec);
+
+            // Skip "." and ".."
+            if (strcmp(basename, ".") == 0 || strcmp(basename, "..") == 0) continue;
+
+            if (rec->type == Montauk::DIRENT_DIR) {
+                // Skip the installer app — no need on the installed system
+                if (strcmp(basename, "installer") == 0 &&
+                    strcmp(src_local, "apps") == 0) continue;
+
+                // Skip requested top-level directory
+                if (skip_toplevel && strcmp(basename, skip_toplevel) == 0) continue;
 
-        // Skip "." and ".."
-        if (basename[0] == '.' && (basename[1] == '\0' || basename[1] == '/')) continue;
-        if (basename[0] == '.' && basename[1] == '.' && (basename[2] == '\0' || basename[2] == '/')) continue;
-
-        int blen = slen(basename);
-
-        // Check if this is a directory (trailing '/')
-        bool is_dir = (blen > 0 && basename[blen - 1] == '/');
-
-        if (is_dir) {
-            // Strip trailing '/' for the name
-            char dir_name[256];
-            int j = 0;
-            for (; j < blen - 1 && j < 255; j++) dir_name[j] = basename[j];
-            dir_name[j] = '\0';
-
-            // Skip the installer app — no need on the installed system
-            if (strcmp(dir_name, "installer") == 0 &&
-                strcmp(src_local, "apps") == 0) continue;
-
-            // Skip requested top-level directory
-            if (skip_toplevel && strcmp(dir_name, skip_toplevel) == 0) continue;
-
-            // Create directory on target
-            char target_path[256];
-            path_join(target_path, sizeof(target_path), dst_dir, dir_name);
-
-            montauk::fmkdir(target_path);
-            g_dirs_created++;
-
-            char log_msg[64];
-            snprintf(log_msg, sizeof(log_msg), "  mkdir %s", dir_name);
-            add_log(log_msg);
-            flush_ui();
-
-            // Recurse into this directory
-            char src_subdir[256];
-            path_join(src_subdir, sizeof(src_subdir), src_dir, dir_name);
-
-            if (!copy_recursive(src_subdir, target_path))
-                return false;
-        } else {
-            // Skip ramdisk and limine.conf — installed system boots from
-            // disk and gets a fresh config without the ramdisk module.
-            // Skip setup.toml — live/setup environment config that should
-            // not be present on the installed system.
-            if (strcmp(basename, "ramdisk.tar") == 0) continue;
-            if (strcmp(basename, "limine.conf") == 0) continue;
-            if (strcmp(basename, "setup.toml") == 0) continue;
-
-            // It's a file — copy it
-            char src_path[256];
-            // Build source path: drive prefix + raw_name (which is the full internal path)
-            // src_dir starts with "0:/" so we need "0:/" + raw_name
-            snprintf(src_path, sizeof(src_path), "0:/%s", raw_name);
-
-            char dst_path[256];
-            path_join(dst_path, sizeof(dst_path), dst_dir, basename);
-
-            char log_msg[64];
-            snprintf(log_msg, sizeof(log_msg), "  copy %s", basename);
-            add_log(log_msg);
-            flush_ui();
-
-            if (!copy_file(src_path, dst_path))
-                return false;
-
-            g_files_copied++;
+                // Create directory on target
+                char target_path[256];
+                path_join(target_path, sizeof(target_path), dst_dir, basename);
+
+                montauk::fmkdir(target_path);
+                g_dirs_created++;
+
+                char log_msg[64];
+                snprintf(log_msg, sizeof(log_msg), "  mkdir %s", basename);
+                add_log(log_msg);
+                flush_ui();
+
+                // Recurse into this directory
+                char src_subdir[256];
+                path_join(src_subdir, sizeof(src_subdir), src_dir, basename);
+
+                if (!copy_recursive(src_subdir, target_path))
+                    return false;
+            } else {
+                // Skip ramdisk and limine.conf — installed system boots from
+                // disk and gets a fresh config without the ramdisk module.
+                // Skip setup.toml — live/setup environment config that should
+                // not be present on the installed system.
+                if (strcmp(basename, "ramdisk.tar") == 0) continue;
+                if (strcmp(basename, "limine.conf") == 0) continue;
+                if (strcmp(basename, "setup.toml") == 0) continue;
+
+                // It's a file — copy it
+                char src_path[256];
+                path_join(src_path, sizeof(src_path), src_dir, basename);
+
+                char dst_path[256];
+                path_join(dst_path, sizeof(dst_path), dst_dir, basename);
+
+                char log_msg[64];
+                snprintf(log_msg, sizeof(log_msg), "  copy %s", basename);
+                add_log(log_msg);
+                flush_ui();
+
+                if (!copy_file(src_path, dst_path))
+                    return false;
+
+                g_files_copied++;
+            }
         }
     }
 
@@ -0,0 +1,677 @@
+/*
+    * main.cpp
+    * iobench - Measure file and block device I/O performance
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+#include <montauk/syscall.h>
+#include <montauk/string.h>
+
+// ============================================================================
+// Configuration
+// ============================================================================
+
+static constexpr int MaxWorkers = 16;
+static constexpr int MaxPathLen = 128;
+static constexpr uint64_t MaxBlockSize = 16 * 1024 * 1024;
+
+// SYS_DISKREAD/SYS_DISKWRITE move at most this many sectors per call
+static constexpr uint32_t MaxDiskSectors = 128;
+
+// Latency histogram: exact below 16 us, then 8 buckets per power of two
+static constexpr int HistBuckets = 256;
+
+struct Job {
+    bool     raw;               // Block device instead of a VFS file
+    char     path[MaxPathLen];  // VFS path when !raw
+    int      disk;              // Block device index when raw
+    bool     write;
+    bool     random;
+    uint64_t bs;
+    uint64_t size;              // Bytes of the file or device region used
+    uint64_t offset;            // Start of the region on a raw device
+    uint32_t seconds;
+    int      workers;           // Queue depth
+    bool     force;             // Allow writes to a raw device
+    int      worker;            // Set in spawned workers, -1 in the parent
+};
+
+struct Stats {
+    uint64_t ops;
+    uint64_t bytes;
+    uint64_t errors;
+    uint64_t elapsedUs;
+    uint64_t minUs;
+    uint64_t maxUs;
+    uint64_t sumUs;
+    uint32_t hist[HistBuckets];
+};
+
+// ============================================================================
+// Output helpers
+// ============================================================================
+
+static void print_int(uint64_t n) {
+    char buf[20];
+    int i = 0;
+    do {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    } while (n > 0);
+    while (i > 0) montauk::putchar(buf[--i]);
+}
+
+// n / 10^decimals with that many fractional digits
+static void print_fixed(uint64_t n, int decimals) {
+    uint64_t scale = 1;
+    for (int i = 0; i < decimals; i++) scale *= 10;
+    print_int(n / scale);
+    if (decimals == 0) return;
+    montauk::putchar('.');
+    uint64_t frac = n % scale;
+    for (uint64_t d = scale / 10; d > 0; d /= 10) {
+        montauk::putchar('0' + (frac / d) % 10);
+    }
+}
+
+static void print_size(uint64_t bytes) {
+    if (bytes >= 1024 * 1024 && bytes % (1024 * 1024) == 0) {
+        print_int(bytes / (1024 * 1024));
+        montauk::print("M");
+    } else if (bytes >= 1024 && bytes % 1024 == 0) {
+        print_int(bytes / 1024);
+        montauk::print("K");
+    } else {
+        print_int(bytes);
+    }
+}
+
+static int append(char* buf, int pos, int max, const char* s) {
+    while (*s && pos < max - 1) buf[pos++] = *s++;
+    buf[pos] = '\0';
+    return pos;
+}
+
+static int append_int(char* buf, int pos, int max, uint64_t n) {
+    char tmp[21];
+    int i = 20;
+    tmp[i] = '\0';
+    do {
+        tmp[--i] = '0' + (n % 10);
+        n /= 10;
+    } while (n > 0);
+    return append(buf, pos, max, tmp + i);
+}
+
+// ============================================================================
+// Timing
+// ============================================================================
+
+static uint64_t rdtsc() {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static uint64_t g_ticksPerUs = 1;
+
+// Measure the TSC against the millisecond clock over ~100 ms
+static void calibrate_tsc() {
+    uint64_t start = montauk::get_milliseconds();
+    while (montauk::get_milliseconds() == start) {}
+
+    uint64_t ms0 = montauk::get_milliseconds();
+    uint64_t tsc0 = rdtsc();
+    while (montauk::get_milliseconds() - ms0 < 100) {}
+    uint64_t ms1 = montauk::get_milliseconds();
+    uint64_t tsc1 = rdtsc();
+
+    uint64_t us = (ms1 - ms0) * 1000;
+    g_ticksPerUs = us > 0 ? (tsc1 - tsc0) / us : 1;
+    if (g_ticksPerUs == 0) g_ticksPerUs = 1;
+}
+
+static uint64_t now_us() {
+    return rdtsc() / g_ticksPerUs;
+}
+
+// ============================================================================
+// Latency histogram
+// ============================================================================
+
+static int bucket_of(uint64_t us) {
+    if (us < 16) return (int)us;
+    int msb = 63 - __builtin_clzll(us);
+    int idx = 16 + (msb - 4) * 8 + (int)((us >> (msb - 3)) & 7);
+    return idx < HistBuckets ? idx : HistBuckets - 1;
+}
+
+// Smallest latency that lands in bucket `idx`
+static uint64_t bucket_floor(int idx) {
+    if (idx < 16) return (uint64_t)idx;
+    int msb = (idx - 16) / 8 + 4;
+    return (8ull + (idx - 16) % 8) << (msb - 3);
+}
+
+static void record(Stats& st, uint64_t us) {
+    st.hist[bucket_of(us)]++;
+    st.sumUs += us;
+    if (us < st.minUs) st.minUs = us;
+    if (us > st.maxUs) st.maxUs = us;
+}
+
+// Latency below which `permille` / 1000 of the operations completed
+static uint64_t percentile(const Stats& st, uint64_t permille) {
+    uint64_t total = 0;
+    for (int i = 0; i < HistBuckets; i++) total += st.hist[i];
+    if (total == 0) return 0;
+
+    uint64_t target = (total * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (int i = 0; i < HistBuckets; i++) {
+        seen += st.hist[i];
+        if (seen >= target) {
+            uint64_t v = bucket_floor(i);
+            return v > st.maxUs ? st.maxUs : v;
+        }
+    }
+    return st.maxUs;
+}
+
+// ============================================================================
+// Argument parsing
+// ============================================================================
+
+// "4k", "64K", "1m", "2g" or plain bytes; 0 on error
+static uint64_t parse_size(const char* s) {
+    uint64_t v = 0;
+    bool digits = false;
+    while (*s >= '0' && *s <= '9') {
+        v = v * 10 + (*s++ - '0');
+        digits = true;
+    }
+    if (!digits) return 0;
+
+    switch (*s) {
+        case 'k': case 'K': v *= 1024; s++; break;
+        case 'm': case 'M': v *= 1024 * 1024; s++; break;
+        case 'g': case 'G': v *= 1024ull * 1024 * 1024; s++; break;
+        default: break;
+    }
+    return *s == '\0' ? v : 0;
+}
+
+// Split `args` in place into space-separated tokens
+static int tokenize(char* args, char** tokens, int max) {
+    int count = 0;
+    char* p = args;
+    while (*p && count < max) {
+        while (*p == ' ') *p++ = '\0';
+        if (!*p) break;
+        tokens[count++] = p;
+        while (*p && *p != ' ') p++;
+    }
+    return count;
+}
+
+static const char* option_value(const char* token, const char* name) {
+    if (!montauk::starts_with(token, name)) return nullptr;
+    const char* v = token + montauk::slen(name);
+    return *v == '=' ? v + 1 : nullptr;
+}
+
+static void usage() {
+    montauk::print("Usage: iobench [options] <file | disk:N>\n");
+    montauk::print("  --rw=read|write|randread|randwrite   workload (default read)\n");
+    montauk::print("  --bs=SIZE       block size (default 4k)\n");
+    montauk::print("  --qd=N          queue depth, 1-16 (default 1)\n");
+    montauk::print("  --size=SIZE     file size or device region (default 64m)\n");
+    montauk::print("  --offset=SIZE   start of the region on a device (default 0)\n");
+    montauk::print("  --time=SEC      run time in seconds (default 10)\n");
+    montauk::print("  --force         allow writing to a raw device\n");
+    montauk::exit(1);
+}
+
+static bool parse_args(char* args, Job& job) {
+    job = {};
+    job.bs = 4096;
+    job.size = 64 * 1024 * 1024;
+    job.seconds = 10;
+    job.workers = 1;
+    job.worker = -1;
+
+    char* tokens[16];
+    int count = tokenize(args, tokens, 16);
+    const char* target = nullptr;
+
+    for (int i = 0; i < count; i++) {
+        const char* t = tokens[i];
+        const char* v;
+
+        if ((v = option_value(t, "--rw"))) {
+            if (montauk::streq(v, "read"))           { job.write = false; job.random = false; }
+            else if (montauk::streq(v, "write"))     { job.write = true;  job.random = false; }
+            else if (montauk::streq(v, "randread"))  { job.write = false; job.random = true; }
+            else if (montauk::streq(v, "randwrite")) { job.write = true;  job.random = true; }
+            else return false;
+        } else if ((v = option_value(t, "--bs"))) {
+            job.bs = parse_size(v);
+        } else if ((v = option_value(t, "--size"))) {
+            job.size = parse_size(v);
+        } else if ((v = option_value(t, "--offset"))) {
+            job.offset = parse_size(v);
+            if (job.offset == 0 && !montauk::streq(v, "0")) return false;
+        } else if ((v = option_value(t, "--qd")) || (v = option_value(t, "--iodepth"))) {
+            job.workers = (int)parse_size(v);
+        } else if ((v = option_value(t, "--time")) || (v = option_value(t, "--runtime"))) {
+            job.seconds = (uint32_t)parse_size(v);
+        } else if ((v = option_value(t, "--worker"))) {
+            job.worker = (int)parse_size(v);
+        } else if (montauk::streq(t, "--force")) {
+            job.force = true;
+        } else if (t[0] == '-') {
+            return false;
+        } else {
+            target = t;
+        }
+    }
+
+    if (target == nullptr) return false;
+    if (job.bs == 0 || job.bs > MaxBlockSize || job.size < job.bs) return false;
+    if (job.workers < 1 || job.workers > MaxWorkers || job.seconds == 0) return false;
+
+    if (montauk::starts_with(target, "disk:")) {
+        job.raw = true;
+        job.disk = (int)parse_size(target + 5);
+        if (job.disk == 0 && !montauk::streq(target + 5, "0")) return false;
+    } else if (target[0] >= '0' && target[0] <= '9' && target[1] == ':') {
+        if (montauk::slen(target) >= MaxPathLen) return false;
+        montauk::strcpy(job.path, target);
+    } else {
+        // Relative names live on the boot drive, like cat
+        if (montauk::slen(target) + 3 >= MaxPathLen) return false;
+        montauk::strcpy(job.path, "0:/");
+        montauk::strcpy(job.path + 3, target);
+    }
+    return true;
+}
+
+// ============================================================================
+// I/O
+// ============================================================================
+
+struct Target {
+    int      fd;                // VFS descriptor, -1 for raw devices
+    uint32_t sectorSize;
+};
+
+static bool raw_io(const Job& job, const Target& t, bool write, uint64_t off, uint8_t* buf) {
+    uint64_t lba = (job.offset + off) / t.sectorSize;
+    uint64_t sectors = job.bs / t.sectorSize;
+
+    while (sectors > 0) {
+        uint32_t n = sectors < MaxDiskSectors ? (uint32_t)sectors : MaxDiskSectors;
+        int64_t r = write ? montauk::disk_write(job.disk, lba, n, buf)
+                          : montauk::disk_read(job.disk, lba, n, buf);
+        if (r < 0) return false;
+        lba += n;
+        sectors -= n;
+        buf += (uint64_t)n * t.sectorSize;
+    }
+    return true;
+}
+
+static bool do_io(const Job& job, const Target& t, uint64_t off, uint8_t* buf) {
+    if (job.raw) return raw_io(job, t, job.write, off, buf);
+    if (job.write) return montauk::fwrite(t.fd, buf, off, job.bs) == (int)job.bs;
+    return montauk::read(t.fd, buf, off, job.bs) == (int)job.bs;
+}
+
+// Make sure a VFS file exists and holds at least job.size bytes
+static bool layout_file(const Job& job, uint8_t* buf) {
+    int fd = montauk::open(job.path);
+    if (fd >= 0) {
+        uint64_t have = montauk::getsize(fd);
+        montauk::close(fd);
+        if (have >= job.size) return true;
+    }
+
+    montauk::print("Laying out ");
+    montauk::print(job.path);
+    montauk::print(" (");
+    print_size(job.size);
+    montauk::print(")...\n");
+
+    fd = montauk::fcreate(job.path);
+    if (fd < 0) return false;
+
+    bool ok = true;
+    for (uint64_t off = 0; ok && off < job.size; off += job.bs) {
+        uint64_t n = job.size - off < job.bs ? job.size - off : job.bs;
+        ok = montauk::fwrite(fd, buf, off, n) == (int)n;
+    }
+    montauk::close(fd);
+    montauk::sync();
+    return ok;
+}
+
+static uint64_t xorshift(uint64_t& s) {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+// Run this process's share of the job for job.seconds
+static bool run_worker(const Job& job, int index, Stats& st) {
+    st = {};
+    st.minUs = ~0ull;
+
+    uint8_t* buf = (uint8_t*)montauk::alloc(job.bs);
+    if (buf == nullptr) return false;
+    for (uint64_t i = 0; i < job.bs; i++) buf[i] = (uint8_t)(i * 131 + index);
+
+    Target t = { -1, 512 };
+    if (job.raw) {
+        Montauk::DiskInfo info;
+        if (montauk::diskinfo(&info, job.disk) < 0) return false;
+        t.sectorSize = info.sectorSizeLog ? info.sectorSizeLog : 512;
+        if (job.bs % t.sectorSize || job.offset % t.sectorSize) return false;
+        if ((job.offset + job.size) / t.sectorSize > info.sectorCount) return false;
+    } else {
+        t.fd = montauk::open(job.path);
+        if (t.fd < 0) return false;
+    }
+
+    // Sequential workers stream through their own slice of the region
+    uint64_t blocks = job.size / job.bs;
+    uint64_t slice = blocks / job.workers;
+    if (slice == 0) slice = 1;
+    uint64_t next = (uint64_t)index * slice % blocks;
+
+    uint64_t seed = 0;
+    montauk::getrandom(&seed, sizeof(seed));
+    seed ^= 0x9E3779B97F4A7C15ull * (index + 1);
+    if (seed == 0) seed = 1;
+
+    uint64_t start = now_us();
+    uint64_t end = start + (uint64_t)job.seconds * 1000000;
+    uint64_t t0 = start;
+
+    while (t0 < end) {
+        uint64_t block;
+        if (job.random) {
+            block = xorshift(seed) % blocks;
+        } else {
+            block = next;
+            next = next + 1 < blocks ? next + 1 : 0;
+        }
+
+        bool ok = do_io(job, t, block * job.bs, buf);
+        uint64_t t1 = now_us();
+
+        if (ok) {
+            st.ops++;
+            st.bytes += job.bs;
+            record(st, t1 - t0);
+        } else {
+            st.errors++;
+            if (st.errors > 16 && st.ops == 0) break;
+        }
+        t0 = t1;
+    }
+
+    st.elapsedUs = t0 - start;
+    if (st.minUs == ~0ull) st.minUs = 0;
+    if (t.fd >= 0) montauk::close(t.fd);
+    montauk::free(buf);
+    return true;
+}
+
+// ============================================================================
+// Worker processes
+// ============================================================================
+//
+// There is no asynchronous I/O syscall, so a queue depth of N runs N
+// processes issuing synchronous I/O. Workers are spawned with their output
+// redirected; each waits for a start byte, runs, prints one STATS line and
+// waits for a second byte before exiting so the parent can read it first.
+
+static void emit_stats(const Stats& st) {
+    static char line[4096];
+    int pos = append(line, 0, sizeof(line), "STATS");
+    const uint64_t fields[] = { st.ops, st.bytes, st.errors, st.elapsedUs, st.minUs, st.maxUs, st.sumUs };
+    for (uint64_t f : fields) {
+        pos = append(line, pos, sizeof(line), " ");
+        pos = append_int(line, pos, sizeof(line), f);
+    }
+    for (int i = 0; i < HistBuckets; i++) {
+        if (st.hist[i] == 0) continue;
+        pos = append(line, pos, sizeof(line), " ");
+        pos = append_int(line, pos, sizeof(line), (uint64_t)i);
+        pos = append(line, pos, sizeof(line), ":");
+        pos = append_int(line, pos, sizeof(line), st.hist[i]);
+    }
+    append(line, pos, sizeof(line), "\n");
+    montauk::print(line);
+}
+
+static const char* parse_u64(const char* p, uint64_t& out) {
+    while (*p == ' ') p++;
+    out = 0;
+    while (*p >= '0' && *p <= '9') out = out * 10 + (*p++ - '0');
+    return p;
+}
+
+static bool parse_stats(const char* line, Stats& st) {
+    st = {};
+    if (!montauk::starts_with(line, "STATS")) return false;
+    const char* p = line + 5;
+
+    uint64_t* fields[] = { &st.ops, &st.bytes, &st.errors, &st.elapsedUs, &st.minUs, &st.maxUs, &st.sumUs };
+    for (uint64_t* f : fields) p = parse_u64(p, *f);
+
+    while (*p == ' ') {
+        uint64_t idx, count;
+        p = parse_u64(p, idx);
+        if (*p != ':') break;
+        p = parse_u64(p + 1, count);
+        if (idx < (uint64_t)HistBuckets) st.hist[idx] = (uint32_t)count;
+    }
+    return true;
+}
+
+// Read a worker's output until its STATS line is complete
+static bool collect(int pid, Stats& st, uint32_t timeoutMs) {
+    static char line[4096];
+    int len = 0;
+    uint64_t deadline = montauk::get_milliseconds() + timeoutMs;
+
+    while (montauk::get_milliseconds() < deadline) {
+        char chunk[256];
+        int n = montauk::childio_read(pid, chunk, sizeof(chunk));
+        if (n < 0) return false;
+        for (int i = 0; i < n; i++) {
+            if (chunk[i] == '\n') {
+                line[len] = '\0';
+                if (parse_stats(line, st)) return true;
+                len = 0;
+            } else if (len < (int)sizeof(line) - 1) {
+                line[len++] = chunk[i];
+            }
+        }
+        if (n == 0) montauk::sleep_ms(10);
+    }
+    return false;
+}
+
+static void merge(Stats& total, const Stats& st) {
+    total.ops += st.ops;
+    total.bytes += st.bytes;
+    total.errors += st.errors;
+    total.sumUs += st.sumUs;
+    if (st.elapsedUs > total.elapsedUs) total.elapsedUs = st.elapsedUs;
+    if (st.ops > 0 && (total.minUs == 0 || st.minUs < total.minUs)) total.minUs = st.minUs;
+    if (st.maxUs > total.maxUs) total.maxUs = st.maxUs;
+    for (int i = 0; i < HistBuckets; i++) total.hist[i] += st.hist[i];
+}
+
+// ============================================================================
+// Report
+// ============================================================================
+
+static void report(const Job& job, const Stats& st) {
+    montauk::print("\n");
+    montauk::print(job.write ? (job.random ? "randwrite" : "write") : (job.random ? "randread" : "read"));
+    montauk::print(": bs=");
+    print_size(job.bs);
+    montauk::print(" qd=");
+    print_int((uint64_t)job.workers);
+    montauk::print(" size=");
+    print_size(job.size);
+    montauk::print(job.raw ? " (block device)\n" : " (vfs)\n");
+
+    if (st.ops == 0 || st.elapsedUs == 0) {
+        montauk::print("  no I/O completed");
+        if (st.errors) {
+            montauk::print(", ");
+            print_int(st.errors);
+            montauk::print(" errors");
+        }
+        montauk::print("\n");
+        return;
+    }
+
+    // Integer arithmetic only: userspace is built without floating point
+    uint64_t kib = st.bytes / 1024;
+    montauk::print("  bw:   ");
+    print_fixed(kib * 10000000 / 1024 / st.elapsedUs, 1);
+    montauk::print(" MiB/s  (");
+    print_int(st.bytes / (1024 * 1024));
+    montauk::print(" MiB in ");
+    print_fixed(st.elapsedUs / 10000, 2);
+    montauk::print(" s)\n");
+
+    montauk::print("  iops: ");
+    print_int(st.ops * 1000000 / st.elapsedUs);
+    montauk::print("\n");
+
+    montauk::print("  lat (us): min=");
+    print_int(st.minUs);
+    montauk::print(" avg=");
+    print_int(st.sumUs / st.ops);
+    montauk::print(" max=");
+    print_int(st.maxUs);
+    montauk::print("\n");
+
+    static const struct { const char* name; uint64_t permille; } points[] = {
+        { "p50", 500 }, { "p90", 900 }, { "p99", 990 }, { "p99.9", 999 },
+    };
+    montauk::print("  percentiles (us):");
+    for (auto& pt : points) {
+        montauk::print(" ");
+        montauk::print(pt.name);
+        montauk::print("=");
+        print_int(percentile(st, pt.permille));
+    }
+    montauk::print("\n");
+
+    if (st.errors) {
+        montauk::print("  errors: ");
+        print_int(st.errors);
+        montauk::print("\n");
+    }
+}
+
+// ============================================================================
+// Entry point
+// ============================================================================
+
+extern "C" void _start() {
+    static char args[256];
+    static char argsCopy[256];
+    int len = montauk::getargs(args, sizeof(args));
+    if (len < 0) len = 0;
+    args[len < (int)sizeof(args) ? len : (int)sizeof(args) - 1] = '\0';
+    montauk::strcpy(argsCopy, args);
+
+    Job job;
+    if (!parse_args(args, job)) usage();
+
+    calibrate_tsc();
+
+    // Spawned worker: wait for the start byte, run, report, wait to be reaped
+    if (job.worker >= 0) {
+        montauk::getchar();
+        Stats st;
+        if (!run_worker(job, job.worker, st)) st = {};
+        emit_stats(st);
+        montauk::getchar();
+        montauk::exit(0);
+    }
+
+    if (job.raw && job.write && !job.force) {
+        montauk::print("iobench: writing to a raw device destroys its contents; add --force\n");
+        montauk::exit(1);
+    }
+
+    if (!job.raw) {
+        uint8_t* fill = (uint8_t*)montauk::alloc(job.bs);
+        if (fill == nullptr || !layout_file(job, fill)) {
+            montauk::print("iobench: cannot prepare ");
+            montauk::print(job.path);
+            montauk::print("\n");
+            montauk::exit(1);
+        }
+        montauk::free(fill);
+    }
+
+    // Spawn the other workers with the same arguments plus their index
+    int pids[MaxWorkers];
+    int spawned = 0;
+    for (int i = 1; i < job.workers; i++) {
+        char workerArgs[256];
+        int pos = append(workerArgs, 0, sizeof(workerArgs), argsCopy);
+        pos = append(workerArgs, pos, sizeof(workerArgs), " --worker=");
+        append_int(workerArgs, pos, sizeof(workerArgs), (uint64_t)i);
+
+        int pid = montauk::spawn_redir("0:/os/iobench.elf", workerArgs);
+        if (pid < 0) {
+            montauk::print("iobench: could not start worker ");
+            print_int((uint64_t)i);
+            montauk::print("\n");
+            break;
+        }
+        pids[spawned++] = pid;
+    }
+    job.workers = spawned + 1;
+
+    montauk::print("Running for ");
+    print_int(job.seconds);
+    montauk::print(" s...\n");
+
+    for (int i = 0; i < spawned; i++) montauk::childio_write(pids[i], "g", 1);
+
+    Stats total = {};
+    Stats st;
+    if (!run_worker(job, 0, st)) {
+        montauk::print("iobench: cannot open target\n");
+    } else {
+        merge(total, st);
+    }
+
+    for (int i = 0; i < spawned; i++) {
+        if (collect(pids[i], st, 30000)) {
+            merge(total, st);
+        } else {
+            montauk::print("iobench: no result from worker ");
+            print_int((uint64_t)(i + 1));
+            montauk::print("\n");
+        }
+        montauk::childio_write(pids[i], "q", 1);
+        montauk::waitpid(pids[i]);
+    }
+
+    report(job, total);
+    montauk::exit(0);
+}
@@ -300,21 +300,28 @@ static bool str_ends_with(const char* s, const char* suffix) {
 static void scan_directory() {
     g.file_count = 0;
 
-    const char* names[256];
-    int count = montauk::readdir(g.dir_path, names, 256);
-
-    for (int i = 0; i < count && g.file_count < MAX_FILES; i++) {
-        bool is_mp3 = str_ends_with(names[i], ".mp3");
-        bool is_wav = str_ends_with(names[i], ".wav");
-        if (!is_mp3 && !is_wav) continue;
-
-        FileEntry& f = g.files[g.file_count];
-        int len = montauk::slen(names[i]);
-        if (len >= (int)sizeof(f.name)) len = sizeof(f.name) - 1;
-        montauk::memcpy(f.name, names[i], len);
-        f.name[len] = 0;
-        f.is_mp3 = is_mp3;
-        g.file_count++;
+    static uint8_t buf[4096];
+    uint64_t cursor = 0;
+    while (g.file_count < MAX_FILES) {
+        int64_t n = montauk::readdir_plus(g.dir_path, &cursor, buf, sizeof(buf));
+        if (n <= 0) break;
+
+        auto* end = (const Montauk::DirRecord*)(buf + n);
+        for (auto* rec = (const Montauk::DirRecord*)buf; rec < end && g.file_count < MAX_FILES; rec = montauk::dirent_next(rec)) {
+            if (rec->type == Montauk::DIRENT_DIR) continue;
+            const char* name = montauk::dirent_name(rec);
+            bool is_mp3 = str_ends_with(name, ".mp3");
+            bool is_wav = str_ends_with(name, ".wav");
+            if (!is_mp3 && !is_wav) continue;
+
+            FileEntry& f = g.files[g.file_count];
+            int len = montauk::slen(name);
+            if (len >= (int)sizeof(f.name)) len = sizeof(f.name) - 1;
+            montauk::memcpy(f.name, name, len);
+            f.name[len] = 0;
+            f.is_mp3 = is_mp3;
+            g.file_count++;
+        }
     }
 }
 
@@ -90,25 +90,30 @@ void cmd_ls(const char* arg) {
     char path[128];
     build_drive_path(drive, dir, path, sizeof(path));
 
-    const char* entries[64];
-    int count = montauk::readdir(path, entries, 64);
-    if (count <= 0) {
-        montauk::print("(empty)\n");
-        return;
-    }
-
-    int prefixLen = 0;
-    if (dir[0]) prefixLen = slen(dir) + 1;
+    static uint8_t buf[4096];
+    uint64_t cursor = 0;
+    int count = 0;
+    for (;;) {
+        int64_t n = montauk::readdir_plus(path, &cursor, buf, sizeof(buf));
+        if (n <= 0) break;
 
-    for (int i = 0; i < count; i++) {
-        montauk::print("  ");
-        if (prefixLen > 0 && starts_with(entries[i], dir)) {
-            montauk::print(entries[i] + prefixLen);
-        } else {
-            montauk::print(entries[i]);
+        auto* end = (const Montauk::DirRecord*)(buf + n);
+        for (auto* rec = (const Montauk::DirRecord*)buf; rec < end; rec = montauk::dirent_next(rec)) {
+            montauk::print("  ");
+            montauk::print(montauk::dirent_name(rec));
+            if (rec->type == Montauk::DIRENT_DIR) montauk::putchar('/');
+            montauk::putchar('\n');
+            count++;
         }
-        montauk::putchar('\n');
     }
+    if (count == 0) montauk::print("(empty)\n");
+}
+
+// True if path names a directory (empty or not)
+static bool is_directory(const char* path) {
+    uint8_t buf[512];
+    uint64_t cursor = 0;
+    return montauk::readdir_plus(path, &cursor, buf, sizeof(buf)) >= 0;
 }
 
 // ---- cd ----
@@ -116,8 +121,7 @@ void cmd_ls(const char* arg) {
 bool switch_drive(int drive) {
     char path[8];
     build_drive_path(drive, "", path, sizeof(path));
-    const char* entries[1];
-    if (montauk::readdir(path, entries, 1) < 0) return false;
+    if (!is_directory(path)) return false;
     current_drive = drive;
     cwd[0] = '\0';
     return true;
@@ -182,8 +186,7 @@ int cmd_cd(const char* arg) {
         if (*arg == '\0') { cwd[0] = '\0'; return 0; }
         char path[128];
         build_dir_path(arg, path, sizeof(path));
-        const char* entries[1];
-        if (montauk::readdir(path, entries, 1) < 0) {
+        if (!is_directory(path)) {
             montauk::print("cd: no such directory: ");
             montauk::print(arg);
             montauk::putchar('\n');
@@ -202,8 +205,7 @@ int cmd_cd(const char* arg) {
 
         char rootPath[8];
         build_drive_path(drive, "", rootPath, sizeof(rootPath));
-        const char* rootEntries[1];
-        if (montauk::readdir(rootPath, rootEntries, 1) < 0) {
+        if (!is_directory(rootPath)) {
             montauk::print("cd: no such drive: ");
             montauk::print(arg);
             montauk::putchar('\n');
@@ -213,8 +215,7 @@ int cmd_cd(const char* arg) {
         if (*rel != '\0') {
             char path[128];
             build_drive_path(drive, rel, path, sizeof(path));
-            const char* entries[1];
-            if (montauk::readdir(path, entries, 1) < 0) {
+            if (!is_directory(path)) {
                 montauk::print("cd: no such directory: ");
                 montauk::print(arg);
                 montauk::putchar('\n');
@@ -241,9 +242,7 @@ int cmd_cd(const char* arg) {
 
     char path[128];
     build_dir_path(target, path, sizeof(path));
-    const char* entries[1];
-    int count = montauk::readdir(path, entries, 1);
-    if (count < 0) {
+    if (!is_directory(path)) {
         montauk::print("cd: no such directory: ");
         montauk::print(arg);
         montauk::putchar('\n');
@@ -1,6 +1,10 @@
 #!/bin/bash
-# mkramdisk.sh - Create a USTAR tar archive for the MontaukOS ramdisk
+# mkramdisk.sh - Create the MontaukOS ramdisk
 # Usage: ./scripts/mkramdisk.sh [input_dir] [output_path]
+#
+# The USTAR archive is converted into a compressed image (per-file LZ4
+# blocks plus an index, see scripts/packramdisk.c) unless RAMDISK_COMPRESS=0.
+# The kernel tells the two formats apart by their magic.
 
 set -e
 
@@ -17,4 +21,14 @@ fi
 # Create USTAR tar archive
 tar --format=ustar -cf "$OUTPUT_PATH" -C "$INPUT_DIR" .
 
+# Compress it; the packer is a host tool built on first use
+if [ "${RAMDISK_COMPRESS:-1}" != "0" ]; then
+    PACKER="$(dirname "$0")/packramdisk"
+    if [ ! -x "$PACKER" ] || [ "$PACKER.c" -nt "$PACKER" ]; then
+        ${HOST_CC:-cc} -O2 -o "$PACKER" "$PACKER.c"
+    fi
+    "$PACKER" "$OUTPUT_PATH" "$OUTPUT_PATH.z"
+    mv "$OUTPUT_PATH.z" "$OUTPUT_PATH"
+fi
+
 echo "mkramdisk: created $OUTPUT_PATH from $INPUT_DIR ($(wc -c < "$OUTPUT_PATH") bytes)"
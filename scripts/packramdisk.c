@@ -0,0 +1,348 @@
+/*
+    * packramdisk.c
+    * Host tool: convert a USTAR ramdisk into a compressed MontaukOS ramdisk image
+    * Copyright (c) 2026 Daniel Hammer
+*/
+
+/*
+ * Usage: packramdisk <input.tar> <output>
+ *
+ * Image layout (all integers little-endian):
+ *
+ *   Header (16 bytes)
+ *     char     magic[8]        "MTKRAMZ1"
+ *     uint32_t entryCount
+ *     uint32_t blockSize       Uncompressed bytes per block (last block may be short)
+ *
+ *   Entry table (entryCount x 128 bytes)
+ *     char     name[100]       Path, NUL-padded; directories end in '/'
+ *     uint8_t  type            0 = file, 1 = directory
+ *     uint8_t  reserved[3]
+ *     uint32_t blockCount
+ *     uint64_t size            Uncompressed size
+ *     uint64_t dataOffset      From image start: uint32_t block sizes, then blocks
+ *     uint32_t mtime           Unix seconds, from the tar header
+ *
+ * Each block is an LZ4 block. A size with bit 31 set marks a block stored
+ * uncompressed because LZ4 did not shrink it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define BLOCK_SIZE     32768
+#define HEADER_SIZE    16
+#define ENTRY_SIZE     128
+#define NAME_LEN       100
+#define STORED_FLAG    0x80000000u
+
+#define HASH_LOG       12
+#define MIN_MATCH      4
+#define LAST_LITERALS  5
+#define MF_LIMIT       12
+
+struct entry {
+    char           name[NAME_LEN];
+    int            isDirectory;
+    const uint8_t* data;
+    uint64_t       size;
+    uint32_t       mtime;
+};
+
+static void put32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void put64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint8_t* write_length(uint8_t* op, int len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/* LZ4 block compressor, same greedy scheme as the kernel's Lib::Lz4.
+   dst must hold at least lz4_bound(srcSize) bytes. */
+static int lz4_bound(int srcSize) {
+    return srcSize + srcSize / 255 + 16;
+}
+
+static int lz4_compress(const uint8_t* src, int srcSize, uint8_t* dst) {
+    static uint16_t table[1 << HASH_LOG];
+
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* end = src + srcSize;
+    const uint8_t* matchLimit = end - LAST_LITERALS;
+    const uint8_t* mfLimit = end - MF_LIMIT;
+    uint8_t* op = dst;
+
+    if (srcSize >= MF_LIMIT) {
+        memset(table, 0, sizeof(table));
+        ip++;
+
+        while (ip < mfLimit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = (seq * 2654435761u) >> (32 - HASH_LOG);
+            const uint8_t* ref = src + table[h];
+            table[h] = (uint16_t)(ip - src);
+
+            if (ref >= ip || read32(ref) != seq) {
+                ip++;
+                continue;
+            }
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            const uint8_t* mp = ip + MIN_MATCH;
+            const uint8_t* rp = ref + MIN_MATCH;
+            while (mp < matchLimit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            int litLen = (int)(ip - anchor);
+            int matchLen = (int)(mp - ip) - MIN_MATCH;
+
+            uint8_t* token = op++;
+            if (litLen >= 15) {
+                *token = 15 << 4;
+                op = write_length(op, litLen - 15);
+            } else {
+                *token = (uint8_t)(litLen << 4);
+            }
+            memcpy(op, anchor, litLen);
+            op += litLen;
+
+            uint16_t offset = (uint16_t)(ip - ref);
+            *op++ = (uint8_t)(offset & 0xFF);
+            *op++ = (uint8_t)(offset >> 8);
+
+            if (matchLen >= 15) {
+                *token |= 15;
+                op = write_length(op, matchLen - 15);
+            } else {
+                *token |= (uint8_t)matchLen;
+            }
+
+            ip = mp;
+            anchor = ip;
+        }
+    }
+
+    int litLen = (int)(end - anchor);
+    uint8_t* token = op++;
+    if (litLen >= 15) {
+        *token = 15 << 4;
+        op = write_length(op, litLen - 15);
+    } else {
+        *token = (uint8_t)(litLen << 4);
+    }
+    memcpy(op, anchor, litLen);
+    op += litLen;
+
+    return (int)(op - dst);
+}
+
+static uint64_t octal(const uint8_t* s, int len) {
+    uint64_t v = 0;
+    for (int i = 0; i < len && s[i] >= '0' && s[i] <= '7'; i++) v = v * 8 + (s[i] - '0');
+    return v;
+}
+
+static uint8_t* read_file(const char* path, size_t* outSize) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = malloc(size > 0 ? (size_t)size : 1);
+    if (buf && fread(buf, 1, (size_t)size, f) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *outSize = (size_t)size;
+    return buf;
+}
+
+/* Collect the members of a USTAR archive, normalised like Fs::Ramdisk does */
+static int parse_tar(const uint8_t* tar, size_t tarSize, struct entry** outEntries) {
+    int count = 0, capacity = 64;
+    struct entry* entries = malloc(capacity * sizeof(struct entry));
+
+    size_t pos = 0;
+    while (entries && pos + 512 <= tarSize) {
+        const uint8_t* hdr = tar + pos;
+
+        int zero = 1;
+        for (int i = 0; i < 512; i++) {
+            if (hdr[i]) {
+                zero = 0;
+                break;
+            }
+        }
+        if (zero) break;
+        if (memcmp(hdr + 257, "ustar", 5) != 0) {
+            fprintf(stderr, "packramdisk: bad USTAR header at offset %zu\n", pos);
+            break;
+        }
+
+        uint64_t size = octal(hdr + 124, 12);
+        int isDirectory = hdr[156] == '5';
+        const uint8_t* data = hdr + 512;
+        pos += 512 + (size + 511) / 512 * 512;
+
+        const char* name = (const char*)hdr;
+        int nameLen = 0;
+        while (nameLen < NAME_LEN && name[nameLen]) nameLen++;
+        if (nameLen >= 2 && name[0] == '.' && name[1] == '/') {
+            name += 2;
+            nameLen -= 2;
+        }
+        while (nameLen > 0 && name[nameLen - 1] == '/') nameLen--;
+        if (nameLen == 0 || (nameLen == 1 && name[0] == '.')) continue;
+        if (nameLen + (isDirectory ? 1 : 0) >= NAME_LEN) {
+            fprintf(stderr, "packramdisk: skipping %.*s (name too long)\n", nameLen, name);
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            entries = realloc(entries, capacity * sizeof(struct entry));
+            if (!entries) break;
+        }
+
+        struct entry* e = &entries[count++];
+        memset(e->name, 0, NAME_LEN);
+        memcpy(e->name, name, nameLen);
+        if (isDirectory) e->name[nameLen] = '/';
+        e->isDirectory = isDirectory;
+        e->data = data;
+        e->size = isDirectory ? 0 : size;
+        e->mtime = (uint32_t)octal(hdr + 136, 12);
+    }
+
+    *outEntries = entries;
+    return entries ? count : -1;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <input.tar> <output>\n", argv[0]);
+        return 1;
+    }
+
+    size_t tarSize;
+    uint8_t* tar = read_file(argv[1], &tarSize);
+    if (!tar) {
+        fprintf(stderr, "packramdisk: cannot read %s\n", argv[1]);
+        return 1;
+    }
+
+    struct entry* entries;
+    int count = parse_tar(tar, tarSize, &entries);
+    if (count < 0) {
+        fprintf(stderr, "packramdisk: out of memory\n");
+        return 1;
+    }
+
+    FILE* out = fopen(argv[2], "wb");
+    if (!out) {
+        fprintf(stderr, "packramdisk: cannot create %s\n", argv[2]);
+        return 1;
+    }
+
+    uint8_t header[HEADER_SIZE];
+    memcpy(header, "MTKRAMZ1", 8);
+    put32(header + 8, (uint32_t)count);
+    put32(header + 12, BLOCK_SIZE);
+    fwrite(header, 1, HEADER_SIZE, out);
+
+    // The table is written once the data offsets are known
+    uint8_t* table = calloc(count ? count : 1, ENTRY_SIZE);
+    fwrite(table, ENTRY_SIZE, count, out);
+
+    uint8_t* block = malloc(lz4_bound(BLOCK_SIZE));
+    uint64_t offset = HEADER_SIZE + (uint64_t)count * ENTRY_SIZE;
+    uint64_t rawTotal = 0;
+
+    for (int i = 0; i < count; i++) {
+        struct entry* e = &entries[i];
+        uint32_t blocks = (uint32_t)((e->size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+        uint8_t* rec = table + (size_t)i * ENTRY_SIZE;
+        memcpy(rec, e->name, NAME_LEN);
+        rec[100] = e->isDirectory ? 1 : 0;
+        put32(rec + 104, blocks);
+        put64(rec + 108, e->size);
+        put64(rec + 116, blocks ? offset : 0);
+        put32(rec + 124, e->mtime);
+        if (blocks == 0) continue;
+
+        // Block size table, patched after the blocks are written
+        long sizesPos = ftell(out);
+        uint8_t* sizes = calloc(blocks, 4);
+        fwrite(sizes, 4, blocks, out);
+        offset += (uint64_t)blocks * 4;
+
+        for (uint32_t b = 0; b < blocks; b++) {
+            const uint8_t* src = e->data + (uint64_t)b * BLOCK_SIZE;
+            int len = (int)(e->size - (uint64_t)b * BLOCK_SIZE < BLOCK_SIZE
+                            ? e->size - (uint64_t)b * BLOCK_SIZE : BLOCK_SIZE);
+
+            int packed = lz4_compress(src, len, block);
+            if (packed < len) {
+                fwrite(block, 1, packed, out);
+                put32(sizes + b * 4, (uint32_t)packed);
+                offset += packed;
+            } else {
+                fwrite(src, 1, len, out);
+                put32(sizes + b * 4, (uint32_t)len | STORED_FLAG);
+                offset += len;
+            }
+        }
+
+        long endPos = ftell(out);
+        fseek(out, sizesPos, SEEK_SET);
+        fwrite(sizes, 4, blocks, out);
+        fseek(out, endPos, SEEK_SET);
+        free(sizes);
+        rawTotal += e->size;
+    }
+
+    fseek(out, HEADER_SIZE, SEEK_SET);
+    fwrite(table, ENTRY_SIZE, count, out);
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "packramdisk: write error on %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("packramdisk: %d entries, %llu bytes of file data packed into %llu bytes\n",
+           count, (unsigned long long)rawTotal, (unsigned long long)offset);
+
+    free(block);
+    free(table);
+    free(entries);
+    free(tar);
+    return 0;
+}